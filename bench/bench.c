@@ -0,0 +1,176 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "stages.h"
+#include "hooks.h"
+#include "intern.h"
+#include "utils.h"
+
+// Synthetic load benchmark: feeds generated event streams through the real
+// pipeline (queue -> log sink batch -> buffer -> logger) without
+// installing any OS hooks, and reports throughput and per-stage latency.
+//   usage: keylog_bench [results.jsonl]
+// Every scenario appends one JSON object per line to the results file.
+
+#define BENCH_RESULTS_FILE "logs/bench.jsonl"
+#define BENCH_WINDOW_NAMES 64     // Distinct titles cycled by the window storm
+#define BENCH_MOUSE_CLICK_PERIOD 16  // Mouse stream events per click press/release pair
+
+typedef enum {
+    BENCH_KEYBOARD,
+    BENCH_MOUSE,
+    BENCH_WINDOW
+} BenchStream;
+
+// One synthetic load pattern
+typedef struct {
+    const char* name;
+    BenchStream stream;
+    size_t events;      // Events submitted
+    DWORD rate_hz;      // Submission rate (0 = as fast as possible)
+    size_t burst;       // Events per burst (0 = no bursts)
+    DWORD burst_gap_us; // Pause between bursts
+} BenchScenario;
+
+static const BenchScenario scenarios[] = {
+    { "keyboard_burst", BENCH_KEYBOARD, 50000, 0,    32, 1000 },
+    { "mouse_1khz",     BENCH_MOUSE,    5000,  1000, 0,  0    },
+    { "window_storm",   BENCH_WINDOW,   20000, 0,    0,  0    },
+};
+
+static InternId window_titles[BENCH_WINDOW_NAMES];
+static InternId window_processes[BENCH_WINDOW_NAMES];
+
+static void make_event(const BenchScenario* scenario, size_t index, Event* event);
+static bool run_scenario(const BenchScenario* scenario, BenchWriter writer, FILE* results);
+
+int main(int argc, char* argv[]) {
+    if (argc > 2) {
+        fprintf(stderr, "Usage: %s [results.jsonl]\n", argv[0]);
+        return 1;
+    }
+    const char* results_path = argc == 2 ? argv[1] : BENCH_RESULTS_FILE;
+
+    if (!create_directory_if_needed("logs")) {
+        fprintf(stderr, "Failed to create logs directory\n");
+        return 1;
+    }
+
+    FILE* results = fopen(results_path, "a");
+    if (!results) {
+        fprintf(stderr, "Failed to open %s\n", results_path);
+        return 1;
+    }
+
+    // Stage samples sized for the largest scenario
+    size_t capacity = 0;
+    for (size_t i = 0; i < sizeof(scenarios) / sizeof(scenarios[0]); i++) {
+        if (scenarios[i].events > capacity) {
+            capacity = scenarios[i].events;
+        }
+    }
+    if (!init_bench_stages(capacity)) {
+        fprintf(stderr, "Failed to allocate latency samples\n");
+        fclose(results);
+        return 1;
+    }
+
+    int result = 0;
+    // Every scenario runs against each writer mode
+    for (int writer = 0; writer < BENCH_WRITER_COUNT; writer++) {
+        for (size_t i = 0; i < sizeof(scenarios) / sizeof(scenarios[0]); i++) {
+            if (!run_scenario(&scenarios[i], (BenchWriter)writer, results)) {
+                fprintf(stderr, "Scenario %s failed\n", scenarios[i].name);
+                result = 1;
+            }
+        }
+    }
+
+    cleanup_bench_stages();
+    fclose(results);
+    printf("Results appended to %s\n", results_path);
+    return result;
+}
+
+static void make_event(const BenchScenario* scenario, size_t index, Event* event) {
+    memset(event, 0, sizeof(Event));
+
+    switch (scenario->stream) {
+        case BENCH_KEYBOARD:
+            // Press/release pairs walking the alphabet, every 8th with shift
+            event->type = (index & 1) ? EVENT_KEY_RELEASE : EVENT_KEY_PRESS;
+            event->data.keyboard.vkCode = 'A' + (DWORD)((index / 2) % 26);
+            event->data.keyboard.scanCode = 0x1E + (DWORD)((index / 2) % 26);
+            event->data.keyboard.modifiers = ((index / 2) % 8 == 0) ? INPUT_MOD_SHIFT : 0;
+            break;
+
+        case BENCH_MOUSE:
+            // Sweeps across a 1920x1080 desktop one pixel step at a time,
+            // with a left click after every 14 moves. The log sink skips
+            // moves, so the clicks are what the format and buffer stages see.
+            event->data.mouse.position.x = (LONG)(index % 1920);
+            event->data.mouse.position.y = (LONG)((index * 3) % 1080);
+            if (index % BENCH_MOUSE_CLICK_PERIOD >= BENCH_MOUSE_CLICK_PERIOD - 2) {
+                event->type = EVENT_MOUSE_CLICK;
+                event->data.mouse.buttonFlags = 0x01;
+                if (index % BENCH_MOUSE_CLICK_PERIOD == BENCH_MOUSE_CLICK_PERIOD - 1) {
+                    event->data.mouse.buttons = INPUT_BTN_LEFT;  // Held until this release
+                }
+            } else {
+                event->type = EVENT_MOUSE_MOVE;
+                event->data.mouse.moveCount = 1;
+            }
+            break;
+
+        case BENCH_WINDOW:
+            event->type = EVENT_WINDOW_CHANGE;
+            event->data.window.titleId = window_titles[index % BENCH_WINDOW_NAMES];
+            event->data.window.processNameId = window_processes[index % BENCH_WINDOW_NAMES];
+            event->data.window.processId = 1000 + (DWORD)(index % BENCH_WINDOW_NAMES);
+            break;
+    }
+
+    event->timestamp = get_precise_time();
+}
+
+static bool run_scenario(const BenchScenario* scenario, BenchWriter writer, FILE* results) {
+    if (!start_bench_pipeline(writer)) {
+        return false;
+    }
+
+    // The intern table is created by init_hooks_ex()
+    for (int i = 0; i < BENCH_WINDOW_NAMES; i++) {
+        char name[MAX_WINDOW_TITLE];
+        int len = snprintf(name, sizeof(name), "Benchmark Document %d - Editor", i);
+        window_titles[i] = intern_string(name, (size_t)len);
+        len = snprintf(name, sizeof(name), "bench%d.exe", i);
+        window_processes[i] = intern_string(name, (size_t)len);
+    }
+
+    // Producer: submit the stream, paced by rate or burst gaps
+    ULONGLONG interval = scenario->rate_hz ? bench_ticks_per_second() / scenario->rate_hz : 0;
+    ULONGLONG gap = bench_ticks_per_second() * scenario->burst_gap_us / 1000000;
+    ULONGLONG start = bench_now();
+    ULONGLONG next = start;
+
+    for (size_t i = 0; i < scenario->events; i++) {
+        if (interval) {
+            bench_wait_until(next);
+            next += interval;
+        } else if (scenario->burst && i > 0 && i % scenario->burst == 0) {
+            bench_wait_until(bench_now() + gap);
+        }
+
+        Event event;
+        make_event(scenario, i, &event);
+        submit_hook_event(&event);
+    }
+
+    BenchRun run = {0};
+    run.scenario = scenario->name;
+    run.writer = writer;
+    run.submitted = scenario->events;
+    finish_bench_pipeline(&run, start);
+    report_bench_run(&run, results);
+    return true;
+}
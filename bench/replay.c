@@ -0,0 +1,349 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "stages.h"
+#include "hooks.h"
+#include "binlog.h"
+#include "compress.h"
+#include "format.h"
+#include "intern.h"
+#include "utils.h"
+
+// Replay driver: feeds the events of a recorded log (binary or text, either
+// one optionally compressed) through the real pipeline without installing
+// any OS hooks, and reports the same stage metrics as the benchmark.
+//   usage: keylog_replay [-s fast|realtime|<N>x] [-w async|mapped|compressed]
+//                        <log> [results.jsonl]
+// fast submits back to back; realtime keeps the recorded gaps between
+// events and <N>x divides them by N. Events are restamped as they are
+// submitted, so the queue stage measures the pipeline, not the recording.
+
+#define REPLAY_RESULTS_FILE "logs/replay.jsonl"
+#define REPLAY_NAME_SIZE 32
+
+// Window strings of one decoded event. A log can name more strings than the
+// intern table keeps, so the IDs decoding gave them are not held until the
+// event goes out; the strings are interned again right before it does.
+typedef struct {
+    char title[INTERN_MAX_LENGTH + 1];
+    char process[INTERN_MAX_LENGTH + 1];
+} ReplayWindow;
+
+// Decoded events, with the strings of their window events in order
+typedef struct {
+    Event* events;
+    size_t count;
+    size_t capacity;
+    ReplayWindow* windows;
+    size_t window_count;
+    size_t window_capacity;
+} ReplayLog;
+
+static BYTE* read_file(const char* path, size_t* size);
+static BYTE* unpack_frames(const BYTE* data, size_t size, size_t* unpacked);
+static bool append_event(ReplayLog* log, const Event* event);
+static void restore_window_strings(Event* event, const ReplayWindow* window);
+static void free_replay_log(ReplayLog* log);
+static bool load_binary_events(const BYTE* data, size_t size, ReplayLog* log);
+static bool load_text_events(const BYTE* data, size_t size, ReplayLog* log);
+static bool parse_speed(const char* text, double* speed);
+
+int main(int argc, char* argv[]) {
+    double speed = 0;  // 0 = as fast as possible
+    const char* speed_name = "fast";
+    BenchWriter writer = BENCH_WRITER_ASYNC;
+    int arg = 1;
+
+    for (; arg + 1 < argc && argv[arg][0] == '-'; arg += 2) {
+        if (strcmp(argv[arg], "-s") == 0 && parse_speed(argv[arg + 1], &speed)) {
+            speed_name = argv[arg + 1];
+        } else if (strcmp(argv[arg], "-w") != 0 || !parse_bench_writer(argv[arg + 1], &writer)) {
+            break;
+        }
+    }
+    if (argc - arg < 1 || argc - arg > 2 || argv[arg][0] == '-') {
+        fprintf(stderr, "Usage: %s [-s fast|realtime|<N>x] [-w async|mapped|compressed] "
+                "<log> [results.jsonl]\n", argv[0]);
+        return 1;
+    }
+    const char* log_path = argv[arg];
+    const char* results_path = argc - arg == 2 ? argv[arg + 1] : REPLAY_RESULTS_FILE;
+
+    size_t size = 0;
+    BYTE* data = read_file(log_path, &size);
+    if (!data) {
+        fprintf(stderr, "Failed to read %s\n", log_path);
+        return 1;
+    }
+    if (is_compressed_log(data, size)) {
+        size_t unpacked = 0;
+        BYTE* raw = unpack_frames(data, size, &unpacked);
+        free(data);
+        if (!raw) {
+            fprintf(stderr, "Failed to unpack %s\n", log_path);
+            return 1;
+        }
+        data = raw;
+        size = unpacked;
+    }
+
+    // Decoding and replay intern window strings here; the pipeline reuses it
+    if (!init_intern_table()) {
+        fprintf(stderr, "Failed to initialize intern table\n");
+        free(data);
+        return 1;
+    }
+
+    ReplayLog log = {0};
+    bool binary = size >= BINLOG_MAGIC_SIZE && memcmp(data, BINLOG_MAGIC, BINLOG_MAGIC_SIZE) == 0;
+    bool loaded = binary ? load_binary_events(data, size, &log) :
+                           load_text_events(data, size, &log);
+    free(data);
+    if (!loaded || log.count == 0) {
+        fprintf(stderr, "No events in %s\n", log_path);
+        free_replay_log(&log);
+        cleanup_intern_table();
+        return 1;
+    }
+    Event* events = log.events;
+    size_t count = log.count;
+    printf("Replaying %zu events from %s (%s, %s)\n", count, log_path,
+           binary ? "binary" : "text", speed_name);
+
+    if (!create_directory_if_needed("logs")) {
+        fprintf(stderr, "Failed to create logs directory\n");
+        free_replay_log(&log);
+        cleanup_intern_table();
+        return 1;
+    }
+    FILE* results = fopen(results_path, "a");
+    if (!results) {
+        fprintf(stderr, "Failed to open %s\n", results_path);
+        free_replay_log(&log);
+        cleanup_intern_table();
+        return 1;
+    }
+    if (!init_bench_stages(count) || !start_bench_pipeline(writer)) {
+        fprintf(stderr, "Failed to start the pipeline\n");
+        cleanup_bench_stages();
+        fclose(results);
+        free_replay_log(&log);
+        cleanup_intern_table();
+        return 1;
+    }
+
+    // Producer: event i goes out (time_i - time_0) / speed after the start;
+    // time only moves forward, recorded producers may be slightly out of order
+    ULONGLONG frequency = bench_ticks_per_second();
+    ULONGLONG first = events[0].timestamp;
+    ULONGLONG last = first;
+    ULONGLONG start = bench_now();
+    size_t window = 0;
+
+    for (size_t i = 0; i < count; i++) {
+        if (speed > 0) {
+            if (events[i].timestamp > last) last = events[i].timestamp;
+            double offset = (double)(last - first) / TIMESTAMP_TICKS_PER_SECOND / speed;
+            bench_wait_until(start + (ULONGLONG)(offset * frequency));
+        }
+
+        if (events[i].type == EVENT_WINDOW_CHANGE) {
+            restore_window_strings(&events[i], &log.windows[window++]);
+        }
+        events[i].timestamp = get_precise_time();
+        submit_hook_event(&events[i]);
+    }
+
+    char name[REPLAY_NAME_SIZE];
+    snprintf(name, sizeof(name), "replay_%s", speed_name);
+
+    BenchRun run = {0};
+    run.scenario = name;
+    run.writer = writer;
+    run.submitted = count;
+    finish_bench_pipeline(&run, start);  // Also releases the intern table
+    report_bench_run(&run, results);
+
+    cleanup_bench_stages();
+    fclose(results);
+    free_replay_log(&log);
+    printf("Results appended to %s\n", results_path);
+    return 0;
+}
+
+// fast, realtime or <N>x with N > 0
+static bool parse_speed(const char* text, double* speed) {
+    if (strcmp(text, "fast") == 0) {
+        *speed = 0;
+        return true;
+    }
+    if (strcmp(text, "realtime") == 0) {
+        *speed = 1;
+        return true;
+    }
+
+    char* end = NULL;
+    double factor = strtod(text, &end);
+    if (end == text || strcmp(end, "x") != 0 || factor <= 0 ||
+        strlen(text) >= REPLAY_NAME_SIZE - 8) {
+        return false;
+    }
+    *speed = factor;
+    return true;
+}
+
+static BYTE* read_file(const char* path, size_t* size) {
+    FILE* file = fopen(path, "rb");
+    if (!file) return NULL;
+
+    fseek(file, 0, SEEK_END);
+    long length = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    if (length < 0) {
+        fclose(file);
+        return NULL;
+    }
+
+    BYTE* data = (BYTE*)malloc(length > 0 ? (size_t)length : 1);
+    if (data && fread(data, 1, (size_t)length, file) != (size_t)length) {
+        free(data);
+        data = NULL;
+    }
+    fclose(file);
+
+    *size = (size_t)length;
+    return data;
+}
+
+// Concatenates the output of every complete frame, up to the first bad one
+static BYTE* unpack_frames(const BYTE* data, size_t size, size_t* unpacked) {
+    size_t capacity = COMPRESS_BLOCK_SIZE;
+    size_t used = 0;
+    size_t pos = 0;
+    BYTE* raw = (BYTE*)malloc(capacity);
+    if (!raw) return NULL;
+
+    while (pos < size) {
+        if (capacity - used < COMPRESS_BLOCK_SIZE) {
+            BYTE* grown = (BYTE*)realloc(raw, capacity * 2);
+            if (!grown) {
+                free(raw);
+                return NULL;
+            }
+            raw = grown;
+            capacity *= 2;
+        }
+
+        size_t consumed = 0;
+        size_t produced = 0;
+        int status = decompress_frame(data + pos, size - pos, raw + used,
+                                      capacity - used, &consumed, &produced);
+        if (status != COMPRESS_OK) {
+            fprintf(stderr, "Stopping at %s frame at offset %zu\n",
+                    status == COMPRESS_TRUNCATED ? "truncated" : "corrupt", pos);
+            break;
+        }
+
+        pos += consumed;
+        used += produced;
+    }
+
+    *unpacked = used;
+    return raw;
+}
+
+// A window event's strings are copied out while its IDs are still fresh
+static bool append_event(ReplayLog* log, const Event* event) {
+    if (log->count == log->capacity) {
+        size_t grown_capacity = log->capacity ? log->capacity * 2 : 4096;
+        Event* grown = (Event*)realloc(log->events, grown_capacity * sizeof(Event));
+        if (!grown) return false;
+        log->events = grown;
+        log->capacity = grown_capacity;
+    }
+    if (event->type == EVENT_WINDOW_CHANGE) {
+        if (log->window_count == log->window_capacity) {
+            size_t grown_capacity = log->window_capacity ? log->window_capacity * 2 : 256;
+            ReplayWindow* grown = (ReplayWindow*)realloc(log->windows,
+                                                         grown_capacity * sizeof(ReplayWindow));
+            if (!grown) return false;
+            log->windows = grown;
+            log->window_capacity = grown_capacity;
+        }
+        ReplayWindow* window = &log->windows[log->window_count++];
+        intern_resolve(event->data.window.titleId, window->title, sizeof(window->title));
+        intern_resolve(event->data.window.processNameId, window->process,
+                       sizeof(window->process));
+    }
+    memcpy(&log->events[log->count++], event, sizeof(Event));
+    return true;
+}
+
+static void restore_window_strings(Event* event, const ReplayWindow* window) {
+    event->data.window.titleId = intern_string(window->title, strlen(window->title));
+    event->data.window.processNameId = intern_string(window->process, strlen(window->process));
+}
+
+static void free_replay_log(ReplayLog* log) {
+    free(log->events);
+    free(log->windows);
+    memset(log, 0, sizeof(*log));
+}
+
+static bool load_binary_events(const BYTE* data, size_t size, ReplayLog* log) {
+    BinlogState state;
+    if (!binlog_read_header(&state, data, size)) {
+        fprintf(stderr, "Not a binary event log (version %d-%d)\n",
+                BINLOG_MIN_VERSION, BINLOG_VERSION);
+        return false;
+    }
+
+    size_t pos = BINLOG_HEADER_SIZE;
+
+    while (pos < size) {
+        Event event;
+        size_t consumed = 0;
+        int status = binlog_decode_record(&state, data + pos, size - pos, &event, &consumed);
+        if (status == BINLOG_TRUNCATED || status == BINLOG_CORRUPT) {
+            fprintf(stderr, "Stopping at %s record at offset %zu\n",
+                    status == BINLOG_TRUNCATED ? "truncated" : "corrupt", pos);
+            break;
+        }
+
+        pos += consumed;
+        if (status == BINLOG_SYNC) continue;
+
+        if (!append_event(log, &event)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// One event per parseable line; anything else is skipped
+static bool load_text_events(const BYTE* data, size_t size, ReplayLog* log) {
+    const char* text = (const char*)data;
+    size_t skipped = 0;
+    size_t pos = 0;
+
+    while (pos < size) {
+        const char* line = text + pos;
+        const char* newline = memchr(line, '\n', size - pos);
+        size_t length = newline ? (size_t)(newline - line) + 1 : size - pos;
+        pos += length;
+
+        Event event;
+        if (!parse_event_text(line, length, &event)) {
+            skipped++;
+            continue;
+        }
+        if (!append_event(log, &event)) {
+            return false;
+        }
+    }
+
+    if (skipped > 0) {
+        fprintf(stderr, "Skipped %zu lines that are not events\n", skipped);
+    }
+    return true;
+}
@@ -0,0 +1,270 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include "stages.h"
+#include "hooks.h"
+#include "buffer.h"
+#include "logger.h"
+#include "format.h"
+#include "metrics.h"
+#include "trace.h"
+#include "utils.h"
+
+static const char* writer_names[BENCH_WRITER_COUNT] = { "async", "mapped", "compressed" };
+
+// Stage samples in nanoseconds, written by the consumer thread only
+static const char* stage_names[BENCH_STAGE_COUNT] = { "queue", "format", "buffer" };
+static ULONGLONG* samples[BENCH_STAGE_COUNT];
+static size_t sample_counts[BENCH_STAGE_COUNT];
+static size_t sample_capacity;
+static atomic_size_t delivered;
+
+static LARGE_INTEGER qpc_frequency;
+static TimestampCache timestamp_cache;
+
+static bool is_logged_event(const Event* event);
+static void add_sample(int stage, ULONGLONG ns);
+static void stage_batch_callback(const Event* events, size_t count);
+static int compare_samples(const void* a, const void* b);
+static ULONGLONG percentile(const ULONGLONG* sorted, size_t count, double p);
+
+bool init_bench_stages(size_t capacity) {
+    QueryPerformanceFrequency(&qpc_frequency);
+    init_timestamp_cache(&timestamp_cache);
+    init_trace();  // Runs can be traced like the real pipeline
+
+    sample_capacity = capacity;
+    for (int s = 0; s < BENCH_STAGE_COUNT; s++) {
+        samples[s] = (ULONGLONG*)malloc((capacity ? capacity : 1) * sizeof(ULONGLONG));
+        if (!samples[s]) {
+            cleanup_bench_stages();
+            return false;
+        }
+    }
+    return true;
+}
+
+void cleanup_bench_stages(void) {
+    for (int s = 0; s < BENCH_STAGE_COUNT; s++) {
+        free(samples[s]);
+        samples[s] = NULL;
+    }
+    sample_capacity = 0;
+    cleanup_trace();
+}
+
+// The event types the log sink writes to the text log
+static bool is_logged_event(const Event* event) {
+    return event->type == EVENT_KEY_PRESS || event->type == EVENT_MOUSE_CLICK ||
+           event->type == EVENT_WINDOW_CHANGE;
+}
+
+static void add_sample(int stage, ULONGLONG ns) {
+    if (sample_counts[stage] < sample_capacity) {
+        samples[stage][sample_counts[stage]++] = ns;
+    }
+}
+
+// Consumer side: the log sink's write_batch (sink.c), run inline on the
+// consumer thread so each stage can be timed; main.c runs it on the sink's
+// worker behind dispatch_sink_events(). Every event gets a queue sample;
+// only the logged ones are formatted and buffered, straight into their
+// reserved entry, with the batch's flush counted to its last entry.
+static void stage_batch_callback(const Event* events, size_t count) {
+    bool batched = begin_buffer_batch();
+    ULONGLONG format_ticks = 0;
+    ULONGLONG buffer_ticks = 0;
+    bool pending = false;
+
+    for (size_t i = 0; i < count; i++) {
+        const Event* event = &events[i];
+        add_sample(0, (get_precise_time() - event->timestamp) * 100);
+        if (!batched || !is_logged_event(event)) {
+            continue;
+        }
+
+        if (pending) {
+            add_sample(1, bench_ticks_to_ns(format_ticks));
+            add_sample(2, bench_ticks_to_ns(buffer_ticks));
+        }
+
+        ULONGLONG start = bench_now();
+        char* entry = reserve_buffer(BUFFER_MAX_EVENT_SIZE);
+        ULONGLONG reserved = bench_now();
+        if (!entry) {
+            pending = false;
+            break;
+        }
+        size_t len = format_event_text(event, &timestamp_cache, entry, BUFFER_MAX_EVENT_SIZE);
+        ULONGLONG formatted = bench_now();
+        commit_buffer(len);
+        ULONGLONG committed = bench_now();
+
+        format_ticks = formatted - reserved;
+        buffer_ticks = (reserved - start) + (committed - formatted);
+        pending = true;
+    }
+
+    if (batched) {
+        ULONGLONG start = bench_now();
+        end_buffer_batch();
+        buffer_ticks += bench_now() - start;
+    }
+    if (pending) {
+        add_sample(1, bench_ticks_to_ns(format_ticks));
+        add_sample(2, bench_ticks_to_ns(buffer_ticks));
+    }
+
+    size_t seen = atomic_load_explicit(&delivered, memory_order_relaxed);
+    atomic_store_explicit(&delivered, seen + count, memory_order_release);
+}
+
+// Fresh log, buffer and synthetic-input hooks with the timing callback
+bool start_bench_pipeline(BenchWriter writer) {
+    DeleteFileA(BENCH_LOG_FILE);
+
+    LoggerConfig logger_config = {0};
+    if (writer == BENCH_WRITER_MAPPED) {
+        logger_config.mapped = true;
+    } else {
+        logger_config.async = true;
+        logger_config.buffer_size = LOG_ASYNC_BUFFER_SIZE;
+        logger_config.buffer_count = LOG_ASYNC_BUFFER_COUNT;
+        logger_config.compress = writer == BENCH_WRITER_COMPRESSED;
+    }
+    if (!init_logger_ex(BENCH_LOG_FILE, &logger_config)) {
+        return false;
+    }
+    if (!init_buffer()) {
+        cleanup_logger();
+        return false;
+    }
+
+    HookOptions options = {0};
+    options.consumer_thread = true;
+    options.batch_size = HOOK_DEFAULT_BATCH_SIZE;
+    options.synthetic_input = true;
+    options.overflow_policy = HOOK_OVERFLOW_SPILL;
+    options.batch_callback = stage_batch_callback;
+    atomic_store(&delivered, 0);
+    memset(sample_counts, 0, sizeof(sample_counts));
+    if (!init_hooks_ex(NULL, &options)) {
+        cleanup_buffer();
+        cleanup_logger();
+        return false;
+    }
+    return true;
+}
+
+// Waits for the consumer to catch up, then for the writer; start is the
+// bench_now() time the first event was submitted
+void finish_bench_pipeline(BenchRun* run, ULONGLONG start) {
+    while (atomic_load_explicit(&delivered, memory_order_acquire) < get_total_events()) {
+        Sleep(0);
+    }
+    flush_log();
+    run->seconds = bench_ticks_to_ns(bench_now() - start) / 1e9;
+
+    run->delivered = atomic_load(&delivered);
+    run->dropped = get_dropped_events();
+    run->spilled = get_metric(METRIC_EVENTS_SPILLED);
+    run->bytes = get_current_file_size();
+
+    cleanup_hooks();
+    cleanup_buffer();
+    cleanup_logger();
+
+    for (int s = 0; s < BENCH_STAGE_COUNT; s++) {
+        qsort(samples[s], sample_counts[s], sizeof(ULONGLONG), compare_samples);
+    }
+}
+
+// Prints the run and appends it to results as one JSON line
+void report_bench_run(const BenchRun* run, FILE* results) {
+    size_t count = run->delivered < sample_capacity ? run->delivered : sample_capacity;
+    const char* writer = get_bench_writer_name(run->writer);
+    double seconds = run->seconds;
+
+    printf("%-16s %-10s %8zu events %8zu dropped %8zu spilled %12.0f ev/s %10.2f MB/s\n",
+           run->scenario, writer, count, run->dropped, run->spilled,
+           seconds > 0 ? count / seconds : 0.0,
+           seconds > 0 ? run->bytes / seconds / (1024.0 * 1024.0) : 0.0);
+
+    fprintf(results, "{\"scenario\":\"%s\",\"writer\":\"%s\",\"submitted\":%zu,\"delivered\":%zu,"
+            "\"dropped\":%zu,\"spilled\":%zu,\"seconds\":%.6f,\"events_per_sec\":%.1f,"
+            "\"bytes\":%zu,\"bytes_per_sec\":%.1f,\"latency_ns\":{",
+            run->scenario, writer, run->submitted, count, run->dropped, run->spilled, seconds,
+            seconds > 0 ? count / seconds : 0.0, run->bytes,
+            seconds > 0 ? run->bytes / seconds : 0.0);
+    for (int s = 0; s < BENCH_STAGE_COUNT; s++) {
+        size_t sampled = sample_counts[s];
+        // A stage no event reached has no latency to report, not a zero one
+        if (sampled == 0) {
+            printf("    %-8s n/a (no samples)\n", stage_names[s]);
+            fprintf(results, "%s\"%s\":null", s ? "," : "", stage_names[s]);
+            continue;
+        }
+        printf("    %-8s p50 %8llu ns  p99 %8llu ns  p99.9 %8llu ns  max %10llu ns\n",
+               stage_names[s],
+               percentile(samples[s], sampled, 0.50),
+               percentile(samples[s], sampled, 0.99),
+               percentile(samples[s], sampled, 0.999),
+               samples[s][sampled - 1]);
+        fprintf(results, "%s\"%s\":{\"p50\":%llu,\"p99\":%llu,\"p999\":%llu,\"max\":%llu}",
+                s ? "," : "", stage_names[s],
+                percentile(samples[s], sampled, 0.50),
+                percentile(samples[s], sampled, 0.99),
+                percentile(samples[s], sampled, 0.999),
+                samples[s][sampled - 1]);
+    }
+    fprintf(results, "}}\n");
+    fflush(results);
+}
+
+const char* get_bench_writer_name(BenchWriter writer) {
+    return (unsigned)writer < BENCH_WRITER_COUNT ? writer_names[writer] : "unknown";
+}
+
+bool parse_bench_writer(const char* name, BenchWriter* writer) {
+    for (int i = 0; i < BENCH_WRITER_COUNT; i++) {
+        if (strcmp(name, writer_names[i]) == 0) {
+            *writer = (BenchWriter)i;
+            return true;
+        }
+    }
+    return false;
+}
+
+ULONGLONG bench_now(void) {
+    LARGE_INTEGER now;
+    QueryPerformanceCounter(&now);
+    return (ULONGLONG)now.QuadPart;
+}
+
+ULONGLONG bench_ticks_per_second(void) {
+    return (ULONGLONG)qpc_frequency.QuadPart;
+}
+
+ULONGLONG bench_ticks_to_ns(ULONGLONG ticks) {
+    ULONGLONG frequency = (ULONGLONG)qpc_frequency.QuadPart;
+    return ticks / frequency * 1000000000ULL + ticks % frequency * 1000000000ULL / frequency;
+}
+
+// Spins: Sleep() is far too coarse for a 1 kHz stream
+void bench_wait_until(ULONGLONG deadline) {
+    while (bench_now() < deadline) {
+        YieldProcessor();
+    }
+}
+
+static int compare_samples(const void* a, const void* b) {
+    ULONGLONG x = *(const ULONGLONG*)a;
+    ULONGLONG y = *(const ULONGLONG*)b;
+    return (x > y) - (x < y);
+}
+
+static ULONGLONG percentile(const ULONGLONG* sorted, size_t count, double p) {
+    if (count == 0) return 0;
+    size_t index = (size_t)(p * (count - 1));
+    return sorted[index];
+}
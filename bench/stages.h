@@ -0,0 +1,57 @@
+#ifndef BENCH_STAGES_H
+#define BENCH_STAGES_H
+
+#include <stdbool.h>
+#include <stdio.h>
+#include "platform.h"
+
+// Pipeline harness shared by the synthetic benchmark and the replay driver:
+// runs the real queue -> log sink batch -> buffer -> logger path without OS
+// hooks, times the events per stage and reports the results. The queue
+// stage covers every event, format and buffer only the ones the log sink
+// writes (key presses, clicks and window changes).
+
+#define BENCH_LOG_FILE     "logs/bench.txt"
+#define BENCH_STAGE_COUNT  3
+
+// Logger modes a run can use
+typedef enum {
+    BENCH_WRITER_ASYNC,
+    BENCH_WRITER_MAPPED,
+    BENCH_WRITER_COMPRESSED,
+    BENCH_WRITER_COUNT
+} BenchWriter;
+
+// Outcome of one run, filled by finish_bench_pipeline()
+typedef struct {
+    const char* scenario;
+    BenchWriter writer;
+    size_t submitted;   // Events handed to submit_hook_event()
+    size_t delivered;   // Events the consumer batches carried
+    size_t dropped;
+    size_t spilled;
+    size_t bytes;       // Log file size
+    double seconds;
+} BenchRun;
+
+// Stage sample storage for runs of up to capacity events
+bool init_bench_stages(size_t capacity);
+void cleanup_bench_stages(void);
+
+// A run: start the pipeline, submit, then finish (waits for the consumer
+// and the writer, stops the pipeline) and report
+bool start_bench_pipeline(BenchWriter writer);
+void finish_bench_pipeline(BenchRun* run, ULONGLONG start);
+void report_bench_run(const BenchRun* run, FILE* results);
+
+// Writers by name
+const char* get_bench_writer_name(BenchWriter writer);
+bool parse_bench_writer(const char* name, BenchWriter* writer);
+
+// Performance counter clock
+ULONGLONG bench_now(void);
+ULONGLONG bench_ticks_per_second(void);
+ULONGLONG bench_ticks_to_ns(ULONGLONG ticks);
+void bench_wait_until(ULONGLONG deadline);
+
+#endif
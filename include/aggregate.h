@@ -0,0 +1,89 @@
+#ifndef AGGREGATE_H
+#define AGGREGATE_H
+
+#include <stdbool.h>
+#include "platform.h"
+#include "hooks.h"
+#include "intern.h"
+#include "utils.h"
+
+// Aggregator configuration
+#define AGGREGATE_TABLE_SLOTS 64              // Open addressing slots, at most 3/4 in use
+#define AGGREGATE_DEFAULT_INTERVAL 60000      // ms per summary interval
+#define AGGREGATE_MIN_INTERVAL 1000
+#define AGGREGATE_IDLE_GAP 5000               // Input gaps up to this long count as active (ms)
+#define AGGREGATE_RECORD_SIZE (MAX_PROCESS_NAME + 160)  // Longest summary line
+#define AGGREGATE_WHEEL_NOTCH 120             // WHEEL_DELTA: wheel units per notch
+#define AGGREGATE_OTHER_NAME "(other)"
+
+// Safety checks
+#if (AGGREGATE_TABLE_SLOTS & (AGGREGATE_TABLE_SLOTS - 1)) != 0
+    #error "AGGREGATE_TABLE_SLOTS must be a power of two"
+#endif
+
+/**
+ * Aggregation-only output
+ * Instead of one line per event the aggregator keeps counters per process
+ * and emits one summary line per process per interval:
+ *   [2026-10-14 14:02:00.000] SUMMARY PROCESS:'notepad.exe' SECS:60 KEYS:412
+ *       CLICKS:12 SCROLL:6 MOVES:880 ACTIVE_MS:48210 WINDOWS:3
+ * (one line in the log). The timestamp is the start of the interval.
+ * KEYS counts key presses, CLICKS button presses, SCROLL wheel notches in
+ * either direction, MOVES raw mouse moves and WINDOWS switches to the
+ * process. ACTIVE_MS sums the gaps between consecutive input events of the
+ * process that are no longer than AGGREGATE_IDLE_GAP.
+ *
+ * Input belongs to the process of the last window change. Input before any
+ * window change, and processes that no longer fit in the table, are
+ * counted under AGGREGATE_OTHER_NAME. Intervals are aligned to multiples of
+ * their length and closed by the first event (or flush time) past their
+ * end; idle processes emit nothing.
+ *
+ * An Aggregator is owned by one thread (a sink worker, or capture under
+ * its lock) and needs no locking of its own.
+ */
+
+// Counters of one process in the current interval
+typedef struct {
+    InternId process;        // INTERN_NONE = free slot
+    size_t keys;
+    size_t clicks;
+    size_t scroll;           // Wheel distance, AGGREGATE_WHEEL_NOTCH per notch
+    size_t moves;
+    size_t windows;
+    ULONGLONG active;        // FILETIME units
+    ULONGLONG last_input;    // Timestamp of the latest input event
+} AggregateEntry;
+
+// Called with each finished summary line and its process (INTERN_NONE for
+// AGGREGATE_OTHER_NAME); returns false if the line was not written
+typedef bool (*AggregateEmitCallback)(void* context, InternId process,
+                                      const char* record, size_t size);
+
+typedef struct {
+    AggregateEntry slots[AGGREGATE_TABLE_SLOTS];
+    AggregateEntry other;    // Unattributed input and table overflow
+    size_t used;             // Occupied slots
+    InternId foreground;     // Process of the last window change
+    ULONGLONG interval;      // Interval length in FILETIME units
+    ULONGLONG start;         // Start of the current interval (0 = none yet)
+    TimestampCache timestamps;
+    AggregateEmitCallback emit;
+    void* context;
+} Aggregator;
+
+// Core functions; interval_ms 0 selects AGGREGATE_DEFAULT_INTERVAL
+bool init_aggregator(Aggregator* aggregator, DWORD interval_ms,
+                     AggregateEmitCallback emit, void* context);
+bool aggregate_events(Aggregator* aggregator, const Event* events, size_t count);
+
+// Emits the current interval if it ended before now (get_precise_time()
+// units); finish emits it regardless, e.g. before the output is closed
+bool flush_aggregator(Aggregator* aggregator, ULONGLONG now);
+bool finish_aggregator(Aggregator* aggregator);
+
+// Formats one summary line; returns its length (0 if it does not fit)
+size_t format_aggregate_record(Aggregator* aggregator, const AggregateEntry* entry,
+                               char* buffer, size_t size);
+
+#endif
@@ -0,0 +1,78 @@
+#ifndef BINLOG_H
+#define BINLOG_H
+
+#include <stdbool.h>
+#include "platform.h"
+#include "hooks.h"
+
+/**
+ * Compact binary event log.
+ *
+ * File layout:
+ *   header: "I2CB" magic, u16 version, u16 reserved, sync payload
+ *   records: one tag byte followed by a type-specific payload
+ *
+ * The tag's low nibble is the EventType (or BINLOG_TAG_SYNC), the high
+ * nibble carries the extended/injected flags. Every event record starts
+ * with the zigzag varint delta in microseconds to the previous record's
+ * time (producers on different threads may enqueue slightly out of
+ * order); mouse coordinates are zigzag varint deltas to the previous mouse
+ * position; coalesced moves (BINLOG_TAG_COALESCED) append the varint move
+ * count. A sync record (u64 FILETIME UTC) resets the base time and all
+ * deltas, and is written whenever an existing log is reopened for appending.
+ */
+#define BINLOG_MAGIC "I2CB"
+#define BINLOG_MAGIC_SIZE 4
+#define BINLOG_VERSION 3
+#define BINLOG_MIN_VERSION 2    // Oldest version the decoder still reads
+#define BINLOG_SYNC_SIZE 8
+#define BINLOG_TICKS_PER_US 10  // FILETIME ticks per encoded time unit
+#define BINLOG_HEADER_SIZE (BINLOG_MAGIC_SIZE + 4 + BINLOG_SYNC_SIZE)
+#define BINLOG_MAX_RECORD_SIZE (32 + MAX_WINDOW_TITLE + MAX_PROCESS_NAME)
+
+// Window records carry the resolved strings; decoding interns them again,
+// so the intern table must be initialized on both sides
+
+#define BINLOG_TAG_TYPE_MASK  0x0F
+#define BINLOG_TAG_SYNC       0x0F
+#define BINLOG_TAG_EXTENDED   0x10
+#define BINLOG_TAG_INJECTED   0x20
+#define BINLOG_TAG_COALESCED  0x40
+
+// Keyboard records store KeyboardEvent.modifiers (INPUT_MOD_*) as-is; mouse
+// records pack buttonFlags into the low nibble and MouseEvent.buttons
+// (INPUT_BTN_*) into the high nibble
+#define BINLOG_BTN_FLAGS_MASK  0x0F
+
+/**
+ * Binlog result codes:
+ * BINLOG_OK (0):        Record decoded
+ * BINLOG_SYNC (1):      Sync record consumed, no event produced
+ * BINLOG_TRUNCATED (2): Input ends in the middle of a record
+ * BINLOG_CORRUPT (3):   Invalid data
+ */
+#define BINLOG_OK         0
+#define BINLOG_SYNC       1
+#define BINLOG_TRUNCATED  2
+#define BINLOG_CORRUPT    3
+
+// Delta coding state, one per open log file (encoder) or input (decoder)
+typedef struct {
+    ULONGLONG base_time;    // FILETIME (UTC) of the last sync
+    ULONGLONG last_time;    // Time of the previous record (microsecond grid)
+    LONG last_x;            // Previous mouse position
+    LONG last_y;
+} BinlogState;
+
+// Encoding
+size_t binlog_write_header(BinlogState* state, BYTE* out, size_t size);
+size_t binlog_write_sync(BinlogState* state, BYTE* out, size_t size);
+size_t binlog_encode_event(BinlogState* state, const Event* event,
+                           BYTE* out, size_t size);
+
+// Decoding
+bool binlog_read_header(BinlogState* state, const BYTE* in, size_t size);
+int binlog_decode_record(BinlogState* state, const BYTE* in, size_t size,
+                         Event* event, size_t* consumed);
+
+#endif
@@ -2,22 +2,15 @@
 #define BUFFER_H
 
 #include <stdbool.h>
-#include <windows.h>
+#include <stdatomic.h>
+#include "platform.h"
 
 // Buffer configuration
-#define BUFFER_SIZE 4096
-#define BUFFER_FLUSH_THRESHOLD ((BUFFER_SIZE * 3) / 4)
+// Entries are written straight into the logger's write buffers; the
+// buffer layer only decides when accumulated output is handed to disk.
+#define BUFFER_DEFAULT_FLUSH_THRESHOLD (64 * 1024)
 #define BUFFER_MAX_EVENT_SIZE 1024
 
-// Safety checks
-#if BUFFER_MAX_EVENT_SIZE >= BUFFER_SIZE
-    #error "BUFFER_MAX_EVENT_SIZE must be smaller than BUFFER_SIZE"
-#endif
-
-#if BUFFER_FLUSH_THRESHOLD >= BUFFER_SIZE
-    #error "BUFFER_FLUSH_THRESHOLD must be smaller than BUFFER_SIZE"
-#endif
-
 /**
  * Buffer error codes:
  * BUFFER_ERROR_NONE (0):    No error
@@ -45,19 +38,12 @@
 
 // Buffer structure containing all buffer-related data and state
 typedef struct {
-    char* data;                  // Buffer data
-    volatile size_t size;        // Current size
-    volatile size_t capacity;    // Maximum capacity
-    CRITICAL_SECTION lock;       // Thread safety
+    atomic_size_t size;               // Bytes added since the last flush
+    volatile size_t flush_threshold;  // Size at which the output is flushed
+    CRITICAL_SECTION lock;       // Serializes flushes with cleanup
     volatile bool initialized;   // Initialization flag
     volatile DWORD last_error;   // Last error code
-    struct {
-        volatile size_t total_flushes;   // Total number of flushes
-        volatile size_t failed_flushes;  // Number of failed flushes
-        volatile size_t total_writes;    // Total number of writes
-        volatile size_t failed_writes;   // Number of failed writes
-    } stats;
-} Buffer;
+} Buffer;   // Statistics live in the METRIC_BUFFER_* counters
 
 // Core functions
 bool init_buffer(void);
@@ -66,6 +52,23 @@ bool add_to_buffer(const char* event_data, size_t data_size);
 bool flush_buffer_if_needed(void);
 bool force_flush_buffer(void);
 
+// Zero-copy append: format directly into reserved output space and commit
+// right away, one reservation per thread. With an async logger any number
+// of threads hold one at once; the sync and mapped loggers hold their lock
+// from reserve to commit.
+char* reserve_buffer(size_t max_size);
+bool commit_buffer(size_t used);
+
+// Batch append: defers the calling thread's flush threshold checks to the
+// end of a run of reserve/commit pairs. Both commit_buffer() and
+// end_buffer_batch() return false when the flush they triggered failed.
+bool begin_buffer_batch(void);
+bool end_buffer_batch(void);
+
+// Runtime configuration
+bool set_buffer_flush_threshold(size_t threshold);
+size_t get_buffer_flush_threshold(void);
+
 // Utility functions
 bool is_buffer_initialized(void);
 size_t get_buffer_size(void);
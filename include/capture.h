@@ -2,9 +2,11 @@
 #define CAPTURE_H
 
 #include <stdbool.h>
-#include <windows.h>
+#include "platform.h"
 #include "hooks.h"
 #include "buffer.h"
+#include "binlog.h"
+#include "logger.h"
 
 // Configuration
 #define CAPTURE_LOG_DIR "logs"
@@ -13,7 +15,9 @@
 #define CAPTURE_FLUSH_INTERVAL 1000  // 1 second
 #define CAPTURE_MAX_FILE_SIZE (10 * 1024 * 1024)  // 10MB
 #define CAPTURE_MAX_ENTRY_SIZE 2048
-#define CAPTURE_BUFFER_SIZE (1024 * 1024)
+#define CAPTURE_BUFFER_SIZE (1024 * 1024)  // Size of each log write buffer
+#define CAPTURE_INDEX_INTERVAL 256  // Events per side index block
+#define CAPTURE_MAX_COMMIT_INTERVAL 60000  // Longest group commit interval in ms
 
 // Error codes
 #define CAPTURE_ERROR_NONE     0
@@ -27,21 +31,37 @@
 typedef enum {
     CAPTURE_MODE_NORMAL,    // Standard capture
     CAPTURE_MODE_STEALTH,   // Minimal disk writes
-    CAPTURE_MODE_DEBUG      // Verbose logging
+    CAPTURE_MODE_DEBUG,     // Verbose logging
+    CAPTURE_MODE_AGGREGATE  // Per-process interval summaries only (see aggregate.h)
 } CaptureMode;
 
+// Log file formats
+typedef enum {
+    CAPTURE_FORMAT_TEXT,    // Human-readable text lines
+    CAPTURE_FORMAT_BINARY   // Compact binary records (see binlog.h)
+} CaptureFormat;
+
 // Capture configuration
 typedef struct {
     char log_path[CAPTURE_MAX_PATH];    // Path to log file
     CaptureMode mode;                   // Capture mode
+    CaptureFormat format;               // Log file format
     DWORD flush_interval;               // Flush interval in ms
     size_t max_file_size;              // Maximum log file size
-    bool rotate_logs;                   // Enable log rotation
+    bool rotate_logs;                   // Rotate at max_file_size (and rotate_interval)
+    DWORD rotate_interval;              // Also rotate after this many ms (0 = size only)
     bool encrypt_logs;                  // Enable encryption
+    bool compress_logs;                 // Write compressed frames (see compress.h)
+    size_t index_interval;              // Events per side index block (0 = no index)
     bool buffer_events;                 // Use buffer for events
+    size_t flush_size;                  // Submit buffered output at this size (0 = when full)
+    HookBackend input_backend;          // Input source if start_capture() starts the hooks
+    DWORD aggregate_interval;           // CAPTURE_MODE_AGGREGATE summary interval in ms (0 = default)
+    LogDurability durability;           // When written events are forced to disk (see logger.h)
+    DWORD commit_interval;              // ms between group commits (0 = LOG_DEFAULT_COMMIT_INTERVAL)
 } CaptureConfig;
 
-// Capture statistics
+// Capture statistics, filled from the metrics registry (see metrics.h)
 typedef struct {
     size_t events_captured;     // Total events captured
     size_t bytes_written;       // Total bytes written
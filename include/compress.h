@@ -0,0 +1,55 @@
+#ifndef COMPRESS_H
+#define COMPRESS_H
+
+#include <stdbool.h>
+#include "platform.h"
+
+/**
+ * Framed block compression for log output.
+ *
+ * A compressed log is a sequence of self-contained frames:
+ *   header: "I2CZ" magic, u32 raw size, u32 payload size, u32 checksum
+ *   payload: one LZ4-format block (or the raw bytes when stored)
+ *
+ * Each frame holds at most COMPRESS_BLOCK_SIZE bytes of output and its
+ * matches never reach into another frame, so every complete frame decodes
+ * on its own and a file cut short by a crash loses only its last frame.
+ * The raw size's top bit (COMPRESS_FRAME_STORED) marks a frame whose data
+ * did not compress. The checksum is FNV-1a over the raw bytes. All fields
+ * are little-endian.
+ */
+#define COMPRESS_MAGIC "I2CZ"
+#define COMPRESS_MAGIC_SIZE 4
+#define COMPRESS_FRAME_HEADER_SIZE (COMPRESS_MAGIC_SIZE + 12)
+#define COMPRESS_FRAME_STORED 0x80000000u
+#define COMPRESS_BLOCK_SIZE (64 * 1024)  // Raw bytes per frame
+#define COMPRESS_BOUND(size) ((size) + (size) / 255 + 16)
+#define COMPRESS_MAX_FRAME_SIZE (COMPRESS_FRAME_HEADER_SIZE + COMPRESS_BOUND(COMPRESS_BLOCK_SIZE))
+
+/**
+ * Compress result codes:
+ * COMPRESS_OK (0):        Frame decoded
+ * COMPRESS_TRUNCATED (1): Input ends in the middle of a frame
+ * COMPRESS_CORRUPT (2):   Invalid frame or checksum mismatch
+ */
+#define COMPRESS_OK         0
+#define COMPRESS_TRUNCATED  1
+#define COMPRESS_CORRUPT    2
+
+// Blocks (LZ4 block format, 64 KB window)
+size_t compress_block(const BYTE* in, size_t size, BYTE* out, size_t capacity);
+size_t decompress_block(const BYTE* in, size_t size, BYTE* out, size_t capacity);
+
+// Frames
+size_t compress_frame(const BYTE* in, size_t size, BYTE* out, size_t capacity);
+int decompress_frame(const BYTE* in, size_t size, BYTE* out, size_t capacity,
+                     size_t* consumed, size_t* produced);
+bool is_compressed_log(const BYTE* in, size_t size);
+
+// Whole logs: the output of every complete frame, in a buffer the caller
+// frees; status ends up COMPRESS_OK, or tells why the frame at consumed
+// was not read
+BYTE* decompress_log(const BYTE* in, size_t size, size_t* produced,
+                     size_t* consumed, int* status);
+
+#endif
@@ -0,0 +1,19 @@
+#ifndef FORMAT_H
+#define FORMAT_H
+
+#include <stdbool.h>
+#include "platform.h"
+#include "hooks.h"
+#include "utils.h"
+
+// Text formatting shared by the capture writer and the offline decoder
+// The event's own timestamp is formatted through the caller's cache.
+size_t format_event_text(const Event* event, TimestampCache* cache,
+                         char* buffer, size_t size);
+
+// Inverse of format_event_text() for one line (with or without its
+// newline); window strings are interned. Times come back at millisecond
+// precision.
+bool parse_event_text(const char* line, size_t length, Event* event);
+
+#endif
@@ -2,13 +2,45 @@
 #define HOOKS_H
 
 #include <stdbool.h>
-#include <windows.h>
-#include <psapi.h>
+#include <stdatomic.h>
+#include "platform.h"
+#include "intern.h"
+#include "proccache.h"
+#include "metrics.h"
 
 // Configuration
 #define MAX_WINDOW_TITLE 256
 #define MAX_PROCESS_NAME 64
 #define MAX_EVENT_QUEUE 1024
+#define HOOK_CACHE_LINE 64
+#define HOOK_EVENT_MAX_SIZE 32          // Event size budget; one ring slot each
+#define HOOK_DEFAULT_BATCH_SIZE 64
+#define HOOK_THREAD_PRIORITY THREAD_PRIORITY_TIME_CRITICAL
+#define HOOK_COALESCE_IDLE_FLUSH 50     // ms before a held move is emitted (distance-only)
+#define HOOK_DEFAULT_COALESCE_MS 16     // Coalescing window used by main.c
+#define HOOK_LATENCY_BUCKETS 32         // Log2 nanosecond buckets, up to ~4 s
+#define HOOK_DEFAULT_LATENCY_THRESHOLD_US 1000  // Slow callback threshold
+#define HOOK_SPILL_BLOCK_EVENTS 256     // Events per overflow block
+#define HOOK_DEFAULT_SPILL_LIMIT (4 * 1024 * 1024)  // Overflow memory cap (bytes)
+#define HOOK_MOVE_SHED_LEVEL (MAX_EVENT_QUEUE * 3 / 4)  // Ring depth where moves are shed
+#define HOOK_RAW_INPUT_BUFFER_SIZE (16 * 1024)  // GetRawInputBuffer() read size (bytes)
+#define HOOK_RAW_INPUT_CLASS "KeylogRawInputSink"
+#define HOOK_EVDEV_DIR "/dev/input"             // Scanned for event* nodes at install
+#define HOOK_EVDEV_MAX_DEVICES 32
+#define HOOK_EVDEV_READ_EVENTS 64               // input_event records per read()
+#define HOOK_FILTER_KEY_BYTES 32                // 256-bit virtual-key bitmap
+#define HOOK_FILTER_MAX_PROCESSES 16            // Process include/exclude set size
+#define HOOK_FILTER_PROCESS_SLOTS 64            // Compiled process set (open addressing)
+
+// Safety checks
+#if (MAX_EVENT_QUEUE & (MAX_EVENT_QUEUE - 1)) != 0
+    #error "MAX_EVENT_QUEUE must be a power of two"
+#endif
+
+#if (HOOK_FILTER_PROCESS_SLOTS & (HOOK_FILTER_PROCESS_SLOTS - 1)) != 0 || \
+    HOOK_FILTER_PROCESS_SLOTS < 2 * HOOK_FILTER_MAX_PROCESSES
+    #error "HOOK_FILTER_PROCESS_SLOTS must be a power of two, at least twice the process set"
+#endif
 
 // Error codes
 #define HOOK_ERROR_NONE          0
@@ -30,38 +62,46 @@ typedef enum {
     EVENT_ERROR
 } EventType;
 
+// Packed input state (KeyboardEvent.modifiers, MouseEvent.buttons).
+// The state is the one in effect when the event arrived, i.e. before the
+// event itself is applied: a Shift press does not carry INPUT_MOD_SHIFT.
+#define INPUT_MOD_ALT       0x01
+#define INPUT_MOD_CONTROL   0x02
+#define INPUT_MOD_SHIFT     0x04
+#define INPUT_MOD_WIN       0x08
+#define INPUT_BTN_LEFT      0x10
+#define INPUT_BTN_RIGHT     0x20
+#define INPUT_BTN_MIDDLE    0x40
+
 // Event data structures
 typedef struct {
     DWORD vkCode;        // Virtual key code
     DWORD scanCode;      // Hardware scan code
     bool extended;       // Extended key flag
     bool injected;       // Injected key flag
-    bool alt;           // Alt key pressed
-    bool shift;         // Shift key pressed
-    bool control;       // Control key pressed
-    bool win;           // Windows key pressed
+    BYTE modifiers;      // INPUT_MOD_* keys held down
 } KeyboardEvent;
 
 typedef struct {
     POINT position;      // Mouse coordinates
-    DWORD buttonFlags;   // Button state flags
+    BYTE buttonFlags;    // Buttons involved in the event (0x01 L, 0x02 R, 0x04 M)
     bool injected;       // Injected click flag
     short wheelDelta;    // Scroll wheel movement
-    bool leftButton;     // Left button state
-    bool rightButton;    // Right button state
-    bool middleButton;   // Middle button state
+    BYTE buttons;        // INPUT_BTN_* buttons held down
+    WORD moveCount;      // Raw moves merged into this EVENT_MOUSE_MOVE (1 = single)
 } MouseEvent;
 
+// Window strings are interned (see intern.h) to keep Event small
 typedef struct {
-    char title[MAX_WINDOW_TITLE];     // Window title
-    char process[MAX_PROCESS_NAME];   // Process name
+    InternId titleId;                 // Interned window title
+    InternId processNameId;           // Interned process name
     DWORD processId;                  // Process ID
     HWND hwnd;                        // Window handle
 } WindowEvent;
 
 typedef struct {
     EventType type;
-    DWORD timestamp;
+    ULONGLONG timestamp;   // get_precise_time() at capture (FILETIME units, UTC)
     union {
         KeyboardEvent keyboard;
         MouseEvent mouse;
@@ -69,47 +109,257 @@ typedef struct {
     } data;
 } Event;
 
+// Every queued event is copied once per stage, keep it small. The budget
+// is 32 bytes: the 8-byte timestamp aligns the union after the
+// 4-byte type, and with a 64-bit hwnd WindowEvent takes 16 bytes, so a
+// 64-bit build uses all of it and the 1024-slot ring holds 32 KB of events.
+_Static_assert(sizeof(Event) <= HOOK_EVENT_MAX_SIZE, "Event must fit in HOOK_EVENT_MAX_SIZE bytes");
+
 // Event filtering configuration
+// Consecutive mouse moves are merged into one event carrying the last
+// position and the number of raw moves while they stay within
+// move_coalesce_ms of the first move or within move_min_distance pixels
+// of its position (0 disables a criterion). Clicks and wheel events are
+// never merged and emit any held move first.
+// ignored_types and ignored_keys drop single event types and keys (bit vk
+// of the bitmap, see HOOK_FILTER_IGNORE_KEY). The process set is matched
+// against the interned process name of window changes and, for input,
+// of the last window change queued; input that arrives before any window
+// change (synthetic input, evdev) is not filtered by process. The IDs come
+// from intern_string() and go stale once recycled (see intern.h); callers
+// that run for long re-set the filters when get_intern_evictions() moves.
+typedef enum {
+    HOOK_PROCESS_FILTER_NONE,      // processes is ignored
+    HOOK_PROCESS_FILTER_INCLUDE,   // Only events of the listed processes
+    HOOK_PROCESS_FILTER_EXCLUDE    // Everything but the listed processes
+} HookProcessFilter;
+
+#define HOOK_FILTER_TYPE(type) (1u << (type))
+#define HOOK_FILTER_IGNORE_KEY(filters, vk) \
+    ((filters)->ignored_keys[((vk) & 0xFF) >> 3] |= (BYTE)(1u << ((vk) & 7)))
+
 typedef struct {
     bool capture_keyboard;
     bool capture_mouse;
     bool capture_window_changes;
     bool ignore_injected;
+    DWORD move_coalesce_ms;     // Time window for merging moves
+    DWORD move_min_distance;    // Pixel radius for merging moves
+    DWORD ignored_types;        // HOOK_FILTER_TYPE() bits of types to drop
+    BYTE ignored_keys[HOOK_FILTER_KEY_BYTES];  // Virtual keys to drop
+    HookProcessFilter process_filter;
+    InternId processes[HOOK_FILTER_MAX_PROCESSES];  // Interned process names
+    size_t process_count;
 } HookFilters;
 
+// HookFilters compiled for the producers. Keys are decided by one bit of
+// keys (indexed by vk, release and injected flags), other types by one bit
+// of types (type, plus 8 when injected); both already fold in the capture_*
+// and ignore_injected switches. set_hook_filters() publishes a new table
+// with one pointer swap and frees the table it replaced once the filter
+// checks that may still read it are done; the checks never wait, only
+// concurrent updaters wait for each other.
+typedef struct HookFilterTable {
+    HookFilters filters;               // Source settings (get_hook_filters)
+    BYTE keys[4 * HOOK_FILTER_KEY_BYTES];  // Set bit = the key event passes
+    DWORD types;                       // Set bit = the event type passes
+    HookProcessFilter process_filter;
+    InternId process_slots[HOOK_FILTER_PROCESS_SLOTS];  // INTERN_NONE = empty
+} HookFilterTable;
+
+// Time spent inside keyboard_proc/mouse_proc (per WM_INPUT drain with
+// HOOK_BACKEND_RAW_INPUT, per device read with HOOK_BACKEND_EVDEV), measured
+// with the performance counter. Bucket i counts callbacks that took [2^i, 2^(i+1))
+// nanoseconds (bucket 0 also takes anything faster); the percentiles are the
+// upper bound of the bucket they fall in, capped at max_ns.
+typedef struct {
+    size_t buckets[HOOK_LATENCY_BUCKETS];
+    size_t count;               // Callbacks measured
+    ULONGLONG p50_ns;
+    ULONGLONG p99_ns;
+    ULONGLONG max_ns;
+    size_t over_threshold;      // Callbacks slower than threshold_us
+    DWORD threshold_us;
+} HookLatencyHistogram;
+
+// Bounded multi-producer/single-consumer event ring.
+// head and tail are free-running counters (slot = index & (MAX_EVENT_QUEUE - 1)).
+// Producers (hook thread, window tracker) claim a slot by advancing tail and
+// publish it through the slot's sequence; the consumer alone advances head.
+// head and tail live on separate cache lines and nobody ever waits on a lock.
+// Sequences are kept apart from the events so that consecutive slots form a
+// plain Event array a batch callback can read in place.
+typedef struct {
+    _Alignas(HOOK_CACHE_LINE) atomic_size_t head;  // Next slot to consume
+    _Alignas(HOOK_CACHE_LINE) atomic_size_t tail;  // Next slot to claim
+    _Alignas(HOOK_CACHE_LINE) atomic_size_t sequences[MAX_EVENT_QUEUE];  // Per slot: who owns it
+    _Alignas(HOOK_CACHE_LINE) Event events[MAX_EVENT_QUEUE];
+} EventRing;
+
 // Callback type for event processing
 typedef void (*EventCallback)(const Event* event);
 
+// Batch callback: count consecutive events, read in place from the ring.
+// A run that wraps around the ring end arrives as two calls. The events are
+// only valid until the callback returns.
+typedef void (*EventBatchCallback)(const Event* events, size_t count);
+
+// What queue_event() does when the ring is full. DROP_OLDEST and SPILL both
+// park overflow in a chain of pooled blocks that the consumer drains after
+// the ring, so order is kept; they differ once the chain reaches its memory
+// cap: SPILL drops the new event, DROP_OLDEST recycles the chain's head
+// block, losing its undrained events (up to HOOK_SPILL_BLOCK_EVENTS) at
+// once. Events already in the ring belong to the consumer and are never
+// evicted, so DROP_OLDEST keeps the ring plus the newest overflow: the gap
+// opens between them, not before the oldest event still queued. The cap is
+// at least two blocks, so the block being filled always has one to evict.
+// Under any policy mouse moves are shed first: once the ring is
+// HOOK_MOVE_SHED_LEVEL deep, or overflow is parked, new moves are dropped.
+typedef enum {
+    HOOK_OVERFLOW_DROP_NEWEST,  // Drop the new event (default)
+    HOOK_OVERFLOW_DROP_OLDEST,  // Keep the ring and the newest overflow
+    HOOK_OVERFLOW_SPILL         // Keep everything up to spill_limit
+} HookOverflowPolicy;
+
+// Overflow block; the pool keeps drained blocks for reuse
+typedef struct SpillBlock {
+    struct SpillBlock* next;
+    size_t head;                // Next event to drain
+    size_t count;               // Events written
+    Event events[HOOK_SPILL_BLOCK_EVENTS];
+} SpillBlock;
+
+// Where keyboard and mouse input comes from
+// LL_HOOKS runs keyboard_proc/mouse_proc inside the system input path, one
+// message per event. RAW_INPUT registers for WM_INPUT with RIDEV_INPUTSINK
+// on a message-only window and pulls every pending packet with one
+// GetRawInputBuffer() call per wakeup; it never delays other applications'
+// input. Raw mouse packets carry deltas, so positions are the cursor
+// position read once per batch.
+// EVDEV is the only backend outside Windows, and is ignored on Windows. It
+// reads the keyboards and relative pointers under HOOK_EVDEV_DIR (which
+// needs read access to them, e.g. membership of the input group), waiting
+// on all of them with one epoll set and taking up to HOOK_EVDEV_READ_EVENTS
+// records per read(). Timestamps are the kernel's, key codes are mapped to
+// their Windows virtual-key and scan codes, devices on the virtual bus
+// (uinput) count as injected. Without a display server to ask, mouse
+// positions are the motion summed since the backend started, and there are
+// no window change events.
+typedef enum {
+    HOOK_BACKEND_LL_HOOKS,   // WH_KEYBOARD_LL / WH_MOUSE_LL (Windows default)
+    HOOK_BACKEND_RAW_INPUT,  // WM_INPUT via GetRawInputBuffer()
+    HOOK_BACKEND_EVDEV       // /dev/input/event* via epoll (Linux)
+} HookBackend;
+
+#ifndef _WIN32
+// One opened /dev/input/event* node
+typedef struct {
+    int fd;                 // -1 once the device is gone
+    bool injected;          // On the virtual bus (uinput)
+    bool dropped;           // Skipping to the next SYN_REPORT after SYN_DROPPED
+    LONG dx;                // Motion of the report being read
+    LONG dy;
+} HookEvdevDevice;
+#endif
+
+// Threading options for the event pipeline
+typedef struct {
+    bool consumer_thread;   // Drain the queue on a dedicated consumer thread
+    bool hook_thread;       // Service the LL hooks on a dedicated thread
+    size_t batch_size;      // Max events handled per consumer pass
+    bool synthetic_input;   // Install no OS hooks; events come from submit_hook_event()
+    HookOverflowPolicy overflow_policy;  // Ring full behavior
+    size_t spill_limit;     // Overflow memory cap in bytes (0 = default, at least two blocks)
+    EventBatchCallback batch_callback;  // Used instead of the per-event callback
+    HookBackend backend;    // Input source (ignored with synthetic_input)
+} HookOptions;
+
 // Structure to hold hook handles and state
 typedef struct {
+#ifdef _WIN32
     HHOOK keyboard;                      // Keyboard hook handle
     HHOOK mouse;                         // Mouse hook handle
+#endif
     HWND activeWindow;                   // Current active window
     char windowTitle[MAX_WINDOW_TITLE];  // Current window title
     char processName[MAX_PROCESS_NAME];  // Current process name
+#ifdef _WIN32
+    HWINEVENTHOOK foreground_hook;       // EVENT_SYSTEM_FOREGROUND hook (NULL = polling)
+    HWINEVENTHOOK namechange_hook;       // EVENT_OBJECT_NAMECHANGE hook for the foreground process
+    DWORD namechange_pid;                // Process the name change hook is scoped to
+#endif
     CRITICAL_SECTION lock;               // Thread synchronization
+    CRITICAL_SECTION filter_lock;        // Serializes filter table updates
     EventCallback callback;              // Event callback function
-    HookFilters filters;                 // Event filtering options
+    EventBatchCallback batch_callback;   // Batch callback (takes precedence)
+    _Atomic(HookFilterTable*) filter_table;    // Compiled filters in effect (NULL = pass all)
+    atomic_size_t filter_checks[2];      // Filter checks in progress, by phase
+    atomic_size_t filter_phase;          // Phase new filter checks count under
+    _Atomic(InternId) foreground_process;      // Process of the last window change queued
+    atomic_bool accepting;               // queue_event_ex() takes new events
+    atomic_size_t producers;             // queue_event_ex() calls in progress
+    bool owns_intern;                    // init_hooks_ex() created the intern table
+    bool owns_process_cache;             // init_hooks_ex() created the process cache
+    HookOptions options;                 // Pipeline threading options
+    HANDLE hook_thread;                  // Hook thread handle
+    DWORD hook_thread_id;                // Hook thread id (for WM_QUIT)
+    HANDLE hook_ready;                   // Set once the hook thread is up
+    HANDLE consumer_thread;              // Consumer thread handle
+    HANDLE queue_signal;                 // Set on empty->non-empty transition
+    volatile bool consumer_running;      // Consumer thread keep-alive flag
+    WORD input_state;                    // Tracked modifier/button state (hook thread)
+    atomic_bool input_resync;            // Re-read input_state on the next event
+    Event pending_move;                  // Move being coalesced (hook thread)
+    bool move_pending;                   // pending_move holds an event
+    ULONGLONG move_start_time;           // Timestamp of the group's first move
+    POINT move_start_pos;                // Position of the group's first move
+#ifdef _WIN32
+    UINT_PTR coalesce_timer;             // Flushes a held move when input stops
+    struct {
+        HWND window;                     // Message-only WM_INPUT target
+        RAWINPUT* buffer;                // GetRawInputBuffer() destination
+        size_t header_pad;               // Extra header bytes of a WOW64 process
+    } raw_input;                         // HOOK_BACKEND_RAW_INPUT state
+#else
+    struct {
+        int epoll;                       // Waits on every device and on wake
+        int wake;                        // eventfd that stops the hook thread
+        HookEvdevDevice devices[HOOK_EVDEV_MAX_DEVICES];
+        size_t device_count;
+        POINT position;                  // Summed relative motion
+    } evdev;                             // HOOK_BACKEND_EVDEV state
+#endif
+    EventRing event_queue;               // Lock-free event queue
     struct {
-        Event queue[MAX_EVENT_QUEUE];    // Event queue
-        volatile size_t queue_head;      // Queue head index
-        volatile size_t queue_tail;      // Queue tail index
-        CRITICAL_SECTION queue_lock;     // Queue synchronization
-    } event_queue;
+        CRITICAL_SECTION lock;           // Only taken once the ring is full
+        atomic_bool active;              // Producers append here until drained
+        SpillBlock* head;                // Oldest block
+        SpillBlock* tail;                // Block being appended to
+        SpillBlock* pool;                // Drained blocks kept for reuse
+        size_t blocks;                   // Blocks allocated (chained + pooled)
+        size_t max_blocks;               // Memory cap in blocks
+        size_t count;                    // Events parked in the chain
+    } spill;                             // Overflow chain (see HookOverflowPolicy)
     struct {
-        volatile size_t total_events;    // Total events processed
-        volatile size_t dropped_events;  // Number of dropped events
-        volatile size_t window_changes;  // Number of window changes
-        volatile size_t queue_overflows; // Number of queue overflows
-    } stats;
+        atomic_size_t buckets[HOOK_LATENCY_BUCKETS];
+        atomic_ullong max_ns;
+        atomic_size_t over_threshold;
+        atomic_ullong threshold_ns;      // Slow callback threshold
+        ULONGLONG qpc_frequency;         // Performance counter ticks per second
+    } latency;                           // Hook callback latency histogram
 } HookSystem;
 
 // Core functions
 bool init_hooks(EventCallback callback);
+bool init_hooks_ex(EventCallback callback, const HookOptions* options);
 bool register_hook_callback(EventCallback callback);
 void unregister_hook_callback(EventCallback callback);
+bool register_hook_batch_callback(EventBatchCallback callback);
+void unregister_hook_batch_callback(EventBatchCallback callback);
 void cleanup_hooks(void);
 bool process_events(void);
+bool hooks_need_polling(void);
+bool submit_hook_event(const Event* event);
 bool are_hooks_active(void);
 DWORD get_last_hook_error(void);
 
@@ -118,10 +368,13 @@ void set_hook_filters(const HookFilters* filters);
 void get_hook_filters(HookFilters* filters);
 void reset_hook_filters(void);
 
-// Statistics functions
+// Statistics functions (views of the METRIC_* hook counters)
 size_t get_total_events(void);
 size_t get_dropped_events(void);
 size_t get_window_changes(void);
 size_t get_queue_overflows(void);  
+size_t get_coalesced_moves(void);
+bool get_hook_latency_histogram(HookLatencyHistogram* histogram);
+void set_hook_latency_threshold(DWORD threshold_us);
 
 #endif 
\ No newline at end of file
@@ -0,0 +1,70 @@
+#ifndef INTERN_H
+#define INTERN_H
+
+#include <stdbool.h>
+#include "platform.h"
+
+// Intern table configuration
+#define INTERN_MAX_STRINGS 4096           // Live strings, a power of two
+#define INTERN_MAX_LENGTH 255             // Longest stored string, excluding NUL
+#define INTERN_POOL_SIZE (128 * 1024)     // Bytes of string storage
+#define INTERN_HASH_BUCKETS 4096          // Must be a power of two
+
+// An ID is a slot index in the low INTERN_SLOT_BITS and the slot's
+// generation (1..INTERN_GENERATIONS) in the bits above
+#define INTERN_SLOT_BITS 12
+#define INTERN_SLOT_MASK ((1u << INTERN_SLOT_BITS) - 1)
+#define INTERN_GENERATIONS ((1u << (16 - INTERN_SLOT_BITS)) - 1)
+
+// Safety checks
+#if INTERN_MAX_STRINGS > (1 << INTERN_SLOT_BITS) || \
+    (INTERN_MAX_STRINGS & (INTERN_MAX_STRINGS - 1)) != 0
+    #error "INTERN_MAX_STRINGS must be a power of two of at most INTERN_SLOT_BITS bits"
+#endif
+
+#if (INTERN_HASH_BUCKETS & (INTERN_HASH_BUCKETS - 1)) != 0
+    #error "INTERN_HASH_BUCKETS must be a power of two"
+#endif
+
+/**
+ * Intern error codes:
+ * INTERN_ERROR_NONE (0):    No error
+ * INTERN_ERROR_INIT (1):    Initialization failed or table not initialized
+ * INTERN_ERROR_INVALID (2): Invalid parameter
+ */
+#define INTERN_ERROR_NONE       0
+#define INTERN_ERROR_INIT       1
+#define INTERN_ERROR_INVALID    2
+
+// Small handle for an interned string; INTERN_NONE stands for ""
+typedef WORD InternId;
+#define INTERN_NONE 0
+
+/**
+ * Strings are stored once and referred to by ID. When the table or its
+ * pool fills up, the oldest strings are recycled first, so an ID stays
+ * valid until INTERN_MAX_STRINGS newer strings or INTERN_POOL_SIZE bytes
+ * of newer strings have been interned, whichever comes first. With typical
+ * window titles that is thousands of window changes, far more than can be
+ * waiting in the event queue at once.
+ *
+ * A recycled slot moves to its next generation, so an ID held past its
+ * string's eviction (by a queued event, a sink queue or an aggregator)
+ * resolves to "" instead of to the slot's new string. Generations wrap
+ * after INTERN_GENERATIONS reuses of the slot, that is after
+ * INTERN_GENERATIONS * INTERN_MAX_STRINGS newer strings at the least.
+ */
+
+// Core functions
+bool init_intern_table(void);
+void cleanup_intern_table(void);
+InternId intern_string(const char* str, size_t length);
+size_t intern_resolve(InternId id, char* buffer, size_t size);
+
+// Utility functions
+bool is_intern_initialized(void);
+size_t get_intern_count(void);
+size_t get_intern_evictions(void);
+DWORD get_intern_last_error(void);
+
+#endif
@@ -2,7 +2,10 @@
 #define LOGGER_H
 
 #include <stdbool.h>
-#include <windows.h>
+#include <stdatomic.h>
+#include "platform.h"
+#include "utils.h"
+#include "logindex.h"
 
 // Logger configuration
 #define LOG_MAX_PATH 260
@@ -11,6 +14,43 @@
 #define LOG_MAX_FILE_SIZE (100 * 1024 * 1024)  // 100MB max file size
 #define LOG_MAX_WRITE_RETRIES 3
 
+// Asynchronous writer configuration
+#define LOG_ASYNC_BUFFER_SIZE (256 * 1024)   // Default size of each write buffer
+#define LOG_ASYNC_BUFFER_COUNT 2             // Default number of write buffers
+#define LOG_ASYNC_MAX_BUFFERS 8
+#define LOG_ASYNC_FLUSH_INTERVAL 1000        // Submit partial buffers after 1 second
+#define LOG_RECORD_MAX_SIZE (LOG_TIMESTAMP_SIZE + LOG_BUFFER_SIZE + 1)
+
+// Memory-mapped segment configuration
+#define LOG_SEGMENT_SIZE (16 * 1024 * 1024)    // Default preallocation step
+#define LOG_MAP_WINDOW_SIZE (4 * 1024 * 1024)  // Size of each mapped view
+#define LOG_MAP_MAX_RECORD (LOG_MAP_WINDOW_SIZE / 2)
+#define LOG_MAP_END_SUFFIX ".end"              // Recovery record of a mapped segment
+
+// Segment rotation configuration (async only)
+#define LOG_DEFAULT_ROTATE_SIZE (64 * 1024 * 1024)        // Default segment size limit
+#define LOG_DEFAULT_ROTATE_INTERVAL (24 * 60 * 60 * 1000)  // Default segment age limit in ms
+#define LOG_NEXT_SEGMENT_SUFFIX ".next"                   // Pre-opened next segment
+#define LOG_ROTATED_NAME_SIZE (LOG_MAX_PATH + 32)          // <path>.<YYYYMMDD_HHMMSS>[_n]
+#define LOG_MAX_ROTATED_NAMES 100                          // Name attempts within one second
+
+// Durability configuration (async only)
+#define LOG_DEFAULT_COMMIT_INTERVAL 100  // ms between group commits
+
+// Side index configuration (async only, see logindex.h)
+#define LOG_INDEX_BUFFER_BLOCKS 128  // Index blocks per write buffer; later records join the last
+
+// Records in async write buffers
+#define LOG_RECORD_ALIGN 8           // Slot alignment, keeps each header aligned
+#define LOG_RECORD_NOTED 0x1         // Noted for the side index
+#define LOG_RECORD_BLOCK 0x2         // Starts an index block
+
+// Write buffer states
+#define LOG_BUFFER_FREE     0
+#define LOG_BUFFER_FILLING  1
+#define LOG_BUFFER_PENDING  2
+#define LOG_BUFFER_WRITING  3
+
 // Logger error codes
 #define LOG_ERROR_NONE      0
 #define LOG_ERROR_INIT      1
@@ -27,6 +67,87 @@
     #define LOG_DEBUG(msg, ...)
 #endif
 
+// When written output is forced to disk (async only). NONE leaves it to
+// the OS cache until flush_log() or cleanup_logger(). INTERVAL is a group
+// commit: the writer thread issues one FlushFileBuffers per commit_interval
+// ms covering every buffer written since the last one, submitting the
+// partial active buffer first. BATCH flushes after every buffer it writes.
+// Producers never wait for a commit under any policy.
+typedef enum {
+    LOG_DURABILITY_NONE,
+    LOG_DURABILITY_INTERVAL,
+    LOG_DURABILITY_BATCH
+} LogDurability;
+
+// Logger configuration
+typedef struct {
+    bool async;                 // Write through the background writer thread
+    size_t buffer_size;         // Size of each write buffer (async only)
+    size_t buffer_count;        // Number of write buffers, at least 2 (async only)
+    size_t flush_threshold;     // Submit a buffer once it holds this many bytes (0 = when full)
+    bool mapped;                // Append into a preallocated, mapped segment (not with async)
+    size_t segment_size;        // Preallocation step of the mapped file (0 = LOG_SEGMENT_SIZE)
+    size_t rotate_size;         // Start a new segment past this size (0 = never, async only)
+    DWORD rotate_interval;      // Start a new segment after this many ms (0 = never, async only)
+    bool compress;              // Write compressed frames, see compress.h (async only)
+    size_t index_interval;      // Records per side index block (0 = no index, async only)
+    LogDurability durability;   // Commit policy (async only)
+    DWORD commit_interval;      // ms between group commits (0 = LOG_DEFAULT_COMMIT_INTERVAL)
+} LoggerConfig;
+
+/**
+ * Called when a new segment begins, on the first producer to reserve log
+ * space after the cut and before its record, without logger.lock held.
+ * Output written from the callback (e.g. a file header, through
+ * write_log_raw) is the first data of the new segment unless another
+ * thread claims space concurrently.
+ */
+typedef void (*LogRotateCallback)(void);
+
+/**
+ * Each record in an async write buffer sits in a slot of its own, claimed
+ * with an atomic add and led by this header. A slot whose tail could not
+ * be given back (another producer claimed after it) keeps a gap; the
+ * writer thread strips headers and gaps when it packs the buffer.
+ */
+typedef struct {
+    DWORD size;                 // Bytes of the slot, header included
+    DWORD used;                 // Record bytes committed (0 = abandoned)
+    ULONGLONG time;             // Noted record time (index only)
+    DWORD process;              // Noted process key (index only)
+    DWORD flags;                // LOG_RECORD_* flags
+} LogRecordHeader;
+
+// One write buffer of the asynchronous writer
+typedef struct {
+    char* data;                 // Page-aligned buffer memory
+    atomic_size_t claimed;      // Slot bytes handed out; failed claims run past the end
+    atomic_size_t filled;       // Slot bytes of finished records
+    atomic_size_t used;         // Record bytes committed; the packed size once written
+    atomic_size_t notes;        // Committed records noted for the index
+    atomic_size_t writers;      // Producers holding a claim on the buffer
+    int state;                  // LOG_BUFFER_* state
+    bool rotate_after;          // Last buffer of its segment
+    ULONGLONG segment;          // Segment the buffer's output belongs to
+    ULONGLONG first_write;      // get_precise_time() of the first record (commit latency)
+} LogWriteBuffer;
+
+// Index block of the buffer being written, until the writer thread knows
+// where the buffer landed in the file
+typedef struct {
+    LogIndexEntry entry;        // file_offset and skip not yet filled in
+    size_t position;            // Offset of the first record in the packed buffer
+} LogIndexBlock;
+
+// Recovery record of a mapped segment, kept in <path>.end through its own
+// mapping. A segment found with committed <= size <= allocated was left
+// preallocated (a crash, or an exit that skipped cleanup_logger()) and
+// ends at committed; any other size was written by someone else.
+typedef struct {
+    ULONGLONG committed;        // Bytes of records in the segment
+    ULONGLONG allocated;        // Preallocated size, set before the file grows
+} LogMapEnd;
+
 // Logger structure containing all logger-related data and state
 typedef struct {
     HANDLE file_handle;         // File handle for the log file
@@ -34,21 +155,71 @@ typedef struct {
     volatile bool initialized;   // Initialization flag
     CRITICAL_SECTION lock;      // Thread safety
     volatile DWORD last_error;  // Last error code
-    volatile size_t current_file_size;  // Current file size
-    struct {
-        volatile size_t total_writes;    // Total number of writes
-        volatile size_t failed_writes;   // Number of failed writes
-        volatile size_t bytes_written;   // Total bytes written
-        volatile size_t retry_count;     // Number of write retries
-    } stats;
-} Logger;
+    atomic_size_t current_file_size;  // Current file size
+    LoggerConfig config;        // Active configuration
+    LogWriteBuffer buffers[LOG_ASYNC_MAX_BUFFERS];  // Async write buffers
+    atomic_size_t active_buffer;  // Buffer producers claim space in, swapped under lock
+    size_t next_write;          // Next buffer the writer thread submits
+    ULONGLONG write_offset;     // File offset of the next submitted buffer
+    HANDLE writer_thread;       // Background writer thread
+    HANDLE io_event;            // Completion event for overlapped writes
+    CONDITION_VARIABLE buffer_ready;  // Wakes the writer thread
+    CONDITION_VARIABLE buffer_free;   // Wakes producers waiting for a buffer
+    volatile bool writer_running;     // Writer thread keep-alive flag
+    HANDLE mapping;             // File mapping of the preallocated segment (mapped only)
+    char* view;                 // Mapped window records are appended to
+    ULONGLONG view_offset;      // File offset of the window
+    size_t view_size;           // Size of the window
+    ULONGLONG segment_end;      // Preallocated file size
+    DWORD map_granularity;      // View offsets must be multiples of this
+    HANDLE end_handle;          // <path>.end (mapped only)
+    HANDLE end_mapping;         // Mapping of end_handle
+    volatile LogMapEnd* end_mark;  // Recovery record, updated with each commit
+    HANDLE next_handle;         // Pre-opened next segment (rotation only)
+    ULONGLONG segment_start;    // GetTickCount64() when the current segment began
+    volatile bool rotate_pending;  // The active buffer ends the current segment
+    atomic_bool preamble_due;   // A segment began; the next reservation runs the callback
+    LogRotateCallback rotate_callback;  // Segment start notification
+    ULONGLONG segment_id;       // Counts segment cuts
+    BYTE* frames;               // Compressed output of one buffer (compress only)
+    size_t frames_size;         // Capacity of frames
+    size_t* frame_starts;       // Offset of each frame within frames
+    HANDLE index_handle;        // Side index of the current segment (index only)
+    LogIndexBlock index_blocks[LOG_INDEX_BUFFER_BLOCKS];  // Blocks of the buffer being written
+    size_t index_count;         // Blocks in index_blocks (writer thread only)
+    bool uncommitted;           // Written since the last commit (writer thread only)
+    ULONGLONG uncommitted_since;  // first_write of the oldest uncommitted buffer
+    ULONGLONG last_commit;      // GetTickCount64() of the last commit
+} Logger;   // Statistics live in the METRIC_LOG_* counters
 
 // Core functions
 bool init_logger(const char* filepath);
+bool init_logger_ex(const char* filepath, const LoggerConfig* config);
 void cleanup_logger(void);
 bool write_to_log(const char* data, size_t size);
 bool flush_log(void);
 
+// Zero-copy output: format straight into the log's write buffer. In async
+// mode producers claim space without logger.lock and any number of threads
+// may hold a reservation at once, one per thread; the other modes hold the
+// lock from reserve to commit.
+char* reserve_log_space(size_t max_size);
+bool commit_log_space(size_t used);
+bool write_log_raw(const void* data, size_t size);
+bool submit_log_buffer(void);
+bool set_logger_flush_threshold(size_t threshold);
+size_t get_logger_pending_bytes(void);
+
+// Side index: call between reserve_log_space() and commit_log_space()
+bool note_log_index(ULONGLONG timestamp, DWORD process_key);
+
+// Segment rotation, done by the writer thread off the producer path
+bool set_logger_rotation(size_t rotate_size, DWORD rotate_interval);
+void set_logger_rotate_callback(LogRotateCallback callback);
+
+// Commit policy, applied by the writer thread from its next buffer on
+bool set_logger_durability(LogDurability durability, DWORD commit_interval);
+
 // Utility functions
 bool is_logger_initialized(void);
 DWORD get_logger_last_error(void);
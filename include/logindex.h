@@ -0,0 +1,97 @@
+#ifndef LOGINDEX_H
+#define LOGINDEX_H
+
+#include <stdbool.h>
+#include <stdio.h>
+#include "platform.h"
+
+/**
+ * Sparse side index of a log segment, stored next to it as <segment>.idx.
+ *
+ * File layout:
+ *   header: "I2CX" magic, u16 version, u16 entry size
+ *   entries: fixed-size records in file order, one per index block
+ *
+ * An index block covers up to index_interval consecutive records and never
+ * spans two write buffers. Its entry holds the block's time range, the
+ * position of its first record, the number of records and a 64-bit filter
+ * of the process keys seen in it: a query can skip every block whose
+ * filter lacks the process it looks for. The position is the file offset
+ * of the record (uncompressed log) or of the frame holding it plus the
+ * record's offset within the frame's output (compressed log). A block ends
+ * where the next entry's position begins, or at the end of the file.
+ * Entries are fixed-size, so readers can binary search them by time.
+ * All fields are little-endian.
+ */
+#define LOG_INDEX_MAGIC "I2CX"
+#define LOG_INDEX_MAGIC_SIZE 4
+#define LOG_INDEX_VERSION 1
+#define LOG_INDEX_SUFFIX ".idx"
+#define LOG_INDEX_HEADER_SIZE (LOG_INDEX_MAGIC_SIZE + 4)
+#define LOG_INDEX_ENTRY_SIZE 48
+
+// One index block
+typedef struct {
+    ULONGLONG first_time;   // Earliest record time (FILETIME, UTC)
+    ULONGLONG last_time;    // Latest record time
+    ULONGLONG file_offset;  // Record or frame offset in the segment
+    DWORD skip;             // Offset within the frame's output (compressed only)
+    DWORD events;           // Records in the block
+    ULONGLONG processes;    // log_index_process_bits() of every record's process
+    DWORD start_process;    // Process key of the first record
+} LogIndexEntry;
+
+/**
+ * Segment reader result codes:
+ * LOG_INDEX_OK (0):        Segment and index open
+ * LOG_INDEX_NO_INDEX (1):  No <segment>.idx next to the segment
+ * LOG_INDEX_BAD_INDEX (2): The index has another magic, version or entry size
+ * LOG_INDEX_NO_LOG (3):    The segment itself cannot be opened
+ * LOG_INDEX_MEMORY (4):    No memory for the frame buffers
+ */
+#define LOG_INDEX_OK        0
+#define LOG_INDEX_NO_INDEX  1
+#define LOG_INDEX_BAD_INDEX 2
+#define LOG_INDEX_NO_LOG    3
+#define LOG_INDEX_MEMORY    4
+
+// One indexed log segment, opened for reading
+typedef struct {
+    FILE* log;
+    FILE* index;
+    size_t entries;         // Entries in the index
+    bool compressed;        // The log is made of compressed frames
+    bool binary;            // The log's output is the binary format
+    BYTE* frame;            // One frame as read (compressed only)
+    BYTE* raw;              // Its output
+} LogIndexSegment;
+
+// Output of one index block, grown as needed; the caller frees data
+typedef struct {
+    BYTE* data;
+    size_t size;
+    size_t capacity;
+} LogIndexOutput;
+
+// File format
+size_t log_index_write_header(BYTE* out, size_t size);
+bool log_index_read_header(const BYTE* in, size_t size);
+size_t log_index_encode(const LogIndexEntry* entry, BYTE* out, size_t size);
+bool log_index_decode(const BYTE* in, size_t size, LogIndexEntry* entry);
+
+// Process keys: a case-insensitive hash of the process name (0 for none),
+// stable across runs unlike intern IDs
+DWORD log_index_process_key(const char* name);
+ULONGLONG log_index_process_bits(DWORD key);
+
+// Segment reader: the log's format is detected from its start. A block
+// ends where next begins (NULL for the last block); a torn last frame
+// ends it too.
+int log_index_open_segment(const char* path, LogIndexSegment* segment);
+void log_index_close_segment(LogIndexSegment* segment);
+bool log_index_read_entry(LogIndexSegment* segment, size_t index, LogIndexEntry* entry);
+size_t log_index_find_block(LogIndexSegment* segment, ULONGLONG from);
+bool log_index_read_block(LogIndexSegment* segment, const LogIndexEntry* entry,
+                          const LogIndexEntry* next, LogIndexOutput* output);
+
+#endif
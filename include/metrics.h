@@ -0,0 +1,118 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stdbool.h>
+#include <stdatomic.h>
+#include "platform.h"
+
+// Metrics configuration
+#define METRICS_CACHE_LINE 64
+#define METRICS_MAX_PATH 260
+#define METRICS_DEFAULT_DUMP_INTERVAL 5000  // ms between side file dumps
+
+/**
+ * Metrics error codes:
+ * METRICS_ERROR_NONE (0):    No error
+ * METRICS_ERROR_INIT (1):    Dump thread already running or failed to start
+ * METRICS_ERROR_INVALID (2): Invalid parameter
+ * METRICS_ERROR_FILE (3):    Dump file could not be opened
+ */
+#define METRICS_ERROR_NONE       0
+#define METRICS_ERROR_INIT       1
+#define METRICS_ERROR_INVALID    2
+#define METRICS_ERROR_FILE       3
+
+// Monotonic counters, grouped by the module that updates them
+typedef enum {
+    // hooks.c
+    METRIC_EVENTS_QUEUED,
+    METRIC_EVENTS_DROPPED,
+    METRIC_QUEUE_OVERFLOWS,
+    METRIC_WINDOW_CHANGES,
+    METRIC_COALESCED_MOVES,
+    METRIC_EVENTS_SPILLED,
+    METRIC_MOVES_SHED,
+    // buffer.c
+    METRIC_BUFFER_WRITES,
+    METRIC_BUFFER_FAILED_WRITES,
+    METRIC_BUFFER_FLUSHES,
+    METRIC_BUFFER_FAILED_FLUSHES,
+    // logger.c
+    METRIC_LOG_WRITES,
+    METRIC_LOG_FAILED_WRITES,
+    METRIC_LOG_BYTES_WRITTEN,
+    METRIC_LOG_RETRIES,
+    METRIC_LOG_BUFFER_STALLS,
+    METRIC_LOG_ROTATIONS,
+    METRIC_LOG_FAILED_ROTATIONS,
+    METRIC_LOG_COMMITS,
+    METRIC_LOG_FAILED_COMMITS,
+    // capture.c
+    METRIC_CAPTURE_EVENTS,
+    METRIC_CAPTURE_EVENTS_BUFFERED,
+    METRIC_CAPTURE_BYTES_WRITTEN,
+    METRIC_CAPTURE_FILES_ROTATED,
+    METRIC_CAPTURE_WRITE_ERRORS,
+    METRIC_CAPTURE_BUFFER_OVERFLOWS,
+    // sink.c
+    METRIC_SINK_EVENTS,
+    METRIC_SINK_EVENTS_DROPPED,
+    METRIC_SINK_FAILED_WRITES,
+    // aggregate.c
+    METRIC_AGGREGATE_EVENTS,
+    METRIC_AGGREGATE_SUMMARIES,
+    METRIC_AGGREGATE_OVERFLOWS,
+    METRIC_COUNTER_COUNT
+} MetricCounter;
+
+// Point-in-time values, overwritten by their owner
+typedef enum {
+    METRIC_QUEUE_DEPTH,           // Events waiting in the hook ring
+    METRIC_SPILL_DEPTH,           // Events parked in the overflow chain
+    METRIC_BUFFER_PENDING_BYTES,  // Output added since the last buffer flush
+    METRIC_LOG_FILE_SIZE,         // Log file size including buffered output
+    METRIC_LOG_COMMIT_LATENCY_US,      // Oldest record's wait for the last commit
+    METRIC_LOG_COMMIT_LATENCY_MAX_US,  // Largest of those since init_logger
+    METRIC_GAUGE_COUNT
+} MetricGauge;
+
+/**
+ * Every counter and gauge is a relaxed atomic on its own cache line, so
+ * updates from the hook, consumer and writer threads never share a line
+ * and never take a lock. A snapshot reads each value once; values are
+ * individually exact but not captured at one common instant.
+ */
+typedef struct {
+    _Alignas(METRICS_CACHE_LINE) atomic_size_t value;
+} MetricCell;
+
+// Snapshot returned by get_pipeline_metrics()
+typedef struct {
+    ULONGLONG timestamp;                    // get_precise_time() of the snapshot
+    size_t counters[METRIC_COUNTER_COUNT];
+    size_t gauges[METRIC_GAUGE_COUNT];
+} PipelineMetrics;
+
+// Core functions
+bool init_metrics(void);
+void cleanup_metrics(void);
+
+// Updates, safe from any thread
+void metrics_add(MetricCounter counter, size_t amount);
+void metrics_increment(MetricCounter counter);
+void metrics_set_gauge(MetricGauge gauge, size_t value);
+void metrics_reset(MetricCounter first, MetricCounter last);
+
+// Reading
+size_t get_metric(MetricCounter counter);
+size_t get_metric_gauge(MetricGauge gauge);
+void get_pipeline_metrics(PipelineMetrics* metrics);
+const char* get_metric_name(MetricCounter counter);
+const char* get_metric_gauge_name(MetricGauge gauge);
+
+// Periodic dump of the snapshot to a side file, one line per interval
+bool start_metrics_dump(const char* path, DWORD interval_ms);
+void stop_metrics_dump(void);
+DWORD get_metrics_last_error(void);
+
+#endif
@@ -0,0 +1,263 @@
+#ifndef PLATFORM_H
+#define PLATFORM_H
+
+// Platform layer
+// Windows builds use the Win32 API directly. Elsewhere platform_posix.c
+// implements the part of it this tree relies on (locks and condition
+// variables, threads and events, clocks, file I/O and mappings, process
+// queries) on top of POSIX, so every module keeps a single code path.
+// Input capture and window tracking are not part of it; hooks.c has a
+// backend per platform.
+
+#ifdef _WIN32
+
+#include <windows.h>
+#include <psapi.h>
+
+#else
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <pthread.h>
+
+// Basic types, sized as on Windows (DWORD and LONG stay 32 bit)
+typedef int BOOL;
+typedef uint8_t BYTE;
+typedef uint16_t WORD;
+typedef uint16_t USHORT;
+typedef int16_t SHORT;
+typedef uint32_t DWORD;
+typedef uint32_t UINT;
+typedef uint32_t ULONG;
+typedef int32_t LONG;
+typedef long long LONGLONG;
+typedef unsigned long long ULONGLONG;
+typedef size_t SIZE_T;
+typedef uintptr_t ULONG_PTR;
+typedef uintptr_t UINT_PTR;
+typedef intptr_t LONG_PTR;
+typedef char CHAR;
+typedef void* LPVOID;
+typedef const void* LPCVOID;
+typedef char* LPSTR;
+typedef const char* LPCSTR;
+typedef DWORD* LPDWORD;
+typedef void* HANDLE;
+typedef struct HWND__* HWND;
+typedef HANDLE HINSTANCE;
+typedef HANDLE HMODULE;
+
+#define WINAPI
+#define CALLBACK
+#define TRUE 1
+#define FALSE 0
+#define INFINITE 0xFFFFFFFF
+#define MAX_PATH 260
+#define INVALID_HANDLE_VALUE ((HANDLE)(LONG_PTR)-1)
+
+typedef struct { LONG x; LONG y; } POINT;
+typedef struct { DWORD dwLowDateTime; DWORD dwHighDateTime; } FILETIME;
+typedef struct {
+    WORD wYear, wMonth, wDayOfWeek, wDay, wHour, wMinute, wSecond, wMilliseconds;
+} SYSTEMTIME;
+typedef union { struct { DWORD LowPart; LONG HighPart; }; LONGLONG QuadPart; } LARGE_INTEGER;
+typedef union { struct { DWORD LowPart; DWORD HighPart; }; ULONGLONG QuadPart; } ULARGE_INTEGER;
+
+// Error codes (GetLastError), translated from errno
+#define ERROR_SUCCESS           0
+#define ERROR_FILE_NOT_FOUND    2
+#define ERROR_PATH_NOT_FOUND    3
+#define ERROR_ACCESS_DENIED     5
+#define ERROR_INVALID_HANDLE    6
+#define ERROR_NOT_ENOUGH_MEMORY 8
+#define ERROR_GEN_FAILURE       31
+#define ERROR_FILE_EXISTS       80
+#define ERROR_INVALID_PARAMETER 87
+#define ERROR_DISK_FULL         112
+#define ERROR_ALREADY_EXISTS    183
+#define ERROR_TIMEOUT           1460
+#define ERROR_IO_PENDING        997
+DWORD GetLastError(void);
+void SetLastError(DWORD error);
+#define FORMAT_MESSAGE_FROM_SYSTEM 0x00001000
+DWORD FormatMessageA(DWORD flags, LPCVOID source, DWORD message, DWORD language,
+                     LPSTR buffer, DWORD size, void* arguments);
+
+// Critical sections are recursive mutexes; DebugInfo is non-NULL while
+// the section is initialized, as on Windows
+typedef struct {
+    pthread_mutex_t mutex;
+    void* DebugInfo;
+} CRITICAL_SECTION;
+typedef struct {
+    pthread_cond_t cond;
+} CONDITION_VARIABLE;
+void InitializeCriticalSection(CRITICAL_SECTION* section);
+BOOL InitializeCriticalSectionAndSpinCount(CRITICAL_SECTION* section, DWORD spin_count);
+void EnterCriticalSection(CRITICAL_SECTION* section);
+void LeaveCriticalSection(CRITICAL_SECTION* section);
+void DeleteCriticalSection(CRITICAL_SECTION* section);
+void InitializeConditionVariable(CONDITION_VARIABLE* condition);
+BOOL SleepConditionVariableCS(CONDITION_VARIABLE* condition, CRITICAL_SECTION* section,
+                              DWORD milliseconds);
+void WakeConditionVariable(CONDITION_VARIABLE* condition);
+void WakeAllConditionVariable(CONDITION_VARIABLE* condition);
+
+// Threads, events and waits. Thread and process handles are signaled once
+// the thread has returned or the process has exited.
+typedef DWORD (WINAPI *LPTHREAD_START_ROUTINE)(LPVOID parameter);
+#define WAIT_OBJECT_0 0x00000000
+#define WAIT_TIMEOUT  0x00000102
+#define WAIT_FAILED   0xFFFFFFFF
+#define THREAD_PRIORITY_NORMAL        0
+#define THREAD_PRIORITY_ABOVE_NORMAL  1
+#define THREAD_PRIORITY_HIGHEST       2
+#define THREAD_PRIORITY_TIME_CRITICAL 15
+#define QS_ALLINPUT 0x04FF
+HANDLE CreateEventA(void* attributes, BOOL manual_reset, BOOL initial_state, LPCSTR name);
+#define CreateEvent CreateEventA
+BOOL SetEvent(HANDLE event);
+BOOL ResetEvent(HANDLE event);
+HANDLE CreateThread(void* attributes, SIZE_T stack_size, LPTHREAD_START_ROUTINE start,
+                    LPVOID parameter, DWORD flags, LPDWORD thread_id);
+BOOL SetThreadPriority(HANDLE thread, int priority);
+DWORD GetCurrentThreadId(void);
+DWORD WaitForSingleObject(HANDLE handle, DWORD milliseconds);
+DWORD MsgWaitForMultipleObjects(DWORD count, const HANDLE* handles, BOOL wait_all,
+                                DWORD milliseconds, DWORD wake_mask);
+BOOL CloseHandle(HANDLE handle);
+void Sleep(DWORD milliseconds);
+
+#if defined(__x86_64__) || defined(__i386__)
+    #define YieldProcessor() __builtin_ia32_pause()
+#elif defined(__aarch64__) || defined(__arm__)
+    #define YieldProcessor() __asm__ __volatile__("yield")
+#else
+    #define YieldProcessor() ((void)0)
+#endif
+
+// Clocks; FILETIME values count 100 ns units since 1601 as on Windows
+DWORD GetTickCount(void);
+ULONGLONG GetTickCount64(void);
+BOOL QueryPerformanceCounter(LARGE_INTEGER* count);
+BOOL QueryPerformanceFrequency(LARGE_INTEGER* frequency);
+void GetSystemTimePreciseAsFileTime(FILETIME* time);
+void GetLocalTime(SYSTEMTIME* time);
+BOOL FileTimeToSystemTime(const FILETIME* file_time, SYSTEMTIME* system_time);
+BOOL SystemTimeToFileTime(const SYSTEMTIME* system_time, FILETIME* file_time);
+BOOL FileTimeToLocalFileTime(const FILETIME* file_time, FILETIME* local_time);
+BOOL LocalFileTimeToFileTime(const FILETIME* local_time, FILETIME* file_time);
+
+// Memory; allocations are page aligned and zeroed
+#define MEM_COMMIT     0x00001000
+#define MEM_RESERVE    0x00002000
+#define MEM_RELEASE    0x00008000
+#define PAGE_READWRITE 0x04
+typedef struct {
+    DWORD dwPageSize;
+    DWORD dwAllocationGranularity;
+    DWORD dwNumberOfProcessors;
+} SYSTEM_INFO;
+LPVOID VirtualAlloc(LPVOID address, SIZE_T size, DWORD type, DWORD protect);
+BOOL VirtualFree(LPVOID address, SIZE_T size, DWORD type);
+void GetSystemInfo(SYSTEM_INFO* info);
+
+// Files. Share modes are accepted and ignored; overlapped writes complete
+// before WriteFile() returns.
+#define GENERIC_READ            0x80000000
+#define GENERIC_WRITE           0x40000000
+#define FILE_APPEND_DATA        0x00000004
+#define FILE_SHARE_READ         0x00000001
+#define FILE_SHARE_WRITE        0x00000002
+#define FILE_SHARE_DELETE       0x00000004
+#define CREATE_NEW              1
+#define CREATE_ALWAYS           2
+#define OPEN_EXISTING           3
+#define OPEN_ALWAYS             4
+#define TRUNCATE_EXISTING       5
+#define FILE_ATTRIBUTE_DIRECTORY 0x00000010
+#define FILE_ATTRIBUTE_NORMAL   0x00000080
+#define FILE_FLAG_WRITE_THROUGH 0x80000000
+#define FILE_FLAG_OVERLAPPED    0x40000000
+#define INVALID_FILE_ATTRIBUTES ((DWORD)-1)
+#define FILE_BEGIN   0
+#define FILE_CURRENT 1
+#define FILE_END     2
+#define MOVEFILE_REPLACE_EXISTING 0x00000001
+#define MOVEFILE_WRITE_THROUGH    0x00000008
+#define FILE_MAP_WRITE 0x0002
+#define FILE_MAP_READ  0x0004
+typedef struct {
+    ULONG_PTR Internal;       // 0 once the write has completed successfully
+    ULONG_PTR InternalHigh;   // Bytes transferred
+    union {
+        struct { DWORD Offset; DWORD OffsetHigh; };
+        void* Pointer;
+    };
+    HANDLE hEvent;
+} OVERLAPPED;
+typedef enum { GetFileExInfoStandard } GET_FILEEX_INFO_LEVELS;
+typedef struct {
+    DWORD dwFileAttributes;
+    FILETIME ftCreationTime;
+    FILETIME ftLastAccessTime;
+    FILETIME ftLastWriteTime;
+    DWORD nFileSizeHigh;
+    DWORD nFileSizeLow;
+} WIN32_FILE_ATTRIBUTE_DATA;
+HANDLE CreateFileA(LPCSTR path, DWORD access, DWORD share, void* security,
+                   DWORD disposition, DWORD flags, HANDLE template_file);
+BOOL WriteFile(HANDLE file, LPCVOID data, DWORD size, LPDWORD written, OVERLAPPED* overlapped);
+BOOL ReadFile(HANDLE file, LPVOID data, DWORD size, LPDWORD bytes_read, OVERLAPPED* overlapped);
+BOOL GetOverlappedResult(HANDLE file, OVERLAPPED* overlapped, LPDWORD transferred, BOOL wait);
+BOOL SetFilePointerEx(HANDLE file, LARGE_INTEGER distance, LARGE_INTEGER* position, DWORD method);
+BOOL SetEndOfFile(HANDLE file);
+BOOL GetFileSizeEx(HANDLE file, LARGE_INTEGER* size);
+BOOL FlushFileBuffers(HANDLE file);
+BOOL SetFileValidData(HANDLE file, LONGLONG length);
+HANDLE CreateFileMappingA(HANDLE file, void* security, DWORD protect,
+                          DWORD size_high, DWORD size_low, LPCSTR name);
+LPVOID MapViewOfFile(HANDLE mapping, DWORD access, DWORD offset_high, DWORD offset_low,
+                     SIZE_T size);
+BOOL FlushViewOfFile(LPCVOID address, SIZE_T size);
+BOOL UnmapViewOfFile(LPCVOID address);
+BOOL MoveFileExA(LPCSTR from, LPCSTR to, DWORD flags);
+BOOL DeleteFileA(LPCSTR path);
+BOOL CreateDirectoryA(LPCSTR path, void* security);
+DWORD GetFileAttributesA(LPCSTR path);
+BOOL GetFileAttributesExA(LPCSTR path, GET_FILEEX_INFO_LEVELS level, LPVOID info);
+
+// Processes; a handle refers to one process instance, a recycled pid
+// does not match it
+#define SYNCHRONIZE                       0x00100000
+#define PROCESS_QUERY_LIMITED_INFORMATION 0x1000
+HANDLE GetCurrentProcess(void);
+DWORD GetCurrentProcessId(void);
+HANDLE OpenProcess(DWORD access, BOOL inherit, DWORD pid);
+BOOL GetProcessTimes(HANDLE process, FILETIME* creation, FILETIME* exit,
+                     FILETIME* kernel, FILETIME* user);
+BOOL QueryFullProcessImageNameA(HANDLE process, DWORD flags, LPSTR path, LPDWORD size);
+
+// Resource usage of the current process only. The handle count is the
+// number of open HANDLEs; PagefileUsage is the private (anonymous) resident
+// memory, the closest match to Windows' private bytes. Other memory fields
+// stay zero.
+typedef struct {
+    DWORD cb;
+    DWORD PageFaultCount;
+    SIZE_T PeakWorkingSetSize;
+    SIZE_T WorkingSetSize;
+    SIZE_T QuotaPeakPagedPoolUsage;
+    SIZE_T QuotaPagedPoolUsage;
+    SIZE_T QuotaPeakNonPagedPoolUsage;
+    SIZE_T QuotaNonPagedPoolUsage;
+    SIZE_T PagefileUsage;
+    SIZE_T PeakPagefileUsage;
+} PROCESS_MEMORY_COUNTERS;
+BOOL GetProcessHandleCount(HANDLE process, LPDWORD count);
+BOOL GetProcessMemoryInfo(HANDLE process, PROCESS_MEMORY_COUNTERS* counters, DWORD size);
+
+#endif
+
+#endif
@@ -0,0 +1,43 @@
+#ifndef PROCCACHE_H
+#define PROCCACHE_H
+
+#include <stdbool.h>
+#include "platform.h"
+
+// Process cache configuration
+#define PROCCACHE_MAX_ENTRIES 64
+#define PROCCACHE_MAX_NAME 64             // Matches MAX_PROCESS_NAME
+
+/**
+ * Process cache error codes:
+ * PROCCACHE_ERROR_NONE (0):    No error
+ * PROCCACHE_ERROR_INIT (1):    Initialization failed or cache not initialized
+ * PROCCACHE_ERROR_INVALID (2): Invalid parameter
+ * PROCCACHE_ERROR_ACCESS (3):  Process could not be opened or queried
+ */
+#define PROCCACHE_ERROR_NONE       0
+#define PROCCACHE_ERROR_INIT       1
+#define PROCCACHE_ERROR_INVALID    2
+#define PROCCACHE_ERROR_ACCESS     3
+
+/**
+ * Maps process IDs to executable names. Entries are keyed by
+ * (pid, process creation time) and keep a SYNCHRONIZE handle to the
+ * process: a hit only checks that the process is still running, so a
+ * recycled pid can never return a stale name, and known processes are
+ * never opened again. The least recently used entry is evicted (and its
+ * handle closed) when the cache is full.
+ */
+
+// Core functions
+bool init_process_cache(void);
+void cleanup_process_cache(void);
+bool lookup_process_name(DWORD pid, char* buffer, size_t size);
+
+// Utility functions
+bool is_process_cache_initialized(void);
+size_t get_process_cache_hits(void);
+size_t get_process_cache_misses(void);
+DWORD get_process_cache_last_error(void);
+
+#endif
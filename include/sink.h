@@ -0,0 +1,141 @@
+#ifndef SINK_H
+#define SINK_H
+
+#include <stdbool.h>
+#include <stdatomic.h>
+#include "platform.h"
+#include "hooks.h"
+#include "utils.h"
+
+// Sink configuration
+#define SINK_MAX_SINKS 8
+#define SINK_CACHE_LINE 64
+#define SINK_DEFAULT_QUEUE_SIZE 4096   // Events per sink queue (power of 2)
+#define SINK_BATCH_SIZE 64             // Max events per write_batch() call
+#define SINK_FLUSH_INTERVAL 1000       // ms of quiet before a sink is flushed
+#define SINK_MEMORY_VIEW_SIZE (64 * 1024)  // Text kept by the memory sink
+#define SINK_INVALID_ID ((DWORD)-1)
+
+/**
+ * Sink error codes:
+ * SINK_ERROR_NONE (0):    No error
+ * SINK_ERROR_INIT (1):    Not initialized or already initialized
+ * SINK_ERROR_INVALID (2): Invalid parameter or unknown sink
+ * SINK_ERROR_FULL (3):    SINK_MAX_SINKS sinks already registered
+ * SINK_ERROR_MEMORY (4):  Memory allocation failed
+ * SINK_ERROR_THREAD (5):  Worker thread could not be started
+ * SINK_ERROR_OPEN (6):    The sink's init() failed
+ */
+#define SINK_ERROR_NONE     0
+#define SINK_ERROR_INIT     1
+#define SINK_ERROR_INVALID  2
+#define SINK_ERROR_FULL     3
+#define SINK_ERROR_MEMORY   4
+#define SINK_ERROR_THREAD   5
+#define SINK_ERROR_OPEN     6
+
+// What a sink's worker hands to write_batch()
+typedef enum {
+    SINK_FORMAT_EVENTS,  // Events only; the sink renders them itself
+    SINK_FORMAT_TEXT     // Events plus their format_event_text() lines
+} SinkFormat;
+
+// One write_batch() call. events stay valid until the call returns.
+typedef struct {
+    const Event* events;
+    size_t count;
+    const char* text;    // SINK_FORMAT_TEXT: the batch's lines, back to back
+    size_t text_size;
+} SinkBatch;
+
+/**
+ * Sink descriptor, copied by register_sink(). Every callback runs on the
+ * sink's own worker thread, so a sink may block or be slow: only its own
+ * queue fills up, and events that do not fit are counted as dropped.
+ *   init:        called once before the first batch (optional)
+ *   write_batch: called with up to SINK_BATCH_SIZE events
+ *   flush:       called after SINK_FLUSH_INTERVAL ms of quiet and before
+ *                close (optional)
+ *   close:       called once after the last batch (optional)
+ */
+typedef struct {
+    const char* name;
+    SinkFormat format;
+    size_t queue_size;  // Events (0 = SINK_DEFAULT_QUEUE_SIZE, rounded up to 2^n)
+    void* context;      // Passed to every callback
+    bool (*init)(void* context);
+    bool (*write_batch)(void* context, const SinkBatch* batch);
+    bool (*flush)(void* context);
+    void (*close)(void* context);
+} SinkDescriptor;
+
+// Per-sink counters, see get_sink_stats()
+typedef struct {
+    size_t delivered;     // Events queued for the sink
+    size_t dropped;       // Events that found the sink's queue full
+    size_t written;       // Events passed to write_batch()
+    size_t failed;        // Events of batches write_batch() reported failed
+    size_t queue_depth;   // Events waiting in the sink's queue
+} SinkStats;
+
+// Registered sink: a bounded single-producer/single-consumer event queue
+// fed by dispatch_sink_events() and drained by the sink's worker thread
+typedef struct {
+    SinkDescriptor desc;
+    DWORD id;
+    size_t capacity;                                 // Queue slots (power of 2)
+    Event* events;                                   // Queue storage
+    char* text;                                      // SINK_FORMAT_TEXT scratch
+    TimestampCache timestamps;                       // Worker thread only
+    _Alignas(SINK_CACHE_LINE) atomic_size_t head;    // Next event to write (worker)
+    _Alignas(SINK_CACHE_LINE) atomic_size_t tail;    // Next free slot (dispatcher)
+    _Alignas(SINK_CACHE_LINE) atomic_size_t delivered;
+    atomic_size_t dropped;
+    atomic_size_t written;
+    atomic_size_t failed;
+    HANDLE signal;                                   // Set on empty->non-empty
+    HANDLE thread;
+    volatile bool running;
+} SinkState;
+
+// Registry of sinks
+typedef struct {
+    CRITICAL_SECTION lock;              // Guards the slots against dispatch
+    SinkState* slots[SINK_MAX_SINKS];
+    DWORD next_id;
+    bool owns_intern;                   // init_sinks() created the intern table
+    bool owns_process_cache;            // init_sinks() created the process cache
+    volatile bool initialized;
+    volatile DWORD last_error;
+} SinkSystem;
+
+// Core functions; init_sinks() creates the intern table and process cache
+// if they do not exist yet and cleanup_sinks() releases them once every
+// queue is written out, so initialize the sinks before the hooks
+bool init_sinks(void);
+void cleanup_sinks(void);
+bool is_sinks_initialized(void);
+
+// Registration; unregister_sink() writes out the sink's queue, flushes and
+// closes it before returning
+bool register_sink(const SinkDescriptor* sink, DWORD* id);
+bool unregister_sink(DWORD id);
+
+// Fan-out: an EventBatchCallback for the hooks (HookOptions.batch_callback
+// or register_hook_batch_callback). Copies the events into every sink's
+// queue and never waits for a sink.
+void dispatch_sink_events(const Event* events, size_t count);
+
+// Statistics
+bool get_sink_stats(DWORD id, SinkStats* stats);
+size_t get_sink_count(void);
+DWORD get_sink_last_error(void);
+
+// Built-in sinks
+const SinkDescriptor* get_log_sink(void);     // Text lines into the buffer/logger
+const SinkDescriptor* get_memory_sink(void);  // Latest output kept in memory
+size_t read_memory_sink(char* out, size_t size);
+const SinkDescriptor* get_aggregate_sink(void);  // Per-process summaries (aggregate.h) into the buffer
+bool set_aggregate_sink_interval(DWORD interval_ms);
+
+#endif
@@ -0,0 +1,77 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdbool.h>
+#include <stdatomic.h>
+#include "platform.h"
+
+/**
+ * Pipeline trace provider
+ * Windows builds with KEYLOG_TRACE (the Makefile default there) register
+ * the TraceLogging provider "Keylog-Pipeline" and emit an event at every
+ * stage boundary, so the pipeline can be profiled in WPA next to kernel
+ * CPU and disk traces without a debug build, e.g.
+ *   xperf -on PROC_THREAD+LOADER+CSWITCH+DISK_IO -start keylog -on *Keylog-Pipeline
+ *   xperf -stop keylog -stop -d pipeline.etl
+ * ETW timestamps every event itself. Hook, format and write events come in
+ * start/stop pairs that WPA shows as regions.
+ *
+ * TRACE_EVENT() tests the enabled keywords, which the provider's enable
+ * callback keeps up to date, before evaluating anything: with no session
+ * listening a trace point costs one relaxed load and a branch. Elsewhere,
+ * and without KEYLOG_TRACE, trace points compile to nothing.
+ */
+
+// Provider identity; the GUID is the EventSource hash of the name
+#define TRACE_PROVIDER_NAME "Keylog-Pipeline"
+
+// Keywords, one per group of stages
+#define TRACE_KEYWORD_HOOKS   0x0001ULL   // Hook enter/exit
+#define TRACE_KEYWORD_QUEUE   0x0002ULL   // Enqueue, dequeue batch
+#define TRACE_KEYWORD_FORMAT  0x0004ULL   // Event formatting
+#define TRACE_KEYWORD_OUTPUT  0x0008ULL   // Buffer flush, file writes, commits, rotation
+
+// Input sources of the hook events
+#define TRACE_HOOK_KEYBOARD   0
+#define TRACE_HOOK_MOUSE      1
+#define TRACE_HOOK_RAW_INPUT  2
+
+/**
+ * Trace error codes:
+ * TRACE_ERROR_NONE (0):     No error
+ * TRACE_ERROR_REGISTER (1): The provider could not be registered
+ */
+#define TRACE_ERROR_NONE      0
+#define TRACE_ERROR_REGISTER  1
+
+#if defined(_WIN32) && defined(KEYLOG_TRACE)
+    extern atomic_ullong trace_keywords;
+    #define TRACE_EVENT(keyword, call) do { \
+        if (atomic_load_explicit(&trace_keywords, memory_order_relaxed) & (keyword)) { \
+            call; \
+        } \
+    } while (0)
+#else
+    #define TRACE_EVENT(keyword, call) ((void)0)
+#endif
+
+// Core functions; without the provider these succeed and do nothing
+bool init_trace(void);
+void cleanup_trace(void);
+bool is_trace_listening(void);
+DWORD get_trace_last_error(void);
+
+// Event writers, called through TRACE_EVENT()
+void trace_hook_enter(DWORD source);
+void trace_hook_exit(DWORD source);
+void trace_enqueue(DWORD type, bool spilled);
+void trace_dequeue_batch(size_t count);
+void trace_format_start(size_t events);
+void trace_format_stop(size_t events, size_t bytes);
+void trace_buffer_flush(size_t bytes);
+void trace_write_submit(ULONGLONG offset, size_t bytes);
+void trace_write_complete(ULONGLONG offset, size_t bytes, bool success);
+void trace_commit(size_t latency_us, bool success);
+void trace_rotation(const char* rotated_path);
+
+#endif
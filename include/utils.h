@@ -1,12 +1,29 @@
 #ifndef UTILS_H
 #define UTILS_H
 
-#include <windows.h>
+#include "platform.h"
 #include <stdbool.h>
 
 // Time utilities
+#define TIMESTAMP_TEXT_SIZE 24  // "YYYY-MM-DD HH:MM:SS.mmm" plus terminator
+#define TIMESTAMP_TICKS_PER_SECOND 10000000ULL
+#define TIMESTAMP_TICKS_PER_MS 10000ULL
+
+// Formatted local time of the last second seen; only the milliseconds
+// are rewritten while events stay within that second. Not thread-safe:
+// every formatting thread (or lock) owns its own cache.
+typedef struct {
+    ULONGLONG second;                   // UTC second the text was built for
+    char text[TIMESTAMP_TEXT_SIZE];     // Last formatted timestamp
+    bool valid;                         // text holds a formatted second
+} TimestampCache;
+
 void get_timestamp_string(char* buffer, size_t size);
 DWORD get_time_ms(void);
+ULONGLONG get_precise_time(void);
+void init_timestamp_cache(TimestampCache* cache);
+size_t format_timestamp_cached(TimestampCache* cache, ULONGLONG time,
+                               char* buffer, size_t size);
 
 // String utilities
 bool str_ends_with(const char* str, const char* suffix);
@@ -0,0 +1,227 @@
+#include "aggregate.h"
+#include "metrics.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Debug logging
+#ifdef DEBUG
+    #define AGGREGATE_DEBUG(msg, ...) fprintf(stderr, "[Aggregate] " msg "\n", ##__VA_ARGS__)
+#else
+    #define AGGREGATE_DEBUG(msg, ...)
+#endif
+
+// Occupied slots stay under 3/4 so probes remain short
+#define AGGREGATE_MAX_PROCESSES (AGGREGATE_TABLE_SLOTS * 3 / 4)
+
+static AggregateEntry* find_entry(Aggregator* aggregator, InternId process);
+static void count_event(Aggregator* aggregator, const Event* event);
+static void note_input(AggregateEntry* entry, ULONGLONG timestamp);
+static bool is_entry_empty(const AggregateEntry* entry);
+static bool emit_entry(Aggregator* aggregator, const AggregateEntry* entry);
+static bool emit_interval(Aggregator* aggregator);
+
+bool init_aggregator(Aggregator* aggregator, DWORD interval_ms,
+                     AggregateEmitCallback emit, void* context) {
+    if (!aggregator || !emit) return false;
+    if (interval_ms == 0) interval_ms = AGGREGATE_DEFAULT_INTERVAL;
+    if (interval_ms < AGGREGATE_MIN_INTERVAL) return false;
+
+    memset(aggregator, 0, sizeof(Aggregator));
+    aggregator->interval = (ULONGLONG)interval_ms * TIMESTAMP_TICKS_PER_MS;
+    aggregator->foreground = INTERN_NONE;
+    aggregator->emit = emit;
+    aggregator->context = context;
+    init_timestamp_cache(&aggregator->timestamps);
+
+    AGGREGATE_DEBUG("Aggregator initialized with a %lu ms interval", (unsigned long)interval_ms);
+    return true;
+}
+
+// Counts a run of events; an event past the current interval emits it first
+bool aggregate_events(Aggregator* aggregator, const Event* events, size_t count) {
+    if (!aggregator || (!events && count > 0)) return false;
+
+    bool success = true;
+    for (size_t i = 0; i < count; i++) {
+        const Event* event = &events[i];
+        if (aggregator->start == 0) {
+            aggregator->start = event->timestamp - event->timestamp % aggregator->interval;
+        } else if (event->timestamp >= aggregator->start + aggregator->interval) {
+            success = emit_interval(aggregator) && success;
+            aggregator->start = event->timestamp - event->timestamp % aggregator->interval;
+        }
+        count_event(aggregator, event);
+    }
+
+    metrics_add(METRIC_AGGREGATE_EVENTS, count);
+    return success;
+}
+
+bool flush_aggregator(Aggregator* aggregator, ULONGLONG now) {
+    if (!aggregator || aggregator->start == 0 || now < aggregator->start + aggregator->interval) {
+        return true;
+    }
+
+    // The next event starts the interval it falls into
+    bool success = emit_interval(aggregator);
+    aggregator->start = 0;
+    return success;
+}
+
+bool finish_aggregator(Aggregator* aggregator) {
+    if (!aggregator || aggregator->start == 0) return true;
+
+    bool success = emit_interval(aggregator);
+    aggregator->start = 0;
+    return success;
+}
+
+size_t format_aggregate_record(Aggregator* aggregator, const AggregateEntry* entry,
+                               char* buffer, size_t size) {
+    if (!aggregator || !entry || !buffer || size == 0) return 0;
+
+    char timestamp[TIMESTAMP_TEXT_SIZE];
+    if (!format_timestamp_cached(&aggregator->timestamps, aggregator->start,
+                                 timestamp, sizeof(timestamp))) {
+        timestamp[0] = '\0';
+    }
+
+    char process[MAX_PROCESS_NAME];
+    if (entry == &aggregator->other ||
+        intern_resolve(entry->process, process, sizeof(process)) == 0) {
+        strncpy(process, AGGREGATE_OTHER_NAME, sizeof(process) - 1);
+        process[sizeof(process) - 1] = '\0';
+    }
+
+    int written = snprintf(buffer, size,
+            "[%s] SUMMARY PROCESS:'%s' SECS:%llu KEYS:%zu CLICKS:%zu SCROLL:%zu "
+            "MOVES:%zu ACTIVE_MS:%llu WINDOWS:%zu\n",
+            timestamp,
+            process,
+            aggregator->interval / TIMESTAMP_TICKS_PER_SECOND,
+            entry->keys,
+            entry->clicks,
+            entry->scroll / AGGREGATE_WHEEL_NOTCH,
+            entry->moves,
+            entry->active / TIMESTAMP_TICKS_PER_MS,
+            entry->windows);
+
+    if (written < 0 || (size_t)written >= size) {
+        buffer[0] = '\0';
+        return 0;
+    }
+    return (size_t)written;
+}
+
+// Open addressing on the interned ID; INTERN_NONE and a full table both
+// end up in the other entry
+static AggregateEntry* find_entry(Aggregator* aggregator, InternId process) {
+    if (process == INTERN_NONE) {
+        return &aggregator->other;
+    }
+
+    size_t slot = process & (AGGREGATE_TABLE_SLOTS - 1);
+    while (aggregator->slots[slot].process != INTERN_NONE) {
+        if (aggregator->slots[slot].process == process) {
+            return &aggregator->slots[slot];
+        }
+        slot = (slot + 1) & (AGGREGATE_TABLE_SLOTS - 1);
+    }
+
+    if (aggregator->used >= AGGREGATE_MAX_PROCESSES) {
+        metrics_increment(METRIC_AGGREGATE_OVERFLOWS);
+        return &aggregator->other;
+    }
+
+    aggregator->slots[slot].process = process;
+    aggregator->used++;
+    return &aggregator->slots[slot];
+}
+
+static void count_event(Aggregator* aggregator, const Event* event) {
+    if (event->type == EVENT_WINDOW_CHANGE) {
+        aggregator->foreground = event->data.window.processNameId;
+        find_entry(aggregator, aggregator->foreground)->windows++;
+        return;
+    }
+
+    AggregateEntry* entry = find_entry(aggregator, aggregator->foreground);
+    const MouseEvent* mouse = &event->data.mouse;
+
+    switch (event->type) {
+        case EVENT_KEY_PRESS:
+            entry->keys++;
+            break;
+        case EVENT_KEY_RELEASE:
+            break;
+        case EVENT_MOUSE_CLICK:
+            // buttons is the state before the click: a press is a button
+            // involved in the event that was not held yet
+            if (((BYTE)(mouse->buttonFlags << 4) & ~mouse->buttons) != 0) {
+                entry->clicks++;
+            }
+            break;
+        case EVENT_MOUSE_MOVE:
+            entry->moves += mouse->moveCount ? mouse->moveCount : 1;
+            break;
+        case EVENT_MOUSE_WHEEL:
+            entry->scroll += (size_t)abs(mouse->wheelDelta);
+            break;
+        default:
+            return;
+    }
+    note_input(entry, event->timestamp);
+}
+
+// Short gaps between input events add up to the active time
+static void note_input(AggregateEntry* entry, ULONGLONG timestamp) {
+    if (entry->last_input != 0 && timestamp > entry->last_input &&
+        timestamp - entry->last_input <= AGGREGATE_IDLE_GAP * TIMESTAMP_TICKS_PER_MS) {
+        entry->active += timestamp - entry->last_input;
+    }
+    if (timestamp > entry->last_input) {
+        entry->last_input = timestamp;
+    }
+}
+
+static bool is_entry_empty(const AggregateEntry* entry) {
+    return entry->keys == 0 && entry->clicks == 0 && entry->scroll == 0 &&
+           entry->moves == 0 && entry->windows == 0 && entry->active == 0;
+}
+
+static bool emit_entry(Aggregator* aggregator, const AggregateEntry* entry) {
+    char record[AGGREGATE_RECORD_SIZE];
+    size_t len = format_aggregate_record(aggregator, entry, record, sizeof(record));
+    InternId process = entry == &aggregator->other ? INTERN_NONE : entry->process;
+    if (len == 0 || !aggregator->emit(aggregator->context, process, record, len)) {
+        return false;
+    }
+    metrics_increment(METRIC_AGGREGATE_SUMMARIES);
+    return true;
+}
+
+// One record per process with any input, then a fresh table
+static bool emit_interval(Aggregator* aggregator) {
+    bool success = true;
+    size_t emitted = 0;
+
+    for (size_t slot = 0; slot < AGGREGATE_TABLE_SLOTS; slot++) {
+        const AggregateEntry* entry = &aggregator->slots[slot];
+        if (entry->process != INTERN_NONE && !is_entry_empty(entry)) {
+            success = emit_entry(aggregator, entry) && success;
+            emitted++;
+        }
+    }
+    if (!is_entry_empty(&aggregator->other)) {
+        success = emit_entry(aggregator, &aggregator->other) && success;
+        emitted++;
+    }
+
+    memset(aggregator->slots, 0, sizeof(aggregator->slots));
+    memset(&aggregator->other, 0, sizeof(aggregator->other));
+    aggregator->used = 0;
+
+    AGGREGATE_DEBUG("Interval emitted: %zu summaries", emitted);
+    return success;
+}
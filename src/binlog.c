@@ -0,0 +1,308 @@
+#include "binlog.h"
+#include "intern.h"
+#include <string.h>
+
+// Internal helpers for the varint/zigzag wire encoding
+static size_t put_varint(BYTE* out, size_t size, ULONGLONG value);
+static bool get_varint(const BYTE* in, size_t size, size_t* pos, ULONGLONG* value);
+static size_t put_u64(BYTE* out, ULONGLONG value);
+static ULONGLONG get_u64(const BYTE* in);
+static ULONGLONG zigzag_encode(LONGLONG value);
+static LONGLONG zigzag_decode(ULONGLONG value);
+static void reset_state(BinlogState* state, ULONGLONG base_time);
+
+// Writes the file header and starts a new delta chain at the current time
+size_t binlog_write_header(BinlogState* state, BYTE* out, size_t size) {
+    if (!state || !out || size < BINLOG_HEADER_SIZE) return 0;
+
+    memcpy(out, BINLOG_MAGIC, BINLOG_MAGIC_SIZE);
+    out[4] = (BYTE)(BINLOG_VERSION & 0xFF);
+    out[5] = (BYTE)(BINLOG_VERSION >> 8);
+    out[6] = 0;
+    out[7] = 0;
+
+    // The header carries a sync payload without the tag byte
+    BYTE sync[1 + BINLOG_SYNC_SIZE];
+    if (binlog_write_sync(state, sync, sizeof(sync)) != sizeof(sync)) return 0;
+    memcpy(out + 8, sync + 1, BINLOG_SYNC_SIZE);
+
+    return BINLOG_HEADER_SIZE;
+}
+
+// Writes a sync record that re-anchors the time base and resets all deltas
+size_t binlog_write_sync(BinlogState* state, BYTE* out, size_t size) {
+    if (!state || !out || size < 1 + BINLOG_SYNC_SIZE) return 0;
+
+    FILETIME ft;
+    GetSystemTimePreciseAsFileTime(&ft);
+    ULONGLONG now = ((ULONGLONG)ft.dwHighDateTime << 32) | ft.dwLowDateTime;
+    reset_state(state, now);
+
+    out[0] = BINLOG_TAG_SYNC;
+    put_u64(out + 1, state->base_time);
+    return 1 + BINLOG_SYNC_SIZE;
+}
+
+// Encodes one event; returns the record length or 0 if it does not fit
+size_t binlog_encode_event(BinlogState* state, const Event* event,
+                           BYTE* out, size_t size) {
+    if (!state || !event || !out || size < BINLOG_MAX_RECORD_SIZE) return 0;
+
+    size_t pos = 1;
+    BYTE tag = (BYTE)(event->type & BINLOG_TAG_TYPE_MASK);
+
+    // Deltas are taken on the microsecond grid so rounding never accumulates
+    LONGLONG delta = ((LONGLONG)event->timestamp - (LONGLONG)state->last_time) / BINLOG_TICKS_PER_US;
+    pos += put_varint(out + pos, size - pos, zigzag_encode(delta));
+    state->last_time += (ULONGLONG)(delta * BINLOG_TICKS_PER_US);
+
+    switch (event->type) {
+        case EVENT_KEY_PRESS:
+        case EVENT_KEY_RELEASE: {
+            const KeyboardEvent* kb = &event->data.keyboard;
+            if (kb->extended) tag |= BINLOG_TAG_EXTENDED;
+            if (kb->injected) tag |= BINLOG_TAG_INJECTED;
+
+            pos += put_varint(out + pos, size - pos, kb->vkCode);
+            pos += put_varint(out + pos, size - pos, kb->scanCode);
+            out[pos++] = kb->modifiers;
+            break;
+        }
+
+        case EVENT_MOUSE_CLICK:
+        case EVENT_MOUSE_MOVE:
+        case EVENT_MOUSE_WHEEL: {
+            const MouseEvent* mouse = &event->data.mouse;
+            BYTE buttons = (BYTE)((mouse->buttonFlags & BINLOG_BTN_FLAGS_MASK) |
+                                  (mouse->buttons & ~BINLOG_BTN_FLAGS_MASK));
+            if (mouse->injected) tag |= BINLOG_TAG_INJECTED;
+
+            out[pos++] = buttons;
+            pos += put_varint(out + pos, size - pos,
+                              zigzag_encode(mouse->position.x - state->last_x));
+            pos += put_varint(out + pos, size - pos,
+                              zigzag_encode(mouse->position.y - state->last_y));
+            if (event->type == EVENT_MOUSE_WHEEL) {
+                pos += put_varint(out + pos, size - pos, zigzag_encode(mouse->wheelDelta));
+            }
+            if (event->type == EVENT_MOUSE_MOVE && mouse->moveCount > 1) {
+                tag |= BINLOG_TAG_COALESCED;
+                pos += put_varint(out + pos, size - pos, mouse->moveCount);
+            }
+            state->last_x = mouse->position.x;
+            state->last_y = mouse->position.y;
+            break;
+        }
+
+        case EVENT_WINDOW_CHANGE: {
+            // Strings are resolved here so the file is self-contained
+            const WindowEvent* window = &event->data.window;
+            char title[MAX_WINDOW_TITLE];
+            char process[MAX_PROCESS_NAME];
+            size_t title_len = intern_resolve(window->titleId, title, sizeof(title));
+            size_t process_len = intern_resolve(window->processNameId, process, sizeof(process));
+
+            pos += put_varint(out + pos, size - pos, window->processId);
+            pos += put_varint(out + pos, size - pos, title_len);
+            memcpy(out + pos, title, title_len);
+            pos += title_len;
+            pos += put_varint(out + pos, size - pos, process_len);
+            memcpy(out + pos, process, process_len);
+            pos += process_len;
+            break;
+        }
+
+        case EVENT_ERROR:
+            break;
+
+        default:
+            return 0;
+    }
+
+    out[0] = tag;
+    return pos;
+}
+
+// Reads and validates the file header, initializing the decoder state
+bool binlog_read_header(BinlogState* state, const BYTE* in, size_t size) {
+    if (!state || !in || size < BINLOG_HEADER_SIZE) return false;
+    if (memcmp(in, BINLOG_MAGIC, BINLOG_MAGIC_SIZE) != 0) return false;
+
+    unsigned version = in[4] | (in[5] << 8);
+    if (version < BINLOG_MIN_VERSION || version > BINLOG_VERSION) return false;
+
+    reset_state(state, get_u64(in + 8));
+    return true;
+}
+
+// Decodes the record at in. On BINLOG_OK the event is filled in; on
+// BINLOG_OK and BINLOG_SYNC consumed holds the record length. Any other
+// result leaves the state alone, so a record cut at the end of one input
+// buffer decodes once the rest has been appended.
+int binlog_decode_record(BinlogState* state, const BYTE* in, size_t size,
+                         Event* event, size_t* consumed) {
+    if (!state || !in || !event || !consumed) return BINLOG_CORRUPT;
+    if (size == 0) return BINLOG_TRUNCATED;
+
+    BinlogState next = *state;
+    BYTE tag = in[0];
+    size_t pos = 1;
+    ULONGLONG value;
+
+    if ((tag & BINLOG_TAG_TYPE_MASK) == BINLOG_TAG_SYNC) {
+        if (size < 1 + BINLOG_SYNC_SIZE) return BINLOG_TRUNCATED;
+        reset_state(state, get_u64(in + 1));
+        *consumed = 1 + BINLOG_SYNC_SIZE;
+        return BINLOG_SYNC;
+    }
+
+    memset(event, 0, sizeof(Event));
+    event->type = (EventType)(tag & BINLOG_TAG_TYPE_MASK);
+
+    if (!get_varint(in, size, &pos, &value)) return BINLOG_TRUNCATED;
+    next.last_time += (ULONGLONG)(zigzag_decode(value) * BINLOG_TICKS_PER_US);
+    event->timestamp = next.last_time;
+
+    switch (event->type) {
+        case EVENT_KEY_PRESS:
+        case EVENT_KEY_RELEASE: {
+            KeyboardEvent* kb = &event->data.keyboard;
+            if (!get_varint(in, size, &pos, &value)) return BINLOG_TRUNCATED;
+            kb->vkCode = (DWORD)value;
+            if (!get_varint(in, size, &pos, &value)) return BINLOG_TRUNCATED;
+            kb->scanCode = (DWORD)value;
+            if (pos >= size) return BINLOG_TRUNCATED;
+            kb->modifiers = in[pos++];
+            kb->extended = (tag & BINLOG_TAG_EXTENDED) != 0;
+            kb->injected = (tag & BINLOG_TAG_INJECTED) != 0;
+            break;
+        }
+
+        case EVENT_MOUSE_CLICK:
+        case EVENT_MOUSE_MOVE:
+        case EVENT_MOUSE_WHEEL: {
+            MouseEvent* mouse = &event->data.mouse;
+            if (pos >= size) return BINLOG_TRUNCATED;
+            BYTE buttons = in[pos++];
+
+            if (!get_varint(in, size, &pos, &value)) return BINLOG_TRUNCATED;
+            next.last_x += (LONG)zigzag_decode(value);
+            if (!get_varint(in, size, &pos, &value)) return BINLOG_TRUNCATED;
+            next.last_y += (LONG)zigzag_decode(value);
+            if (event->type == EVENT_MOUSE_WHEEL) {
+                if (!get_varint(in, size, &pos, &value)) return BINLOG_TRUNCATED;
+                mouse->wheelDelta = (short)zigzag_decode(value);
+            }
+            if (event->type == EVENT_MOUSE_MOVE) {
+                mouse->moveCount = 1;
+                if (tag & BINLOG_TAG_COALESCED) {
+                    if (!get_varint(in, size, &pos, &value)) return BINLOG_TRUNCATED;
+                    if (value == 0 || value > 0xFFFF) return BINLOG_CORRUPT;
+                    mouse->moveCount = (WORD)value;
+                }
+            }
+
+            mouse->position.x = next.last_x;
+            mouse->position.y = next.last_y;
+            mouse->buttonFlags = buttons & BINLOG_BTN_FLAGS_MASK;
+            mouse->buttons = buttons & ~BINLOG_BTN_FLAGS_MASK;
+            mouse->injected = (tag & BINLOG_TAG_INJECTED) != 0;
+            break;
+        }
+
+        case EVENT_WINDOW_CHANGE: {
+            WindowEvent* window = &event->data.window;
+            if (!get_varint(in, size, &pos, &value)) return BINLOG_TRUNCATED;
+            window->processId = (DWORD)value;
+
+            if (!get_varint(in, size, &pos, &value)) return BINLOG_TRUNCATED;
+            if (value >= MAX_WINDOW_TITLE) return BINLOG_CORRUPT;
+            if (size - pos < value) return BINLOG_TRUNCATED;
+            size_t title = pos;
+            size_t title_len = (size_t)value;
+            pos += title_len;
+
+            if (!get_varint(in, size, &pos, &value)) return BINLOG_TRUNCATED;
+            if (value >= MAX_PROCESS_NAME) return BINLOG_CORRUPT;
+            if (size - pos < value) return BINLOG_TRUNCATED;
+            size_t process = pos;
+            size_t process_len = (size_t)value;
+            pos += process_len;
+
+            // Strings are interned again on the decoding side, once the
+            // whole record is there
+            window->titleId = intern_string((const char*)in + title, title_len);
+            window->processNameId = intern_string((const char*)in + process, process_len);
+            break;
+        }
+
+        case EVENT_ERROR:
+            break;
+
+        default:
+            return BINLOG_CORRUPT;
+    }
+
+    *state = next;
+    *consumed = pos;
+    return BINLOG_OK;
+}
+
+// Internal helper functions
+static size_t put_varint(BYTE* out, size_t size, ULONGLONG value) {
+    size_t pos = 0;
+    while (value >= 0x80 && pos < size) {
+        out[pos++] = (BYTE)(value | 0x80);
+        value >>= 7;
+    }
+    if (pos < size) {
+        out[pos++] = (BYTE)value;
+    }
+    return pos;
+}
+
+static bool get_varint(const BYTE* in, size_t size, size_t* pos, ULONGLONG* value) {
+    ULONGLONG result = 0;
+    unsigned shift = 0;
+
+    while (*pos < size && shift < 64) {
+        BYTE b = in[(*pos)++];
+        result |= (ULONGLONG)(b & 0x7F) << shift;
+        if (!(b & 0x80)) {
+            *value = result;
+            return true;
+        }
+        shift += 7;
+    }
+    return false;
+}
+
+static size_t put_u64(BYTE* out, ULONGLONG value) {
+    for (int i = 0; i < 8; i++) {
+        out[i] = (BYTE)(value >> (8 * i));
+    }
+    return 8;
+}
+
+static ULONGLONG get_u64(const BYTE* in) {
+    ULONGLONG value = 0;
+    for (int i = 0; i < 8; i++) {
+        value |= (ULONGLONG)in[i] << (8 * i);
+    }
+    return value;
+}
+
+static ULONGLONG zigzag_encode(LONGLONG value) {
+    return ((ULONGLONG)value << 1) ^ (ULONGLONG)(value >> 63);
+}
+
+static LONGLONG zigzag_decode(ULONGLONG value) {
+    return (LONGLONG)(value >> 1) ^ -(LONGLONG)(value & 1);
+}
+
+static void reset_state(BinlogState* state, ULONGLONG base_time) {
+    state->base_time = base_time;
+    state->last_time = base_time;
+    state->last_x = 0;
+    state->last_y = 0;
+}
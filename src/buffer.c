@@ -1,5 +1,7 @@
 #include "buffer.h"
 #include "logger.h"
+#include "metrics.h"
+#include "trace.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -9,6 +11,10 @@
 // Global buffer instance
 static Buffer buffer = {0};
 
+// Per-thread append state: the open reservation and batch nesting
+static _Thread_local size_t reserved_size;   // 0 = no reservation open
+static _Thread_local size_t batch_depth;
+
 // Internal utility functions to manage errors, validate state, and reset stats
 static void set_buffer_error_internal(DWORD error_code);
 static bool should_flush_buffer(void);
@@ -17,73 +23,50 @@ static void reset_buffer_stats_internal(void);
 
 // Sets up the buffer for use, including memory allocation and critical section initialization
 bool init_buffer(void) {
-    // Initialize critical section for thread safety
-    if (!InitializeCriticalSectionAndSpinCount(&buffer.lock, 0x00000400)) { 
-        set_buffer_error_internal(BUFFER_ERROR_INIT);
-        return false;
-    }
-
-    EnterCriticalSection(&buffer.lock);
-
-    // Check if already initialized
     if (buffer.initialized) {
         set_buffer_error_internal(BUFFER_ERROR_INIT);
-        LeaveCriticalSection(&buffer.lock);
-        DeleteCriticalSection(&buffer.lock);
         return false;
     }
 
-    // Allocate and initialize buffer memory
-    buffer.data = (char *)malloc(BUFFER_SIZE);
-    if (!buffer.data) {
-        set_buffer_error_internal(BUFFER_ERROR_MEMORY);
-        LeaveCriticalSection(&buffer.lock);
-        DeleteCriticalSection(&buffer.lock);
+    // Initialize critical section for thread safety
+    if (!InitializeCriticalSectionAndSpinCount(&buffer.lock, 0x00000400)) { 
+        set_buffer_error_internal(BUFFER_ERROR_INIT);
         return false;
     }
 
-    // Initialize buffer metadata
-    memset(buffer.data, 0, BUFFER_SIZE);
-    buffer.capacity = BUFFER_SIZE;
-    buffer.size = 0;
-    buffer.initialized = true;
+    // The storage itself belongs to the logger
+    atomic_store(&buffer.size, 0);
+    buffer.flush_threshold = BUFFER_DEFAULT_FLUSH_THRESHOLD;
     buffer.last_error = BUFFER_ERROR_NONE;
+    metrics_set_gauge(METRIC_BUFFER_PENDING_BYTES, 0);
+    buffer.initialized = true;
     reset_buffer_stats_internal();
 
-    BUFFER_LOG("Buffer initialized with capacity: %zu bytes", buffer.capacity);
-    LeaveCriticalSection(&buffer.lock);
-
+    BUFFER_LOG("Buffer initialized with flush threshold: %zu bytes", buffer.flush_threshold);
     return true;
 }
 
 // Releases memory and critical section resources associated with the buffer
 void cleanup_buffer(void) {
-    EnterCriticalSection(&buffer.lock);
     if (!buffer.initialized) {
-        LeaveCriticalSection(&buffer.lock);
         return;
     }
 
-    // Flush remaining data in buffer
-    if (buffer.size > 0) {
-        BUFFER_LOG("Flushing remaining %zu bytes during cleanup", buffer.size);
+    // Flush remaining data in buffer; producers must have stopped
+    EnterCriticalSection(&buffer.lock);
+    if (get_buffer_size() > 0) {
+        BUFFER_LOG("Flushing remaining %zu bytes during cleanup", get_buffer_size());
         force_flush_buffer();
     }
 
-    // Free allocated memory
-    if (buffer.data) {
-        free(buffer.data);
-        buffer.data = NULL;
-    }
-
-    // Reset buffer metadata
-    buffer.size = 0;
-    buffer.capacity = 0;
     buffer.initialized = false;
+    buffer.flush_threshold = 0;
+    atomic_store(&buffer.size, 0);
+    metrics_set_gauge(METRIC_BUFFER_PENDING_BYTES, 0);
 
     BUFFER_LOG("Buffer cleanup complete. Stats: Flushes: %zu, Failed: %zu, Writes: %zu, Failed: %zu",
-               buffer.stats.total_flushes, buffer.stats.failed_flushes,
-               buffer.stats.total_writes, buffer.stats.failed_writes);
+               get_metric(METRIC_BUFFER_FLUSHES), get_metric(METRIC_BUFFER_FAILED_FLUSHES),
+               get_metric(METRIC_BUFFER_WRITES), get_metric(METRIC_BUFFER_FAILED_WRITES));
     LeaveCriticalSection(&buffer.lock);
 
     // Delete critical section to prevent further access
@@ -91,7 +74,7 @@ void cleanup_buffer(void) {
 }
 
 
-// Appends new data to the buffer, flushing it if necessary when full
+// Appends new data to the buffer, flushing it once the threshold is reached
 bool add_to_buffer(const char *event_data, size_t data_size) {
     if (!event_data || data_size == 0 || data_size > BUFFER_MAX_EVENT_SIZE) {
         set_buffer_error_internal(BUFFER_ERROR_INVALID);
@@ -99,52 +82,110 @@ bool add_to_buffer(const char *event_data, size_t data_size) {
         return false;
     }
 
-    if (data_size > SIZE_MAX - buffer.size) {
-        set_buffer_error_internal(BUFFER_ERROR_INVALID);
-        BUFFER_LOG("Integer overflow detected in add_to_buffer");
+    char* space = reserve_buffer(data_size);
+    if (!space) {
         return false;
     }
 
+    memcpy(space, event_data, data_size);
+    return commit_buffer(data_size);
+}
+
+// Reserves up to max_size bytes directly in the log output buffer. The
+// caller writes the entry in place and must call commit_buffer() right
+// after on the same thread. An async logger claims the space without its
+// lock, so concurrent appends proceed side by side; the sync and mapped
+// loggers hold the lock in between, and appends take turns per entry.
+char* reserve_buffer(size_t max_size) {
+    if (max_size == 0 || max_size > BUFFER_MAX_EVENT_SIZE || reserved_size != 0) {
+        set_buffer_error_internal(BUFFER_ERROR_INVALID);
+        BUFFER_LOG("Invalid buffer reserve attempt: size=%zu", max_size);
+        return NULL;
+    }
+
     if (!validate_buffer_state()) {
+        return NULL;
+    }
+
+    char* space = reserve_log_space(max_size);
+    if (!space) {
+        set_buffer_error_internal(BUFFER_ERROR_FULL);
+        metrics_increment(METRIC_BUFFER_FAILED_WRITES);
+        BUFFER_LOG("No output space for %zu bytes", max_size);
+        return NULL;
+    }
+
+    reserved_size = max_size;
+    return space;
+}
+
+// Commits the first used bytes of the reservation (0 abandons it); the
+// unused tail goes back to the logger. Returns false if the entry was not
+// written or the flush it triggered failed.
+bool commit_buffer(size_t used) {
+    if (reserved_size == 0) {
+        set_buffer_error_internal(BUFFER_ERROR_INVALID);
+        metrics_increment(METRIC_BUFFER_FAILED_WRITES);
         return false;
     }
 
-    EnterCriticalSection(&buffer.lock);
+    bool oversized = used > reserved_size;
+    reserved_size = 0;
+    if (oversized) {
+        commit_log_space(0);
+        set_buffer_error_internal(BUFFER_ERROR_INVALID);
+        metrics_increment(METRIC_BUFFER_FAILED_WRITES);
+        return false;
+    }
 
-    // Check if the buffer has enough space and flush if necessary
-    if (buffer.size + data_size > buffer.capacity) {
-        BUFFER_LOG("Buffer full, attempting flush before add");
-        if (!force_flush_buffer()) {
-            set_buffer_error_internal(BUFFER_ERROR_FULL);
-            buffer.stats.failed_writes++;
-            LeaveCriticalSection(&buffer.lock);
-            return false;
-        }
-    }
-
-    // Add data to buffer
-    if (buffer.size + data_size <= buffer.capacity) {
-        memcpy(buffer.data + buffer.size, event_data, data_size);
-        buffer.size += data_size;
-        buffer.stats.total_writes++;
-        BUFFER_LOG("Added %zu bytes to buffer, total size: %zu", data_size, buffer.size);
-        LeaveCriticalSection(&buffer.lock);
+    // A failed commit is a failed write in the synchronous logger
+    if (!commit_log_space(used)) {
+        set_buffer_error_internal(BUFFER_ERROR_FLUSH);
+        metrics_increment(METRIC_BUFFER_FAILED_WRITES);
+        return false;
+    }
+    if (used == 0) {
         return true;
-    } else {
-        // If buffer is still full after flush, return error
-        set_buffer_error_internal(BUFFER_ERROR_FULL);
-        buffer.stats.failed_writes++;
-        BUFFER_LOG("Buffer full after flush attempt");
     }
 
-    LeaveCriticalSection(&buffer.lock);
-    return false;
+    size_t size = atomic_fetch_add(&buffer.size, used) + used;
+    metrics_increment(METRIC_BUFFER_WRITES);
+    metrics_set_gauge(METRIC_BUFFER_PENDING_BYTES, size);
+    BUFFER_LOG("Added %zu bytes to buffer, total size: %zu", used, size);
+
+    // A batch checks the threshold once, in end_buffer_batch()
+    if (batch_depth == 0 && should_flush_buffer()) {
+        return force_flush_buffer();
+    }
+    return true;
 }
 
+// Opens a batch of entries on the calling thread
+bool begin_buffer_batch(void) {
+    if (!validate_buffer_state()) {
+        return false;
+    }
+
+    batch_depth++;
+    return true;
+}
+
+// Closes the batch and flushes if its entries reached the threshold
+bool end_buffer_batch(void) {
+    if (batch_depth == 0) {
+        set_buffer_error_internal(BUFFER_ERROR_INVALID);
+        return false;
+    }
+
+    if (--batch_depth == 0 && should_flush_buffer()) {
+        return force_flush_buffer();
+    }
+    return true;
+}
 
 // Check if buffer should be flushed
 static bool should_flush_buffer(void) {
-    return buffer.size >= BUFFER_FLUSH_THRESHOLD;
+    return atomic_load(&buffer.size) >= buffer.flush_threshold;
 }
 
 // Writes buffer data to the log if the flush threshold is met
@@ -153,14 +194,10 @@ bool flush_buffer_if_needed(void) {
         return false;
     }
 
-    EnterCriticalSection(&buffer.lock);
     if (should_flush_buffer()) {
-        BUFFER_LOG("Threshold reached (%zu bytes), flushing buffer", buffer.size);
-        bool flushed = force_flush_buffer();
-        LeaveCriticalSection(&buffer.lock);
-        return flushed;
+        BUFFER_LOG("Threshold reached (%zu bytes), flushing buffer", get_buffer_size());
+        return force_flush_buffer();
     }
-    LeaveCriticalSection(&buffer.lock);
 
     return false;
 }
@@ -168,61 +205,76 @@ bool flush_buffer_if_needed(void) {
 
 // Force buffer flush
 bool force_flush_buffer(void) {
-    if (!validate_buffer_state() || buffer.size == 0) {
+    if (!validate_buffer_state() || get_buffer_size() == 0) {
         return false;
     }
 
     EnterCriticalSection(&buffer.lock);
-
-    buffer.stats.total_flushes++;
-    if (write_to_log(buffer.data, buffer.size)) {
-        buffer.size = 0;
-        memset(buffer.data, 0, buffer.capacity);
-        BUFFER_LOG("Buffer flushed successfully");
+    if (!buffer.initialized) {
         LeaveCriticalSection(&buffer.lock);
-        return true;
+        return false;
+    }
+
+    // Hands the logger's active buffer to its writer; no data is copied.
+    // Entries committed meanwhile stay counted until the next flush.
+    size_t size = atomic_load(&buffer.size);
+    metrics_increment(METRIC_BUFFER_FLUSHES);
+    TRACE_EVENT(TRACE_KEYWORD_OUTPUT, trace_buffer_flush(size));
+    bool flushed = submit_log_buffer();
+    if (flushed) {
+        size_t left = atomic_fetch_sub(&buffer.size, size) - size;
+        metrics_set_gauge(METRIC_BUFFER_PENDING_BYTES, left);
+        BUFFER_LOG("Buffer flushed successfully (%zu bytes)", size);
     } else {
-        buffer.stats.failed_flushes++;
+        metrics_increment(METRIC_BUFFER_FAILED_FLUSHES);
         set_buffer_error_internal(BUFFER_ERROR_FLUSH);
         BUFFER_LOG("Buffer flush failed");
     }
 
     LeaveCriticalSection(&buffer.lock);
-    return false;
+    return flushed;
 }
 
 
 // Utility functions
 bool is_buffer_initialized(void) {
-    EnterCriticalSection(&buffer.lock);
-    bool init = buffer.initialized;
-    LeaveCriticalSection(&buffer.lock);
-    return init;
+    return buffer.initialized;
 }
 
+// Bytes added since the last flush; read without the lock
 size_t get_buffer_size(void) {
-    if (!validate_buffer_state()) {
+    if (!buffer.initialized) {
         return 0;
     }
-    
-    EnterCriticalSection(&buffer.lock);
-    size_t size = buffer.size;
-    LeaveCriticalSection(&buffer.lock);
-    return size;
+    return atomic_load(&buffer.size);
 }
 
+// The capacity is the flush threshold: output beyond it is handed to disk
 size_t get_buffer_capacity(void) {
-    EnterCriticalSection(&buffer.lock);
-    size_t cap = buffer.capacity;
-    LeaveCriticalSection(&buffer.lock);
-    return cap;
+    return get_buffer_flush_threshold();
+}
+
+bool set_buffer_flush_threshold(size_t threshold) {
+    if (threshold < BUFFER_MAX_EVENT_SIZE) {
+        set_buffer_error_internal(BUFFER_ERROR_INVALID);
+        return false;
+    }
+
+    if (!validate_buffer_state()) {
+        return false;
+    }
+
+    buffer.flush_threshold = threshold;
+    BUFFER_LOG("Flush threshold set to %zu bytes", threshold);
+    return !should_flush_buffer() || force_flush_buffer();
+}
+
+size_t get_buffer_flush_threshold(void) {
+    return buffer.flush_threshold;
 }
 
 DWORD get_buffer_last_error(void) {
-    EnterCriticalSection(&buffer.lock);
-    DWORD error = buffer.last_error;
-    LeaveCriticalSection(&buffer.lock);
-    return error;
+    return buffer.last_error;
 }
 
 void clear_buffer(void) {
@@ -230,11 +282,14 @@ void clear_buffer(void) {
         return;
     }
 
+    // Entries already live in the log output, so only the accounting resets
     EnterCriticalSection(&buffer.lock);
 
-    buffer.size = 0;
-    memset(buffer.data, 0, buffer.capacity);
-    reset_buffer_stats_internal();
+    if (buffer.initialized) {
+        atomic_store(&buffer.size, 0);
+        metrics_set_gauge(METRIC_BUFFER_PENDING_BYTES, 0);
+        reset_buffer_stats_internal();
+    }
 
     BUFFER_LOG("Buffer cleared and stats reset");
     LeaveCriticalSection(&buffer.lock);
@@ -246,11 +301,8 @@ bool check_buffer_health(void) {
         return false;
     }
     
-    EnterCriticalSection(&buffer.lock);
-    bool healthy = (buffer.size <= buffer.capacity) && 
-                  (buffer.data != NULL) &&
+    bool healthy = (buffer.flush_threshold >= BUFFER_MAX_EVENT_SIZE) &&
                   (buffer.initialized);
-    LeaveCriticalSection(&buffer.lock);
     
     BUFFER_LOG("Buffer health check: %s", healthy ? "OK" : "FAILED");
     return healthy;
@@ -258,36 +310,25 @@ bool check_buffer_health(void) {
 
 // Additional status functions
 bool is_buffer_full(void) {
-    if (!validate_buffer_state()) {
+    if (!buffer.initialized) {
         return true;
     }
-    
-    EnterCriticalSection(&buffer.lock);
-    bool full = buffer.size >= buffer.capacity;
-    LeaveCriticalSection(&buffer.lock);
-    return full;
+    return get_metric_gauge(METRIC_BUFFER_PENDING_BYTES) >= buffer.flush_threshold;
 }
 
 bool is_buffer_empty(void) {
-    if (!validate_buffer_state()) {
+    if (!buffer.initialized) {
         return true;
     }
-    
-    EnterCriticalSection(&buffer.lock);
-    bool empty = buffer.size == 0;
-    LeaveCriticalSection(&buffer.lock);
-    return empty;
+    return get_metric_gauge(METRIC_BUFFER_PENDING_BYTES) == 0;
 }
 
 float get_buffer_usage_percentage(void) {
-    if (!validate_buffer_state()) {
+    size_t threshold = buffer.flush_threshold;
+    if (!buffer.initialized || threshold == 0) {
         return 0.0f;
     }
-    
-    EnterCriticalSection(&buffer.lock);
-    float usage = ((float)buffer.size / buffer.capacity) * 100.0f;
-    LeaveCriticalSection(&buffer.lock);
-    return usage;
+    return ((float)get_metric_gauge(METRIC_BUFFER_PENDING_BYTES) / threshold) * 100.0f;
 }
 
 void reset_buffer_stats(void) {
@@ -307,19 +348,14 @@ static void set_buffer_error_internal(DWORD error_code) {
 }
 
 static bool validate_buffer_state(void) {
-    EnterCriticalSection(&buffer.lock);
-    bool valid = buffer.initialized && buffer.data;
-    if (!valid) {
+    if (!buffer.initialized) {
         set_buffer_error_internal(BUFFER_ERROR_INIT);
+        return false;
     }
-    LeaveCriticalSection(&buffer.lock);
-    return valid;
+    return true;
 }
 
 static void reset_buffer_stats_internal(void) {
     assert(buffer.initialized);
-    buffer.stats.total_flushes = 0;
-    buffer.stats.failed_flushes = 0;
-    buffer.stats.total_writes = 0;
-    buffer.stats.failed_writes = 0;
+    metrics_reset(METRIC_BUFFER_WRITES, METRIC_BUFFER_FAILED_FLUSHES);
 }
\ No newline at end of file
@@ -1,5 +1,11 @@
 #include "capture.h"
+#include "aggregate.h"
+#include "format.h"
 #include "logger.h"
+#include "logindex.h"
+#include "intern.h"
+#include "metrics.h"
+#include "sink.h"
 #include "utils.h"
 #include <stdio.h>
 #include <stdlib.h>
@@ -15,16 +21,18 @@
 // Capture system state
 typedef struct {
     CaptureConfig config;          // Current capture configuration
-    CaptureStats stats;           // Capture statistics
     CRITICAL_SECTION lock;        // Synchronization for thread safety
-    FILE* log_file;              // Current log file handle
+    bool log_open;               // Log file opened through the logger
     DWORD last_flush;            // Last flush timestamp
     bool initialized;            // Initialization flag
     bool active;                // Capture active flag
     DWORD last_error;           // Last error code
-    char* buffer;               // Event buffer
-    size_t buffer_size;         // Current buffer size
-    size_t buffer_capacity;     // Maximum buffer size
+    BinlogState binlog;         // Delta state of the binary writer
+    TimestampCache timestamps;  // Text timestamp cache, guarded by lock
+    DWORD process_key;          // Side index key of the foreground process
+    DWORD sink_id;              // Capture's sink while active
+    bool owns_hooks;            // start_capture() initialized the hooks
+    Aggregator aggregator;      // CAPTURE_MODE_AGGREGATE counters, guarded by lock
 } CaptureSystem;
 
 static CaptureSystem capture = {0};
@@ -32,59 +40,93 @@ static CaptureSystem capture = {0};
 // Internal helpers used to manage various capture-related tasks
 static bool open_log_file(void);
 static void close_log_file(void);
-static bool rotate_log_file(void);
-static void format_event_entry(const Event* event, char* buffer, size_t size);
-static bool write_event_to_file(const char* entry);
-static bool should_rotate_log(void);
+static void on_log_rotated(void);
+static bool write_binlog_preamble(bool new_file);
+static size_t format_event_entry(const Event* event, char* buffer, size_t size);
+static bool write_event_to_file(const Event* event);
+static bool write_summary_to_file(void* context, InternId process,
+                                  const char* record, size_t size);
 static bool create_log_directory(void);
 static void update_flush_timer(void);
 static bool should_flush(void);
 static void set_capture_error(DWORD error);
-static bool buffer_event_entry(const char* entry);
 static bool flush_buffer_to_file(void);
 static bool validate_config(const CaptureConfig* config);
 static void cleanup_capture_internal(void);
-
-// Called whenever an event (e.g., key press, mouse click) is captured by the hooks
-static void capture_event_callback(const Event* event) {
-    if (!capture.active || !event) 
-    printf("[Capture] Callback received no event or capture is inactive.\n");
-    return;
+static bool capture_sink_write(void* context, const SinkBatch* batch);
+static bool capture_sink_flush(void* context);
+static bool start_capture_input(void);
+
+// Capture's output is one of the sinks fed by the hooks; its worker thread
+// does all formatting and writing
+static const SinkDescriptor capture_sink = {
+    .name = "capture",
+    .format = SINK_FORMAT_EVENTS,
+    .write_batch = capture_sink_write,
+    .flush = capture_sink_flush
+};
+
+// Called with each run of events (key presses, mouse clicks, ...) captured by the hooks
+static bool capture_sink_write(void* context, const SinkBatch* batch) {
+    (void)context;
+    if (!capture.active) {
+        CAPTURE_DEBUG("Sink received events while capture is inactive");
+        return false;
+    }
 
     EnterCriticalSection(&capture.lock);
 
-    char entry[CAPTURE_MAX_ENTRY_SIZE];
-    format_event_entry(event, entry, sizeof(entry));
+    // Aggregation writes nothing per event, only the interval summaries
+    if (capture.config.mode == CAPTURE_MODE_AGGREGATE) {
+        bool success = aggregate_events(&capture.aggregator, batch->events, batch->count);
+        metrics_add(METRIC_CAPTURE_EVENTS, batch->count);
+        if (should_flush()) {
+            flush_buffer_to_file();
+        }
+        LeaveCriticalSection(&capture.lock);
+        return success;
+    }
 
-    if (capture.config.buffer_events) {
-        // Add event to the buffer
-        if (buffer_event_entry(entry)) {
-            capture.stats.events_buffered++;
+    size_t written = 0;
+    for (size_t i = 0; i < batch->count; i++) {
+        if (!write_event_to_file(&batch->events[i])) continue;
 
-            if (should_flush()) {
-                flush_buffer_to_file();
-            }
-        } else {
-            capture.stats.buffer_overflows++;
-            CAPTURE_DEBUG("Buffer overflow occurred");
+        written++;
+        // Unbuffered capture hands every entry straight to the writer
+        if (!capture.config.buffer_events) {
+            flush_buffer_to_file();
         }
-    } else {
-        if (write_event_to_file(entry)) {
-            capture.stats.events_captured++;
+    }
 
+    if (written > 0) {
+        metrics_add(METRIC_CAPTURE_EVENTS, written);
+        if (capture.config.buffer_events) {
+            metrics_add(METRIC_CAPTURE_EVENTS_BUFFERED, written);
+            // One threshold check for the whole batch
             if (should_flush()) {
-                fflush(capture.log_file);
-                update_flush_timer();
+                flush_buffer_to_file();
             }
         }
     }
 
-    // Rotate the log file if necessary
-    if (should_rotate_log()) {
-        rotate_log_file();
-    }
+    LeaveCriticalSection(&capture.lock);
+    return written == batch->count;
+}
+
+// Quiet periods still honour the flush interval
+static bool capture_sink_flush(void* context) {
+    (void)context;
+    bool success = true;
 
+    EnterCriticalSection(&capture.lock);
+    if (capture.active && capture.config.mode == CAPTURE_MODE_AGGREGATE) {
+        success = flush_aggregator(&capture.aggregator, get_precise_time());
+    }
+    if (capture.active && should_flush()) {
+        success = flush_buffer_to_file() && success;
+    }
     LeaveCriticalSection(&capture.lock);
+    return success;
 }
 
 // Sets up the capture system, including configuration, logging, and buffer allocation
@@ -114,24 +156,26 @@ bool init_capture(const CaptureConfig* config) {
     } else {
         strncpy(capture.config.log_path, CAPTURE_DEFAULT_LOG, CAPTURE_MAX_PATH);
         capture.config.mode = CAPTURE_MODE_NORMAL;
+        capture.config.format = CAPTURE_FORMAT_TEXT;
         capture.config.flush_interval = CAPTURE_FLUSH_INTERVAL;
         capture.config.max_file_size = CAPTURE_MAX_FILE_SIZE;
         capture.config.rotate_logs = true;
+        capture.config.rotate_interval = 0;
         capture.config.encrypt_logs = false;
+        capture.config.compress_logs = false;
+        capture.config.index_interval = CAPTURE_INDEX_INTERVAL;
         capture.config.buffer_events = true;
+        capture.config.flush_size = 0;
+        capture.config.aggregate_interval = 0;
+        capture.config.durability = LOG_DURABILITY_INTERVAL;
+        capture.config.commit_interval = 0;
         init_success = true;
     }
 
-    // Allocate buffer if buffering is enabled
-    if (init_success && capture.config.buffer_events) {
-        capture.buffer_capacity = CAPTURE_BUFFER_SIZE;
-        capture.buffer = (char*)malloc(capture.buffer_capacity);
-        if (!capture.buffer) {
-            set_capture_error(CAPTURE_ERROR_MEMORY);
-            init_success = false;
-        } else {
-            capture.buffer_size = 0;
-        }
+    // validate_config() checked the interval
+    if (init_success) {
+        init_aggregator(&capture.aggregator, capture.config.aggregate_interval,
+                        write_summary_to_file, NULL);
     }
 
     // Create log directory and open log file
@@ -144,7 +188,8 @@ bool init_capture(const CaptureConfig* config) {
     }
 
     if (init_success) {
-        memset(&capture.stats, 0, sizeof(CaptureStats));
+        metrics_reset(METRIC_CAPTURE_EVENTS, METRIC_CAPTURE_BUFFER_OVERFLOWS);
+        init_timestamp_cache(&capture.timestamps);
         capture.initialized = true;
         capture.last_flush = GetTickCount();
         capture.last_error = CAPTURE_ERROR_NONE;
@@ -165,11 +210,12 @@ bool init_capture(const CaptureConfig* config) {
 void cleanup_capture(void) {
     if (!capture.initialized) return;
 
-    EnterCriticalSection(&capture.lock);
-
+    // Outside the lock: stopping waits for the sink worker, which takes it
     if (capture.active) {
         stop_capture();
     }
+
+    EnterCriticalSection(&capture.lock);
     cleanup_capture_internal();
 
     LeaveCriticalSection(&capture.lock);
@@ -178,19 +224,9 @@ void cleanup_capture(void) {
 
 
 static void cleanup_capture_internal(void) {
-    if (capture.buffer) {
-        if (capture.buffer_size > 0) {
-            flush_buffer_to_file();
-        }
-        free(capture.buffer);
-        capture.buffer = NULL;
-    }
-
     close_log_file();
     capture.initialized = false;
     capture.active = false;
-    capture.buffer_size = 0;
-    capture.buffer_capacity = 0;
 
     CAPTURE_DEBUG("Capture system cleaned up");
 }
@@ -203,20 +239,52 @@ bool start_capture(void) {
         return false;
     }
 
+    if (!is_sinks_initialized() && !init_sinks()) {
+        set_capture_error(CAPTURE_ERROR_HOOKS);
+        printf("[Capture] Failed to initialize sinks.\n");
+        return false;
+    }
+
     EnterCriticalSection(&capture.lock);
+    capture.active = true;
+    capture.last_flush = GetTickCount();
+    LeaveCriticalSection(&capture.lock);
 
-    if (!register_hook_callback(capture_event_callback)) {
+    // The hooks feed every sink through the dispatcher
+    if (!register_sink(&capture_sink, &capture.sink_id) || !start_capture_input()) {
         set_capture_error(CAPTURE_ERROR_HOOKS);
         printf("[Capture] Failed to register hook callback.\n");
-        LeaveCriticalSection(&capture.lock);
+        if (capture.sink_id != SINK_INVALID_ID) {
+            unregister_sink(capture.sink_id);
+        }
+        capture.active = false;
         return false;
     }
 
-    capture.active = true;
-    capture.last_flush = GetTickCount();
     CAPTURE_DEBUG("Capture started");
+    return true;
+}
 
-    LeaveCriticalSection(&capture.lock);
+// Joins the running hooks, or starts them with the configured backend
+static bool start_capture_input(void) {
+    if (are_hooks_active()) {
+        return register_hook_batch_callback(dispatch_sink_events);
+    }
+
+    HookOptions options = {0};
+    options.consumer_thread = true;
+    options.hook_thread = true;
+    options.batch_size = HOOK_DEFAULT_BATCH_SIZE;
+    options.batch_callback = dispatch_sink_events;
+    options.backend = capture.config.input_backend;
+    if (!init_hooks_ex(NULL, &options)) {
+        CAPTURE_DEBUG("Failed to start hooks (error %lu)", (unsigned long)get_last_hook_error());
+        return false;
+    }
+
+    capture.owns_hooks = true;
+    CAPTURE_DEBUG("Hooks started with the %s backend",
+                  options.backend == HOOK_BACKEND_RAW_INPUT ? "raw input" : "LL hook");
     return true;
 }
 
@@ -224,17 +292,29 @@ bool start_capture(void) {
 void stop_capture(void) {
     if (!capture.active) return;
 
-    EnterCriticalSection(&capture.lock);
-
-    unregister_hook_callback(capture_event_callback);
+    // Hooks capture started are drained into the sinks and removed first
+    if (capture.owns_hooks) {
+        cleanup_hooks();
+        capture.owns_hooks = false;
+    }
 
-    if (capture.buffer_size > 0) {
-        flush_buffer_to_file();
+    // Writes out the events still queued for capture; not under the lock,
+    // the sink worker needs it to finish. The string tables they resolve
+    // belong to the sink registry, which start_capture() set up before
+    // the hooks, so they outlive cleanup_hooks().
+    unregister_sink(capture.sink_id);
+    capture.sink_id = SINK_INVALID_ID;
+    if (are_hooks_active() && get_sink_count() == 0) {
+        unregister_hook_batch_callback(dispatch_sink_events);
     }
 
-    if (capture.log_file) {
-        fflush(capture.log_file);
+    EnterCriticalSection(&capture.lock);
+
+    // The interval in progress is summarized up to now
+    if (capture.config.mode == CAPTURE_MODE_AGGREGATE) {
+        finish_aggregator(&capture.aggregator);
     }
+    flush_buffer_to_file();
 
     capture.active = false;
     CAPTURE_DEBUG("Capture stopped");
@@ -242,169 +322,182 @@ void stop_capture(void) {
     LeaveCriticalSection(&capture.lock);
 }
 
+// Opens the log file through the logger; its write buffers are the only
+// buffering between the formatter and the file
 static bool open_log_file(void) {
     char full_path[CAPTURE_MAX_PATH + 10];
     snprintf(full_path, sizeof(full_path), "%s/%s", 
              CAPTURE_LOG_DIR, capture.config.log_path);
 
+    LoggerConfig logger_config = {0};
+    logger_config.async = true;
+    logger_config.buffer_size = CAPTURE_BUFFER_SIZE;
+    logger_config.buffer_count = LOG_ASYNC_BUFFER_COUNT;
+    logger_config.flush_threshold = capture.config.flush_size;
+    logger_config.compress = capture.config.compress_logs;
+    logger_config.index_interval = capture.config.index_interval;
+    logger_config.durability = capture.config.durability;
+    logger_config.commit_interval = capture.config.commit_interval;
+    if (capture.config.rotate_logs) {
+        // The logger's writer thread rotates; the capture path never waits for it
+        logger_config.rotate_size = capture.config.max_file_size;
+        logger_config.rotate_interval = capture.config.rotate_interval;
+    }
+
     printf("[Capture] Opening log file: %s\n", full_path);
-    capture.log_file = fopen(full_path, "ab");
-    if (!capture.log_file) {
+    if (!init_logger_ex(full_path, &logger_config)) {
         set_capture_error(CAPTURE_ERROR_FILE);
         CAPTURE_DEBUG("Failed to open log file: %s", full_path);
         return false;
     }
+    capture.log_open = true;
+    set_logger_rotate_callback(on_log_rotated);
 
-    return true;
-}
-
-static void close_log_file(void) {
-    if (capture.log_file) {
-        fflush(capture.log_file);
-        fclose(capture.log_file);
-        capture.log_file = NULL;
+    if (capture.config.format == CAPTURE_FORMAT_BINARY && !write_binlog_preamble(get_current_file_size() == 0)) {
+        close_log_file();
+        return false;
     }
-}
 
-static bool rotate_log_file(void) {
-    if (!capture.config.rotate_logs || !capture.log_file) return false;
-
-    char timestamp[64];
-    SYSTEMTIME st;
-    GetLocalTime(&st);
-    snprintf(timestamp, sizeof(timestamp), "%04d%02d%02d_%02d%02d%02d",
-             st.wYear, st.wMonth, st.wDay, st.wHour, st.wMinute, st.wSecond);
+    return true;
+}
 
-    char old_path[512];
-    char new_path[512];
+// Starts a binary log: a file header for a new file, a sync record when
+// appending to an existing one
+static bool write_binlog_preamble(bool new_file) {
+    BYTE preamble[BINLOG_HEADER_SIZE];
+    size_t len;
 
-    int written = snprintf(old_path, sizeof(old_path), "%s/%s", 
-                           CAPTURE_LOG_DIR, capture.config.log_path);
-    if (written < 0 || (size_t)written >= sizeof(old_path)) {
-        CAPTURE_DEBUG("Buffer overflow detected in old_path");
-        return false;
+    if (new_file) {
+        len = binlog_write_header(&capture.binlog, preamble, sizeof(preamble));
+    } else {
+        len = binlog_write_sync(&capture.binlog, preamble, sizeof(preamble));
     }
 
-    written = snprintf(new_path, sizeof(new_path), "%s/%s.%s", 
-                       CAPTURE_LOG_DIR, capture.config.log_path, timestamp);
-    if (written < 0 || (size_t)written >= sizeof(new_path)) {
-        CAPTURE_DEBUG("Buffer overflow detected in new_path");
+    if (len == 0 || !write_log_raw(preamble, len)) {
+        set_capture_error(CAPTURE_ERROR_FILE);
+        CAPTURE_DEBUG("Failed to write binary log header");
         return false;
     }
 
-    close_log_file();
+    metrics_add(METRIC_CAPTURE_BYTES_WRITTEN, len);
+    return true;
+}
 
-    if (rename(old_path, new_path) == 0) {
-        capture.stats.files_rotated++;
-        return open_log_file();
+static void close_log_file(void) {
+    if (capture.log_open) {
+        // Drains the write buffers before the file is closed
+        cleanup_logger();
+        capture.log_open = false;
     }
+}
 
-    CAPTURE_DEBUG("Failed to rotate log file");
-    return false;
+// A new segment begins; runs inside the next reservation, which capture
+// only makes under capture.lock, serializing it with the binary encoder
+static void on_log_rotated(void) {
+    metrics_increment(METRIC_CAPTURE_FILES_ROTATED);
+
+    // Each segment starts its own binary delta chain
+    if (capture.config.format == CAPTURE_FORMAT_BINARY) {
+        write_binlog_preamble(true);
+    }
 }
 
-static void format_event_entry(const Event* event, char* buffer, size_t size) {
-    if (!event || !buffer || size == 0) return;
+// Formats an event in the configured log format; returns the entry length
+static size_t format_event_entry(const Event* event, char* buffer, size_t size) {
+    if (!event || !buffer || size == 0) return 0;
 
-    char timestamp[32];
-    SYSTEMTIME st;
-    GetLocalTime(&st);
-    
-    int written = snprintf(timestamp, sizeof(timestamp),
-                       "%04d-%02d-%02d %02d:%02d:%02d.%03hu",
-                       st.wYear, st.wMonth, st.wDay,
-                       st.wHour, st.wMinute, st.wSecond,
-                       (unsigned short)st.wMilliseconds);
-
-    if (written < 0 || (size_t)written >= sizeof(timestamp)) {
-        CAPTURE_DEBUG("Timestamp buffer overflow in format_event_entry");
-        timestamp[0] = '\0';
-    }
-
-    switch (event->type) {
-        case EVENT_KEY_PRESS:
-        case EVENT_KEY_RELEASE:
-            snprintf(buffer, size,
-                    "[%s] KEY %s VK:0x%04lX SC:0x%04lX%s%s%s%s\n",
-                    timestamp,
-                    event->type == EVENT_KEY_PRESS ? "DOWN" : "UP",
-                    event->data.keyboard.vkCode,
-                    event->data.keyboard.scanCode,
-                    event->data.keyboard.alt ? " ALT" : "",
-                    event->data.keyboard.control ? " CTRL" : "",
-                    event->data.keyboard.shift ? " SHIFT" : "",
-                    event->data.keyboard.win ? " WIN" : "");
-            break;
-
-        case EVENT_MOUSE_CLICK:
-        case EVENT_MOUSE_MOVE:
-        case EVENT_MOUSE_WHEEL:
-            snprintf(buffer, size,
-                    "[%s] MOUSE %s X:%ld Y:%ld BTN:%s%s%s WHL:%d\n",
-                    timestamp,
-                    event->type == EVENT_MOUSE_CLICK ? "CLICK" :
-                    event->type == EVENT_MOUSE_MOVE ? "MOVE" : "WHEEL",
-                    event->data.mouse.position.x,
-                    event->data.mouse.position.y,
-                    event->data.mouse.leftButton ? " LEFT" : "",
-                    event->data.mouse.rightButton ? " RIGHT" : "",
-                    event->data.mouse.middleButton ? " MIDDLE" : "",
-                    event->data.mouse.wheelDelta);
-            break;
-
-        case EVENT_WINDOW_CHANGE:
-            snprintf(buffer, size,
-                    "[%s] WINDOW TITLE:'%s' PROCESS:'%s' PID:%lu\n",
-                    timestamp,
-                    event->data.window.title,
-                    event->data.window.process,
-                    event->data.window.processId);
-            break;
-
-        default:
-            buffer[0] = '\0';
-            break;
+    if (capture.config.format == CAPTURE_FORMAT_BINARY) {
+        return binlog_encode_event(&capture.binlog, event, (BYTE*)buffer, size);
     }
+
+    return format_event_text(event, &capture.timestamps, buffer, size);
 }
 
-static bool write_event_to_file(const char* entry) {
-    if (!entry || !capture.log_file) {
+// Formats an event directly into reserved log output space
+static bool write_event_to_file(const Event* event) {
+    if (!capture.log_open) {
         set_capture_error(CAPTURE_ERROR_FILE);
         return false;
     }
 
-    size_t len = strlen(entry);
-    if (fwrite(entry, 1, len, capture.log_file) != len) {
-        capture.stats.write_errors++;
+    // Key events belong to the process of the last window change
+    if (event->type == EVENT_WINDOW_CHANGE) {
+        char process[MAX_PROCESS_NAME];
+        intern_resolve(event->data.window.processNameId, process, sizeof(process));
+        capture.process_key = log_index_process_key(process);
+    }
+
+    char* entry = reserve_log_space(CAPTURE_MAX_ENTRY_SIZE);
+    if (!entry) {
+        set_capture_error(CAPTURE_ERROR_BUFFER);
+        metrics_increment(METRIC_CAPTURE_BUFFER_OVERFLOWS);
+        CAPTURE_DEBUG("No log space for event");
+        return false;
+    }
+
+    // Binary index blocks start with a sync record so a query can decode
+    // them without the records before
+    size_t len = 0;
+    if (note_log_index(event->timestamp, capture.process_key) &&
+        capture.config.format == CAPTURE_FORMAT_BINARY) {
+        len = binlog_write_sync(&capture.binlog, (BYTE*)entry, CAPTURE_MAX_ENTRY_SIZE);
+    }
+
+    size_t event_len = format_event_entry(event, entry + len, CAPTURE_MAX_ENTRY_SIZE - len);
+    len += event_len;
+    if (!commit_log_space(len)) {
+        metrics_increment(METRIC_CAPTURE_WRITE_ERRORS);
         CAPTURE_DEBUG("Failed to write event to log");
         return false;
     }
+    if (event_len == 0) {
+        return false;
+    }
 
-    capture.stats.bytes_written += len;
+    metrics_add(METRIC_CAPTURE_BYTES_WRITTEN, len);
     return true;
 }
 
-static bool buffer_event_entry(const char* entry) {
-    if (!entry || !capture.buffer) {
+// Aggregator output: one summary line, indexed under the interval start
+// and its process
+static bool write_summary_to_file(void* context, InternId process,
+                                  const char* record, size_t size) {
+    (void)context;
+    if (!capture.log_open) {
+        set_capture_error(CAPTURE_ERROR_FILE);
+        return false;
+    }
+
+    char* entry = reserve_log_space(size);
+    if (!entry) {
         set_capture_error(CAPTURE_ERROR_BUFFER);
-    return false;
+        metrics_increment(METRIC_CAPTURE_BUFFER_OVERFLOWS);
+        CAPTURE_DEBUG("No log space for summary");
+        return false;
     }
-    
-    size_t len = strlen(entry);
-    if (capture.buffer_size + len >= capture.buffer_capacity) {
-        if (!flush_buffer_to_file()) {
-            return false;
-        }
+
+    // Keyed by the name on the line, so keylog_query -p finds "(other)" too
+    char name[MAX_PROCESS_NAME];
+    if (intern_resolve(process, name, sizeof(name)) == 0) {
+        strncpy(name, AGGREGATE_OTHER_NAME, sizeof(name) - 1);
+        name[sizeof(name) - 1] = '\0';
     }
-    
-    memcpy(capture.buffer + capture.buffer_size, entry, len);
-    capture.buffer_size += len;
+    note_log_index(capture.aggregator.start, log_index_process_key(name));
+
+    memcpy(entry, record, size);
+    if (!commit_log_space(size)) {
+        metrics_increment(METRIC_CAPTURE_WRITE_ERRORS);
+        CAPTURE_DEBUG("Failed to write summary to log");
+        return false;
+    }
+
+    metrics_add(METRIC_CAPTURE_BYTES_WRITTEN, size);
     return true;
 }
 
+// Hands buffered output to the logger's writer thread
 static bool flush_buffer_to_file(void) {
-    if (!capture.buffer || capture.buffer_size == 0) return true;
-    if (!capture.log_file) {
+    if (!capture.log_open) {
         set_capture_error(CAPTURE_ERROR_FILE);
         return false;
     }
@@ -414,28 +507,17 @@ static bool flush_buffer_to_file(void) {
         CAPTURE_DEBUG("Encryption not yet implemented");
     }
     
-    size_t written = fwrite(capture.buffer, 1, capture.buffer_size, capture.log_file);
-    if (written != capture.buffer_size) {
+    if (!submit_log_buffer()) {
         set_capture_error(CAPTURE_ERROR_FILE);
-        capture.stats.write_errors++;
-        CAPTURE_DEBUG("Failed to flush buffer: %zu/%zu bytes written", 
-                     written, capture.buffer_size);
+        metrics_increment(METRIC_CAPTURE_WRITE_ERRORS);
+        CAPTURE_DEBUG("Failed to flush buffer");
         return false;
     }
     
-    capture.stats.bytes_written += capture.buffer_size;
-    capture.buffer_size = 0;
     update_flush_timer();
     return true;
 }
 
-static bool should_rotate_log(void) {
-    if (!capture.config.rotate_logs || !capture.log_file) return false;
-    
-    size_t file_size = (size_t)ftell(capture.log_file);
-    return file_size >= capture.config.max_file_size;
-}
-
 static bool create_log_directory(void) {
     printf("[Capture] Creating log directory: %s\n", CAPTURE_LOG_DIR);
     if (CreateDirectoryA(CAPTURE_LOG_DIR, NULL) || GetLastError() == ERROR_ALREADY_EXISTS) {
@@ -470,6 +552,18 @@ static bool validate_config(const CaptureConfig* config) {
         return false;
     }
     
+    if (config->format != CAPTURE_FORMAT_TEXT &&
+        config->format != CAPTURE_FORMAT_BINARY) {
+        return false;
+    }
+
+    // Summaries are text lines
+    if (config->mode == CAPTURE_MODE_AGGREGATE &&
+        (config->format != CAPTURE_FORMAT_TEXT ||
+         (config->aggregate_interval != 0 && config->aggregate_interval < AGGREGATE_MIN_INTERVAL))) {
+        return false;
+    }
+    
     if (strlen(config->log_path) == 0 || 
         strlen(config->log_path) >= CAPTURE_MAX_PATH) {
         return false;
@@ -480,6 +574,26 @@ static bool validate_config(const CaptureConfig* config) {
         return false;
     }
     
+    if (config->flush_size > CAPTURE_BUFFER_SIZE) {
+        return false;
+    }
+
+    if (config->durability > LOG_DURABILITY_BATCH ||
+        config->commit_interval > CAPTURE_MAX_COMMIT_INTERVAL) {
+        return false;
+    }
+
+    if (config->input_backend != HOOK_BACKEND_LL_HOOKS &&
+        config->input_backend != HOOK_BACKEND_RAW_INPUT) {
+        return false;
+    }
+    
+    // A segment may overrun its limit by one write buffer
+    if (config->rotate_logs &&
+        config->max_file_size + CAPTURE_BUFFER_SIZE > LOG_MAX_FILE_SIZE) {
+        return false;
+    }
+    
     return true;
 }
 
@@ -488,7 +602,30 @@ void set_capture_config(const CaptureConfig* config) {
     if (!config) return;
     
     EnterCriticalSection(&capture.lock);
+    CaptureFormat format = capture.config.format;
+    bool compress = capture.config.compress_logs;
+    size_t index_interval = capture.config.index_interval;
+    CaptureMode mode = capture.config.mode;
+    DWORD aggregate_interval = capture.config.aggregate_interval;
     memcpy(&capture.config, config, sizeof(CaptureConfig));
+    // The format of an open log file cannot change under the writer
+    if (capture.log_open) {
+        capture.config.format = format;
+        capture.config.compress_logs = compress;
+        capture.config.index_interval = index_interval;
+        // Nor can it switch between event lines and summaries
+        if ((mode == CAPTURE_MODE_AGGREGATE) != (capture.config.mode == CAPTURE_MODE_AGGREGATE)) {
+            capture.config.mode = mode;
+        }
+        capture.config.aggregate_interval = aggregate_interval;
+        set_logger_flush_threshold(capture.config.flush_size);
+        set_logger_durability(capture.config.durability, capture.config.commit_interval);
+        if (capture.config.rotate_logs) {
+            set_logger_rotation(capture.config.max_file_size, capture.config.rotate_interval);
+        } else {
+            set_logger_rotation(0, 0);
+        }
+    }
     LeaveCriticalSection(&capture.lock);
 }
 
@@ -500,12 +637,16 @@ void get_capture_config(CaptureConfig* config) {
     LeaveCriticalSection(&capture.lock);
 }
 
+// View of the METRIC_CAPTURE_* counters; no lock needed
 void get_capture_stats(CaptureStats* stats) {
     if (!stats) return;
-    
-    EnterCriticalSection(&capture.lock);
-    memcpy(stats, &capture.stats, sizeof(CaptureStats));
-    LeaveCriticalSection(&capture.lock);
+
+    stats->events_captured = get_metric(METRIC_CAPTURE_EVENTS);
+    stats->bytes_written = get_metric(METRIC_CAPTURE_BYTES_WRITTEN);
+    stats->files_rotated = get_metric(METRIC_CAPTURE_FILES_ROTATED);
+    stats->write_errors = get_metric(METRIC_CAPTURE_WRITE_ERRORS);
+    stats->events_buffered = get_metric(METRIC_CAPTURE_EVENTS_BUFFERED);
+    stats->buffer_overflows = get_metric(METRIC_CAPTURE_BUFFER_OVERFLOWS);
 }
 
 bool is_capture_active(void) {
@@ -530,10 +671,10 @@ bool flush_capture_buffer(void) {
 }
 
 bool is_capture_buffer_full(void) {
-    if (!capture.initialized || !capture.buffer) return true;
+    if (!capture.initialized || !capture.log_open) return true;
     
     EnterCriticalSection(&capture.lock);
-    bool full = capture.buffer_size >= capture.buffer_capacity;
+    bool full = get_logger_pending_bytes() + CAPTURE_MAX_ENTRY_SIZE > CAPTURE_BUFFER_SIZE;
     LeaveCriticalSection(&capture.lock);
     
     return full;
@@ -0,0 +1,280 @@
+#include "compress.h"
+#include <stdlib.h>
+#include <string.h>
+
+// LZ4 block format parameters
+#define COMPRESS_MIN_MATCH 4
+#define COMPRESS_LAST_LITERALS 5   // The block always ends with literals
+#define COMPRESS_MATCH_LIMIT 12    // No match may start in the last 12 bytes
+#define COMPRESS_MAX_OFFSET 65535
+#define COMPRESS_HASH_BITS 12
+#define COMPRESS_SKIP_SHIFT 6      // Step faster through data that does not match
+
+// Internal helpers for the wire encoding
+static DWORD hash_sequence(DWORD sequence);
+static DWORD get_u32(const BYTE* in);
+static void put_u32(BYTE* out, DWORD value);
+static size_t put_length(BYTE* out, size_t length);
+static bool get_length(const BYTE* in, size_t size, size_t* pos, size_t* length);
+static DWORD checksum(const BYTE* data, size_t size);
+
+// Compresses size bytes into one LZ4 block; returns the block size, or 0
+// when capacity is below COMPRESS_BOUND(size)
+size_t compress_block(const BYTE* in, size_t size, BYTE* out, size_t capacity) {
+    if (!in || !out || capacity < COMPRESS_BOUND(size)) return 0;
+
+    // Positions + 1 of the last occurrence of each hashed 4-byte sequence
+    DWORD table[1 << COMPRESS_HASH_BITS];
+    memset(table, 0, sizeof(table));
+
+    size_t ip = 0;
+    size_t anchor = 0;
+    size_t op = 0;
+
+    while (size >= COMPRESS_MATCH_LIMIT && ip + COMPRESS_MATCH_LIMIT <= size) {
+        DWORD sequence = get_u32(in + ip);
+        DWORD h = hash_sequence(sequence);
+        size_t ref = table[h];
+        table[h] = (DWORD)ip + 1;
+
+        if (ref == 0 || ip - (ref - 1) > COMPRESS_MAX_OFFSET ||
+            get_u32(in + ref - 1) != sequence) {
+            ip += 1 + ((ip - anchor) >> COMPRESS_SKIP_SHIFT);
+            continue;
+        }
+        ref--;
+
+        size_t match = COMPRESS_MIN_MATCH;
+        while (ip + match < size - COMPRESS_LAST_LITERALS && in[ref + match] == in[ip + match]) {
+            match++;
+        }
+
+        // Sequence: token, literal length, literals, offset, match length
+        size_t literals = ip - anchor;
+        size_t extra = match - COMPRESS_MIN_MATCH;
+        BYTE* token = out + op++;
+        *token = (BYTE)(((literals < 15 ? literals : 15) << 4) | (extra < 15 ? extra : 15));
+        if (literals >= 15) op += put_length(out + op, literals - 15);
+        memcpy(out + op, in + anchor, literals);
+        op += literals;
+        out[op++] = (BYTE)((ip - ref) & 0xFF);
+        out[op++] = (BYTE)((ip - ref) >> 8);
+        if (extra >= 15) op += put_length(out + op, extra - 15);
+
+        ip += match;
+        anchor = ip;
+        if (ip + COMPRESS_MATCH_LIMIT <= size) {
+            table[hash_sequence(get_u32(in + ip - 2))] = (DWORD)(ip - 2) + 1;
+        }
+    }
+
+    // Last sequence: literals only
+    size_t literals = size - anchor;
+    out[op++] = (BYTE)((literals < 15 ? literals : 15) << 4);
+    if (literals >= 15) op += put_length(out + op, literals - 15);
+    memcpy(out + op, in + anchor, literals);
+    return op + literals;
+}
+
+// Expands one LZ4 block; returns the decompressed size, or 0 on invalid data
+// or insufficient capacity
+size_t decompress_block(const BYTE* in, size_t size, BYTE* out, size_t capacity) {
+    if (!in || !out || size == 0) return 0;
+
+    size_t ip = 0;
+    size_t op = 0;
+
+    for (;;) {
+        BYTE token = in[ip++];
+
+        size_t literals = token >> 4;
+        if (literals == 15 && !get_length(in, size, &ip, &literals)) return 0;
+        if (literals > size - ip || literals > capacity - op) return 0;
+        memcpy(out + op, in + ip, literals);
+        ip += literals;
+        op += literals;
+
+        if (ip == size) return op;  // The last sequence has no match
+
+        if (size - ip < 2) return 0;
+        size_t offset = in[ip] | ((size_t)in[ip + 1] << 8);
+        ip += 2;
+        if (offset == 0 || offset > op) return 0;
+
+        size_t match = token & 0x0F;
+        if (match == 15 && !get_length(in, size, &ip, &match)) return 0;
+        match += COMPRESS_MIN_MATCH;
+        if (match > capacity - op) return 0;
+
+        // Byte by byte: a match may overlap the output it copies
+        const BYTE* from = out + op - offset;
+        for (size_t i = 0; i < match; i++) {
+            out[op + i] = from[i];
+        }
+        op += match;
+
+        if (ip >= size) return 0;
+    }
+}
+
+// Writes one frame holding up to COMPRESS_BLOCK_SIZE raw bytes; returns the
+// frame size, or 0 when capacity is below COMPRESS_FRAME_HEADER_SIZE +
+// COMPRESS_BOUND(size)
+size_t compress_frame(const BYTE* in, size_t size, BYTE* out, size_t capacity) {
+    if (!in || !out || size == 0 || size > COMPRESS_BLOCK_SIZE ||
+        capacity < COMPRESS_FRAME_HEADER_SIZE + COMPRESS_BOUND(size)) {
+        return 0;
+    }
+
+    BYTE* payload = out + COMPRESS_FRAME_HEADER_SIZE;
+    size_t length = compress_block(in, size, payload, capacity - COMPRESS_FRAME_HEADER_SIZE);
+    DWORD raw_size = (DWORD)size;
+
+    if (length == 0 || length >= size) {
+        memcpy(payload, in, size);
+        length = size;
+        raw_size |= COMPRESS_FRAME_STORED;
+    }
+
+    memcpy(out, COMPRESS_MAGIC, COMPRESS_MAGIC_SIZE);
+    put_u32(out + 4, raw_size);
+    put_u32(out + 8, (DWORD)length);
+    put_u32(out + 12, checksum(in, size));
+    return COMPRESS_FRAME_HEADER_SIZE + length;
+}
+
+// Decodes the frame at the start of in into out (at least
+// COMPRESS_BLOCK_SIZE bytes); returns a COMPRESS_* result code
+int decompress_frame(const BYTE* in, size_t size, BYTE* out, size_t capacity,
+                     size_t* consumed, size_t* produced) {
+    if (!in || !out || !consumed || !produced) return COMPRESS_CORRUPT;
+    *consumed = 0;
+    *produced = 0;
+
+    if (size < COMPRESS_FRAME_HEADER_SIZE) {
+        // A torn header still has to look like one
+        size_t check = size < COMPRESS_MAGIC_SIZE ? size : COMPRESS_MAGIC_SIZE;
+        return memcmp(in, COMPRESS_MAGIC, check) == 0 ? COMPRESS_TRUNCATED : COMPRESS_CORRUPT;
+    }
+    if (memcmp(in, COMPRESS_MAGIC, COMPRESS_MAGIC_SIZE) != 0) return COMPRESS_CORRUPT;
+
+    DWORD raw_size = get_u32(in + 4);
+    bool stored = (raw_size & COMPRESS_FRAME_STORED) != 0;
+    size_t expected = raw_size & ~COMPRESS_FRAME_STORED;
+    size_t length = get_u32(in + 8);
+
+    if (expected == 0 || expected > COMPRESS_BLOCK_SIZE || expected > capacity ||
+        length > COMPRESS_BOUND(COMPRESS_BLOCK_SIZE) || (stored && length != expected)) {
+        return COMPRESS_CORRUPT;
+    }
+    if (length > size - COMPRESS_FRAME_HEADER_SIZE) return COMPRESS_TRUNCATED;
+
+    const BYTE* payload = in + COMPRESS_FRAME_HEADER_SIZE;
+    size_t decoded;
+    if (stored) {
+        memcpy(out, payload, length);
+        decoded = length;
+    } else {
+        decoded = decompress_block(payload, length, out, expected);
+    }
+    if (decoded != expected || checksum(out, decoded) != get_u32(in + 12)) {
+        return COMPRESS_CORRUPT;
+    }
+
+    *consumed = COMPRESS_FRAME_HEADER_SIZE + length;
+    *produced = decoded;
+    return COMPRESS_OK;
+}
+
+// Concatenates the output of every complete frame; stops at the first
+// truncated (crash) or corrupt frame. Returns NULL only when out of memory.
+BYTE* decompress_log(const BYTE* in, size_t size, size_t* produced,
+                     size_t* consumed, int* status) {
+    if (!in || !produced || !consumed || !status) return NULL;
+
+    size_t capacity = COMPRESS_BLOCK_SIZE;
+    size_t used = 0;
+    size_t pos = 0;
+    BYTE* raw = (BYTE*)malloc(capacity);
+    if (!raw) return NULL;
+
+    *status = COMPRESS_OK;
+    while (pos < size) {
+        if (capacity - used < COMPRESS_BLOCK_SIZE) {
+            BYTE* grown = (BYTE*)realloc(raw, capacity * 2);
+            if (!grown) {
+                free(raw);
+                return NULL;
+            }
+            raw = grown;
+            capacity *= 2;
+        }
+
+        size_t frame_size = 0;
+        size_t frame_output = 0;
+        *status = decompress_frame(in + pos, size - pos, raw + used, capacity - used,
+                                   &frame_size, &frame_output);
+        if (*status != COMPRESS_OK) break;
+
+        pos += frame_size;
+        used += frame_output;
+    }
+
+    *produced = used;
+    *consumed = pos;
+    return raw;
+}
+
+// Whether the data starts with a compressed frame
+bool is_compressed_log(const BYTE* in, size_t size) {
+    return in && size >= COMPRESS_MAGIC_SIZE &&
+           memcmp(in, COMPRESS_MAGIC, COMPRESS_MAGIC_SIZE) == 0;
+}
+
+// Multiplicative hash of a 4-byte sequence into the match table
+static DWORD hash_sequence(DWORD sequence) {
+    return (sequence * 2654435761u) >> (32 - COMPRESS_HASH_BITS);
+}
+
+static DWORD get_u32(const BYTE* in) {
+    return (DWORD)in[0] | ((DWORD)in[1] << 8) | ((DWORD)in[2] << 16) | ((DWORD)in[3] << 24);
+}
+
+static void put_u32(BYTE* out, DWORD value) {
+    out[0] = (BYTE)(value & 0xFF);
+    out[1] = (BYTE)((value >> 8) & 0xFF);
+    out[2] = (BYTE)((value >> 16) & 0xFF);
+    out[3] = (BYTE)(value >> 24);
+}
+
+// Length continuation: runs of 255 and a final byte below 255
+static size_t put_length(BYTE* out, size_t length) {
+    size_t op = 0;
+    while (length >= 255) {
+        out[op++] = 255;
+        length -= 255;
+    }
+    out[op++] = (BYTE)length;
+    return op;
+}
+
+// Adds the continuation bytes at *pos to *length
+static bool get_length(const BYTE* in, size_t size, size_t* pos, size_t* length) {
+    BYTE byte;
+    do {
+        if (*pos >= size) return false;
+        byte = in[(*pos)++];
+        *length += byte;
+    } while (byte == 255);
+    return true;
+}
+
+// FNV-1a
+static DWORD checksum(const BYTE* data, size_t size) {
+    DWORD hash = 2166136261u;
+    for (size_t i = 0; i < size; i++) {
+        hash ^= data[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
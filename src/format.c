@@ -0,0 +1,217 @@
+#include "format.h"
+#include "intern.h"
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+// Formats one event as a text log line and returns its length (0 if the
+// event has no text representation or does not fit)
+size_t format_event_text(const Event* event, TimestampCache* cache,
+                         char* buffer, size_t size) {
+    if (!event || !buffer || size == 0) return 0;
+
+    char timestamp[TIMESTAMP_TEXT_SIZE];
+    if (!format_timestamp_cached(cache, event->timestamp, timestamp, sizeof(timestamp))) {
+        timestamp[0] = '\0';
+    }
+
+    int written;
+    char title[MAX_WINDOW_TITLE];
+    char process[MAX_PROCESS_NAME];
+    char moves[16] = "";
+
+    switch (event->type) {
+        case EVENT_KEY_PRESS:
+        case EVENT_KEY_RELEASE:
+            written = snprintf(buffer, size,
+                    "[%s] KEY %s VK:0x%04lX SC:0x%04lX%s%s%s%s\n",
+                    timestamp,
+                    event->type == EVENT_KEY_PRESS ? "DOWN" : "UP",
+                    (unsigned long)event->data.keyboard.vkCode,
+                    (unsigned long)event->data.keyboard.scanCode,
+                    (event->data.keyboard.modifiers & INPUT_MOD_ALT) ? " ALT" : "",
+                    (event->data.keyboard.modifiers & INPUT_MOD_CONTROL) ? " CTRL" : "",
+                    (event->data.keyboard.modifiers & INPUT_MOD_SHIFT) ? " SHIFT" : "",
+                    (event->data.keyboard.modifiers & INPUT_MOD_WIN) ? " WIN" : "");
+            break;
+
+        case EVENT_MOUSE_CLICK:
+        case EVENT_MOUSE_MOVE:
+        case EVENT_MOUSE_WHEEL:
+            // Coalesced moves report how many raw moves they stand for
+            if (event->type == EVENT_MOUSE_MOVE && event->data.mouse.moveCount > 1) {
+                snprintf(moves, sizeof(moves), " COUNT:%u", (unsigned)event->data.mouse.moveCount);
+            }
+            written = snprintf(buffer, size,
+                    "[%s] MOUSE %s X:%ld Y:%ld BTN:%s%s%s WHL:%d%s\n",
+                    timestamp,
+                    event->type == EVENT_MOUSE_CLICK ? "CLICK" :
+                    event->type == EVENT_MOUSE_MOVE ? "MOVE" : "WHEEL",
+                    (long)event->data.mouse.position.x,
+                    (long)event->data.mouse.position.y,
+                    (event->data.mouse.buttons & INPUT_BTN_LEFT) ? " LEFT" : "",
+                    (event->data.mouse.buttons & INPUT_BTN_RIGHT) ? " RIGHT" : "",
+                    (event->data.mouse.buttons & INPUT_BTN_MIDDLE) ? " MIDDLE" : "",
+                    event->data.mouse.wheelDelta,
+                    moves);
+            break;
+
+        case EVENT_WINDOW_CHANGE:
+            intern_resolve(event->data.window.titleId, title, sizeof(title));
+            intern_resolve(event->data.window.processNameId, process, sizeof(process));
+            written = snprintf(buffer, size,
+                    "[%s] WINDOW TITLE:'%s' PROCESS:'%s' PID:%lu\n",
+                    timestamp,
+                    title,
+                    process,
+                    (unsigned long)event->data.window.processId);
+            break;
+
+        default:
+            buffer[0] = '\0';
+            return 0;
+    }
+
+    if (written < 0 || (size_t)written >= size) {
+        buffer[0] = '\0';
+        return 0;
+    }
+    return (size_t)written;
+}
+
+// Parses "YYYY-MM-DD HH:MM:SS.mmm" (local time) into a UTC FILETIME value
+static bool parse_timestamp(const char* text, ULONGLONG* time) {
+    unsigned year, month, day, hour, minute, second, ms;
+    if (sscanf(text, "%4u-%2u-%2u %2u:%2u:%2u.%3u",
+               &year, &month, &day, &hour, &minute, &second, &ms) != 7) {
+        return false;
+    }
+
+    SYSTEMTIME st = {0};
+    st.wYear = (WORD)year;
+    st.wMonth = (WORD)month;
+    st.wDay = (WORD)day;
+    st.wHour = (WORD)hour;
+    st.wMinute = (WORD)minute;
+    st.wSecond = (WORD)second;
+
+    FILETIME local, utc;
+    if (!SystemTimeToFileTime(&st, &local) || !LocalFileTimeToFileTime(&local, &utc)) {
+        return false;
+    }
+    *time = (((ULONGLONG)utc.dwHighDateTime << 32) | utc.dwLowDateTime) +
+            ms * TIMESTAMP_TICKS_PER_MS;
+    return true;
+}
+
+// Returns the value after " <name>:" in text, or NULL
+static const char* find_field(const char* text, const char* name) {
+    size_t length = strlen(name);
+    for (const char* p = strstr(text, name); p; p = strstr(p + 1, name)) {
+        if (p > text && p[-1] == ' ' && p[length] == ':') return p + length + 1;
+    }
+    return NULL;
+}
+
+bool parse_event_text(const char* line, size_t length, Event* event) {
+    char text[MAX_WINDOW_TITLE + MAX_PROCESS_NAME + 128];  // Longest formatted line
+    if (!line || !event || length < TIMESTAMP_TEXT_SIZE + 3 || length >= sizeof(text)) {
+        return false;
+    }
+
+    memcpy(text, line, length);
+    text[length] = '\0';
+    if (text[length - 1] == '\n') text[--length] = '\0';
+    if (text[0] != '[' || text[TIMESTAMP_TEXT_SIZE] != ']') return false;
+
+    memset(event, 0, sizeof(Event));
+    if (!parse_timestamp(text + 1, &event->timestamp)) return false;
+
+    const char* body = text + TIMESTAMP_TEXT_SIZE + 2;
+    const char* field;
+
+    if (strncmp(body, "KEY ", 4) == 0) {
+        if (strncmp(body + 4, "DOWN ", 5) == 0) {
+            event->type = EVENT_KEY_PRESS;
+        } else if (strncmp(body + 4, "UP ", 3) == 0) {
+            event->type = EVENT_KEY_RELEASE;
+        } else {
+            return false;
+        }
+        if (!(field = find_field(body, "VK"))) return false;
+        event->data.keyboard.vkCode = strtoul(field, NULL, 16);
+        if (!(field = find_field(body, "SC"))) return false;
+        event->data.keyboard.scanCode = strtoul(field, NULL, 16);
+
+        // Modifier names follow the scan code
+        const char* mods = strchr(field, ' ');
+        if (mods) {
+            if (strstr(mods, " ALT")) event->data.keyboard.modifiers |= INPUT_MOD_ALT;
+            if (strstr(mods, " CTRL")) event->data.keyboard.modifiers |= INPUT_MOD_CONTROL;
+            if (strstr(mods, " SHIFT")) event->data.keyboard.modifiers |= INPUT_MOD_SHIFT;
+            if (strstr(mods, " WIN")) event->data.keyboard.modifiers |= INPUT_MOD_WIN;
+        }
+        return true;
+    }
+
+    if (strncmp(body, "MOUSE ", 6) == 0) {
+        if (strncmp(body + 6, "CLICK ", 6) == 0) {
+            event->type = EVENT_MOUSE_CLICK;
+        } else if (strncmp(body + 6, "MOVE ", 5) == 0) {
+            event->type = EVENT_MOUSE_MOVE;
+            event->data.mouse.moveCount = 1;
+        } else if (strncmp(body + 6, "WHEEL ", 6) == 0) {
+            event->type = EVENT_MOUSE_WHEEL;
+        } else {
+            return false;
+        }
+        if (!(field = find_field(body, "X"))) return false;
+        event->data.mouse.position.x = strtol(field, NULL, 10);
+        if (!(field = find_field(body, "Y"))) return false;
+        event->data.mouse.position.y = strtol(field, NULL, 10);
+
+        const char* buttons = find_field(body, "BTN");
+        const char* wheel = find_field(body, "WHL");
+        if (!buttons || !wheel) return false;
+        if (strstr(buttons, " LEFT") && strstr(buttons, " LEFT") < wheel) {
+            event->data.mouse.buttons |= INPUT_BTN_LEFT;
+        }
+        if (strstr(buttons, " RIGHT") && strstr(buttons, " RIGHT") < wheel) {
+            event->data.mouse.buttons |= INPUT_BTN_RIGHT;
+        }
+        if (strstr(buttons, " MIDDLE") && strstr(buttons, " MIDDLE") < wheel) {
+            event->data.mouse.buttons |= INPUT_BTN_MIDDLE;
+        }
+        event->data.mouse.wheelDelta = (short)strtol(wheel, NULL, 10);
+
+        if (event->type == EVENT_MOUSE_MOVE && (field = find_field(body, "COUNT"))) {
+            event->data.mouse.moveCount = (WORD)strtoul(field, NULL, 10);
+        }
+        return true;
+    }
+
+    if (strncmp(body, "WINDOW TITLE:'", 14) == 0) {
+        // Titles may contain anything: the process and PID are taken from the end
+        char* pid = NULL;
+        for (char* p = strstr(text, "' PID:"); p; p = strstr(p + 1, "' PID:")) pid = p;
+        char* process = NULL;
+        for (char* p = strstr(text, "' PROCESS:'"); p && (!pid || p < pid);
+             p = strstr(p + 1, "' PROCESS:'")) {
+            process = p;
+        }
+        if (!pid || !process) return false;
+
+        event->type = EVENT_WINDOW_CHANGE;
+        event->data.window.processId = strtoul(pid + 6, NULL, 10);
+        *pid = '\0';
+        *process = '\0';
+
+        const char* title = body + 14;
+        const char* name = process + 11;
+        event->data.window.titleId = intern_string(title, strlen(title));
+        event->data.window.processNameId = intern_string(name, strlen(name));
+        return true;
+    }
+
+    return false;
+}
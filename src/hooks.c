@@ -1,9 +1,22 @@
 #include "hooks.h"
 #include "logger.h"
+#include "utils.h"
+#include "trace.h"
+#include "platform.h"
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
-#include <windows.h>
-#include <winuser.h>
+
+#ifndef _WIN32
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/ioctl.h>
+#include <linux/input.h>
+#endif
 
 // Debug logging
 #ifdef DEBUG
@@ -12,12 +25,63 @@
     #define HOOK_DEBUG(msg, ...)
 #endif
 
+#ifdef _WIN32
 #ifndef LLMHF_INJECTED
 #define LLMHF_INJECTED 0x00000001
 #endif
+#else
+// Windows virtual-key codes; events carry them on every platform
+#define VK_LBUTTON  0x01
+#define VK_RBUTTON  0x02
+#define VK_MBUTTON  0x04
+#define VK_LWIN     0x5B
+#define VK_RWIN     0x5C
+#define VK_LSHIFT   0xA0
+#define VK_RSHIFT   0xA1
+#define VK_LCONTROL 0xA2
+#define VK_RCONTROL 0xA3
+#define VK_LMENU    0xA4
+#define VK_RMENU    0xA5
+#define WHEEL_DELTA 120
+
+// 100 ns units between 1601-01-01 and the kernel's 1970 epoch
+#define EVDEV_EPOCH_OFFSET 116444736000000000ULL
+#define EVDEV_WAKE_INDEX HOOK_EVDEV_MAX_DEVICES
+#define EVDEV_BITS_LONGS(bits) (((bits) + 8 * sizeof(long) - 1) / (8 * sizeof(long)))
+#define EVDEV_TEST_BIT(array, bit) \
+    (((array)[(bit) / (8 * sizeof(long))] >> ((bit) % (8 * sizeof(long)))) & 1)
+#endif
 
+// Tracked input state, left and right modifiers kept apart
+#define INPUT_STATE_LSHIFT    0x0001
+#define INPUT_STATE_RSHIFT    0x0002
+#define INPUT_STATE_LCONTROL  0x0004
+#define INPUT_STATE_RCONTROL  0x0008
+#define INPUT_STATE_LALT      0x0010
+#define INPUT_STATE_RALT      0x0020
+#define INPUT_STATE_LWIN      0x0040
+#define INPUT_STATE_RWIN      0x0080
+#define INPUT_STATE_LBUTTON   0x0100
+#define INPUT_STATE_RBUTTON   0x0200
+#define INPUT_STATE_MBUTTON   0x0400
+
+// Fold the tracked state into the packed INPUT_MOD_* / INPUT_BTN_* bits
+#define INPUT_STATE_MODIFIERS(s) (BYTE)( \
+    (((s) & (INPUT_STATE_LALT | INPUT_STATE_RALT)) ? INPUT_MOD_ALT : 0) | \
+    (((s) & (INPUT_STATE_LCONTROL | INPUT_STATE_RCONTROL)) ? INPUT_MOD_CONTROL : 0) | \
+    (((s) & (INPUT_STATE_LSHIFT | INPUT_STATE_RSHIFT)) ? INPUT_MOD_SHIFT : 0) | \
+    (((s) & (INPUT_STATE_LWIN | INPUT_STATE_RWIN)) ? INPUT_MOD_WIN : 0))
+#define INPUT_STATE_BUTTONS(s) (BYTE)( \
+    (((s) & INPUT_STATE_LBUTTON) ? INPUT_BTN_LEFT : 0) | \
+    (((s) & INPUT_STATE_RBUTTON) ? INPUT_BTN_RIGHT : 0) | \
+    (((s) & INPUT_STATE_MBUTTON) ? INPUT_BTN_MIDDLE : 0))
+
+#ifdef _WIN32
 LRESULT CALLBACK keyboard_proc(int nCode, WPARAM wParam, LPARAM lParam);
 LRESULT CALLBACK mouse_proc(int nCode, WPARAM wParam, LPARAM lParam);
+void CALLBACK win_event_proc(HWINEVENTHOOK hook, DWORD event, HWND hwnd,
+                             LONG idObject, LONG idChild, DWORD thread, DWORD time);
+#endif
 
 // Global variables for managing hooks
 static HookSystem hooks = {0};
@@ -27,22 +91,95 @@ static volatile DWORD last_error = HOOK_ERROR_NONE;
 // Forward declarations for helper functions
 static bool init_critical_section(void);
 static void cleanup_critical_section(void);
-static void check_active_window(void);
+static void release_hook_resources(void);
 static void set_last_error(DWORD error_code);
-static bool get_process_name(HWND hwnd, char* process_name, size_t size);
-static void create_keyboard_event(Event* event, KBDLLHOOKSTRUCT* kb);
-static void create_mouse_event(Event* event, MSLLHOOKSTRUCT* mouse, UINT msg);
-static void create_window_event(Event* event, HWND hwnd);
+static void create_keyboard_event(Event* event, DWORD vk, DWORD scan, bool extended,
+                                  bool injected, bool down);
+static void create_mouse_event(Event* event, EventType type, WORD button, bool down,
+                               POINT position, short wheel, bool injected);
+static WORD input_state_bit(DWORD vk);
+static void apply_input_state(WORD bit, bool down);
+static bool accept_key_event(DWORD vk, bool down, bool injected);
+static bool accept_mouse_event(EventType type, WORD button, bool down, bool injected);
+static void resync_input_state(void);
+static void check_input_resync(void);
+static bool install_hooks(void);
+static void remove_hooks(void);
+#ifdef _WIN32
+static void create_window_event(Event* event, HWND hwnd, const char* title, DWORD processId);
+static void check_active_window(void);
+static bool create_message_mouse_event(Event* event, const MSLLHOOKSTRUCT* mouse, UINT msg);
+static bool install_win_event_hooks(void);
+static void remove_win_event_hooks(void);
+static void scope_namechange_hook(DWORD processId);
 static bool is_valid_window(HWND hwnd);
 static bool verify_hooks(void);
+static bool install_raw_input(void);
+static void remove_raw_input(void);
+static LRESULT CALLBACK raw_input_window_proc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam);
+static void drain_raw_input(HRAWINPUT current);
+static DWORD raw_key_vk(const RAWKEYBOARD* kb);
+static void handle_raw_keyboard(const RAWINPUTHEADER* header, const RAWKEYBOARD* kb);
+static void handle_raw_mouse(const RAWINPUTHEADER* header, const RAWMOUSE* mouse, POINT cursor);
+static void CALLBACK coalesce_timer_proc(HWND hwnd, UINT msg, UINT_PTR id, DWORD time);
+#else
+static bool open_evdev_device(const char* path);
+static void close_evdev_device(size_t index);
+static bool poll_evdev(int timeout);
+static void read_evdev_device(size_t index);
+static void handle_evdev_event(size_t index, const struct input_event* input);
+static void flush_evdev_motion(size_t index, ULONGLONG timestamp);
+static ULONGLONG evdev_timestamp(const struct input_event* input);
+static int evdev_idle_timeout(void);
+#endif
+static bool start_hook_thread(void);
+static void stop_hook_thread(void);
+static DWORD WINAPI hook_thread_proc(LPVOID param);
 static bool queue_event(const Event* event);
+static bool queue_input_event(const Event* event);
+static bool queue_event_ex(const Event* event, bool accepted);
+static bool enqueue_event(const Event* event, bool accepted);
+static void wait_for_producers(void);
+static bool spill_event(const Event* event);
+static SpillBlock* acquire_spill_block(void);
+static void retire_spill_chain(void);
+static void free_spill_blocks(void);
+static size_t drain_spilled_events(EventCallback callback, EventBatchCallback batch_callback,
+                                   size_t max_events);
 static bool process_queued_event(void);
+static size_t process_event_batch(size_t max_events);
 static void process_remaining_events(void);
+static bool start_consumer_thread(void);
+static void stop_consumer_thread(void);
+static DWORD WINAPI consumer_thread_proc(LPVOID param);
 static bool should_process_event(const Event* event);
-
-// Sets up keyboard and mouse hooks
+static bool filter_passes_event(const HookFilterTable* table, const Event* event);
+static size_t enter_filter_check(void);
+static void leave_filter_check(size_t phase);
+static void wait_for_filter_checks(void);
+static const HookFilterTable* get_filter_table(void);
+static bool filter_passes_key(const HookFilterTable* table, DWORD vk, bool down, bool injected);
+static bool filter_passes_type(const HookFilterTable* table, EventType type, bool injected);
+static bool filter_passes_process(const HookFilterTable* table, InternId process);
+static void compile_filters(HookFilterTable* table, const HookFilters* filters);
+static void default_hook_filters(HookFilters* filters);
+static void free_filter_tables(void);
+static DWORD get_move_coalesce_ms(void);
+static bool get_coalesce_settings(DWORD* coalesce_ms, DWORD* min_distance);
+static void coalesce_mouse_move(const Event* event);
+static void flush_pending_move(void);
+static void reset_hook_latency(void);
+static ULONGLONG read_hook_clock(void);
+static void record_hook_latency(ULONGLONG entry);
+
+// Sets up keyboard and mouse hooks with the default (polling) pipeline
 bool init_hooks(EventCallback callback) {
-    if (hooks_active || !callback) {
+    return init_hooks_ex(callback, NULL);
+}
+
+// Sets up keyboard and mouse hooks and, if requested, the hook and consumer threads
+bool init_hooks_ex(EventCallback callback, const HookOptions* options) {
+    if (hooks_active || (!callback && !(options && options->batch_callback))) {
         set_last_error(HOOK_ERROR_INVALID);
         return false;
     }
@@ -53,53 +190,77 @@ bool init_hooks(EventCallback callback) {
         return false;
     }
 
+    // Window events carry interned strings and process names are resolved
+    // through the pid cache. Whoever owns the sinks creates both first and
+    // keeps them until the queued events are written out; without sinks
+    // the hooks create and release them.
+    hooks.owns_intern = !is_intern_initialized();
+    hooks.owns_process_cache = !is_process_cache_initialized();
+    if ((hooks.owns_intern && !init_intern_table()) ||
+        (hooks.owns_process_cache && !init_process_cache())) {
+        set_last_error(HOOK_ERROR_INIT_FAILED);
+        release_hook_resources();
+        return false;
+    }
+
     EnterCriticalSection(&hooks.lock);
     bool init_success = true;
 
-    // Set the callback function for processing events
-    hooks.callback = callback;
     reset_hook_filters();
 
-    // Reset statistics and event queue
-    memset(&hooks.stats, 0, sizeof(hooks.stats));
-    hooks.event_queue.queue_head = 0;
-    hooks.event_queue.queue_tail = 0;
-
-    // Install keyboard hook
-    hooks.keyboard = SetWindowsHookEx(
-        WH_KEYBOARD_LL,
-        keyboard_proc,
-        GetModuleHandle(NULL),
-        0
-    );
+    // Apply pipeline options
+    memset(&hooks.options, 0, sizeof(hooks.options));
+    if (options) {
+        memcpy(&hooks.options, options, sizeof(HookOptions));
+    }
 
-    if (!hooks.keyboard) {
-        set_last_error(HOOK_ERROR_HOOK_FAILED);
-        HOOK_DEBUG("Failed to install keyboard hook: %u", GetLastError());
-        init_success = false;
+    // Set the callback functions for processing events
+    hooks.callback = callback;
+    hooks.batch_callback = hooks.options.batch_callback;
+    if (hooks.options.batch_size == 0) {
+        hooks.options.batch_size = HOOK_DEFAULT_BATCH_SIZE;
+    }
+    if (hooks.options.overflow_policy > HOOK_OVERFLOW_SPILL) {
+        hooks.options.overflow_policy = HOOK_OVERFLOW_DROP_NEWEST;
+    }
+    if (hooks.options.spill_limit == 0) {
+        hooks.options.spill_limit = HOOK_DEFAULT_SPILL_LIMIT;
     }
+#ifdef _WIN32
+    if (hooks.options.backend != HOOK_BACKEND_RAW_INPUT) {
+        hooks.options.backend = HOOK_BACKEND_LL_HOOKS;
+    }
+#else
+    hooks.options.backend = HOOK_BACKEND_EVDEV;
+    hooks.evdev.epoll = -1;
+    hooks.evdev.wake = -1;
+    hooks.evdev.device_count = 0;
+#endif
 
-    // Install mouse hook
-    if (init_success) {
-        hooks.mouse = SetWindowsHookEx(
-            WH_MOUSE_LL,
-            mouse_proc,
-            GetModuleHandle(NULL),
-            0
-        );
-
-        if (!hooks.mouse) {
-            set_last_error(HOOK_ERROR_HOOK_FAILED);
-            HOOK_DEBUG("Failed to install mouse hook: %u", GetLastError());
-            init_success = false;
-        }
+    // Overflow chain; DROP_OLDEST needs two blocks, one to evict while the
+    // other is full, so a smaller cap is rounded up
+    hooks.spill.max_blocks = hooks.options.spill_limit / sizeof(SpillBlock);
+    if (hooks.spill.max_blocks < 2) hooks.spill.max_blocks = 2;
+    atomic_store(&hooks.spill.active, false);
+
+    // Reset statistics and event queue
+    metrics_reset(METRIC_EVENTS_QUEUED, METRIC_MOVES_SHED);
+    metrics_set_gauge(METRIC_QUEUE_DEPTH, 0);
+    metrics_set_gauge(METRIC_SPILL_DEPTH, 0);
+    reset_hook_latency();
+    atomic_store(&hooks.event_queue.head, 0);
+    atomic_store(&hooks.event_queue.tail, 0);
+    for (size_t i = 0; i < MAX_EVENT_QUEUE; i++) {
+        atomic_store(&hooks.event_queue.sequences[i], i);
     }
 
-    // Verify hooks functionality by testing dummy inputs
-    if (init_success && !verify_hooks()) {
-        set_last_error(HOOK_ERROR_HOOK_FAILED);
-        HOOK_DEBUG("Hook verification failed");
-        init_success = false;
+    // Install the hooks, either here or on the dedicated hook thread
+    if (hooks.options.synthetic_input) {
+        HOOK_DEBUG("Synthetic input, no OS hooks installed");
+    } else if (hooks.options.hook_thread) {
+        init_success = start_hook_thread();
+    } else {
+        init_success = install_hooks();
     }
 
     if (init_success) {
@@ -107,14 +268,41 @@ bool init_hooks(EventCallback callback) {
         hooks.activeWindow = NULL;
         memset(hooks.windowTitle, 0, MAX_WINDOW_TITLE);
         memset(hooks.processName, 0, MAX_PROCESS_NAME);
+        atomic_store(&hooks.foreground_process, INTERN_NONE);
 
         hooks_active = true;
-        HOOK_DEBUG("Hooks initialized successfully, xD");
-    } else {
-        cleanup_hooks();
+        atomic_store(&hooks.accepting, true);
+
+#ifdef _WIN32
+        // Foreground changes are delivered to this thread's message loop;
+        // without the hooks process_events() falls back to polling
+        if (!hooks.options.synthetic_input) {
+            if (!install_win_event_hooks()) {
+                HOOK_DEBUG("WinEvent hooks unavailable, polling the foreground window");
+            }
+            check_active_window();
+        }
+#endif
+
+        if (hooks.options.consumer_thread && !start_consumer_thread()) {
+            set_last_error(HOOK_ERROR_INIT_FAILED);
+            HOOK_DEBUG("Failed to start consumer thread");
+            init_success = false;
+        }
     }
 
     LeaveCriticalSection(&hooks.lock);
+
+    // cleanup_hooks() takes the lock itself and deletes it at the end; it
+    // only runs once the hooks went live, before that nothing needs
+    // stopping and only the resources set up so far are released
+    if (init_success) {
+        HOOK_DEBUG("Hooks initialized successfully, xD");
+    } else if (hooks_active) {
+        cleanup_hooks();
+    } else {
+        release_hook_resources();
+    }
     return init_success;
 }
 
@@ -124,338 +312,1909 @@ void cleanup_hooks(void) {
         return;
     }
 
-    hooks_active = false;
-
     EnterCriticalSection(&hooks.lock);
 
-    // Process any events still in queue
-    process_remaining_events();
-
-    // Unhook keyboard
-    if (hooks.keyboard) {
-        UnhookWindowsHookEx(hooks.keyboard);
-        hooks.keyboard = NULL;
+    // Stop the producers first so the queue can be drained completely
+#ifdef _WIN32
+    remove_win_event_hooks();
+#endif
+    if (hooks.hook_thread) {
+        stop_hook_thread();
+    } else {
+        remove_hooks();
     }
 
-    // Unhook mouse
-    if (hooks.mouse) {
-        UnhookWindowsHookEx(hooks.mouse);
-        hooks.mouse = NULL;
+    // Synthetic and replay producers run on threads of their own; once the
+    // last call in progress has returned nothing touches the ring
+    atomic_store(&hooks.accepting, false);
+    wait_for_producers();
+
+    // Process any events still in queue
+    if (hooks.consumer_thread) {
+        stop_consumer_thread();
+    } else {
+        process_remaining_events();
     }
 
+    hooks_active = false;
+
     // Reset window tracking and callback
     hooks.activeWindow = NULL;
     memset(hooks.windowTitle, 0, MAX_WINDOW_TITLE);
     memset(hooks.processName, 0, MAX_PROCESS_NAME);
     hooks.callback = NULL;
+    hooks.batch_callback = NULL;
 
     LeaveCriticalSection(&hooks.lock);
 
-    cleanup_critical_section();
+    release_hook_resources();
 
     HOOK_DEBUG("Hooks cleaned up successfully");
 }
 
+// Frees the overflow chain, the filter tables, the locks and the string
+// tables init_hooks_ex() created; also undoes a failed initialization
+static void release_hook_resources(void) {
+    free_spill_blocks();
+    free_filter_tables();
+    cleanup_critical_section();
+    if (hooks.owns_process_cache) {
+        cleanup_process_cache();
+        hooks.owns_process_cache = false;
+    }
+    if (hooks.owns_intern) {
+        cleanup_intern_table();
+        hooks.owns_intern = false;
+    }
+}
+
+#ifdef _WIN32
 
 // Processes low-level keyboard input events
 LRESULT CALLBACK keyboard_proc(int nCode, WPARAM wParam, LPARAM lParam) {
+    ULONGLONG entry = read_hook_clock();
+    TRACE_EVENT(TRACE_KEYWORD_HOOKS, trace_hook_enter(TRACE_HOOK_KEYBOARD));
     if (nCode >= 0 && hooks_active) {
         KBDLLHOOKSTRUCT* kb = (KBDLLHOOKSTRUCT*)lParam;
+        bool extended = (kb->flags & LLKHF_EXTENDED) != 0;
+        bool injected = (kb->flags & LLKHF_INJECTED) != 0;
         Event event = {0};
         
         switch (wParam) {
             case WM_KEYDOWN:
             case WM_SYSKEYDOWN:
+                if (!accept_key_event(kb->vkCode, true, injected)) break;
+                flush_pending_move();
                 event.type = EVENT_KEY_PRESS;
-                create_keyboard_event(&event, kb);
-                queue_event(&event);
+                create_keyboard_event(&event, kb->vkCode, kb->scanCode, extended, injected, true);
+                queue_input_event(&event);
                 break;
             case WM_KEYUP:
             case WM_SYSKEYUP:
+                if (!accept_key_event(kb->vkCode, false, injected)) break;
+                flush_pending_move();
                 event.type = EVENT_KEY_RELEASE;
-                create_keyboard_event(&event, kb);
-                queue_event(&event);
+                create_keyboard_event(&event, kb->vkCode, kb->scanCode, extended, injected, false);
+                queue_input_event(&event);
                 break;
         }
     }
+    record_hook_latency(entry);
+    TRACE_EVENT(TRACE_KEYWORD_HOOKS, trace_hook_exit(TRACE_HOOK_KEYBOARD));
     return CallNextHookEx(hooks.keyboard, nCode, wParam, lParam);
 }
 
 // Processes low-level mouse input events
 LRESULT CALLBACK mouse_proc(int nCode, WPARAM wParam, LPARAM lParam) {
+    ULONGLONG entry = read_hook_clock();
+    TRACE_EVENT(TRACE_KEYWORD_HOOKS, trace_hook_enter(TRACE_HOOK_MOUSE));
     if (nCode >= 0 && hooks_active) {
         MSLLHOOKSTRUCT* mouse = (MSLLHOOKSTRUCT*)lParam;
         Event event = {0};
-        create_mouse_event(&event, mouse, wParam);
-        queue_event(&event);
+        if (!create_message_mouse_event(&event, mouse, wParam)) {
+            // Filtered out, or not a message the events describe (X buttons,
+            // horizontal wheel)
+        } else if (event.type == EVENT_MOUSE_MOVE) {
+            coalesce_mouse_move(&event);
+        } else {
+            flush_pending_move();
+            queue_input_event(&event);
+        }
     }
+    record_hook_latency(entry);
+    TRACE_EVENT(TRACE_KEYWORD_HOOKS, trace_hook_exit(TRACE_HOOK_MOUSE));
     return CallNextHookEx(hooks.mouse, nCode, wParam, lParam);
 }
 
-// Helper function to create a keyboard even
-static void create_keyboard_event(Event* event, KBDLLHOOKSTRUCT* kb) {
-    if (!event || !kb) return;
-
-    event->timestamp = GetTickCount();
-    event->data.keyboard.vkCode = kb->vkCode;
-    event->data.keyboard.scanCode = kb->scanCode;
-    event->data.keyboard.extended = (kb->flags & LLKHF_EXTENDED) != 0;
-    event->data.keyboard.injected = (kb->flags & LLKHF_INJECTED) != 0;
-
-    // Capture the state of modifier keys
-    event->data.keyboard.alt = (GetAsyncKeyState(VK_MENU) & 0x8000) != 0;
-    event->data.keyboard.shift = (GetAsyncKeyState(VK_SHIFT) & 0x8000) != 0;
-    event->data.keyboard.control = (GetAsyncKeyState(VK_CONTROL) & 0x8000) != 0;
-    event->data.keyboard.win = (GetAsyncKeyState(VK_LWIN) & 0x8000) != 0 ||
-                               (GetAsyncKeyState(VK_RWIN) & 0x8000) != 0;
-}
-
-// Helper function to create a mouse event
-static void create_mouse_event(Event* event, MSLLHOOKSTRUCT* mouse, UINT msg) {
-    if (!event || !mouse) return;
+// Translates a mouse hook message for create_mouse_event(); the filters
+// are checked before the event is built
+static bool create_message_mouse_event(Event* event, const MSLLHOOKSTRUCT* mouse, UINT msg) {
+    bool injected = (mouse->flags & LLMHF_INJECTED) != 0;
+    EventType type = EVENT_MOUSE_CLICK;
+    WORD button = 0;
+    short wheel = 0;
 
-    event->timestamp = GetTickCount();
-    
-    // Determine the type of mouse event
     switch (msg) {
+        case WM_MOUSEMOVE:
+            type = EVENT_MOUSE_MOVE;
+            break;
+        case WM_MOUSEWHEEL:
+            type = EVENT_MOUSE_WHEEL;
+            wheel = (short)HIWORD(mouse->mouseData);
+            break;
         case WM_LBUTTONDOWN:
-        case WM_RBUTTONDOWN:
-        case WM_MBUTTONDOWN:
         case WM_LBUTTONUP:
-        case WM_RBUTTONUP:
-        case WM_MBUTTONUP:
-            event->type = EVENT_MOUSE_CLICK;
+            button = INPUT_STATE_LBUTTON;
             break;
-        case WM_MOUSEWHEEL:
-            event->type = EVENT_MOUSE_WHEEL;
+        case WM_RBUTTONDOWN:
+        case WM_RBUTTONUP:
+            button = INPUT_STATE_RBUTTON;
             break;
-        case WM_MOUSEMOVE:
-            event->type = EVENT_MOUSE_MOVE;
+        case WM_MBUTTONDOWN:
+        case WM_MBUTTONUP:
+            button = INPUT_STATE_MBUTTON;
             break;
         default:
-            return;
+            return false;
+    }
+
+    bool down = msg == WM_LBUTTONDOWN || msg == WM_RBUTTONDOWN || msg == WM_MBUTTONDOWN;
+    if (!accept_mouse_event(type, button, down, injected)) {
+        return false;
+    }
+    create_mouse_event(event, type, button, down, mouse->pt, wheel, injected);
+    return true;
+}
+
+#endif
+
+// Hook latency instrumentation
+// The hook procs are timed up to CallNextHookEx(): that is the part of the
+// LowLevelHooksTimeout budget this module spends. Recording is a handful of
+// relaxed atomic increments, so it stays on in release builds.
+static void reset_hook_latency(void) {
+    LARGE_INTEGER frequency;
+    QueryPerformanceFrequency(&frequency);
+    hooks.latency.qpc_frequency = (ULONGLONG)frequency.QuadPart;
+
+    for (int i = 0; i < HOOK_LATENCY_BUCKETS; i++) {
+        atomic_store(&hooks.latency.buckets[i], 0);
+    }
+    atomic_store(&hooks.latency.max_ns, 0);
+    atomic_store(&hooks.latency.over_threshold, 0);
+    if (atomic_load(&hooks.latency.threshold_ns) == 0) {
+        atomic_store(&hooks.latency.threshold_ns,
+                     (ULONGLONG)HOOK_DEFAULT_LATENCY_THRESHOLD_US * 1000);
+    }
+}
+
+static ULONGLONG read_hook_clock(void) {
+    LARGE_INTEGER now;
+    QueryPerformanceCounter(&now);
+    return (ULONGLONG)now.QuadPart;
+}
+
+static void record_hook_latency(ULONGLONG entry) {
+    ULONGLONG frequency = hooks.latency.qpc_frequency;
+    if (frequency == 0) return;
+
+    ULONGLONG ticks = read_hook_clock() - entry;
+    ULONGLONG ns = ticks / frequency * 1000000000ULL +
+                   ticks % frequency * 1000000000ULL / frequency;
+
+    int bucket = ns > 1 ? 63 - __builtin_clzll(ns) : 0;
+    if (bucket >= HOOK_LATENCY_BUCKETS) bucket = HOOK_LATENCY_BUCKETS - 1;
+    atomic_fetch_add_explicit(&hooks.latency.buckets[bucket], 1, memory_order_relaxed);
+
+    if (ns > atomic_load_explicit(&hooks.latency.threshold_ns, memory_order_relaxed)) {
+        atomic_fetch_add_explicit(&hooks.latency.over_threshold, 1, memory_order_relaxed);
+    }
+
+    ULONGLONG max = atomic_load_explicit(&hooks.latency.max_ns, memory_order_relaxed);
+    while (ns > max && !atomic_compare_exchange_weak_explicit(&hooks.latency.max_ns,
+               &max, ns, memory_order_relaxed, memory_order_relaxed)) {
     }
+}
+
+// Helper function to create a keyboard event; every backend builds its
+// events here so they all look the same
+static void create_keyboard_event(Event* event, DWORD vk, DWORD scan, bool extended,
+                                  bool injected, bool down) {
+    if (!event) return;
+
+    event->timestamp = get_precise_time();
+    event->data.keyboard.vkCode = vk;
+    event->data.keyboard.scanCode = scan;
+    event->data.keyboard.extended = extended;
+    event->data.keyboard.injected = injected;
+
+    // Modifier state comes from the tracker, then the key is applied to it
+    check_input_resync();
+    event->data.keyboard.modifiers = INPUT_STATE_MODIFIERS(hooks.input_state);
+    apply_input_state(input_state_bit(vk), down);
+}
+
+// Helper function to create a mouse event. button is the INPUT_STATE_*
+// button of a click (0 otherwise), down tells press from release.
+static void create_mouse_event(Event* event, EventType type, WORD button, bool down,
+                               POINT position, short wheel, bool injected) {
+    if (!event) return;
+
+    event->type = type;
+    event->timestamp = get_precise_time();
 
     event->data.mouse.buttonFlags = 0;
-    if (msg == WM_LBUTTONDOWN || msg == WM_LBUTTONUP)
+    if (button & INPUT_STATE_LBUTTON)
         event->data.mouse.buttonFlags |= 0x01;
-    if (msg == WM_RBUTTONDOWN || msg == WM_RBUTTONUP)
+    if (button & INPUT_STATE_RBUTTON)
         event->data.mouse.buttonFlags |= 0x02;
-    if (msg == WM_MBUTTONDOWN || msg == WM_MBUTTONUP)
+    if (button & INPUT_STATE_MBUTTON)
         event->data.mouse.buttonFlags |= 0x04;
 
-    event->data.mouse.position = mouse->pt;
-    event->data.mouse.injected = (mouse->flags & LLMHF_INJECTED) != 0;
-    event->data.mouse.wheelDelta = HIWORD(mouse->mouseData);
+    event->data.mouse.position = position;
+    event->data.mouse.moveCount = type == EVENT_MOUSE_MOVE ? 1 : 0;
+    event->data.mouse.injected = injected;
+    event->data.mouse.wheelDelta = wheel;
     
-    // Get button states
-    event->data.mouse.leftButton = (GetAsyncKeyState(VK_LBUTTON) & 0x8000) != 0;
-    event->data.mouse.rightButton = (GetAsyncKeyState(VK_RBUTTON) & 0x8000) != 0;
-    event->data.mouse.middleButton = (GetAsyncKeyState(VK_MBUTTON) & 0x8000) != 0;
+    // Button state comes from the tracker, then the click is applied to it
+    check_input_resync();
+    event->data.mouse.buttons = INPUT_STATE_BUTTONS(hooks.input_state);
+    apply_input_state(button, down);
 }
 
-static void create_window_event(Event* event, HWND hwnd) {
-    if (!event || !hwnd) return;
+// Filter checks the backends make before building an event. A filtered
+// key or click still updates the input state, so the events that do pass
+// carry the right modifiers and buttons.
+static bool accept_key_event(DWORD vk, bool down, bool injected) {
+    size_t phase = enter_filter_check();
+    const HookFilterTable* table = get_filter_table();
+    bool passes = !table || (filter_passes_key(table, vk, down, injected) &&
+                             filter_passes_process(table, atomic_load_explicit(&hooks.foreground_process,
+                                                                               memory_order_relaxed)));
+    leave_filter_check(phase);
+    if (passes) {
+        return true;
+    }
 
-    event->type = EVENT_WINDOW_CHANGE;
-    event->timestamp = GetTickCount();
-    event->data.window.hwnd = hwnd;
-    
-    GetWindowTextA(hwnd, event->data.window.title, MAX_WINDOW_TITLE - 1);
-    get_process_name(hwnd, event->data.window.process, MAX_PROCESS_NAME - 1);
-    
-    DWORD processId;
-    GetWindowThreadProcessId(hwnd, &processId);
-    event->data.window.processId = processId;
+    check_input_resync();
+    apply_input_state(input_state_bit(vk), down);
+    return false;
 }
 
-// Queue management
-static bool queue_event(const Event* event) {
-    if (!event || !hooks_active) return false;
-    
-    if (!should_process_event(event)) {
+static bool accept_mouse_event(EventType type, WORD button, bool down, bool injected) {
+    size_t phase = enter_filter_check();
+    const HookFilterTable* table = get_filter_table();
+    bool passes = !table || (filter_passes_type(table, type, injected) &&
+                             filter_passes_process(table, atomic_load_explicit(&hooks.foreground_process,
+                                                                               memory_order_relaxed)));
+    leave_filter_check(phase);
+    if (passes) {
         return true;
     }
 
-    EnterCriticalSection(&hooks.event_queue.queue_lock);
-    bool success = false;
-
-    size_t next = (hooks.event_queue.queue_tail + 1) % MAX_EVENT_QUEUE;
-    if (next != hooks.event_queue.queue_head) {
-        memcpy(&hooks.event_queue.queue[hooks.event_queue.queue_tail], 
-               event, sizeof(Event));
-        hooks.event_queue.queue_tail = next;
-        hooks.stats.total_events++;
-        success = true;
-    } else {
-        hooks.stats.queue_overflows++;
-        hooks.stats.dropped_events++;
-        HOOK_DEBUG("Event queue overflow");
+    if (button) {
+        check_input_resync();
+        apply_input_state(button, down);
     }
+    return false;
+}
 
-    LeaveCriticalSection(&hooks.event_queue.queue_lock);
-    return success;
+// Mouse move coalescing
+// Runs on the thread servicing the LL hooks. A move is held back while
+// later moves can still be merged into it; the next click, wheel or key
+// event, a move outside the window, or the idle timer emits it.
+// Copies the merge criteria out of the filter table; false when both are off
+static bool get_coalesce_settings(DWORD* coalesce_ms, DWORD* min_distance) {
+    size_t phase = enter_filter_check();
+    const HookFilterTable* table = get_filter_table();
+    *coalesce_ms = table ? table->filters.move_coalesce_ms : 0;
+    *min_distance = table ? table->filters.move_min_distance : 0;
+    leave_filter_check(phase);
+    return *coalesce_ms != 0 || *min_distance != 0;
 }
 
-static bool process_queued_event(void) {
-    if (!hooks_active || !hooks.callback) return false;
+static void coalesce_mouse_move(const Event* event) {
+    DWORD coalesce_ms;
+    DWORD min_distance;
+    if (!get_coalesce_settings(&coalesce_ms, &min_distance)) {
+        flush_pending_move();
+        queue_input_event(event);
+        return;
+    }
+
+    if (hooks.move_pending) {
+        const POINT* pos = &event->data.mouse.position;
+        LONGLONG dx = pos->x - hooks.move_start_pos.x;
+        LONGLONG dy = pos->y - hooks.move_start_pos.y;
+        LONGLONG radius = min_distance;
+        ULONGLONG window = (ULONGLONG)coalesce_ms * TIMESTAMP_TICKS_PER_MS;
 
-    EnterCriticalSection(&hooks.event_queue.queue_lock);
-    bool processed = false;
+        bool in_window = window != 0 && event->timestamp - hooks.move_start_time < window;
+        bool in_radius = radius != 0 && dx * dx + dy * dy < radius * radius;
 
-    if (hooks.event_queue.queue_head != hooks.event_queue.queue_tail) {
-        Event* event = &hooks.event_queue.queue[hooks.event_queue.queue_head];
-        hooks.callback(event);
-        hooks.event_queue.queue_head = 
-            (hooks.event_queue.queue_head + 1) % MAX_EVENT_QUEUE;
-        processed = true;
+        if (in_window || in_radius) {
+            MouseEvent* merged = &hooks.pending_move.data.mouse;
+            WORD count = merged->moveCount;
+
+            hooks.pending_move.timestamp = event->timestamp;
+            *merged = event->data.mouse;
+            merged->moveCount = count < 0xFFFF ? count + 1 : count;
+            metrics_increment(METRIC_COALESCED_MOVES);
+            return;
+        }
+        flush_pending_move();
     }
 
-    LeaveCriticalSection(&hooks.event_queue.queue_lock);
-    return processed;
-}
+    memcpy(&hooks.pending_move, event, sizeof(Event));
+    hooks.move_pending = true;
+    hooks.move_start_time = event->timestamp;
+    hooks.move_start_pos = event->data.mouse.position;
 
-static void process_remaining_events(void) {
-    while (process_queued_event()) {
-        // Process all remaining events
+    // The evdev loop times the idle flush itself (evdev_idle_timeout())
+#ifdef _WIN32
+    if (!hooks.coalesce_timer) {
+        UINT period = coalesce_ms ? coalesce_ms : HOOK_COALESCE_IDLE_FLUSH;
+        hooks.coalesce_timer = SetTimer(NULL, 0, period, coalesce_timer_proc);
     }
+#endif
 }
 
-// Window tracking
-static void check_active_window(void) {
-    HWND foreground = GetForegroundWindow();
-    if (!is_valid_window(foreground)) {
+static void flush_pending_move(void) {
+    if (!hooks.move_pending) return;
+
+    hooks.move_pending = false;
+    queue_input_event(&hooks.pending_move);
+}
+
+#ifdef _WIN32
+// Emits a held move once its window has passed; stops itself when idle
+static void CALLBACK coalesce_timer_proc(HWND hwnd, UINT msg, UINT_PTR id, DWORD time) {
+    (void)hwnd;
+    (void)msg;
+    (void)id;
+    (void)time;
+
+    if (!hooks.move_pending) {
+        KillTimer(NULL, hooks.coalesce_timer);
+        hooks.coalesce_timer = 0;
         return;
     }
 
-    char new_title[MAX_WINDOW_TITLE] = {0};
-    GetWindowTextA(foreground, new_title, MAX_WINDOW_TITLE - 1);
-    
-    if (foreground != hooks.activeWindow || 
-        strcmp(new_title, hooks.windowTitle) != 0) {
-        Event event = {0};
-        create_window_event(&event, foreground);
-        queue_event(&event);
-        
-        hooks.activeWindow = foreground;
-        strncpy(hooks.windowTitle, new_title, MAX_WINDOW_TITLE - 1);
-        hooks.stats.window_changes++;
+    ULONGLONG window = (ULONGLONG)get_move_coalesce_ms() * TIMESTAMP_TICKS_PER_MS;
+    if (get_precise_time() - hooks.move_start_time >= window) {
+        flush_pending_move();
     }
 }
+#endif
 
-static bool verify_hooks(void) {
-    if (!hooks.keyboard || !hooks.mouse) {
-        return false;
+// Input state tracking
+// The LL hook streams already carry every modifier and button transition,
+// so the hook thread keeps its own state instead of asking the OS per event.
+// It is re-read once when the hooks start and after focus changes, where
+// transitions may have been missed (e.g. secure desktop, elevated windows).
+static WORD input_state_bit(DWORD vk) {
+    switch (vk) {
+        case VK_LSHIFT: return INPUT_STATE_LSHIFT;
+        case VK_RSHIFT: return INPUT_STATE_RSHIFT;
+        case VK_LCONTROL: return INPUT_STATE_LCONTROL;
+        case VK_RCONTROL: return INPUT_STATE_RCONTROL;
+        case VK_LMENU: return INPUT_STATE_LALT;
+        case VK_RMENU: return INPUT_STATE_RALT;
+        case VK_LWIN: return INPUT_STATE_LWIN;
+        case VK_RWIN: return INPUT_STATE_RWIN;
+        default: return 0;
     }
+}
 
-    // Test keyboard hook
-    INPUT input = {0};
-    input.type = INPUT_KEYBOARD;
-    input.ki.wVk = VK_SCROLL;
-    
-    if (!SendInput(1, &input, sizeof(INPUT))) {
-        HOOK_DEBUG("Failed to verify keyboard hook");
-        return false;
+static void apply_input_state(WORD bit, bool down) {
+    if (down) {
+        hooks.input_state |= bit;
+    } else {
+        hooks.input_state &= (WORD)~bit;
     }
+}
 
-    return true;
+#ifdef _WIN32
+static void resync_input_state(void) {
+    static const struct { int vk; WORD bit; } keys[] = {
+        { VK_LSHIFT, INPUT_STATE_LSHIFT }, { VK_RSHIFT, INPUT_STATE_RSHIFT },
+        { VK_LCONTROL, INPUT_STATE_LCONTROL }, { VK_RCONTROL, INPUT_STATE_RCONTROL },
+        { VK_LMENU, INPUT_STATE_LALT }, { VK_RMENU, INPUT_STATE_RALT },
+        { VK_LWIN, INPUT_STATE_LWIN }, { VK_RWIN, INPUT_STATE_RWIN },
+        { VK_LBUTTON, INPUT_STATE_LBUTTON }, { VK_RBUTTON, INPUT_STATE_RBUTTON },
+        { VK_MBUTTON, INPUT_STATE_MBUTTON }
+    };
+    WORD state = 0;
+
+    for (size_t i = 0; i < sizeof(keys) / sizeof(keys[0]); i++) {
+        if (GetAsyncKeyState(keys[i].vk) & 0x8000) {
+            state |= keys[i].bit;
+        }
+    }
+    hooks.input_state = state;
 }
+#endif
 
-bool process_events(void) {
-    printf("[DEBUG] Entering process_events...\n");
-    if (!hooks_active) {
-        printf("[DEBUG] Hooks are not active\n");
-        return false;
+// Called by the hook procs; other threads only raise input_resync
+static void check_input_resync(void) {
+    if (atomic_exchange_explicit(&hooks.input_resync, false, memory_order_acquire)) {
+        resync_input_state();
     }
+}
 
-    EnterCriticalSection(&hooks.lock);
+#ifdef _WIN32
+static void create_window_event(Event* event, HWND hwnd, const char* title, DWORD processId) {
+    if (!event || !hwnd || !title) return;
 
-    check_active_window();
+    event->type = EVENT_WINDOW_CHANGE;
+    event->timestamp = get_precise_time();
+    event->data.window.hwnd = hwnd;
+    event->data.window.processId = processId;
 
-    MSG msg;
-    while (PeekMessage(&msg, NULL, 0, 0, PM_REMOVE)) {
-        TranslateMessage(&msg);
-        DispatchMessage(&msg);
-    }
+    // Only the interned IDs travel through the queue
+    char process[MAX_PROCESS_NAME] = {0};
+    lookup_process_name(processId, process, MAX_PROCESS_NAME);
+    event->data.window.titleId = intern_string(title, strlen(title));
+    event->data.window.processNameId = intern_string(process, strlen(process));
+}
+#endif
 
-    while (process_queued_event()) {
-        printf("[DEBUG] Processed an event from the queue.\n");
-    }
+// Queue management
+// Producer side of the ring, safe to call from any number of threads, also
+// while cleanup_hooks() runs: a call either completes before the queue is
+// drained or is refused. The count and the flag are both sequentially
+// consistent, so cleanup_hooks() sees every call that could still enqueue.
+// Window changes and submit_hook_event() go through the filters here.
+static bool queue_event(const Event* event) {
+    return queue_event_ex(event, false);
+}
 
-    LeaveCriticalSection(&hooks.lock);
-    return true;
+// Input a backend built after accept_key_event() or accept_mouse_event()
+// passed it; the filters are not looked up a second time
+static bool queue_input_event(const Event* event) {
+    return queue_event_ex(event, true);
 }
 
+static bool queue_event_ex(const Event* event, bool accepted) {
+    if (!event) return false;
 
-// Utility functions
-static bool init_critical_section(void) {
-    InitializeCriticalSection(&hooks.lock);
-    InitializeCriticalSection(&hooks.event_queue.queue_lock);
-    return true;
+    atomic_fetch_add(&hooks.producers, 1);
+    bool queued = false;
+    if (atomic_load(&hooks.accepting)) {
+        queued = enqueue_event(event, accepted);
+    }
+    atomic_fetch_sub_explicit(&hooks.producers, 1, memory_order_release);
+    return queued;
 }
 
-static void cleanup_critical_section(void) {
-    if (hooks.lock.DebugInfo)
-        DeleteCriticalSection(&hooks.lock);
-    if (hooks.event_queue.queue_lock.DebugInfo)
-        DeleteCriticalSection(&hooks.event_queue.queue_lock);
+// Waits for queue_event_ex() calls that got past the accepting check
+static void wait_for_producers(void) {
+    while (atomic_load_explicit(&hooks.producers, memory_order_acquire) != 0) {
+        YieldProcessor();
+    }
 }
 
-static bool is_valid_window(HWND hwnd) {
-    return hwnd != NULL && IsWindow(hwnd) && IsWindowVisible(hwnd);
-}
+static bool enqueue_event(const Event* event, bool accepted) {
+    if (!hooks_active) return false;
 
-static void set_last_error(DWORD error_code) {
-    last_error = error_code;
-    HOOK_DEBUG("Hook error set: %u", error_code);
-}
+    // Input is attributed to the process of the latest window change
+    if (event->type == EVENT_WINDOW_CHANGE) {
+        atomic_store_explicit(&hooks.foreground_process, event->data.window.processNameId,
+                              memory_order_relaxed);
+    }
+
+    if (!accepted && !should_process_event(event)) {
+        return true;
+    }
 
-static bool get_process_name(HWND hwnd, char* process_name, size_t size) {
-    if (!process_name || size == 0) return false;
+    EventRing* ring = &hooks.event_queue;
+    size_t index;
+
+    // Shed mouse moves first so the ring's last quarter and the overflow
+    // chain stay free for keys, clicks and window changes. head is read
+    // before tail so the difference cannot underflow.
+    if (event->type == EVENT_MOUSE_MOVE) {
+        size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+        size_t depth = atomic_load_explicit(&ring->tail, memory_order_relaxed) - head;
+        if (depth >= HOOK_MOVE_SHED_LEVEL ||
+            atomic_load_explicit(&hooks.spill.active, memory_order_relaxed)) {
+            metrics_increment(METRIC_MOVES_SHED);
+            metrics_increment(METRIC_EVENTS_DROPPED);
+            return false;
+        }
+    }
 
-    DWORD processId;
-    GetWindowThreadProcessId(hwnd, &processId);
+    // While overflow is parked new events queue up behind it
+    if (atomic_load_explicit(&hooks.spill.active, memory_order_acquire)) {
+        return spill_event(event);
+    }
 
-    HANDLE hProcess = OpenProcess(PROCESS_QUERY_LIMITED_INFORMATION, FALSE, processId);
-    if (!hProcess) return false;
+    size_t pos = atomic_load_explicit(&ring->tail, memory_order_relaxed);
 
-    bool success = false;
+    // Claim a slot: it is free when its sequence equals our position
+    for (;;) {
+        index = pos & (MAX_EVENT_QUEUE - 1);
+        size_t seq = atomic_load_explicit(&ring->sequences[index], memory_order_acquire);
+        intptr_t diff = (intptr_t)seq - (intptr_t)pos;
 
-    if (GetModuleFileNameExA(hProcess, NULL, process_name, size)) {
-        char* last_slash = strrchr(process_name, '\\');
-        if (last_slash) {
-            memmove(process_name, last_slash + 1, strlen(last_slash + 1) + 1);
+        if (diff == 0) {
+            if (atomic_compare_exchange_weak_explicit(&ring->tail, &pos, pos + 1,
+                    memory_order_relaxed, memory_order_relaxed)) {
+                break;
+            }
+        } else if (diff < 0) {
+            // Slot still holds an event from the previous lap: queue is full
+            metrics_increment(METRIC_QUEUE_OVERFLOWS);
+            HOOK_DEBUG("Event queue overflow");
+            if (hooks.options.overflow_policy != HOOK_OVERFLOW_DROP_NEWEST) {
+                return spill_event(event);
+            }
+            metrics_increment(METRIC_EVENTS_DROPPED);
+            return false;
+        } else {
+            pos = atomic_load_explicit(&ring->tail, memory_order_relaxed);
         }
-        success = true;
     }
 
-    CloseHandle(hProcess);
-    return success;
+    memcpy(&ring->events[index], event, sizeof(Event));
+    atomic_store_explicit(&ring->sequences[index], pos + 1, memory_order_release);
+    metrics_increment(METRIC_EVENTS_QUEUED);
+    TRACE_EVENT(TRACE_KEYWORD_QUEUE, trace_enqueue(event->type, false));
+
+    // Wake the consumer only if it had caught up with everything before this
+    // event. Pairs with the fence in consumer_thread_proc().
+    if (hooks.queue_signal) {
+        atomic_thread_fence(memory_order_seq_cst);
+        if (atomic_load_explicit(&ring->head, memory_order_relaxed) == pos) {
+            SetEvent(hooks.queue_signal);
+        }
+    }
+    return true;
 }
 
-// Event filtering
-static bool should_process_event(const Event* event) {
-    if (!event) return false;
+// Parks an event in the overflow chain. Only reached once the ring is full,
+// so the lock is off the fast path.
+static bool spill_event(const Event* event) {
+    bool kept = true;
+
+    EnterCriticalSection(&hooks.spill.lock);
+
+    SpillBlock* block = hooks.spill.tail;
+    if (!block || block->count == HOOK_SPILL_BLOCK_EVENTS) {
+        block = acquire_spill_block();
+
+        // At the cap DROP_OLDEST recycles the oldest block of parked events.
+        // With at least two blocks every one is in the chain by now, so the
+        // head is never the full tail block.
+        if (!block && hooks.options.overflow_policy == HOOK_OVERFLOW_DROP_OLDEST &&
+            hooks.spill.head != hooks.spill.tail) {
+            SpillBlock* oldest = hooks.spill.head;
+            size_t lost = oldest->count - oldest->head;
+            hooks.spill.head = oldest->next;
+            hooks.spill.count -= lost;
+            metrics_add(METRIC_EVENTS_DROPPED, lost);
+            oldest->next = hooks.spill.pool;
+            hooks.spill.pool = oldest;
+            block = acquire_spill_block();
+        }
 
-    switch (event->type) {
-        case EVENT_KEY_PRESS:
-        case EVENT_KEY_RELEASE:
-            if (!hooks.filters.capture_keyboard) return false;
-            if (hooks.filters.ignore_injected && 
-                event->data.keyboard.injected) return false;
-            break;
+        if (block) {
+            if (hooks.spill.tail) {
+                hooks.spill.tail->next = block;
+            } else {
+                hooks.spill.head = block;
+            }
+            hooks.spill.tail = block;
+        }
+    }
 
-        case EVENT_MOUSE_CLICK:
-        case EVENT_MOUSE_MOVE:
-        case EVENT_MOUSE_WHEEL:
-            if (!hooks.filters.capture_mouse) return false;
-            if (hooks.filters.ignore_injected && 
-                event->data.mouse.injected) return false;
-            break;
+    if (block) {
+        memcpy(&block->events[block->count++], event, sizeof(Event));
+        hooks.spill.count++;
+        atomic_store_explicit(&hooks.spill.active, true, memory_order_release);
+        metrics_increment(METRIC_EVENTS_SPILLED);
+        metrics_increment(METRIC_EVENTS_QUEUED);
+        metrics_set_gauge(METRIC_SPILL_DEPTH, hooks.spill.count);
+        TRACE_EVENT(TRACE_KEYWORD_QUEUE, trace_enqueue(event->type, true));
+    } else {
+        metrics_increment(METRIC_EVENTS_DROPPED);
+        kept = false;
+    }
+
+    LeaveCriticalSection(&hooks.spill.lock);
+
+    // The consumer goes back to sleep only after checking the chain
+    if (kept && hooks.queue_signal) {
+        SetEvent(hooks.queue_signal);
+    }
+    return kept;
+}
+
+// Takes a block from the pool, allocating while under the memory cap.
+// Called with spill.lock held.
+static SpillBlock* acquire_spill_block(void) {
+    SpillBlock* block = hooks.spill.pool;
+    if (block) {
+        hooks.spill.pool = block->next;
+    } else if (hooks.spill.blocks < hooks.spill.max_blocks) {
+        block = (SpillBlock*)malloc(sizeof(SpillBlock));
+        if (!block) return NULL;
+        hooks.spill.blocks++;
+    } else {
+        return NULL;
+    }
+
+    block->next = NULL;
+    block->head = 0;
+    block->count = 0;
+    return block;
+}
+
+// Returns the whole chain to the pool. Called with spill.lock held.
+static void retire_spill_chain(void) {
+    while (hooks.spill.head) {
+        SpillBlock* block = hooks.spill.head;
+        hooks.spill.head = block->next;
+        block->next = hooks.spill.pool;
+        hooks.spill.pool = block;
+    }
+    hooks.spill.tail = NULL;
+    hooks.spill.count = 0;
+    atomic_store_explicit(&hooks.spill.active, false, memory_order_release);
+    metrics_set_gauge(METRIC_SPILL_DEPTH, 0);
+}
+
+// Releases the pooled memory once no producer is left
+static void free_spill_blocks(void) {
+    retire_spill_chain();
+    while (hooks.spill.pool) {
+        SpillBlock* block = hooks.spill.pool;
+        hooks.spill.pool = block->next;
+        free(block);
+    }
+    hooks.spill.blocks = 0;
+}
+
+// Consumer side of the overflow chain. Events are copied out under the
+// lock and the callback runs after it is released, so a slow callback
+// never blocks the hook thread.
+static size_t drain_spilled_events(EventCallback callback, EventBatchCallback batch_callback,
+                                   size_t max_events) {
+    Event batch[HOOK_DEFAULT_BATCH_SIZE];
+    size_t count = 0;
+
+    if (max_events > HOOK_DEFAULT_BATCH_SIZE) max_events = HOOK_DEFAULT_BATCH_SIZE;
+
+    EnterCriticalSection(&hooks.spill.lock);
+    while (count < max_events && hooks.spill.head) {
+        SpillBlock* block = hooks.spill.head;
+        if (block->head == block->count) {
+            if (block == hooks.spill.tail) break;
+            hooks.spill.head = block->next;
+            block->next = hooks.spill.pool;
+            hooks.spill.pool = block;
+            continue;
+        }
+        memcpy(&batch[count++], &block->events[block->head++], sizeof(Event));
+    }
+
+    hooks.spill.count -= count;
+    if (hooks.spill.count == 0) {
+        // Everything parked is handed out: producers go back to the ring
+        retire_spill_chain();
+    } else {
+        metrics_set_gauge(METRIC_SPILL_DEPTH, hooks.spill.count);
+    }
+    LeaveCriticalSection(&hooks.spill.lock);
+
+    if (batch_callback) {
+        if (count > 0) batch_callback(batch, count);
+    } else {
+        for (size_t i = 0; i < count; i++) {
+            callback(&batch[i]);
+        }
+    }
+    return count;
+}
+
+// Returns the event at head if a producer has published it, NULL otherwise
+static Event* peek_queued_slot(size_t head) {
+    size_t index = head & (MAX_EVENT_QUEUE - 1);
+    size_t seq = atomic_load_explicit(&hooks.event_queue.sequences[index], memory_order_acquire);
+    return seq == head + 1 ? &hooks.event_queue.events[index] : NULL;
+}
+
+// Hands a consumed slot back to the producers for the next lap
+static void release_queued_slot(size_t head) {
+    atomic_store_explicit(&hooks.event_queue.sequences[head & (MAX_EVENT_QUEUE - 1)],
+                          head + MAX_EVENT_QUEUE, memory_order_release);
+}
+
+// Consumer side of the ring. Callbacks run on the slots in place; a slot
+// is only handed back to the producers once its callback has returned.
+static bool process_queued_event(void) {
+    return process_event_batch(1) > 0;
+}
+
+// Runs the callback for up to max_events queued events and publishes the
+// new head once for the whole batch. A batch callback gets the published
+// run as is: one span, or two when the run wraps around the ring end.
+static size_t process_event_batch(size_t max_events) {
+    EventCallback callback = hooks.callback;
+    EventBatchCallback batch_callback = hooks.batch_callback;
+    if (!hooks_active || (!callback && !batch_callback)) return 0;
+
+    EventRing* ring = &hooks.event_queue;
+    size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    size_t count = 0;
+
+    if (batch_callback) {
+        while (count < max_events && peek_queued_slot(head + count)) {
+            count++;
+        }
+
+        if (count > 0) {
+            size_t first = head & (MAX_EVENT_QUEUE - 1);
+            size_t span = MAX_EVENT_QUEUE - first;
+            if (span > count) span = count;
+
+            batch_callback(&ring->events[first], span);
+            if (span < count) {
+                batch_callback(ring->events, count - span);
+            }
+            for (size_t i = 0; i < count; i++) {
+                release_queued_slot(head + i);
+            }
+        }
+    } else {
+        while (count < max_events) {
+            Event* event = peek_queued_slot(head + count);
+            if (!event) break;
+
+            callback(event);
+            release_queued_slot(head + count);
+            count++;
+        }
+    }
+
+    if (count > 0) {
+        atomic_store_explicit(&ring->head, head + count, memory_order_release);
+        metrics_set_gauge(METRIC_QUEUE_DEPTH,
+            atomic_load_explicit(&ring->tail, memory_order_relaxed) - (head + count));
+        TRACE_EVENT(TRACE_KEYWORD_QUEUE, trace_dequeue_batch(count));
+    }
+
+    // Parked overflow is newer than anything in the ring: drain it only once
+    // every claimed ring slot has been consumed
+    if (count < max_events &&
+        atomic_load_explicit(&hooks.spill.active, memory_order_acquire) &&
+        atomic_load_explicit(&ring->tail, memory_order_acquire) == head + count) {
+        count += drain_spilled_events(callback, batch_callback, max_events - count);
+    }
+    return count;
+}
+
+static void process_remaining_events(void) {
+    while (process_queued_event()) {
+        // Process all remaining events
+    }
+}
+
+// Consumer thread: drains the queue in batches and sleeps on queue_signal
+// whenever it has caught up, so an idle pipeline costs no CPU
+static DWORD WINAPI consumer_thread_proc(LPVOID param) {
+    (void)param;
+    EventRing* ring = &hooks.event_queue;
+
+    while (hooks.consumer_running) {
+        size_t processed = process_event_batch(hooks.options.batch_size);
+        if (processed == hooks.options.batch_size) {
+            continue;
+        }
+
+        // Without a callback queued events stay put: sleep until one is
+        // registered instead of finding them again and again
+        if (!hooks.callback && !hooks.batch_callback) {
+            WaitForSingleObject(hooks.queue_signal, INFINITE);
+            continue;
+        }
+
+        // Re-check after publishing head; pairs with the fence in queue_event_ex()
+        atomic_thread_fence(memory_order_seq_cst);
+        if (peek_queued_slot(atomic_load_explicit(&ring->head, memory_order_relaxed)) ||
+            atomic_load_explicit(&hooks.spill.active, memory_order_acquire)) {
+            continue;
+        }
+
+        WaitForSingleObject(hooks.queue_signal, INFINITE);
+    }
+
+    // Drain whatever arrived before shutdown was requested
+    while (process_event_batch(hooks.options.batch_size) > 0) {
+    }
+
+    HOOK_DEBUG("Consumer thread exiting");
+    return 0;
+}
+
+static bool start_consumer_thread(void) {
+    hooks.queue_signal = CreateEvent(NULL, FALSE, FALSE, NULL);
+    if (!hooks.queue_signal) {
+        return false;
+    }
+
+    hooks.consumer_running = true;
+    hooks.consumer_thread = CreateThread(NULL, 0, consumer_thread_proc, NULL, 0, NULL);
+    if (!hooks.consumer_thread) {
+        hooks.consumer_running = false;
+        CloseHandle(hooks.queue_signal);
+        hooks.queue_signal = NULL;
+        return false;
+    }
+
+    HOOK_DEBUG("Consumer thread started (batch size %zu)", hooks.options.batch_size);
+    return true;
+}
+
+static void stop_consumer_thread(void) {
+    if (!hooks.consumer_thread) return;
+
+    hooks.consumer_running = false;
+    SetEvent(hooks.queue_signal);
+    WaitForSingleObject(hooks.consumer_thread, INFINITE);
+
+    CloseHandle(hooks.consumer_thread);
+    hooks.consumer_thread = NULL;
+    CloseHandle(hooks.queue_signal);
+    hooks.queue_signal = NULL;
+}
+
+#ifdef _WIN32
+// Window tracking
+static void check_active_window(void) {
+    HWND foreground = GetForegroundWindow();
+    if (!is_valid_window(foreground)) {
+        return;
+    }
+
+    char new_title[MAX_WINDOW_TITLE] = {0};
+    GetWindowTextA(foreground, new_title, MAX_WINDOW_TITLE - 1);
+    
+    if (foreground != hooks.activeWindow || 
+        strcmp(new_title, hooks.windowTitle) != 0) {
+        DWORD processId = 0;
+        GetWindowThreadProcessId(foreground, &processId);
+        scope_namechange_hook(processId);
+
+        Event event = {0};
+        create_window_event(&event, foreground, new_title, processId);
+        queue_event(&event);
+        
+        hooks.activeWindow = foreground;
+        strncpy(hooks.windowTitle, new_title, MAX_WINDOW_TITLE - 1);
+        metrics_increment(METRIC_WINDOW_CHANGES);
+
+        // Key-ups may have gone to a window the hooks cannot see
+        atomic_store_explicit(&hooks.input_resync, true, memory_order_release);
+    }
+}
+
+// Foreground tracking via WinEvents
+// Both hooks are out-of-context and call win_event_proc from the message
+// loop of the thread that called init_hooks (the one running process_events).
+// Title changes are only watched in the foreground process.
+void CALLBACK win_event_proc(HWINEVENTHOOK hook, DWORD event, HWND hwnd,
+                             LONG idObject, LONG idChild, DWORD thread, DWORD time) {
+    (void)hook;
+    (void)thread;
+    (void)time;
+
+    if (!hooks_active || idObject != OBJID_WINDOW || idChild != CHILDID_SELF) {
+        return;
+    }
+    if (event == EVENT_OBJECT_NAMECHANGE && hwnd != hooks.activeWindow) {
+        return;
+    }
+
+    EnterCriticalSection(&hooks.lock);
+    check_active_window();
+    LeaveCriticalSection(&hooks.lock);
+}
+
+static bool install_win_event_hooks(void) {
+    hooks.foreground_hook = SetWinEventHook(
+        EVENT_SYSTEM_FOREGROUND, EVENT_SYSTEM_FOREGROUND,
+        NULL, win_event_proc, 0, 0,
+        WINEVENT_OUTOFCONTEXT | WINEVENT_SKIPOWNPROCESS);
+
+    if (!hooks.foreground_hook) {
+        HOOK_DEBUG("Failed to install foreground hook: %u", GetLastError());
+        return false;
+    }
+    return true;
+}
+
+static void remove_win_event_hooks(void) {
+    if (hooks.namechange_hook) {
+        UnhookWinEvent(hooks.namechange_hook);
+        hooks.namechange_hook = NULL;
+        hooks.namechange_pid = 0;
+    }
+
+    if (hooks.foreground_hook) {
+        UnhookWinEvent(hooks.foreground_hook);
+        hooks.foreground_hook = NULL;
+    }
+}
+
+// Moves the name change hook to the new foreground process, so title
+// changes elsewhere on the desktop never wake the tracker
+static void scope_namechange_hook(DWORD processId) {
+    if (!hooks.foreground_hook || processId == hooks.namechange_pid) {
+        return;
+    }
+
+    if (hooks.namechange_hook) {
+        UnhookWinEvent(hooks.namechange_hook);
+    }
+
+    hooks.namechange_hook = SetWinEventHook(
+        EVENT_OBJECT_NAMECHANGE, EVENT_OBJECT_NAMECHANGE,
+        NULL, win_event_proc, processId, 0,
+        WINEVENT_OUTOFCONTEXT);
+    hooks.namechange_pid = hooks.namechange_hook ? processId : 0;
+}
+
+// Installs the input backend on the calling thread, which must pump messages
+static bool install_hooks(void) {
+    if (hooks.options.backend == HOOK_BACKEND_RAW_INPUT) {
+        return install_raw_input();
+    }
+
+    hooks.keyboard = SetWindowsHookEx(
+        WH_KEYBOARD_LL,
+        keyboard_proc,
+        GetModuleHandle(NULL),
+        0
+    );
+
+    if (!hooks.keyboard) {
+        set_last_error(HOOK_ERROR_HOOK_FAILED);
+        HOOK_DEBUG("Failed to install keyboard hook: %u", GetLastError());
+        return false;
+    }
+
+    hooks.mouse = SetWindowsHookEx(
+        WH_MOUSE_LL,
+        mouse_proc,
+        GetModuleHandle(NULL),
+        0
+    );
+
+    if (!hooks.mouse) {
+        set_last_error(HOOK_ERROR_HOOK_FAILED);
+        HOOK_DEBUG("Failed to install mouse hook: %u", GetLastError());
+        remove_hooks();
+        return false;
+    }
+
+    // Verify hooks functionality by testing dummy inputs
+    if (!verify_hooks()) {
+        set_last_error(HOOK_ERROR_HOOK_FAILED);
+        HOOK_DEBUG("Hook verification failed");
+        remove_hooks();
+        return false;
+    }
+
+    // Start tracking from the current state; this is the hook proc's thread
+    atomic_store(&hooks.input_resync, false);
+    resync_input_state();
+
+    return true;
+}
+
+static void remove_hooks(void) {
+    // Emit a held move while the queue still accepts events
+    flush_pending_move();
+    if (hooks.coalesce_timer) {
+        KillTimer(NULL, hooks.coalesce_timer);
+        hooks.coalesce_timer = 0;
+    }
+
+    if (hooks.raw_input.window) {
+        remove_raw_input();
+    }
+
+    if (hooks.keyboard) {
+        UnhookWindowsHookEx(hooks.keyboard);
+        hooks.keyboard = NULL;
+    }
+
+    if (hooks.mouse) {
+        UnhookWindowsHookEx(hooks.mouse);
+        hooks.mouse = NULL;
+    }
+}
+
+// Raw input backend
+// The message-only window belongs to the thread that installs the backend
+// (the hook thread if there is one). GetRawInputBuffer() only returns the
+// packets behind the one a WM_INPUT carries, so each WM_INPUT reads its own
+// packet with GetRawInputData() first and then drains the rest of the
+// burst; the packets drained take their WM_INPUT messages with them.
+static bool install_raw_input(void) {
+    HINSTANCE instance = GetModuleHandle(NULL);
+
+    WNDCLASSEX window_class = {0};
+    window_class.cbSize = sizeof(window_class);
+    window_class.lpfnWndProc = raw_input_window_proc;
+    window_class.hInstance = instance;
+    window_class.lpszClassName = HOOK_RAW_INPUT_CLASS;
+    if (!RegisterClassEx(&window_class) && GetLastError() != ERROR_CLASS_ALREADY_EXISTS) {
+        set_last_error(HOOK_ERROR_HOOK_FAILED);
+        HOOK_DEBUG("Failed to register raw input window class: %u", GetLastError());
+        return false;
+    }
+
+    // Page aligned, as the 8-byte aligned RAWINPUT blocks require
+    hooks.raw_input.buffer = (RAWINPUT*)VirtualAlloc(NULL, HOOK_RAW_INPUT_BUFFER_SIZE,
+                                                     MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+    if (!hooks.raw_input.buffer) {
+        set_last_error(HOOK_ERROR_MEMORY);
+        UnregisterClass(HOOK_RAW_INPUT_CLASS, instance);
+        return false;
+    }
+
+    hooks.raw_input.window = CreateWindowEx(0, HOOK_RAW_INPUT_CLASS, NULL, 0, 0, 0, 0, 0,
+                                            HWND_MESSAGE, NULL, instance, NULL);
+    if (!hooks.raw_input.window) {
+        set_last_error(HOOK_ERROR_HOOK_FAILED);
+        HOOK_DEBUG("Failed to create raw input window: %u", GetLastError());
+        remove_raw_input();
+        return false;
+    }
+
+    // A 32-bit process on 64-bit Windows gets 64-bit headers from
+    // GetRawInputBuffer(), so the payload sits 8 bytes further in
+    BOOL wow64 = FALSE;
+    hooks.raw_input.header_pad = IsWow64Process(GetCurrentProcess(), &wow64) && wow64 ? 8 : 0;
+
+    // Generic desktop keyboard and mouse, also while another window has focus
+    RAWINPUTDEVICE devices[2] = {
+        { 0x01, 0x06, RIDEV_INPUTSINK, hooks.raw_input.window },
+        { 0x01, 0x02, RIDEV_INPUTSINK, hooks.raw_input.window }
+    };
+    if (!RegisterRawInputDevices(devices, 2, sizeof(RAWINPUTDEVICE))) {
+        set_last_error(HOOK_ERROR_HOOK_FAILED);
+        HOOK_DEBUG("Failed to register raw input devices: %u", GetLastError());
+        remove_raw_input();
+        return false;
+    }
+
+    // Start tracking from the current state; this is the input thread
+    atomic_store(&hooks.input_resync, false);
+    resync_input_state();
+
+    HOOK_DEBUG("Raw input backend installed");
+    return true;
+}
+
+static void remove_raw_input(void) {
+    RAWINPUTDEVICE devices[2] = {
+        { 0x01, 0x06, RIDEV_REMOVE, NULL },
+        { 0x01, 0x02, RIDEV_REMOVE, NULL }
+    };
+    RegisterRawInputDevices(devices, 2, sizeof(RAWINPUTDEVICE));
+
+    if (hooks.raw_input.window) {
+        DestroyWindow(hooks.raw_input.window);
+        hooks.raw_input.window = NULL;
+    }
+    UnregisterClass(HOOK_RAW_INPUT_CLASS, GetModuleHandle(NULL));
+
+    if (hooks.raw_input.buffer) {
+        VirtualFree(hooks.raw_input.buffer, 0, MEM_RELEASE);
+        hooks.raw_input.buffer = NULL;
+    }
+}
+
+static LRESULT CALLBACK raw_input_window_proc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam) {
+    if (msg == WM_INPUT && hooks_active) {
+        ULONGLONG entry = read_hook_clock();
+        TRACE_EVENT(TRACE_KEYWORD_HOOKS, trace_hook_enter(TRACE_HOOK_RAW_INPUT));
+        drain_raw_input((HRAWINPUT)lParam);
+        record_hook_latency(entry);
+        TRACE_EVENT(TRACE_KEYWORD_HOOKS, trace_hook_exit(TRACE_HOOK_RAW_INPUT));
+    }
+    // Also releases the WM_INPUT message's own data
+    return DefWindowProc(hwnd, msg, wParam, lParam);
+}
+
+static void drain_raw_input(HRAWINPUT current) {
+    // Mouse packets only carry deltas; one cursor read serves each batch
+    POINT cursor = {0};
+    GetCursorPos(&cursor);
+
+    // The message's own packet comes first and has no WOW64 padding
+    UINT size = HOOK_RAW_INPUT_BUFFER_SIZE;
+    RAWINPUT* raw = hooks.raw_input.buffer;
+    if (GetRawInputData(current, RID_INPUT, raw, &size, sizeof(RAWINPUTHEADER)) != (UINT)-1) {
+        if (raw->header.dwType == RIM_TYPEKEYBOARD) {
+            handle_raw_keyboard(&raw->header, &raw->data.keyboard);
+        } else if (raw->header.dwType == RIM_TYPEMOUSE) {
+            handle_raw_mouse(&raw->header, &raw->data.mouse, cursor);
+        }
+    }
+
+    for (;;) {
+        size = HOOK_RAW_INPUT_BUFFER_SIZE;
+        UINT count = GetRawInputBuffer(hooks.raw_input.buffer, &size, sizeof(RAWINPUTHEADER));
+        if (count == 0 || count == (UINT)-1) {
+            break;
+        }
+
+        GetCursorPos(&cursor);
+        raw = hooks.raw_input.buffer;
+        for (UINT i = 0; i < count; i++, raw = NEXTRAWINPUTBLOCK(raw)) {
+            const BYTE* data = (const BYTE*)&raw->data + hooks.raw_input.header_pad;
+            if (raw->header.dwType == RIM_TYPEKEYBOARD) {
+                handle_raw_keyboard(&raw->header, (const RAWKEYBOARD*)data);
+            } else if (raw->header.dwType == RIM_TYPEMOUSE) {
+                handle_raw_mouse(&raw->header, (const RAWMOUSE*)data, cursor);
+            }
+        }
+    }
+}
+
+// Raw packets name the generic modifier keys; the LL hooks, and with them
+// the input state tracker, use the left/right codes
+static DWORD raw_key_vk(const RAWKEYBOARD* kb) {
+    bool e0 = (kb->Flags & RI_KEY_E0) != 0;
+    switch (kb->VKey) {
+        case VK_SHIFT: return MapVirtualKey(kb->MakeCode, MAPVK_VSC_TO_VK_EX);
+        case VK_CONTROL: return e0 ? VK_RCONTROL : VK_LCONTROL;
+        case VK_MENU: return e0 ? VK_RMENU : VK_LMENU;
+        default: return kb->VKey;
+    }
+}
+
+// Packets without a device were injected
+static void handle_raw_keyboard(const RAWINPUTHEADER* header, const RAWKEYBOARD* kb) {
+    if (kb->VKey == 0 || kb->VKey >= 0xFF) {
+        return;  // Fake keys of E1 sequences
+    }
+
+    bool down = (kb->Flags & RI_KEY_BREAK) == 0;
+    bool injected = header->hDevice == NULL;
+    DWORD vk = raw_key_vk(kb);
+    if (!accept_key_event(vk, down, injected)) {
+        return;
+    }
+
+    Event event = {0};
+    flush_pending_move();
+    event.type = down ? EVENT_KEY_PRESS : EVENT_KEY_RELEASE;
+    create_keyboard_event(&event, vk, kb->MakeCode, (kb->Flags & RI_KEY_E0) != 0,
+                          injected, down);
+    queue_input_event(&event);
+}
+
+// One packet can carry a move, several button transitions and a wheel turn
+static void handle_raw_mouse(const RAWINPUTHEADER* header, const RAWMOUSE* mouse, POINT cursor) {
+    static const struct { USHORT flag; WORD button; bool down; } transitions[] = {
+        { RI_MOUSE_LEFT_BUTTON_DOWN, INPUT_STATE_LBUTTON, true },
+        { RI_MOUSE_LEFT_BUTTON_UP, INPUT_STATE_LBUTTON, false },
+        { RI_MOUSE_RIGHT_BUTTON_DOWN, INPUT_STATE_RBUTTON, true },
+        { RI_MOUSE_RIGHT_BUTTON_UP, INPUT_STATE_RBUTTON, false },
+        { RI_MOUSE_MIDDLE_BUTTON_DOWN, INPUT_STATE_MBUTTON, true },
+        { RI_MOUSE_MIDDLE_BUTTON_UP, INPUT_STATE_MBUTTON, false }
+    };
+    bool injected = header->hDevice == NULL;
+    POINT position = cursor;
+    Event event;
+
+    // Tablets and remote sessions report absolute 0..65535 coordinates
+    bool absolute = (mouse->usFlags & MOUSE_MOVE_ABSOLUTE) != 0;
+    if (absolute) {
+        bool desktop = (mouse->usFlags & MOUSE_VIRTUAL_DESKTOP) != 0;
+        int left = desktop ? GetSystemMetrics(SM_XVIRTUALSCREEN) : 0;
+        int top = desktop ? GetSystemMetrics(SM_YVIRTUALSCREEN) : 0;
+        int width = GetSystemMetrics(desktop ? SM_CXVIRTUALSCREEN : SM_CXSCREEN);
+        int height = GetSystemMetrics(desktop ? SM_CYVIRTUALSCREEN : SM_CYSCREEN);
+        position.x = left + (LONG)((LONGLONG)mouse->lLastX * width / 65536);
+        position.y = top + (LONG)((LONGLONG)mouse->lLastY * height / 65536);
+    }
+
+    if ((absolute || mouse->lLastX != 0 || mouse->lLastY != 0) &&
+        accept_mouse_event(EVENT_MOUSE_MOVE, 0, false, injected)) {
+        memset(&event, 0, sizeof(event));
+        create_mouse_event(&event, EVENT_MOUSE_MOVE, 0, false, position, 0, injected);
+        coalesce_mouse_move(&event);
+    }
+
+    for (size_t i = 0; i < sizeof(transitions) / sizeof(transitions[0]); i++) {
+        if ((mouse->usButtonFlags & transitions[i].flag) &&
+            accept_mouse_event(EVENT_MOUSE_CLICK, transitions[i].button,
+                               transitions[i].down, injected)) {
+            memset(&event, 0, sizeof(event));
+            create_mouse_event(&event, EVENT_MOUSE_CLICK, transitions[i].button,
+                               transitions[i].down, position, 0, injected);
+            flush_pending_move();
+            queue_input_event(&event);
+        }
+    }
+
+    if ((mouse->usButtonFlags & RI_MOUSE_WHEEL) &&
+        accept_mouse_event(EVENT_MOUSE_WHEEL, 0, false, injected)) {
+        memset(&event, 0, sizeof(event));
+        create_mouse_event(&event, EVENT_MOUSE_WHEEL, 0, false, position,
+                           (short)mouse->usButtonData, injected);
+        flush_pending_move();
+        queue_input_event(&event);
+    }
+}
+
+// Hook thread: owns the input backend and does nothing but run the message
+// loop that delivers its input, so nothing else can delay input for the desktop
+static DWORD WINAPI hook_thread_proc(LPVOID param) {
+    bool* installed = (bool*)param;
+    MSG msg;
+
+    // Force creation of the message queue before anyone can post WM_QUIT
+    PeekMessage(&msg, NULL, 0, 0, PM_NOREMOVE);
+
+    // installed lives in start_hook_thread(), which returns once it is set
+    bool ok = install_hooks();
+    *installed = ok;
+    SetEvent(hooks.hook_ready);
+    if (!ok) {
+        return 1;
+    }
+
+    while (GetMessage(&msg, NULL, 0, 0) > 0) {
+        TranslateMessage(&msg);
+        DispatchMessage(&msg);
+    }
+
+    remove_hooks();
+    HOOK_DEBUG("Hook thread exiting");
+    return 0;
+}
+#endif
+
+static bool start_hook_thread(void) {
+    bool installed = false;
+
+    hooks.hook_ready = CreateEvent(NULL, TRUE, FALSE, NULL);
+    if (!hooks.hook_ready) {
+        set_last_error(HOOK_ERROR_INIT_FAILED);
+        return false;
+    }
+
+    hooks.hook_thread = CreateThread(NULL, 0, hook_thread_proc, &installed,
+                                     0, &hooks.hook_thread_id);
+    if (!hooks.hook_thread) {
+        set_last_error(HOOK_ERROR_INIT_FAILED);
+        CloseHandle(hooks.hook_ready);
+        hooks.hook_ready = NULL;
+        return false;
+    }
+    SetThreadPriority(hooks.hook_thread, HOOK_THREAD_PRIORITY);
+
+    // The thread reports back once the hooks are installed (or failed to)
+    WaitForSingleObject(hooks.hook_ready, INFINITE);
+    CloseHandle(hooks.hook_ready);
+    hooks.hook_ready = NULL;
+
+    if (!installed) {
+        stop_hook_thread();
+        return false;
+    }
+
+    HOOK_DEBUG("Hook thread started (id %lu)", (unsigned long)hooks.hook_thread_id);
+    return true;
+}
+
+#ifdef _WIN32
+static void stop_hook_thread(void) {
+    if (!hooks.hook_thread) return;
+
+    PostThreadMessage(hooks.hook_thread_id, WM_QUIT, 0, 0);
+    WaitForSingleObject(hooks.hook_thread, INFINITE);
+
+    CloseHandle(hooks.hook_thread);
+    hooks.hook_thread = NULL;
+    hooks.hook_thread_id = 0;
+}
+
+static bool verify_hooks(void) {
+    if (!hooks.keyboard || !hooks.mouse) {
+        return false;
+    }
+
+    // Test keyboard hook
+    INPUT input = {0};
+    input.type = INPUT_KEYBOARD;
+    input.ki.wVk = VK_SCROLL;
+    
+    if (!SendInput(1, &input, sizeof(INPUT))) {
+        HOOK_DEBUG("Failed to verify keyboard hook");
+        return false;
+    }
+
+    return true;
+}
+
+#else
+
+// Evdev backend
+// Keyboards and relative pointers are opened once, non-blocking, when the
+// backend is installed and share one epoll set with the wake eventfd. Each
+// wakeup reads the ready devices HOOK_EVDEV_READ_EVENTS records at a time
+// until they would block. Devices plugged in later are not picked up; one
+// that goes away is closed.
+
+// Linux key codes to Windows virtual-key and set 1 scan codes, so logs look
+// the same on both platforms; keys without an entry are skipped
+static const struct { BYTE vk; BYTE scan; bool extended; } evdev_keys[KEY_STOPCD + 1] = {
+    [KEY_ESC] = { 0x1B, 0x01, false },
+    [KEY_1] = { '1', 0x02, false }, [KEY_2] = { '2', 0x03, false },
+    [KEY_3] = { '3', 0x04, false }, [KEY_4] = { '4', 0x05, false },
+    [KEY_5] = { '5', 0x06, false }, [KEY_6] = { '6', 0x07, false },
+    [KEY_7] = { '7', 0x08, false }, [KEY_8] = { '8', 0x09, false },
+    [KEY_9] = { '9', 0x0A, false }, [KEY_0] = { '0', 0x0B, false },
+    [KEY_MINUS] = { 0xBD, 0x0C, false }, [KEY_EQUAL] = { 0xBB, 0x0D, false },
+    [KEY_BACKSPACE] = { 0x08, 0x0E, false }, [KEY_TAB] = { 0x09, 0x0F, false },
+    [KEY_Q] = { 'Q', 0x10, false }, [KEY_W] = { 'W', 0x11, false },
+    [KEY_E] = { 'E', 0x12, false }, [KEY_R] = { 'R', 0x13, false },
+    [KEY_T] = { 'T', 0x14, false }, [KEY_Y] = { 'Y', 0x15, false },
+    [KEY_U] = { 'U', 0x16, false }, [KEY_I] = { 'I', 0x17, false },
+    [KEY_O] = { 'O', 0x18, false }, [KEY_P] = { 'P', 0x19, false },
+    [KEY_LEFTBRACE] = { 0xDB, 0x1A, false }, [KEY_RIGHTBRACE] = { 0xDD, 0x1B, false },
+    [KEY_ENTER] = { 0x0D, 0x1C, false }, [KEY_LEFTCTRL] = { VK_LCONTROL, 0x1D, false },
+    [KEY_A] = { 'A', 0x1E, false }, [KEY_S] = { 'S', 0x1F, false },
+    [KEY_D] = { 'D', 0x20, false }, [KEY_F] = { 'F', 0x21, false },
+    [KEY_G] = { 'G', 0x22, false }, [KEY_H] = { 'H', 0x23, false },
+    [KEY_J] = { 'J', 0x24, false }, [KEY_K] = { 'K', 0x25, false },
+    [KEY_L] = { 'L', 0x26, false }, [KEY_SEMICOLON] = { 0xBA, 0x27, false },
+    [KEY_APOSTROPHE] = { 0xDE, 0x28, false }, [KEY_GRAVE] = { 0xC0, 0x29, false },
+    [KEY_LEFTSHIFT] = { VK_LSHIFT, 0x2A, false }, [KEY_BACKSLASH] = { 0xDC, 0x2B, false },
+    [KEY_Z] = { 'Z', 0x2C, false }, [KEY_X] = { 'X', 0x2D, false },
+    [KEY_C] = { 'C', 0x2E, false }, [KEY_V] = { 'V', 0x2F, false },
+    [KEY_B] = { 'B', 0x30, false }, [KEY_N] = { 'N', 0x31, false },
+    [KEY_M] = { 'M', 0x32, false }, [KEY_COMMA] = { 0xBC, 0x33, false },
+    [KEY_DOT] = { 0xBE, 0x34, false }, [KEY_SLASH] = { 0xBF, 0x35, false },
+    [KEY_RIGHTSHIFT] = { VK_RSHIFT, 0x36, false }, [KEY_KPASTERISK] = { 0x6A, 0x37, false },
+    [KEY_LEFTALT] = { VK_LMENU, 0x38, false }, [KEY_SPACE] = { 0x20, 0x39, false },
+    [KEY_CAPSLOCK] = { 0x14, 0x3A, false },
+    [KEY_F1] = { 0x70, 0x3B, false }, [KEY_F2] = { 0x71, 0x3C, false },
+    [KEY_F3] = { 0x72, 0x3D, false }, [KEY_F4] = { 0x73, 0x3E, false },
+    [KEY_F5] = { 0x74, 0x3F, false }, [KEY_F6] = { 0x75, 0x40, false },
+    [KEY_F7] = { 0x76, 0x41, false }, [KEY_F8] = { 0x77, 0x42, false },
+    [KEY_F9] = { 0x78, 0x43, false }, [KEY_F10] = { 0x79, 0x44, false },
+    [KEY_NUMLOCK] = { 0x90, 0x45, true }, [KEY_SCROLLLOCK] = { 0x91, 0x46, false },
+    [KEY_KP7] = { 0x67, 0x47, false }, [KEY_KP8] = { 0x68, 0x48, false },
+    [KEY_KP9] = { 0x69, 0x49, false }, [KEY_KPMINUS] = { 0x6D, 0x4A, false },
+    [KEY_KP4] = { 0x64, 0x4B, false }, [KEY_KP5] = { 0x65, 0x4C, false },
+    [KEY_KP6] = { 0x66, 0x4D, false }, [KEY_KPPLUS] = { 0x6B, 0x4E, false },
+    [KEY_KP1] = { 0x61, 0x4F, false }, [KEY_KP2] = { 0x62, 0x50, false },
+    [KEY_KP3] = { 0x63, 0x51, false }, [KEY_KP0] = { 0x60, 0x52, false },
+    [KEY_KPDOT] = { 0x6E, 0x53, false }, [KEY_102ND] = { 0xE2, 0x56, false },
+    [KEY_F11] = { 0x7A, 0x57, false }, [KEY_F12] = { 0x7B, 0x58, false },
+    [KEY_KPENTER] = { 0x0D, 0x1C, true }, [KEY_RIGHTCTRL] = { VK_RCONTROL, 0x1D, true },
+    [KEY_KPSLASH] = { 0x6F, 0x35, true }, [KEY_SYSRQ] = { 0x2C, 0x37, true },
+    [KEY_RIGHTALT] = { VK_RMENU, 0x38, true }, [KEY_HOME] = { 0x24, 0x47, true },
+    [KEY_UP] = { 0x26, 0x48, true }, [KEY_PAGEUP] = { 0x21, 0x49, true },
+    [KEY_LEFT] = { 0x25, 0x4B, true }, [KEY_RIGHT] = { 0x27, 0x4D, true },
+    [KEY_END] = { 0x23, 0x4F, true }, [KEY_DOWN] = { 0x28, 0x50, true },
+    [KEY_PAGEDOWN] = { 0x22, 0x51, true }, [KEY_INSERT] = { 0x2D, 0x52, true },
+    [KEY_DELETE] = { 0x2E, 0x53, true }, [KEY_MUTE] = { 0xAD, 0x20, true },
+    [KEY_VOLUMEDOWN] = { 0xAE, 0x2E, true }, [KEY_VOLUMEUP] = { 0xAF, 0x30, true },
+    [KEY_PAUSE] = { 0x13, 0x45, false }, [KEY_LEFTMETA] = { VK_LWIN, 0x5B, true },
+    [KEY_RIGHTMETA] = { VK_RWIN, 0x5C, true }, [KEY_COMPOSE] = { 0x5D, 0x5D, true },
+    [KEY_NEXTSONG] = { 0xB0, 0x19, true }, [KEY_PLAYPAUSE] = { 0xB3, 0x22, true },
+    [KEY_PREVIOUSSONG] = { 0xB1, 0x10, true }, [KEY_STOPCD] = { 0xB2, 0x24, true }
+};
+
+// Installs the input backend; the calling thread must keep calling
+// poll_evdev() (the hook thread, or process_events())
+static bool install_hooks(void) {
+    hooks.evdev.device_count = 0;
+    hooks.evdev.position.x = 0;
+    hooks.evdev.position.y = 0;
+
+    hooks.evdev.epoll = epoll_create1(EPOLL_CLOEXEC);
+    if (hooks.evdev.epoll < 0) {
+        set_last_error(HOOK_ERROR_INIT_FAILED);
+        HOOK_DEBUG("Failed to create epoll set: %s", strerror(errno));
+        return false;
+    }
 
-        case EVENT_WINDOW_CHANGE:
-            if (!hooks.filters.capture_window_changes) return false;
+    struct epoll_event wake = { .events = EPOLLIN, .data.u32 = EVDEV_WAKE_INDEX };
+    hooks.evdev.wake = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (hooks.evdev.wake < 0 ||
+        epoll_ctl(hooks.evdev.epoll, EPOLL_CTL_ADD, hooks.evdev.wake, &wake) != 0) {
+        set_last_error(HOOK_ERROR_INIT_FAILED);
+        HOOK_DEBUG("Failed to set up the wake eventfd: %s", strerror(errno));
+        remove_hooks();
+        return false;
+    }
+
+    DIR* dir = opendir(HOOK_EVDEV_DIR);
+    if (dir) {
+        struct dirent* entry;
+        char path[sizeof(HOOK_EVDEV_DIR) + sizeof(entry->d_name)];
+        while ((entry = readdir(dir)) && hooks.evdev.device_count < HOOK_EVDEV_MAX_DEVICES) {
+            if (strncmp(entry->d_name, "event", 5) == 0) {
+                snprintf(path, sizeof(path), "%s/%s", HOOK_EVDEV_DIR, entry->d_name);
+                open_evdev_device(path);
+            }
+        }
+        closedir(dir);
+    }
+
+    if (hooks.evdev.device_count == 0) {
+        set_last_error(HOOK_ERROR_HOOK_FAILED);
+        HOOK_DEBUG("No readable keyboard or mouse under %s", HOOK_EVDEV_DIR);
+        remove_hooks();
+        return false;
+    }
+
+    // Start tracking from the current state; this is the input thread
+    atomic_store(&hooks.input_resync, false);
+    resync_input_state();
+
+    HOOK_DEBUG("Evdev backend installed (%zu devices)", hooks.evdev.device_count);
+    return true;
+}
+
+static void remove_hooks(void) {
+    // Emit a held move while the queue still accepts events
+    flush_pending_move();
+
+    for (size_t i = 0; i < hooks.evdev.device_count; i++) {
+        close_evdev_device(i);
+    }
+    hooks.evdev.device_count = 0;
+
+    if (hooks.evdev.wake >= 0) {
+        close(hooks.evdev.wake);
+        hooks.evdev.wake = -1;
+    }
+    if (hooks.evdev.epoll >= 0) {
+        close(hooks.evdev.epoll);
+        hooks.evdev.epoll = -1;
+    }
+}
+
+// Keeps keyboards (letter keys) and relative pointers (X/Y motion and a left
+// button); touchpads, tablets, joysticks and power buttons are closed again
+static bool open_evdev_device(const char* path) {
+    int fd = open(path, O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+    if (fd < 0) {
+        HOOK_DEBUG("Cannot open %s: %s", path, strerror(errno));
+        return false;
+    }
+
+    unsigned long types[EVDEV_BITS_LONGS(EV_MAX + 1)] = {0};
+    unsigned long keys[EVDEV_BITS_LONGS(KEY_MAX + 1)] = {0};
+    unsigned long axes[EVDEV_BITS_LONGS(REL_MAX + 1)] = {0};
+    ioctl(fd, EVIOCGBIT(0, sizeof(types)), types);
+    ioctl(fd, EVIOCGBIT(EV_KEY, sizeof(keys)), keys);
+    ioctl(fd, EVIOCGBIT(EV_REL, sizeof(axes)), axes);
+
+    bool keyboard = EVDEV_TEST_BIT(types, EV_KEY) && EVDEV_TEST_BIT(keys, KEY_A) &&
+                    EVDEV_TEST_BIT(keys, KEY_SPACE);
+    bool mouse = EVDEV_TEST_BIT(types, EV_REL) && EVDEV_TEST_BIT(axes, REL_X) &&
+                 EVDEV_TEST_BIT(axes, REL_Y) && EVDEV_TEST_BIT(keys, BTN_LEFT);
+    if (!keyboard && !mouse) {
+        close(fd);
+        return false;
+    }
+
+    size_t index = hooks.evdev.device_count;
+    struct epoll_event ready = { .events = EPOLLIN, .data.u32 = (uint32_t)index };
+    if (epoll_ctl(hooks.evdev.epoll, EPOLL_CTL_ADD, fd, &ready) != 0) {
+        HOOK_DEBUG("Cannot watch %s: %s", path, strerror(errno));
+        close(fd);
+        return false;
+    }
+
+    struct input_id id = {0};
+    ioctl(fd, EVIOCGID, &id);
+
+    HookEvdevDevice* device = &hooks.evdev.devices[index];
+    device->fd = fd;
+    device->injected = id.bustype == BUS_VIRTUAL;
+    device->dropped = false;
+    device->dx = 0;
+    device->dy = 0;
+    hooks.evdev.device_count++;
+
+    HOOK_DEBUG("Reading %s (%s%s%s)", path, keyboard ? "keyboard" : "",
+               keyboard && mouse ? ", " : "", mouse ? "mouse" : "");
+    return true;
+}
+
+// Closing the fd also takes it out of the epoll set
+static void close_evdev_device(size_t index) {
+    HookEvdevDevice* device = &hooks.evdev.devices[index];
+    if (device->fd >= 0) {
+        close(device->fd);
+        device->fd = -1;
+    }
+}
+
+// Waits up to timeout ms (-1 = until input) and reads every ready device.
+// Returns false once stop_hook_thread() has signaled the wake eventfd.
+static bool poll_evdev(int timeout) {
+    struct epoll_event ready[HOOK_EVDEV_MAX_DEVICES + 1];
+    bool running = true;
+
+    int count = epoll_wait(hooks.evdev.epoll, ready, HOOK_EVDEV_MAX_DEVICES + 1, timeout);
+    if (count < 0 && errno != EINTR) {
+        HOOK_DEBUG("epoll_wait failed: %s", strerror(errno));
+        return false;
+    }
+
+    for (int i = 0; i < count; i++) {
+        if (ready[i].data.u32 == EVDEV_WAKE_INDEX) {
+            running = false;
+        } else {
+            read_evdev_device(ready[i].data.u32);
+        }
+    }
+
+    // Idle flush of a held move, coalesce_timer_proc() on Windows
+    if (hooks.move_pending && evdev_idle_timeout() == 0) {
+        flush_pending_move();
+    }
+    return running;
+}
+
+// Milliseconds until a held move is due (-1 = none held): the end of its
+// time window, or HOOK_COALESCE_IDLE_FLUSH after the last merged move
+static int evdev_idle_timeout(void) {
+    if (!hooks.move_pending) return -1;
+
+    DWORD coalesce_ms = get_move_coalesce_ms();
+    ULONGLONG deadline = coalesce_ms
+        ? hooks.move_start_time + (ULONGLONG)coalesce_ms * TIMESTAMP_TICKS_PER_MS
+        : hooks.pending_move.timestamp + (ULONGLONG)HOOK_COALESCE_IDLE_FLUSH * TIMESTAMP_TICKS_PER_MS;
+    ULONGLONG now = get_precise_time();
+    if (now >= deadline) return 0;
+    return (int)((deadline - now + TIMESTAMP_TICKS_PER_MS - 1) / TIMESTAMP_TICKS_PER_MS);
+}
+
+// Reads whole batches until the device is drained; evdev hands out as many
+// complete records as are queued, so a short read means nothing is left
+static void read_evdev_device(size_t index) {
+    struct input_event batch[HOOK_EVDEV_READ_EVENTS];
+    int fd = hooks.evdev.devices[index].fd;
+    if (fd < 0) return;
+
+    for (;;) {
+        ssize_t bytes = read(fd, batch, sizeof(batch));
+        if (bytes < 0 && errno == EINTR) {
+            continue;
+        }
+        if (bytes <= 0) {
+            // ENODEV once the device is unplugged
+            if (bytes == 0 || errno != EAGAIN) {
+                HOOK_DEBUG("Device %zu gone: %s", index, bytes ? strerror(errno) : "EOF");
+                close_evdev_device(index);
+            }
+            return;
+        }
+
+        ULONGLONG entry = read_hook_clock();
+        size_t count = (size_t)bytes / sizeof(struct input_event);
+        for (size_t i = 0; i < count; i++) {
+            handle_evdev_event(index, &batch[i]);
+        }
+        record_hook_latency(entry);
+
+        if (count < HOOK_EVDEV_READ_EVENTS) return;
+    }
+}
+
+// Events carry the kernel's timestamp: when the device reported the input,
+// not when this thread got around to reading it
+static void handle_evdev_event(size_t index, const struct input_event* input) {
+    HookEvdevDevice* device = &hooks.evdev.devices[index];
+    ULONGLONG timestamp = evdev_timestamp(input);
+    Event event = {0};
+
+    // After SYN_DROPPED the rest of the report is unreliable; skip it and
+    // re-read the key state from the kernel
+    if (device->dropped) {
+        if (input->type == EV_SYN && input->code == SYN_REPORT) {
+            device->dropped = false;
+        }
+        return;
+    }
+
+    switch (input->type) {
+        case EV_SYN:
+            if (input->code == SYN_REPORT) {
+                flush_evdev_motion(index, timestamp);
+            } else if (input->code == SYN_DROPPED) {
+                HOOK_DEBUG("Device %zu dropped events", index);
+                device->dropped = true;
+                device->dx = 0;
+                device->dy = 0;
+                atomic_store_explicit(&hooks.input_resync, true, memory_order_release);
+            }
+            break;
+
+        case EV_REL:
+            if (input->code == REL_X) {
+                device->dx += input->value;
+            } else if (input->code == REL_Y) {
+                device->dy += input->value;
+            } else if (input->code == REL_WHEEL && input->value != 0) {
+                flush_evdev_motion(index, timestamp);
+                if (!accept_mouse_event(EVENT_MOUSE_WHEEL, 0, false, device->injected)) break;
+                create_mouse_event(&event, EVENT_MOUSE_WHEEL, 0, false, hooks.evdev.position,
+                                   (short)(input->value * WHEEL_DELTA), device->injected);
+                event.timestamp = timestamp;
+                flush_pending_move();
+                queue_input_event(&event);
+            }
+            break;
+
+        case EV_KEY: {
+            WORD button = input->code == BTN_LEFT ? INPUT_STATE_LBUTTON :
+                          input->code == BTN_RIGHT ? INPUT_STATE_RBUTTON :
+                          input->code == BTN_MIDDLE ? INPUT_STATE_MBUTTON : 0;
+            if (button) {
+                // Motion earlier in the report happened before the click
+                flush_evdev_motion(index, timestamp);
+                if (!accept_mouse_event(EVENT_MOUSE_CLICK, button, input->value != 0,
+                                        device->injected)) break;
+                create_mouse_event(&event, EVENT_MOUSE_CLICK, button, input->value != 0,
+                                   hooks.evdev.position, 0, device->injected);
+                event.timestamp = timestamp;
+                flush_pending_move();
+                queue_input_event(&event);
+            } else if (input->code < sizeof(evdev_keys) / sizeof(evdev_keys[0]) &&
+                       evdev_keys[input->code].vk != 0) {
+                // Autorepeat (value 2) is another press, like a repeated WM_KEYDOWN
+                bool down = input->value != 0;
+                if (!accept_key_event(evdev_keys[input->code].vk, down, device->injected)) break;
+                flush_pending_move();
+                event.type = down ? EVENT_KEY_PRESS : EVENT_KEY_RELEASE;
+                create_keyboard_event(&event, evdev_keys[input->code].vk,
+                                      evdev_keys[input->code].scan,
+                                      evdev_keys[input->code].extended, device->injected, down);
+                event.timestamp = timestamp;
+                queue_input_event(&event);
+            }
             break;
+        }
+    }
+}
+
+// Emits the motion of the report read so far as one move
+static void flush_evdev_motion(size_t index, ULONGLONG timestamp) {
+    HookEvdevDevice* device = &hooks.evdev.devices[index];
+    if (device->dx == 0 && device->dy == 0) return;
+
+    hooks.evdev.position.x += device->dx;
+    hooks.evdev.position.y += device->dy;
+    device->dx = 0;
+    device->dy = 0;
+    if (!accept_mouse_event(EVENT_MOUSE_MOVE, 0, false, device->injected)) return;
+
+    Event event = {0};
+    create_mouse_event(&event, EVENT_MOUSE_MOVE, 0, false, hooks.evdev.position, 0,
+                       device->injected);
+    event.timestamp = timestamp;
+    coalesce_mouse_move(&event);
+}
+
+// Kernel time is CLOCK_REALTIME unless a reader asked for another clock
+static ULONGLONG evdev_timestamp(const struct input_event* input) {
+#ifdef input_event_sec
+    ULONGLONG seconds = (ULONGLONG)input->input_event_sec;
+    ULONGLONG microseconds = (ULONGLONG)input->input_event_usec;
+#else
+    ULONGLONG seconds = (ULONGLONG)input->time.tv_sec;
+    ULONGLONG microseconds = (ULONGLONG)input->time.tv_usec;
+#endif
+    return EVDEV_EPOCH_OFFSET + seconds * TIMESTAMP_TICKS_PER_SECOND + microseconds * 10;
+}
+
+// The kernel keeps the pressed keys and buttons of every device
+static void resync_input_state(void) {
+    static const struct { int code; WORD bit; } keys[] = {
+        { KEY_LEFTSHIFT, INPUT_STATE_LSHIFT }, { KEY_RIGHTSHIFT, INPUT_STATE_RSHIFT },
+        { KEY_LEFTCTRL, INPUT_STATE_LCONTROL }, { KEY_RIGHTCTRL, INPUT_STATE_RCONTROL },
+        { KEY_LEFTALT, INPUT_STATE_LALT }, { KEY_RIGHTALT, INPUT_STATE_RALT },
+        { KEY_LEFTMETA, INPUT_STATE_LWIN }, { KEY_RIGHTMETA, INPUT_STATE_RWIN },
+        { BTN_LEFT, INPUT_STATE_LBUTTON }, { BTN_RIGHT, INPUT_STATE_RBUTTON },
+        { BTN_MIDDLE, INPUT_STATE_MBUTTON }
+    };
+    WORD state = 0;
+
+    for (size_t d = 0; d < hooks.evdev.device_count; d++) {
+        unsigned long pressed[EVDEV_BITS_LONGS(KEY_MAX + 1)] = {0};
+        int fd = hooks.evdev.devices[d].fd;
+        if (fd < 0 || ioctl(fd, EVIOCGKEY(sizeof(pressed)), pressed) < 0) {
+            continue;
+        }
+        for (size_t i = 0; i < sizeof(keys) / sizeof(keys[0]); i++) {
+            if (EVDEV_TEST_BIT(pressed, keys[i].code)) {
+                state |= keys[i].bit;
+            }
+        }
+    }
+    hooks.input_state = state;
+}
+
+// Hook thread: reads the devices and sleeps in epoll_wait() between
+// reports, or until a held move is due
+static DWORD WINAPI hook_thread_proc(LPVOID param) {
+    bool* installed = (bool*)param;
+
+    // installed lives in start_hook_thread(), which returns once it is set
+    bool ok = install_hooks();
+    *installed = ok;
+    SetEvent(hooks.hook_ready);
+    if (!ok) {
+        return 1;
+    }
+
+    while (poll_evdev(evdev_idle_timeout())) {
+    }
+
+    HOOK_DEBUG("Hook thread exiting");
+    return 0;
+}
+
+static void stop_hook_thread(void) {
+    if (!hooks.hook_thread) return;
+
+    uint64_t wake = 1;
+    if (hooks.evdev.wake >= 0 && write(hooks.evdev.wake, &wake, sizeof(wake)) != sizeof(wake)) {
+        HOOK_DEBUG("Failed to wake the hook thread: %s", strerror(errno));
+    }
+    WaitForSingleObject(hooks.hook_thread, INFINITE);
+
+    CloseHandle(hooks.hook_thread);
+    hooks.hook_thread = NULL;
+    hooks.hook_thread_id = 0;
+
+    // Unlike hooks, descriptors are not tied to a thread; closing them here
+    // keeps the wake eventfd open until the thread can no longer be woken
+    remove_hooks();
+}
+
+#endif
+
+// Whether process_events() finds work nobody wakes its thread for: the
+// foreground window without WinEvent hooks, the devices without a hook
+// thread, or the queue without a consumer thread
+bool hooks_need_polling(void) {
+    if (!hooks_active) return false;
+    if (!hooks.consumer_thread) return true;
+    if (hooks.options.synthetic_input) return false;
+#ifdef _WIN32
+    return !hooks.foreground_hook;
+#else
+    return !hooks.hook_thread;
+#endif
+}
+
+bool process_events(void) {
+    if (!hooks_active) {
+        HOOK_DEBUG("Hooks are not active");
+        return false;
+    }
+
+    EnterCriticalSection(&hooks.lock);
+
+#ifdef _WIN32
+    // Without WinEvent hooks the foreground window has to be polled
+    if (!hooks.foreground_hook && !hooks.options.synthetic_input) {
+        check_active_window();
+    }
+
+    // Pump this thread's messages; this delivers the WinEvent hooks, and
+    // the LL hooks unless they run on the dedicated hook thread
+    MSG msg;
+    while (PeekMessage(&msg, NULL, 0, 0, PM_REMOVE)) {
+        TranslateMessage(&msg);
+        DispatchMessage(&msg);
+    }
+#else
+    // Without a hook thread the devices are read here, without blocking
+    if (!hooks.hook_thread && !hooks.options.synthetic_input) {
+        poll_evdev(0);
+    }
+#endif
+
+    // In pipeline mode the consumer thread drains the queue
+    if (!hooks.consumer_thread) {
+        while (process_queued_event()) {
+            HOOK_DEBUG("Processed an event from the queue");
+        }
+    }
+
+    LeaveCriticalSection(&hooks.lock);
+    return true;
+}
+
+
+// Utility functions
+// Queues an event as if a hook had produced it (synthetic input, replay)
+bool submit_hook_event(const Event* event) {
+    return queue_event(event);
+}
+
+static bool init_critical_section(void) {
+    InitializeCriticalSection(&hooks.lock);
+    InitializeCriticalSection(&hooks.filter_lock);
+    InitializeCriticalSection(&hooks.spill.lock);
+    return true;
+}
+
+static void cleanup_critical_section(void) {
+    if (hooks.lock.DebugInfo) {
+        DeleteCriticalSection(&hooks.lock);
+        DeleteCriticalSection(&hooks.filter_lock);
+        DeleteCriticalSection(&hooks.spill.lock);
+    }
+}
+
+#ifdef _WIN32
+static bool is_valid_window(HWND hwnd) {
+    return hwnd != NULL && IsWindow(hwnd) && IsWindowVisible(hwnd);
+}
+#endif
+
+static void set_last_error(DWORD error_code) {
+    last_error = error_code;
+    HOOK_DEBUG("Hook error set: %u", error_code);
+}
+
+
+// Event filtering
+// One lookup in the compiled table. The backends already checked their
+// input (accept_key_event(), accept_mouse_event()) and queue it with
+// queue_input_event(); this covers window changes and submit_hook_event().
+static bool should_process_event(const Event* event) {
+    if (!event) return false;
+
+    size_t phase = enter_filter_check();
+    bool passes = filter_passes_event(get_filter_table(), event);
+    leave_filter_check(phase);
+    return passes;
+}
+
+static bool filter_passes_event(const HookFilterTable* table, const Event* event) {
+    InternId foreground = atomic_load_explicit(&hooks.foreground_process, memory_order_relaxed);
+
+    switch (event->type) {
+        case EVENT_KEY_PRESS:
+        case EVENT_KEY_RELEASE:
+            return !table ||
+                   (filter_passes_key(table, event->data.keyboard.vkCode,
+                                      event->type == EVENT_KEY_PRESS,
+                                      event->data.keyboard.injected) &&
+                    filter_passes_process(table, foreground));
+
+        case EVENT_MOUSE_CLICK:
+        case EVENT_MOUSE_MOVE:
+        case EVENT_MOUSE_WHEEL:
+            return !table ||
+                   (filter_passes_type(table, event->type, event->data.mouse.injected) &&
+                    filter_passes_process(table, foreground));
+
+        case EVENT_WINDOW_CHANGE:
+            return !table ||
+                   (filter_passes_type(table, event->type, false) &&
+                    filter_passes_process(table, event->data.window.processNameId));
 
         case EVENT_ERROR:
             return true;  // Always process error events
@@ -463,8 +2222,140 @@ static bool should_process_event(const Event* event) {
         default:
             return false;
     }
+}
 
-    return true;
+// Replaced tables are freed as soon as the checks that may still read them
+// are done. Each check counts itself under the current phase for as long
+// as it uses the table; set_hook_filters() flips the phase twice after the
+// swap and waits for each count in turn to drain, so new checks never
+// keep it waiting. Updaters hold hooks.filter_lock from the swap to the
+// free: two overlapping waits would share the phase counter, and each
+// could see a flip the other made instead of the two it needs. The counts and the table pointer are sequentially
+// consistent: a check that loaded the old table was counted before the
+// swap and is still counted when its phase is waited for.
+static size_t enter_filter_check(void) {
+    size_t phase = atomic_load(&hooks.filter_phase) & 1;
+    atomic_fetch_add(&hooks.filter_checks[phase], 1);
+    return phase;
+}
+
+static void leave_filter_check(size_t phase) {
+    atomic_fetch_sub_explicit(&hooks.filter_checks[phase], 1, memory_order_release);
+}
+
+static void wait_for_filter_checks(void) {
+    for (int i = 0; i < 2; i++) {
+        size_t phase = atomic_fetch_add(&hooks.filter_phase, 1) & 1;
+        while (atomic_load(&hooks.filter_checks[phase]) != 0) {
+            YieldProcessor();
+        }
+    }
+}
+
+// Only valid between enter_filter_check() and leave_filter_check()
+static const HookFilterTable* get_filter_table(void) {
+    return atomic_load(&hooks.filter_table);
+}
+
+// Bit vk | release << 8 | injected << 9; codes past the bitmap only go by type
+static bool filter_passes_key(const HookFilterTable* table, DWORD vk, bool down, bool injected) {
+    if (vk > 0xFF) {
+        return filter_passes_type(table, down ? EVENT_KEY_PRESS : EVENT_KEY_RELEASE, injected);
+    }
+    DWORD bit = vk | (down ? 0 : 0x100) | (injected ? 0x200 : 0);
+    return (table->keys[bit >> 3] >> (bit & 7)) & 1;
+}
+
+static bool filter_passes_type(const HookFilterTable* table, EventType type, bool injected) {
+    return (table->types >> (type + (injected ? 8 : 0))) & 1;
+}
+
+// Unknown processes (no window change seen yet) pass either way
+static bool filter_passes_process(const HookFilterTable* table, InternId process) {
+    if (table->process_filter == HOOK_PROCESS_FILTER_NONE || process == INTERN_NONE) {
+        return true;
+    }
+
+    bool listed = false;
+    for (size_t slot = process & (HOOK_FILTER_PROCESS_SLOTS - 1);
+         table->process_slots[slot] != INTERN_NONE;
+         slot = (slot + 1) & (HOOK_FILTER_PROCESS_SLOTS - 1)) {
+        if (table->process_slots[slot] == process) {
+            listed = true;
+            break;
+        }
+    }
+    return listed == (table->process_filter == HOOK_PROCESS_FILTER_INCLUDE);
+}
+
+static void compile_filters(HookFilterTable* table, const HookFilters* filters) {
+    memset(table, 0, sizeof(HookFilterTable));
+    memcpy(&table->filters, filters, sizeof(HookFilters));
+    if (table->filters.process_count > HOOK_FILTER_MAX_PROCESSES) {
+        table->filters.process_count = HOOK_FILTER_MAX_PROCESSES;
+    }
+
+    // Window changes are never injected; errors always pass
+    for (int type = EVENT_KEY_PRESS; type < EVENT_ERROR; type++) {
+        bool captured = type <= EVENT_KEY_RELEASE ? filters->capture_keyboard :
+                        type <= EVENT_MOUSE_WHEEL ? filters->capture_mouse :
+                                                    filters->capture_window_changes;
+        if (!captured || (filters->ignored_types & HOOK_FILTER_TYPE(type))) continue;
+
+        table->types |= 1u << type;
+        if (!filters->ignore_injected || type == EVENT_WINDOW_CHANGE) {
+            table->types |= 1u << (type + 8);
+        }
+    }
+    table->types |= (1u << EVENT_ERROR) | (1u << (EVENT_ERROR + 8));
+
+    for (DWORD bit = 0; bit < 8 * sizeof(table->keys); bit++) {
+        DWORD vk = bit & 0xFF;
+        bool down = (bit & 0x100) == 0;
+        bool injected = (bit & 0x200) != 0;
+        bool ignored = (filters->ignored_keys[vk >> 3] >> (vk & 7)) & 1;
+        if (!ignored && filter_passes_type(table, down ? EVENT_KEY_PRESS : EVENT_KEY_RELEASE,
+                                           injected)) {
+            table->keys[bit >> 3] |= (BYTE)(1u << (bit & 7));
+        }
+    }
+
+    table->process_filter = filters->process_filter;
+    for (size_t i = 0; i < table->filters.process_count; i++) {
+        InternId process = filters->processes[i];
+        if (process == INTERN_NONE) continue;
+
+        size_t slot = process & (HOOK_FILTER_PROCESS_SLOTS - 1);
+        while (table->process_slots[slot] != INTERN_NONE &&
+               table->process_slots[slot] != process) {
+            slot = (slot + 1) & (HOOK_FILTER_PROCESS_SLOTS - 1);
+        }
+        table->process_slots[slot] = process;
+    }
+}
+
+static void default_hook_filters(HookFilters* filters) {
+    memset(filters, 0, sizeof(HookFilters));
+    filters->capture_keyboard = true;
+    filters->capture_mouse = true;
+    filters->capture_window_changes = true;
+}
+
+// Called once the producers have stopped
+static void free_filter_tables(void) {
+    EnterCriticalSection(&hooks.filter_lock);
+    HookFilterTable* table = atomic_exchange(&hooks.filter_table, NULL);
+    wait_for_filter_checks();
+    free(table);
+    LeaveCriticalSection(&hooks.filter_lock);
+}
+
+static DWORD get_move_coalesce_ms(void) {
+    size_t phase = enter_filter_check();
+    const HookFilterTable* table = get_filter_table();
+    DWORD coalesce_ms = table ? table->filters.move_coalesce_ms : 0;
+    leave_filter_check(phase);
+    return coalesce_ms;
 }
 
 // Public utility functions
@@ -478,75 +2369,138 @@ DWORD get_last_hook_error(void) {
 
 // Statistics functions
 size_t get_total_events(void) {
-    return hooks.stats.total_events;
+    return get_metric(METRIC_EVENTS_QUEUED);
 }
 
 size_t get_dropped_events(void) {
-    return hooks.stats.dropped_events;
+    return get_metric(METRIC_EVENTS_DROPPED);
 }
 
 size_t get_window_changes(void) {
-    return hooks.stats.window_changes;
+    return get_metric(METRIC_WINDOW_CHANGES);
 }
 
 size_t get_queue_overflows(void) {
-    return hooks.stats.queue_overflows;
+    return get_metric(METRIC_QUEUE_OVERFLOWS);
+}
+
+size_t get_coalesced_moves(void) {
+    return get_metric(METRIC_COALESCED_MOVES);
+}
+
+// Snapshot of the hook callback latency histogram. The buckets are read one
+// by one without stopping the hooks, so the totals may be off by the few
+// callbacks that complete during the copy.
+bool get_hook_latency_histogram(HookLatencyHistogram* histogram) {
+    if (!histogram) return false;
+
+    memset(histogram, 0, sizeof(HookLatencyHistogram));
+    for (int i = 0; i < HOOK_LATENCY_BUCKETS; i++) {
+        histogram->buckets[i] = atomic_load_explicit(&hooks.latency.buckets[i],
+                                                     memory_order_relaxed);
+        histogram->count += histogram->buckets[i];
+    }
+    histogram->max_ns = atomic_load_explicit(&hooks.latency.max_ns, memory_order_relaxed);
+    histogram->over_threshold = atomic_load_explicit(&hooks.latency.over_threshold,
+                                                     memory_order_relaxed);
+    histogram->threshold_us = (DWORD)(atomic_load_explicit(&hooks.latency.threshold_ns,
+                                                           memory_order_relaxed) / 1000);
+
+    // Percentiles resolve to the upper bound of their bucket
+    size_t p50_rank = (histogram->count + 1) / 2;
+    size_t p99_rank = histogram->count - histogram->count / 100;
+    size_t seen = 0;
+    for (int i = 0; i < HOOK_LATENCY_BUCKETS && histogram->count > 0; i++) {
+        seen += histogram->buckets[i];
+        ULONGLONG upper = 2ULL << i;
+        if (upper > histogram->max_ns) upper = histogram->max_ns;
+        if (histogram->p50_ns == 0 && seen >= p50_rank) histogram->p50_ns = upper;
+        if (seen >= p99_rank) {
+            histogram->p99_ns = upper;
+            break;
+        }
+    }
+    return true;
+}
+
+// Callbacks slower than this are counted in over_threshold (0 = default)
+void set_hook_latency_threshold(DWORD threshold_us) {
+    if (threshold_us == 0) threshold_us = HOOK_DEFAULT_LATENCY_THRESHOLD_US;
+    atomic_store(&hooks.latency.threshold_ns, (ULONGLONG)threshold_us * 1000);
 }
 
 // Queue management functions
+// These read the ring indices without locking; the result is a snapshot that
+// may be stale by the time the caller looks at it.
 size_t get_queue_size(void) {
-    EnterCriticalSection(&hooks.event_queue.queue_lock);
-    size_t size = (hooks.event_queue.queue_tail - hooks.event_queue.queue_head + 
-                   MAX_EVENT_QUEUE) % MAX_EVENT_QUEUE;
-    LeaveCriticalSection(&hooks.event_queue.queue_lock);
-    return size;
+    size_t head = atomic_load_explicit(&hooks.event_queue.head, memory_order_acquire);
+    size_t tail = atomic_load_explicit(&hooks.event_queue.tail, memory_order_acquire);
+    size_t size = tail - head;
+    return size > MAX_EVENT_QUEUE ? MAX_EVENT_QUEUE : size;
 }
 
 bool is_queue_full(void) {
-    EnterCriticalSection(&hooks.event_queue.queue_lock);
-    bool full = ((hooks.event_queue.queue_tail + 1) % MAX_EVENT_QUEUE) == 
-                 hooks.event_queue.queue_head;
-    LeaveCriticalSection(&hooks.event_queue.queue_lock);
-    return full;
+    return get_queue_size() >= MAX_EVENT_QUEUE;
 }
 
 bool is_queue_empty(void) {
-    EnterCriticalSection(&hooks.event_queue.queue_lock);
-    bool empty = hooks.event_queue.queue_head == hooks.event_queue.queue_tail;
-    LeaveCriticalSection(&hooks.event_queue.queue_lock);
-    return empty;
+    return get_queue_size() == 0;
 }
 
+// Discards all queued events. Must be called from the consumer side.
 void clear_event_queue(void) {
-    EnterCriticalSection(&hooks.event_queue.queue_lock);
-    hooks.event_queue.queue_head = hooks.event_queue.queue_tail = 0;
-    LeaveCriticalSection(&hooks.event_queue.queue_lock);
+    size_t head = atomic_load_explicit(&hooks.event_queue.head, memory_order_relaxed);
+    while (peek_queued_slot(head)) {
+        release_queued_slot(head);
+        head++;
+    }
+    atomic_store_explicit(&hooks.event_queue.head, head, memory_order_release);
+
+    EnterCriticalSection(&hooks.spill.lock);
+    retire_spill_chain();
+    LeaveCriticalSection(&hooks.spill.lock);
 }
 
 // Filter management functions
+// Compiles the filters into a new table and swaps it in. Only other
+// updaters are locked out (hooks.filter_lock, never hooks.lock), so
+// filters can change from any thread while the hooks run.
 void set_hook_filters(const HookFilters* filters) {
     if (!filters) return;
-    
-    EnterCriticalSection(&hooks.lock);
-    memcpy(&hooks.filters, filters, sizeof(HookFilters));
-    LeaveCriticalSection(&hooks.lock);
+
+    HookFilterTable* table = (HookFilterTable*)malloc(sizeof(HookFilterTable));
+    if (!table) {
+        set_last_error(HOOK_ERROR_MEMORY);
+        return;
+    }
+    compile_filters(table, filters);
+
+    EnterCriticalSection(&hooks.filter_lock);
+    HookFilterTable* old = atomic_exchange(&hooks.filter_table, table);
+    if (old) {
+        wait_for_filter_checks();
+        free(old);
+    }
+    LeaveCriticalSection(&hooks.filter_lock);
 }
 
 void get_hook_filters(HookFilters* filters) {
     if (!filters) return;
-    
-    EnterCriticalSection(&hooks.lock);
-    memcpy(filters, &hooks.filters, sizeof(HookFilters));
-    LeaveCriticalSection(&hooks.lock);
+
+    size_t phase = enter_filter_check();
+    const HookFilterTable* table = get_filter_table();
+    if (table) {
+        memcpy(filters, &table->filters, sizeof(HookFilters));
+    } else {
+        default_hook_filters(filters);
+    }
+    leave_filter_check(phase);
 }
 
 void reset_hook_filters(void) {
-    EnterCriticalSection(&hooks.lock);
-    hooks.filters.capture_keyboard = true;
-    hooks.filters.capture_mouse = true;
-    hooks.filters.capture_window_changes = true;
-    hooks.filters.ignore_injected = false;
-    LeaveCriticalSection(&hooks.lock);
+    HookFilters filters;
+    default_hook_filters(&filters);
+    set_hook_filters(&filters);
 }
 
 // Register callback function
@@ -557,6 +2511,10 @@ bool register_hook_callback(EventCallback callback) {
 
     EnterCriticalSection(&hooks.lock);
     hooks.callback = callback;
+    // A consumer thread parked without a callback picks up the queue now
+    if (hooks.queue_signal) {
+        SetEvent(hooks.queue_signal);
+    }
     LeaveCriticalSection(&hooks.lock);
 
     HOOK_DEBUG("Hook callback registered successfully");
@@ -572,3 +2530,31 @@ void unregister_hook_callback(EventCallback callback) {
     }
     LeaveCriticalSection(&hooks.lock);
 }
+
+// Register batch callback function; while set it replaces the per-event one
+bool register_hook_batch_callback(EventBatchCallback callback) {
+    if (!callback) {
+        return false;
+    }
+
+    EnterCriticalSection(&hooks.lock);
+    hooks.batch_callback = callback;
+    // A consumer thread parked without a callback picks up the queue now
+    if (hooks.queue_signal) {
+        SetEvent(hooks.queue_signal);
+    }
+    LeaveCriticalSection(&hooks.lock);
+
+    HOOK_DEBUG("Hook batch callback registered successfully");
+    return true;
+}
+
+// Unregister batch callback function
+void unregister_hook_batch_callback(EventBatchCallback callback) {
+    EnterCriticalSection(&hooks.lock);
+    if (hooks.batch_callback == callback) {
+        hooks.batch_callback = NULL;
+        HOOK_DEBUG("Hook batch callback unregistered successfully");
+    }
+    LeaveCriticalSection(&hooks.lock);
+}
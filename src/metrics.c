@@ -0,0 +1,226 @@
+#include "metrics.h"
+#include "utils.h"
+#include <stdio.h>
+#include <string.h>
+
+#ifdef DEBUG
+    #define METRICS_DEBUG(msg, ...) fprintf(stderr, "[Metrics] " msg "\n", ##__VA_ARGS__)
+#else
+    #define METRICS_DEBUG(msg, ...)
+#endif
+
+// Registry storage; the cells are zero at load, so updates are valid
+// before init_metrics() runs
+static MetricCell counters[METRIC_COUNTER_COUNT];
+static MetricCell gauges[METRIC_GAUGE_COUNT];
+
+static const char* counter_names[METRIC_COUNTER_COUNT] = {
+    "events_queued",
+    "events_dropped",
+    "queue_overflows",
+    "window_changes",
+    "coalesced_moves",
+    "events_spilled",
+    "moves_shed",
+    "buffer_writes",
+    "buffer_failed_writes",
+    "buffer_flushes",
+    "buffer_failed_flushes",
+    "log_writes",
+    "log_failed_writes",
+    "log_bytes_written",
+    "log_retries",
+    "log_buffer_stalls",
+    "log_rotations",
+    "log_failed_rotations",
+    "log_commits",
+    "log_failed_commits",
+    "capture_events",
+    "capture_events_buffered",
+    "capture_bytes_written",
+    "capture_files_rotated",
+    "capture_write_errors",
+    "capture_buffer_overflows",
+    "sink_events",
+    "sink_events_dropped",
+    "sink_failed_writes",
+    "aggregate_events",
+    "aggregate_summaries",
+    "aggregate_overflows"
+};
+
+static const char* gauge_names[METRIC_GAUGE_COUNT] = {
+    "queue_depth",
+    "spill_depth",
+    "buffer_pending_bytes",
+    "log_file_size",
+    "log_commit_latency_us",
+    "log_commit_latency_max_us"
+};
+
+// Side file dump state, only touched by the thread controlling the dump
+static struct {
+    HANDLE thread;
+    HANDLE stop_event;
+    FILE* file;
+    DWORD interval;
+    volatile DWORD last_error;
+} dump = {0};
+
+static DWORD WINAPI dump_thread_proc(LPVOID param);
+static void write_metrics_line(FILE* file, TimestampCache* cache);
+
+// Starts from all-zero counters and gauges
+bool init_metrics(void) {
+    for (int i = 0; i < METRIC_COUNTER_COUNT; i++) {
+        atomic_store_explicit(&counters[i].value, 0, memory_order_relaxed);
+    }
+    for (int i = 0; i < METRIC_GAUGE_COUNT; i++) {
+        atomic_store_explicit(&gauges[i].value, 0, memory_order_relaxed);
+    }
+    dump.last_error = METRICS_ERROR_NONE;
+    return true;
+}
+
+void cleanup_metrics(void) {
+    stop_metrics_dump();
+}
+
+void metrics_add(MetricCounter counter, size_t amount) {
+    if ((unsigned)counter >= METRIC_COUNTER_COUNT) return;
+    atomic_fetch_add_explicit(&counters[counter].value, amount, memory_order_relaxed);
+}
+
+void metrics_increment(MetricCounter counter) {
+    metrics_add(counter, 1);
+}
+
+void metrics_set_gauge(MetricGauge gauge, size_t value) {
+    if ((unsigned)gauge >= METRIC_GAUGE_COUNT) return;
+    atomic_store_explicit(&gauges[gauge].value, value, memory_order_relaxed);
+}
+
+// Zeroes the counters first..last (inclusive), e.g. one module's group
+void metrics_reset(MetricCounter first, MetricCounter last) {
+    for (int i = first; i <= (int)last && i < METRIC_COUNTER_COUNT; i++) {
+        atomic_store_explicit(&counters[i].value, 0, memory_order_relaxed);
+    }
+}
+
+size_t get_metric(MetricCounter counter) {
+    if ((unsigned)counter >= METRIC_COUNTER_COUNT) return 0;
+    return atomic_load_explicit(&counters[counter].value, memory_order_relaxed);
+}
+
+size_t get_metric_gauge(MetricGauge gauge) {
+    if ((unsigned)gauge >= METRIC_GAUGE_COUNT) return 0;
+    return atomic_load_explicit(&gauges[gauge].value, memory_order_relaxed);
+}
+
+void get_pipeline_metrics(PipelineMetrics* metrics) {
+    if (!metrics) return;
+
+    metrics->timestamp = get_precise_time();
+    for (int i = 0; i < METRIC_COUNTER_COUNT; i++) {
+        metrics->counters[i] = atomic_load_explicit(&counters[i].value, memory_order_relaxed);
+    }
+    for (int i = 0; i < METRIC_GAUGE_COUNT; i++) {
+        metrics->gauges[i] = atomic_load_explicit(&gauges[i].value, memory_order_relaxed);
+    }
+}
+
+const char* get_metric_name(MetricCounter counter) {
+    if ((unsigned)counter >= METRIC_COUNTER_COUNT) return "unknown";
+    return counter_names[counter];
+}
+
+const char* get_metric_gauge_name(MetricGauge gauge) {
+    if ((unsigned)gauge >= METRIC_GAUGE_COUNT) return "unknown";
+    return gauge_names[gauge];
+}
+
+// Appends a snapshot line to path every interval_ms (0 = default). The dump
+// goes through stdio, not the logger, so it never competes with event output.
+bool start_metrics_dump(const char* path, DWORD interval_ms) {
+    if (!path || !*path || strlen(path) >= METRICS_MAX_PATH) {
+        dump.last_error = METRICS_ERROR_INVALID;
+        return false;
+    }
+    if (dump.thread) {
+        dump.last_error = METRICS_ERROR_INIT;
+        return false;
+    }
+
+    dump.file = fopen(path, "a");
+    if (!dump.file) {
+        dump.last_error = METRICS_ERROR_FILE;
+        METRICS_DEBUG("Failed to open metrics file %s", path);
+        return false;
+    }
+
+    dump.interval = interval_ms ? interval_ms : METRICS_DEFAULT_DUMP_INTERVAL;
+    dump.stop_event = CreateEvent(NULL, TRUE, FALSE, NULL);
+    if (dump.stop_event) {
+        dump.thread = CreateThread(NULL, 0, dump_thread_proc, NULL, 0, NULL);
+    }
+    if (!dump.thread) {
+        if (dump.stop_event) CloseHandle(dump.stop_event);
+        dump.stop_event = NULL;
+        fclose(dump.file);
+        dump.file = NULL;
+        dump.last_error = METRICS_ERROR_INIT;
+        return false;
+    }
+
+    METRICS_DEBUG("Dumping metrics to %s every %lu ms", path, (unsigned long)dump.interval);
+    return true;
+}
+
+// Stops the dump thread after a final snapshot
+void stop_metrics_dump(void) {
+    if (!dump.thread) return;
+
+    SetEvent(dump.stop_event);
+    WaitForSingleObject(dump.thread, INFINITE);
+    CloseHandle(dump.thread);
+    dump.thread = NULL;
+    CloseHandle(dump.stop_event);
+    dump.stop_event = NULL;
+    fclose(dump.file);
+    dump.file = NULL;
+}
+
+DWORD get_metrics_last_error(void) {
+    return dump.last_error;
+}
+
+static DWORD WINAPI dump_thread_proc(LPVOID param) {
+    (void)param;
+    TimestampCache cache;
+    init_timestamp_cache(&cache);
+
+    while (WaitForSingleObject(dump.stop_event, dump.interval) == WAIT_TIMEOUT) {
+        write_metrics_line(dump.file, &cache);
+    }
+    write_metrics_line(dump.file, &cache);
+    return 0;
+}
+
+// [timestamp] name=value ... with counters first, then gauges
+static void write_metrics_line(FILE* file, TimestampCache* cache) {
+    PipelineMetrics metrics;
+    char timestamp[TIMESTAMP_TEXT_SIZE];
+
+    get_pipeline_metrics(&metrics);
+    format_timestamp_cached(cache, metrics.timestamp, timestamp, sizeof(timestamp));
+
+    fprintf(file, "[%s]", timestamp);
+    for (int i = 0; i < METRIC_COUNTER_COUNT; i++) {
+        fprintf(file, " %s=%zu", counter_names[i], metrics.counters[i]);
+    }
+    for (int i = 0; i < METRIC_GAUGE_COUNT; i++) {
+        fprintf(file, " %s=%zu", gauge_names[i], metrics.gauges[i]);
+    }
+    fputc('\n', file);
+    fflush(file);
+}
@@ -0,0 +1,1115 @@
+// POSIX implementation of the Win32 subset declared in platform.h
+#ifndef _WIN32
+
+#define _GNU_SOURCE
+#include "platform.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+
+// 100 ns units between 1601-01-01 and 1970-01-01
+#define FILETIME_UNIX_EPOCH 116444736000000000ULL
+#define FILETIME_PER_SECOND 10000000ULL
+
+#define PLATFORM_MAX_VIEWS 64
+
+typedef enum {
+    HANDLE_EVENT,
+    HANDLE_THREAD,
+    HANDLE_FILE,
+    HANDLE_MAPPING,
+    HANDLE_PROCESS
+} HandleKind;
+
+// Every HANDLE points at one of these. Events and threads share the
+// signaled state; a running thread holds its own reference.
+typedef struct {
+    HandleKind kind;
+    atomic_int refs;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    bool signaled;
+    bool manual_reset;
+    LPTHREAD_START_ROUTINE start;
+    LPVOID parameter;
+    int fd;
+    ULONGLONG mapping_size;
+    pid_t pid;
+    ULONGLONG start_ticks;  // Process instance, from /proc/<pid>/stat
+} PlatformHandle;
+
+// Mapped views, so unmapping by address knows the length
+static struct {
+    pthread_mutex_t lock;
+    void* address[PLATFORM_MAX_VIEWS];
+    size_t size[PLATFORM_MAX_VIEWS];
+} views = { .lock = PTHREAD_MUTEX_INITIALIZER };
+
+static _Thread_local DWORD last_error;
+static _Thread_local int last_errno;
+static PlatformHandle current_process = { .kind = HANDLE_PROCESS, .fd = -1 };
+static atomic_uint open_handles;  // GetProcessHandleCount()
+
+static void set_errno_error(int error);
+static PlatformHandle* new_handle(HandleKind kind);
+static void release_handle(PlatformHandle* handle);
+static void deadline_after(DWORD milliseconds, struct timespec* deadline);
+static ULONGLONG unix_to_filetime(time_t seconds, long nanoseconds);
+static long local_offset_seconds(time_t seconds);
+static bool read_process_start(pid_t pid, ULONGLONG* ticks);
+static SIZE_T read_status_kb(const char* field);
+
+// Errors
+DWORD GetLastError(void) {
+    return last_error;
+}
+
+void SetLastError(DWORD error) {
+    last_error = error;
+}
+
+static void set_errno_error(int error) {
+    last_errno = error;
+    switch (error) {
+        case 0: last_error = ERROR_SUCCESS; break;
+        case ENOENT: last_error = ERROR_FILE_NOT_FOUND; break;
+        case ENOTDIR: last_error = ERROR_PATH_NOT_FOUND; break;
+        case EACCES:
+        case EPERM: last_error = ERROR_ACCESS_DENIED; break;
+        case EBADF: last_error = ERROR_INVALID_HANDLE; break;
+        case ENOMEM: last_error = ERROR_NOT_ENOUGH_MEMORY; break;
+        case EEXIST: last_error = ERROR_ALREADY_EXISTS; break;
+        case EINVAL: last_error = ERROR_INVALID_PARAMETER; break;
+        case ENOSPC: last_error = ERROR_DISK_FULL; break;
+        case ETIMEDOUT: last_error = ERROR_TIMEOUT; break;
+        default: last_error = ERROR_GEN_FAILURE; break;
+    }
+}
+
+// Describes the calling thread's last error; other codes get their number
+DWORD FormatMessageA(DWORD flags, LPCVOID source, DWORD message, DWORD language,
+                     LPSTR buffer, DWORD size, void* arguments) {
+    (void)flags;
+    (void)source;
+    (void)language;
+    (void)arguments;
+    if (!buffer || size == 0) return 0;
+
+    int written = message == last_error && last_errno != 0
+        ? snprintf(buffer, size, "%s", strerror(last_errno))
+        : snprintf(buffer, size, "Error %u", (unsigned)message);
+    return written > 0 ? (DWORD)written : 0;
+}
+
+// Critical sections and condition variables
+void InitializeCriticalSection(CRITICAL_SECTION* section) {
+    InitializeCriticalSectionAndSpinCount(section, 0);
+}
+
+BOOL InitializeCriticalSectionAndSpinCount(CRITICAL_SECTION* section, DWORD spin_count) {
+    (void)spin_count;
+    pthread_mutexattr_t attributes;
+    pthread_mutexattr_init(&attributes);
+    pthread_mutexattr_settype(&attributes, PTHREAD_MUTEX_RECURSIVE);
+    int error = pthread_mutex_init(&section->mutex, &attributes);
+    pthread_mutexattr_destroy(&attributes);
+    if (error != 0) {
+        set_errno_error(error);
+        return FALSE;
+    }
+    section->DebugInfo = &section->mutex;
+    return TRUE;
+}
+
+void EnterCriticalSection(CRITICAL_SECTION* section) {
+    pthread_mutex_lock(&section->mutex);
+}
+
+void LeaveCriticalSection(CRITICAL_SECTION* section) {
+    pthread_mutex_unlock(&section->mutex);
+}
+
+void DeleteCriticalSection(CRITICAL_SECTION* section) {
+    pthread_mutex_destroy(&section->mutex);
+    section->DebugInfo = NULL;
+}
+
+void InitializeConditionVariable(CONDITION_VARIABLE* condition) {
+    pthread_condattr_t attributes;
+    pthread_condattr_init(&attributes);
+    pthread_condattr_setclock(&attributes, CLOCK_MONOTONIC);
+    pthread_cond_init(&condition->cond, &attributes);
+    pthread_condattr_destroy(&attributes);
+}
+
+// The section must be held exactly once by the caller
+BOOL SleepConditionVariableCS(CONDITION_VARIABLE* condition, CRITICAL_SECTION* section,
+                              DWORD milliseconds) {
+    int error;
+    if (milliseconds == INFINITE) {
+        error = pthread_cond_wait(&condition->cond, &section->mutex);
+    } else {
+        struct timespec deadline;
+        deadline_after(milliseconds, &deadline);
+        error = pthread_cond_timedwait(&condition->cond, &section->mutex, &deadline);
+    }
+    if (error != 0) {
+        set_errno_error(error);
+        return FALSE;
+    }
+    return TRUE;
+}
+
+void WakeConditionVariable(CONDITION_VARIABLE* condition) {
+    pthread_cond_signal(&condition->cond);
+}
+
+void WakeAllConditionVariable(CONDITION_VARIABLE* condition) {
+    pthread_cond_broadcast(&condition->cond);
+}
+
+// Handles
+static PlatformHandle* new_handle(HandleKind kind) {
+    PlatformHandle* handle = (PlatformHandle*)calloc(1, sizeof(PlatformHandle));
+    if (!handle) {
+        set_errno_error(ENOMEM);
+        return NULL;
+    }
+
+    pthread_condattr_t attributes;
+    pthread_condattr_init(&attributes);
+    pthread_condattr_setclock(&attributes, CLOCK_MONOTONIC);
+    pthread_mutex_init(&handle->mutex, NULL);
+    pthread_cond_init(&handle->cond, &attributes);
+    pthread_condattr_destroy(&attributes);
+
+    handle->kind = kind;
+    handle->fd = -1;
+    atomic_init(&handle->refs, 1);
+    atomic_fetch_add(&open_handles, 1);
+    return handle;
+}
+
+static void release_handle(PlatformHandle* handle) {
+    if (atomic_fetch_sub(&handle->refs, 1) != 1) return;
+
+    if (handle->fd >= 0) {
+        close(handle->fd);
+    }
+    pthread_cond_destroy(&handle->cond);
+    pthread_mutex_destroy(&handle->mutex);
+    free(handle);
+    atomic_fetch_sub(&open_handles, 1);
+}
+
+BOOL CloseHandle(HANDLE object) {
+    PlatformHandle* handle = (PlatformHandle*)object;
+    if (!handle || object == INVALID_HANDLE_VALUE) {
+        SetLastError(ERROR_INVALID_HANDLE);
+        return FALSE;
+    }
+    if (handle != &current_process) {
+        release_handle(handle);
+    }
+    return TRUE;
+}
+
+HANDLE CreateEventA(void* attributes, BOOL manual_reset, BOOL initial_state, LPCSTR name) {
+    (void)attributes;
+    (void)name;
+    PlatformHandle* event = new_handle(HANDLE_EVENT);
+    if (!event) return NULL;
+
+    event->manual_reset = manual_reset;
+    event->signaled = initial_state;
+    return event;
+}
+
+BOOL SetEvent(HANDLE object) {
+    PlatformHandle* event = (PlatformHandle*)object;
+    if (!event || event->kind != HANDLE_EVENT) {
+        SetLastError(ERROR_INVALID_HANDLE);
+        return FALSE;
+    }
+
+    pthread_mutex_lock(&event->mutex);
+    event->signaled = true;
+    if (event->manual_reset) {
+        pthread_cond_broadcast(&event->cond);
+    } else {
+        pthread_cond_signal(&event->cond);
+    }
+    pthread_mutex_unlock(&event->mutex);
+    return TRUE;
+}
+
+BOOL ResetEvent(HANDLE object) {
+    PlatformHandle* event = (PlatformHandle*)object;
+    if (!event || event->kind != HANDLE_EVENT) {
+        SetLastError(ERROR_INVALID_HANDLE);
+        return FALSE;
+    }
+
+    pthread_mutex_lock(&event->mutex);
+    event->signaled = false;
+    pthread_mutex_unlock(&event->mutex);
+    return TRUE;
+}
+
+static void* thread_trampoline(void* parameter) {
+    PlatformHandle* thread = (PlatformHandle*)parameter;
+    thread->start(thread->parameter);
+
+    pthread_mutex_lock(&thread->mutex);
+    thread->signaled = true;
+    pthread_cond_broadcast(&thread->cond);
+    pthread_mutex_unlock(&thread->mutex);
+
+    release_handle(thread);
+    return NULL;
+}
+
+HANDLE CreateThread(void* attributes, SIZE_T stack_size, LPTHREAD_START_ROUTINE start,
+                    LPVOID parameter, DWORD flags, LPDWORD thread_id) {
+    (void)attributes;
+    (void)flags;
+    PlatformHandle* thread = new_handle(HANDLE_THREAD);
+    if (!thread) return NULL;
+
+    thread->manual_reset = true;
+    thread->start = start;
+    thread->parameter = parameter;
+    atomic_store(&thread->refs, 2);  // The handle and the running thread
+
+    pthread_attr_t thread_attributes;
+    pthread_attr_init(&thread_attributes);
+    pthread_attr_setdetachstate(&thread_attributes, PTHREAD_CREATE_DETACHED);
+    if (stack_size > 0) {
+        pthread_attr_setstacksize(&thread_attributes, stack_size);
+    }
+
+    pthread_t id;
+    int error = pthread_create(&id, &thread_attributes, thread_trampoline, thread);
+    pthread_attr_destroy(&thread_attributes);
+    if (error != 0) {
+        set_errno_error(error);
+        atomic_store(&thread->refs, 1);
+        release_handle(thread);
+        return NULL;
+    }
+
+    if (thread_id) {
+        *thread_id = (DWORD)(uintptr_t)thread;
+    }
+    return thread;
+}
+
+// Raising priority needs privileges most collection hosts do not grant
+BOOL SetThreadPriority(HANDLE thread, int priority) {
+    (void)thread;
+    (void)priority;
+    return TRUE;
+}
+
+DWORD GetCurrentThreadId(void) {
+    return (DWORD)syscall(SYS_gettid);
+}
+
+DWORD WaitForSingleObject(HANDLE object, DWORD milliseconds) {
+    PlatformHandle* handle = (PlatformHandle*)object;
+    if (!handle || object == INVALID_HANDLE_VALUE) {
+        SetLastError(ERROR_INVALID_HANDLE);
+        return WAIT_FAILED;
+    }
+
+    // A process is signaled once the instance the handle refers to is gone
+    if (handle->kind == HANDLE_PROCESS) {
+        for (;;) {
+            ULONGLONG ticks = 0;
+            if (!read_process_start(handle->pid, &ticks) || ticks != handle->start_ticks) {
+                return WAIT_OBJECT_0;
+            }
+            if (milliseconds == 0) {
+                return WAIT_TIMEOUT;
+            }
+            DWORD step = milliseconds < 10 ? milliseconds : 10;
+            Sleep(step);
+            if (milliseconds != INFINITE) milliseconds -= step;
+        }
+    }
+
+    if (handle->kind != HANDLE_EVENT && handle->kind != HANDLE_THREAD) {
+        SetLastError(ERROR_INVALID_HANDLE);
+        return WAIT_FAILED;
+    }
+
+    struct timespec deadline;
+    if (milliseconds != INFINITE) {
+        deadline_after(milliseconds, &deadline);
+    }
+
+    DWORD result = WAIT_OBJECT_0;
+    pthread_mutex_lock(&handle->mutex);
+    while (!handle->signaled) {
+        int error = milliseconds == INFINITE
+            ? pthread_cond_wait(&handle->cond, &handle->mutex)
+            : pthread_cond_timedwait(&handle->cond, &handle->mutex, &deadline);
+        if (error == ETIMEDOUT) {
+            result = WAIT_TIMEOUT;
+            break;
+        }
+    }
+    if (result == WAIT_OBJECT_0 && !handle->manual_reset) {
+        handle->signaled = false;  // Auto-reset events release one waiter
+    }
+    pthread_mutex_unlock(&handle->mutex);
+    return result;
+}
+
+// There is no message queue; waiting on nothing is a sleep
+DWORD MsgWaitForMultipleObjects(DWORD count, const HANDLE* handles, BOOL wait_all,
+                                DWORD milliseconds, DWORD wake_mask) {
+    (void)wake_mask;
+    if (count == 0) {
+        Sleep(milliseconds);
+        return WAIT_TIMEOUT;
+    }
+    if (count == 1 || wait_all) {
+        DWORD result = WAIT_OBJECT_0;
+        for (DWORD i = 0; i < count && result == WAIT_OBJECT_0; i++) {
+            result = WaitForSingleObject(handles[i], milliseconds);
+        }
+        return result;
+    }
+
+    // Any of several: poll in short steps
+    for (DWORD waited = 0;; waited++) {
+        for (DWORD i = 0; i < count; i++) {
+            if (WaitForSingleObject(handles[i], 0) == WAIT_OBJECT_0) {
+                return WAIT_OBJECT_0 + i;
+            }
+        }
+        if (milliseconds != INFINITE && waited >= milliseconds) {
+            return WAIT_TIMEOUT;
+        }
+        Sleep(1);
+    }
+}
+
+void Sleep(DWORD milliseconds) {
+    struct timespec delay = { milliseconds / 1000, (long)(milliseconds % 1000) * 1000000L };
+    while (nanosleep(&delay, &delay) != 0 && errno == EINTR) {
+    }
+}
+
+static void deadline_after(DWORD milliseconds, struct timespec* deadline) {
+    clock_gettime(CLOCK_MONOTONIC, deadline);
+    deadline->tv_sec += milliseconds / 1000;
+    deadline->tv_nsec += (long)(milliseconds % 1000) * 1000000L;
+    if (deadline->tv_nsec >= 1000000000L) {
+        deadline->tv_sec++;
+        deadline->tv_nsec -= 1000000000L;
+    }
+}
+
+// Clocks
+DWORD GetTickCount(void) {
+    return (DWORD)GetTickCount64();
+}
+
+ULONGLONG GetTickCount64(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (ULONGLONG)now.tv_sec * 1000 + (ULONGLONG)now.tv_nsec / 1000000;
+}
+
+BOOL QueryPerformanceCounter(LARGE_INTEGER* count) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    count->QuadPart = (LONGLONG)now.tv_sec * 1000000000LL + now.tv_nsec;
+    return TRUE;
+}
+
+BOOL QueryPerformanceFrequency(LARGE_INTEGER* frequency) {
+    frequency->QuadPart = 1000000000LL;
+    return TRUE;
+}
+
+static ULONGLONG unix_to_filetime(time_t seconds, long nanoseconds) {
+    return (ULONGLONG)seconds * FILETIME_PER_SECOND + (ULONGLONG)nanoseconds / 100 +
+           FILETIME_UNIX_EPOCH;
+}
+
+void GetSystemTimePreciseAsFileTime(FILETIME* time) {
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    ULONGLONG value = unix_to_filetime(now.tv_sec, now.tv_nsec);
+    time->dwLowDateTime = (DWORD)value;
+    time->dwHighDateTime = (DWORD)(value >> 32);
+}
+
+void GetLocalTime(SYSTEMTIME* time) {
+    FILETIME now;
+    FILETIME local;
+    GetSystemTimePreciseAsFileTime(&now);
+    FileTimeToLocalFileTime(&now, &local);
+    FileTimeToSystemTime(&local, time);
+}
+
+BOOL FileTimeToSystemTime(const FILETIME* file_time, SYSTEMTIME* system_time) {
+    ULONGLONG value = ((ULONGLONG)file_time->dwHighDateTime << 32) | file_time->dwLowDateTime;
+    if (value < FILETIME_UNIX_EPOCH) {
+        SetLastError(ERROR_INVALID_PARAMETER);
+        return FALSE;
+    }
+
+    value -= FILETIME_UNIX_EPOCH;
+    time_t seconds = (time_t)(value / FILETIME_PER_SECOND);
+    struct tm parts;
+    if (!gmtime_r(&seconds, &parts)) {
+        SetLastError(ERROR_INVALID_PARAMETER);
+        return FALSE;
+    }
+
+    system_time->wYear = (WORD)(parts.tm_year + 1900);
+    system_time->wMonth = (WORD)(parts.tm_mon + 1);
+    system_time->wDayOfWeek = (WORD)parts.tm_wday;
+    system_time->wDay = (WORD)parts.tm_mday;
+    system_time->wHour = (WORD)parts.tm_hour;
+    system_time->wMinute = (WORD)parts.tm_min;
+    system_time->wSecond = (WORD)parts.tm_sec;
+    system_time->wMilliseconds = (WORD)(value % FILETIME_PER_SECOND / 10000);
+    return TRUE;
+}
+
+BOOL SystemTimeToFileTime(const SYSTEMTIME* system_time, FILETIME* file_time) {
+    if (system_time->wMonth < 1 || system_time->wMonth > 12 || system_time->wDay < 1 ||
+        system_time->wDay > 31 || system_time->wHour > 23 || system_time->wMinute > 59 ||
+        system_time->wSecond > 59 || system_time->wMilliseconds > 999 ||
+        system_time->wYear < 1970) {
+        SetLastError(ERROR_INVALID_PARAMETER);
+        return FALSE;
+    }
+
+    struct tm parts = {0};
+    parts.tm_year = system_time->wYear - 1900;
+    parts.tm_mon = system_time->wMonth - 1;
+    parts.tm_mday = system_time->wDay;
+    parts.tm_hour = system_time->wHour;
+    parts.tm_min = system_time->wMinute;
+    parts.tm_sec = system_time->wSecond;
+
+    ULONGLONG value = unix_to_filetime(timegm(&parts), 0) +
+                      (ULONGLONG)system_time->wMilliseconds * 10000;
+    file_time->dwLowDateTime = (DWORD)value;
+    file_time->dwHighDateTime = (DWORD)(value >> 32);
+    return TRUE;
+}
+
+static long local_offset_seconds(time_t seconds) {
+    struct tm parts;
+    return localtime_r(&seconds, &parts) ? parts.tm_gmtoff : 0;
+}
+
+BOOL FileTimeToLocalFileTime(const FILETIME* file_time, FILETIME* local_time) {
+    ULONGLONG value = ((ULONGLONG)file_time->dwHighDateTime << 32) | file_time->dwLowDateTime;
+    time_t seconds = value >= FILETIME_UNIX_EPOCH
+        ? (time_t)((value - FILETIME_UNIX_EPOCH) / FILETIME_PER_SECOND) : 0;
+
+    value += (ULONGLONG)((LONGLONG)local_offset_seconds(seconds) * (LONGLONG)FILETIME_PER_SECOND);
+    local_time->dwLowDateTime = (DWORD)value;
+    local_time->dwHighDateTime = (DWORD)(value >> 32);
+    return TRUE;
+}
+
+// The offset in effect at the local time, found from the UTC guess
+BOOL LocalFileTimeToFileTime(const FILETIME* local_time, FILETIME* file_time) {
+    ULONGLONG value = ((ULONGLONG)local_time->dwHighDateTime << 32) | local_time->dwLowDateTime;
+    time_t seconds = value >= FILETIME_UNIX_EPOCH
+        ? (time_t)((value - FILETIME_UNIX_EPOCH) / FILETIME_PER_SECOND) : 0;
+    long offset = local_offset_seconds(seconds);
+    offset = local_offset_seconds(seconds - offset);
+
+    value -= (ULONGLONG)((LONGLONG)offset * (LONGLONG)FILETIME_PER_SECOND);
+    file_time->dwLowDateTime = (DWORD)value;
+    file_time->dwHighDateTime = (DWORD)(value >> 32);
+    return TRUE;
+}
+
+// Memory; the first page of every allocation records its length
+LPVOID VirtualAlloc(LPVOID address, SIZE_T size, DWORD type, DWORD protect) {
+    (void)type;
+    (void)protect;
+    if (address || size == 0) {
+        SetLastError(ERROR_INVALID_PARAMETER);
+        return NULL;
+    }
+
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    size_t total = page + (size + page - 1) / page * page;
+    char* base = (char*)mmap(NULL, total, PROT_READ | PROT_WRITE,
+                             MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (base == MAP_FAILED) {
+        set_errno_error(errno);
+        return NULL;
+    }
+
+    *(size_t*)base = total;
+    return base + page;
+}
+
+BOOL VirtualFree(LPVOID address, SIZE_T size, DWORD type) {
+    (void)size;
+    if (!address || type != MEM_RELEASE) {
+        SetLastError(ERROR_INVALID_PARAMETER);
+        return FALSE;
+    }
+
+    char* base = (char*)address - sysconf(_SC_PAGESIZE);
+    if (munmap(base, *(size_t*)base) != 0) {
+        set_errno_error(errno);
+        return FALSE;
+    }
+    return TRUE;
+}
+
+void GetSystemInfo(SYSTEM_INFO* info) {
+    long page = sysconf(_SC_PAGESIZE);
+    long processors = sysconf(_SC_NPROCESSORS_ONLN);
+    info->dwPageSize = (DWORD)page;
+    info->dwAllocationGranularity = (DWORD)page;
+    info->dwNumberOfProcessors = processors > 0 ? (DWORD)processors : 1;
+}
+
+// Files
+HANDLE CreateFileA(LPCSTR path, DWORD access, DWORD share, void* security,
+                   DWORD disposition, DWORD flags, HANDLE template_file) {
+    (void)share;
+    (void)security;
+    (void)template_file;
+
+    bool read = (access & GENERIC_READ) != 0;
+    bool write = (access & (GENERIC_WRITE | FILE_APPEND_DATA)) != 0;
+    int mode = read && write ? O_RDWR : write ? O_WRONLY : O_RDONLY;
+    if ((access & FILE_APPEND_DATA) && !(access & GENERIC_WRITE)) {
+        mode |= O_APPEND;
+    }
+    if (flags & FILE_FLAG_WRITE_THROUGH) {
+        mode |= O_DSYNC;
+    }
+
+    switch (disposition) {
+        case CREATE_NEW: mode |= O_CREAT | O_EXCL; break;
+        case CREATE_ALWAYS: mode |= O_CREAT | O_TRUNC; break;
+        case OPEN_ALWAYS: mode |= O_CREAT; break;
+        case TRUNCATE_EXISTING: mode |= O_TRUNC; break;
+        case OPEN_EXISTING: break;
+        default:
+            SetLastError(ERROR_INVALID_PARAMETER);
+            return INVALID_HANDLE_VALUE;
+    }
+
+    // The ALWAYS dispositions report whether the file was already there
+    struct stat info;
+    bool existed = (disposition == CREATE_ALWAYS || disposition == OPEN_ALWAYS) &&
+                   stat(path, &info) == 0;
+
+    int fd = open(path, mode | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        int error = errno;
+        set_errno_error(error);
+        if (error == EEXIST) SetLastError(ERROR_FILE_EXISTS);
+        return INVALID_HANDLE_VALUE;
+    }
+
+    PlatformHandle* file = new_handle(HANDLE_FILE);
+    if (!file) {
+        close(fd);
+        return INVALID_HANDLE_VALUE;
+    }
+    file->fd = fd;
+    SetLastError(existed ? ERROR_ALREADY_EXISTS : ERROR_SUCCESS);
+    return file;
+}
+
+static int file_descriptor(HANDLE object) {
+    PlatformHandle* handle = (PlatformHandle*)object;
+    if (!handle || object == INVALID_HANDLE_VALUE || handle->kind != HANDLE_FILE) {
+        SetLastError(ERROR_INVALID_HANDLE);
+        return -1;
+    }
+    return handle->fd;
+}
+
+// Overlapped writes go to their offset and are complete on return
+BOOL WriteFile(HANDLE file, LPCVOID data, DWORD size, LPDWORD written, OVERLAPPED* overlapped) {
+    int fd = file_descriptor(file);
+    if (fd < 0) return FALSE;
+
+    const char* bytes = (const char*)data;
+    off_t offset = overlapped
+        ? (off_t)(((ULONGLONG)overlapped->OffsetHigh << 32) | overlapped->Offset) : 0;
+    size_t done = 0;
+
+    while (done < size) {
+        ssize_t result = overlapped ? pwrite(fd, bytes + done, size - done, offset + (off_t)done)
+                                    : write(fd, bytes + done, size - done);
+        if (result < 0) {
+            if (errno == EINTR) continue;
+            set_errno_error(errno);
+            break;
+        }
+        done += (size_t)result;
+    }
+
+    if (written) *written = (DWORD)done;
+    if (overlapped) {
+        overlapped->Internal = done == size ? 0 : (ULONG_PTR)GetLastError();
+        overlapped->InternalHigh = done;
+    }
+    return done == size;
+}
+
+BOOL ReadFile(HANDLE file, LPVOID data, DWORD size, LPDWORD bytes_read, OVERLAPPED* overlapped) {
+    int fd = file_descriptor(file);
+    if (fd < 0) return FALSE;
+
+    off_t offset = overlapped
+        ? (off_t)(((ULONGLONG)overlapped->OffsetHigh << 32) | overlapped->Offset) : 0;
+    ssize_t result;
+    do {
+        result = overlapped ? pread(fd, data, size, offset) : read(fd, data, size);
+    } while (result < 0 && errno == EINTR);
+
+    if (result < 0) {
+        set_errno_error(errno);
+        return FALSE;
+    }
+    if (bytes_read) *bytes_read = (DWORD)result;
+    if (overlapped) {
+        overlapped->Internal = 0;
+        overlapped->InternalHigh = (ULONG_PTR)result;
+    }
+    return TRUE;
+}
+
+BOOL GetOverlappedResult(HANDLE file, OVERLAPPED* overlapped, LPDWORD transferred, BOOL wait) {
+    (void)file;
+    (void)wait;
+    if (transferred) *transferred = (DWORD)overlapped->InternalHigh;
+    if (overlapped->Internal != 0) {
+        SetLastError((DWORD)overlapped->Internal);
+        return FALSE;
+    }
+    return TRUE;
+}
+
+BOOL SetFilePointerEx(HANDLE file, LARGE_INTEGER distance, LARGE_INTEGER* position, DWORD method) {
+    int fd = file_descriptor(file);
+    if (fd < 0) return FALSE;
+
+    int whence = method == FILE_END ? SEEK_END : method == FILE_CURRENT ? SEEK_CUR : SEEK_SET;
+    off_t result = lseek(fd, (off_t)distance.QuadPart, whence);
+    if (result < 0) {
+        set_errno_error(errno);
+        return FALSE;
+    }
+    if (position) position->QuadPart = (LONGLONG)result;
+    return TRUE;
+}
+
+BOOL SetEndOfFile(HANDLE file) {
+    int fd = file_descriptor(file);
+    if (fd < 0) return FALSE;
+
+    off_t position = lseek(fd, 0, SEEK_CUR);
+    if (position < 0 || ftruncate(fd, position) != 0) {
+        set_errno_error(errno);
+        return FALSE;
+    }
+    return TRUE;
+}
+
+BOOL GetFileSizeEx(HANDLE file, LARGE_INTEGER* size) {
+    int fd = file_descriptor(file);
+    if (fd < 0) return FALSE;
+
+    struct stat info;
+    if (fstat(fd, &info) != 0) {
+        set_errno_error(errno);
+        return FALSE;
+    }
+    size->QuadPart = (LONGLONG)info.st_size;
+    return TRUE;
+}
+
+// Also writes back pages dirtied through mapped views of the file
+BOOL FlushFileBuffers(HANDLE file) {
+    int fd = file_descriptor(file);
+    if (fd < 0) return FALSE;
+
+    if (fsync(fd) != 0) {
+        set_errno_error(errno);
+        return FALSE;
+    }
+    return TRUE;
+}
+
+// Extended regions already read back as zeros without being written
+BOOL SetFileValidData(HANDLE file, LONGLONG length) {
+    (void)length;
+    return file_descriptor(file) >= 0;
+}
+
+// Grows the file to the mapping size, as Windows does
+HANDLE CreateFileMappingA(HANDLE file, void* security, DWORD protect,
+                          DWORD size_high, DWORD size_low, LPCSTR name) {
+    (void)security;
+    (void)protect;
+    (void)name;
+    int fd = file_descriptor(file);
+    if (fd < 0) return NULL;
+
+    ULONGLONG size = ((ULONGLONG)size_high << 32) | size_low;
+    struct stat info;
+    if (fstat(fd, &info) != 0) {
+        set_errno_error(errno);
+        return NULL;
+    }
+    if (size == 0) {
+        size = (ULONGLONG)info.st_size;
+    } else if ((ULONGLONG)info.st_size < size && ftruncate(fd, (off_t)size) != 0) {
+        set_errno_error(errno);
+        return NULL;
+    }
+
+    int mapping_fd = dup(fd);
+    if (mapping_fd < 0) {
+        set_errno_error(errno);
+        return NULL;
+    }
+
+    PlatformHandle* mapping = new_handle(HANDLE_MAPPING);
+    if (!mapping) {
+        close(mapping_fd);
+        return NULL;
+    }
+    mapping->fd = mapping_fd;
+    mapping->mapping_size = size;
+    return mapping;
+}
+
+LPVOID MapViewOfFile(HANDLE object, DWORD access, DWORD offset_high, DWORD offset_low,
+                     SIZE_T size) {
+    PlatformHandle* mapping = (PlatformHandle*)object;
+    if (!mapping || mapping->kind != HANDLE_MAPPING) {
+        SetLastError(ERROR_INVALID_HANDLE);
+        return NULL;
+    }
+
+    ULONGLONG offset = ((ULONGLONG)offset_high << 32) | offset_low;
+    if (size == 0) {
+        size = (SIZE_T)(mapping->mapping_size - offset);
+    }
+    int protection = (access & FILE_MAP_WRITE) ? PROT_READ | PROT_WRITE : PROT_READ;
+    void* address = mmap(NULL, size, protection, MAP_SHARED, mapping->fd, (off_t)offset);
+    if (address == MAP_FAILED) {
+        set_errno_error(errno);
+        return NULL;
+    }
+
+    pthread_mutex_lock(&views.lock);
+    for (size_t i = 0; i < PLATFORM_MAX_VIEWS; i++) {
+        if (!views.address[i]) {
+            views.address[i] = address;
+            views.size[i] = size;
+            pthread_mutex_unlock(&views.lock);
+            return address;
+        }
+    }
+    pthread_mutex_unlock(&views.lock);
+
+    munmap(address, size);
+    SetLastError(ERROR_NOT_ENOUGH_MEMORY);
+    return NULL;
+}
+
+// Starts write-back of the range; FlushFileBuffers() waits for it
+BOOL FlushViewOfFile(LPCVOID address, SIZE_T size) {
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    uintptr_t start = (uintptr_t)address / page * page;
+    uintptr_t end = (uintptr_t)address + size;
+
+    if (size == 0) {
+        pthread_mutex_lock(&views.lock);
+        for (size_t i = 0; i < PLATFORM_MAX_VIEWS; i++) {
+            uintptr_t base = (uintptr_t)views.address[i];
+            if (base && (uintptr_t)address >= base && (uintptr_t)address < base + views.size[i]) {
+                end = base + views.size[i];
+                break;
+            }
+        }
+        pthread_mutex_unlock(&views.lock);
+    }
+
+    if (end > start && msync((void*)start, end - start, MS_ASYNC) != 0) {
+        set_errno_error(errno);
+        return FALSE;
+    }
+    return TRUE;
+}
+
+BOOL UnmapViewOfFile(LPCVOID address) {
+    pthread_mutex_lock(&views.lock);
+    for (size_t i = 0; i < PLATFORM_MAX_VIEWS; i++) {
+        if (views.address[i] == address) {
+            size_t size = views.size[i];
+            views.address[i] = NULL;
+            pthread_mutex_unlock(&views.lock);
+            return munmap((void*)address, size) == 0;
+        }
+    }
+    pthread_mutex_unlock(&views.lock);
+
+    SetLastError(ERROR_INVALID_PARAMETER);
+    return FALSE;
+}
+
+// Without MOVEFILE_REPLACE_EXISTING an existing target fails the move
+BOOL MoveFileExA(LPCSTR from, LPCSTR to, DWORD flags) {
+    if (flags & MOVEFILE_REPLACE_EXISTING) {
+        if (rename(from, to) != 0) {
+            set_errno_error(errno);
+            return FALSE;
+        }
+    } else {
+        if (link(from, to) != 0) {
+            set_errno_error(errno);
+            return FALSE;
+        }
+        unlink(from);
+    }
+
+    if (flags & MOVEFILE_WRITE_THROUGH) {
+        sync();
+    }
+    return TRUE;
+}
+
+BOOL DeleteFileA(LPCSTR path) {
+    if (unlink(path) != 0) {
+        set_errno_error(errno);
+        return FALSE;
+    }
+    return TRUE;
+}
+
+BOOL CreateDirectoryA(LPCSTR path, void* security) {
+    (void)security;
+    if (mkdir(path, 0755) != 0) {
+        set_errno_error(errno);
+        return FALSE;
+    }
+    return TRUE;
+}
+
+DWORD GetFileAttributesA(LPCSTR path) {
+    struct stat info;
+    if (stat(path, &info) != 0) {
+        set_errno_error(errno);
+        return INVALID_FILE_ATTRIBUTES;
+    }
+    return S_ISDIR(info.st_mode) ? FILE_ATTRIBUTE_DIRECTORY : FILE_ATTRIBUTE_NORMAL;
+}
+
+BOOL GetFileAttributesExA(LPCSTR path, GET_FILEEX_INFO_LEVELS level, LPVOID info) {
+    (void)level;
+    struct stat status;
+    if (stat(path, &status) != 0) {
+        set_errno_error(errno);
+        return FALSE;
+    }
+
+    WIN32_FILE_ATTRIBUTE_DATA* data = (WIN32_FILE_ATTRIBUTE_DATA*)info;
+    ULONGLONG changed = unix_to_filetime(status.st_ctim.tv_sec, status.st_ctim.tv_nsec);
+    ULONGLONG accessed = unix_to_filetime(status.st_atim.tv_sec, status.st_atim.tv_nsec);
+    ULONGLONG modified = unix_to_filetime(status.st_mtim.tv_sec, status.st_mtim.tv_nsec);
+
+    data->dwFileAttributes = S_ISDIR(status.st_mode) ? FILE_ATTRIBUTE_DIRECTORY
+                                                     : FILE_ATTRIBUTE_NORMAL;
+    data->ftCreationTime.dwLowDateTime = (DWORD)changed;
+    data->ftCreationTime.dwHighDateTime = (DWORD)(changed >> 32);
+    data->ftLastAccessTime.dwLowDateTime = (DWORD)accessed;
+    data->ftLastAccessTime.dwHighDateTime = (DWORD)(accessed >> 32);
+    data->ftLastWriteTime.dwLowDateTime = (DWORD)modified;
+    data->ftLastWriteTime.dwHighDateTime = (DWORD)(modified >> 32);
+    data->nFileSizeHigh = (DWORD)((ULONGLONG)status.st_size >> 32);
+    data->nFileSizeLow = (DWORD)status.st_size;
+    return TRUE;
+}
+
+// Processes
+HANDLE GetCurrentProcess(void) {
+    if (current_process.pid == 0) {
+        current_process.pid = getpid();
+        read_process_start(current_process.pid, &current_process.start_ticks);
+    }
+    return &current_process;
+}
+
+DWORD GetCurrentProcessId(void) {
+    return (DWORD)getpid();
+}
+
+// Field 22 of /proc/<pid>/stat: start time in clock ticks after boot
+static bool read_process_start(pid_t pid, ULONGLONG* ticks) {
+    char path[64];
+    char line[1024];
+    snprintf(path, sizeof(path), "/proc/%d/stat", (int)pid);
+
+    FILE* file = fopen(path, "r");
+    if (!file) return false;
+    size_t length = fread(line, 1, sizeof(line) - 1, file);
+    fclose(file);
+    line[length] = '\0';
+
+    // The command name may contain spaces and parentheses
+    char* field = strrchr(line, ')');
+    if (!field) return false;
+    for (int i = 2; i < 22 && field; i++) {
+        field = strchr(field + 1, ' ');
+    }
+    if (!field) return false;
+
+    *ticks = strtoull(field + 1, NULL, 10);
+    return true;
+}
+
+HANDLE OpenProcess(DWORD access, BOOL inherit, DWORD pid) {
+    (void)access;
+    (void)inherit;
+    ULONGLONG ticks = 0;
+    if (pid == 0 || !read_process_start((pid_t)pid, &ticks)) {
+        SetLastError(ERROR_INVALID_PARAMETER);
+        return NULL;
+    }
+
+    PlatformHandle* process = new_handle(HANDLE_PROCESS);
+    if (!process) return NULL;
+    process->pid = (pid_t)pid;
+    process->start_ticks = ticks;
+    return process;
+}
+
+// Only the creation time is known; boot time plus the start ticks
+BOOL GetProcessTimes(HANDLE object, FILETIME* creation, FILETIME* exit,
+                     FILETIME* kernel, FILETIME* user) {
+    PlatformHandle* process = (PlatformHandle*)object;
+    if (!process || process->kind != HANDLE_PROCESS) {
+        SetLastError(ERROR_INVALID_HANDLE);
+        return FALSE;
+    }
+
+    ULONGLONG boot = 0;
+    char line[256];
+    FILE* file = fopen("/proc/stat", "r");
+    while (file && fgets(line, sizeof(line), file)) {
+        if (strncmp(line, "btime ", 6) == 0) {
+            boot = strtoull(line + 6, NULL, 10);
+            break;
+        }
+    }
+    if (file) fclose(file);
+
+    long hertz = sysconf(_SC_CLK_TCK);
+    ULONGLONG value = unix_to_filetime((time_t)boot, 0) +
+                      process->start_ticks * FILETIME_PER_SECOND / (ULONGLONG)(hertz > 0 ? hertz : 100);
+    creation->dwLowDateTime = (DWORD)value;
+    creation->dwHighDateTime = (DWORD)(value >> 32);
+    memset(exit, 0, sizeof(FILETIME));
+    memset(kernel, 0, sizeof(FILETIME));
+    memset(user, 0, sizeof(FILETIME));
+    return TRUE;
+}
+
+// The executable path, or the command name where it cannot be read
+BOOL QueryFullProcessImageNameA(HANDLE object, DWORD flags, LPSTR path, LPDWORD size) {
+    (void)flags;
+    PlatformHandle* process = (PlatformHandle*)object;
+    if (!process || process->kind != HANDLE_PROCESS || !path || !size || *size == 0) {
+        SetLastError(ERROR_INVALID_PARAMETER);
+        return FALSE;
+    }
+
+    char link[64];
+    snprintf(link, sizeof(link), "/proc/%d/exe", (int)process->pid);
+    ssize_t length = readlink(link, path, *size - 1);
+    if (length < 0) {
+        snprintf(link, sizeof(link), "/proc/%d/comm", (int)process->pid);
+        FILE* file = fopen(link, "r");
+        if (!file) {
+            set_errno_error(errno);
+            return FALSE;
+        }
+        length = (ssize_t)fread(path, 1, *size - 1, file);
+        fclose(file);
+        while (length > 0 && path[length - 1] == '\n') length--;
+    }
+
+    path[length] = '\0';
+    *size = (DWORD)length;
+    return length > 0;
+}
+
+// Handles still referenced, including those of running threads
+BOOL GetProcessHandleCount(HANDLE object, LPDWORD count) {
+    if (object != &current_process || !count) {
+        SetLastError(ERROR_INVALID_PARAMETER);
+        return FALSE;
+    }
+    *count = atomic_load(&open_handles);
+    return TRUE;
+}
+
+BOOL GetProcessMemoryInfo(HANDLE object, PROCESS_MEMORY_COUNTERS* counters, DWORD size) {
+    if (object != &current_process || !counters || size < sizeof(PROCESS_MEMORY_COUNTERS)) {
+        SetLastError(ERROR_INVALID_PARAMETER);
+        return FALSE;
+    }
+
+    memset(counters, 0, sizeof(PROCESS_MEMORY_COUNTERS));
+    counters->cb = sizeof(PROCESS_MEMORY_COUNTERS);
+    counters->WorkingSetSize = read_status_kb("VmRSS:") * 1024;
+    counters->PeakWorkingSetSize = read_status_kb("VmHWM:") * 1024;
+    counters->PagefileUsage = read_status_kb("RssAnon:") * 1024;
+    counters->PeakPagefileUsage = counters->PagefileUsage;
+    return counters->WorkingSetSize != 0;
+}
+
+// A "<field> <n> kB" line of /proc/self/status, 0 if missing
+static SIZE_T read_status_kb(const char* field) {
+    char line[256];
+    size_t length = strlen(field);
+    SIZE_T value = 0;
+
+    FILE* file = fopen("/proc/self/status", "r");
+    while (file && fgets(line, sizeof(line), file)) {
+        if (strncmp(line, field, length) == 0) {
+            value = (SIZE_T)strtoull(line + length, NULL, 10);
+            break;
+        }
+    }
+    if (file) fclose(file);
+    return value;
+}
+
+#endif
@@ -0,0 +1,199 @@
+#include "proccache.h"
+#include <stdio.h>
+#include <string.h>
+
+#ifdef DEBUG
+    #define PROCCACHE_DEBUG(msg, ...) fprintf(stderr, "[ProcCache] " msg "\n", ##__VA_ARGS__)
+#else
+    #define PROCCACHE_DEBUG(msg, ...)
+#endif
+
+// One cached process; an entry is free when handle is NULL
+typedef struct {
+    DWORD pid;
+    ULONGLONG start_time;             // Process creation time (FILETIME)
+    HANDLE handle;                    // Kept open to detect process exit
+    ULONGLONG last_used;              // LRU clock value of the last hit
+    char name[PROCCACHE_MAX_NAME];    // Executable name without the path
+} ProcessEntry;
+
+// Process cache state
+typedef struct {
+    CRITICAL_SECTION lock;
+    bool initialized;
+    DWORD last_error;
+    ProcessEntry entries[PROCCACHE_MAX_ENTRIES];
+    ULONGLONG clock;                  // Incremented on every lookup
+    size_t hits;
+    size_t misses;
+} ProcessCache;
+
+static ProcessCache cache = {0};
+
+// Internal helpers
+static ProcessEntry* find_entry(DWORD pid);
+static ProcessEntry* claim_entry(void);
+static void release_entry(ProcessEntry* entry);
+static bool open_entry(ProcessEntry* entry, DWORD pid);
+
+bool init_process_cache(void) {
+    if (cache.initialized) {
+        cache.last_error = PROCCACHE_ERROR_INIT;
+        return false;
+    }
+
+    if (!InitializeCriticalSectionAndSpinCount(&cache.lock, 0x00000400)) {
+        cache.last_error = PROCCACHE_ERROR_INIT;
+        return false;
+    }
+
+    memset(cache.entries, 0, sizeof(cache.entries));
+    cache.clock = 0;
+    cache.hits = 0;
+    cache.misses = 0;
+    cache.initialized = true;
+    cache.last_error = PROCCACHE_ERROR_NONE;
+
+    PROCCACHE_DEBUG("Process cache initialized (%d entries)", PROCCACHE_MAX_ENTRIES);
+    return true;
+}
+
+void cleanup_process_cache(void) {
+    if (!cache.initialized) return;
+
+    EnterCriticalSection(&cache.lock);
+    for (size_t i = 0; i < PROCCACHE_MAX_ENTRIES; i++) {
+        release_entry(&cache.entries[i]);
+    }
+    cache.initialized = false;
+    LeaveCriticalSection(&cache.lock);
+
+    DeleteCriticalSection(&cache.lock);
+    PROCCACHE_DEBUG("Process cache cleaned up (%zu hits, %zu misses)", cache.hits, cache.misses);
+}
+
+// Copies the executable name of pid into buffer, opening the process only
+// if it is not cached yet. Returns false (with an empty buffer) if the
+// process cannot be queried.
+bool lookup_process_name(DWORD pid, char* buffer, size_t size) {
+    if (!buffer || size == 0) {
+        cache.last_error = PROCCACHE_ERROR_INVALID;
+        return false;
+    }
+    buffer[0] = '\0';
+
+    if (!cache.initialized) {
+        cache.last_error = PROCCACHE_ERROR_INIT;
+        return false;
+    }
+
+    EnterCriticalSection(&cache.lock);
+    cache.clock++;
+
+    ProcessEntry* entry = find_entry(pid);
+    if (entry) {
+        cache.hits++;
+    } else {
+        cache.misses++;
+        entry = claim_entry();
+        if (!open_entry(entry, pid)) {
+            cache.last_error = PROCCACHE_ERROR_ACCESS;
+            LeaveCriticalSection(&cache.lock);
+            return false;
+        }
+    }
+
+    entry->last_used = cache.clock;
+    strncpy(buffer, entry->name, size - 1);
+    buffer[size - 1] = '\0';
+
+    LeaveCriticalSection(&cache.lock);
+    return true;
+}
+
+bool is_process_cache_initialized(void) {
+    return cache.initialized;
+}
+
+size_t get_process_cache_hits(void) {
+    return cache.hits;
+}
+
+size_t get_process_cache_misses(void) {
+    return cache.misses;
+}
+
+DWORD get_process_cache_last_error(void) {
+    return cache.last_error;
+}
+
+// Internal helper functions
+
+// Returns the live entry for pid. An entry whose process has exited is
+// dropped here, since its pid may already belong to a new process.
+static ProcessEntry* find_entry(DWORD pid) {
+    for (size_t i = 0; i < PROCCACHE_MAX_ENTRIES; i++) {
+        ProcessEntry* entry = &cache.entries[i];
+        if (!entry->handle || entry->pid != pid) continue;
+
+        if (WaitForSingleObject(entry->handle, 0) == WAIT_TIMEOUT) {
+            return entry;
+        }
+        PROCCACHE_DEBUG("Process %lu exited, dropping cached name", (unsigned long)pid);
+        release_entry(entry);
+        return NULL;
+    }
+    return NULL;
+}
+
+// Returns a free entry, evicting the least recently used one if necessary
+static ProcessEntry* claim_entry(void) {
+    ProcessEntry* oldest = &cache.entries[0];
+
+    for (size_t i = 0; i < PROCCACHE_MAX_ENTRIES; i++) {
+        ProcessEntry* entry = &cache.entries[i];
+        if (!entry->handle) return entry;
+        if (entry->last_used < oldest->last_used) oldest = entry;
+    }
+
+    release_entry(oldest);
+    return oldest;
+}
+
+static void release_entry(ProcessEntry* entry) {
+    if (entry->handle) {
+        CloseHandle(entry->handle);
+    }
+    memset(entry, 0, sizeof(ProcessEntry));
+}
+
+// Opens pid and fills entry with its start time and executable name
+static bool open_entry(ProcessEntry* entry, DWORD pid) {
+    HANDLE process = OpenProcess(PROCESS_QUERY_LIMITED_INFORMATION | SYNCHRONIZE, FALSE, pid);
+    if (!process) return false;
+
+    FILETIME created, exited, kernel, user;
+    char path[MAX_PATH];
+    DWORD length = MAX_PATH;
+
+    if (!GetProcessTimes(process, &created, &exited, &kernel, &user) ||
+        !QueryFullProcessImageNameA(process, 0, path, &length)) {
+        CloseHandle(process);
+        return false;
+    }
+
+    // Image paths use '\\' on Windows and '/' elsewhere
+    const char* name = strrchr(path, '\\');
+    const char* slash = strrchr(path, '/');
+    if (slash && (!name || slash > name)) name = slash;
+    name = name ? name + 1 : path;
+
+    entry->pid = pid;
+    entry->start_time = ((ULONGLONG)created.dwHighDateTime << 32) | created.dwLowDateTime;
+    entry->handle = process;
+    strncpy(entry->name, name, PROCCACHE_MAX_NAME - 1);
+    entry->name[PROCCACHE_MAX_NAME - 1] = '\0';
+
+    PROCCACHE_DEBUG("Cached process %lu: %s", (unsigned long)pid, entry->name);
+    return true;
+}
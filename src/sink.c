@@ -0,0 +1,644 @@
+#include "sink.h"
+#include "aggregate.h"
+#include "buffer.h"
+#include "format.h"
+#include "intern.h"
+#include "metrics.h"
+#include "proccache.h"
+#include "trace.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Debug logging
+#ifdef DEBUG
+    #define SINK_DEBUG(msg, ...) fprintf(stderr, "[Sink] " msg "\n", ##__VA_ARGS__)
+#else
+    #define SINK_DEBUG(msg, ...)
+#endif
+
+// Global sink registry
+static SinkSystem sinks = {0};
+
+// Internal helpers
+static void set_sink_error(DWORD error);
+static void release_string_tables(void);
+static size_t round_queue_size(size_t size);
+static void free_sink_state(SinkState* sink);
+static void stop_sink_worker(SinkState* sink);
+static void enqueue_sink_events(SinkState* sink, const Event* events, size_t count);
+static size_t write_queued_events(SinkState* sink);
+static DWORD WINAPI sink_worker_proc(LPVOID param);
+
+// Built-in sinks
+static bool log_sink_init(void* context);
+static bool log_sink_write(void* context, const SinkBatch* batch);
+static bool log_sink_flush(void* context);
+static bool memory_sink_init(void* context);
+static bool memory_sink_write(void* context, const SinkBatch* batch);
+static void memory_sink_close(void* context);
+static bool aggregate_sink_init(void* context);
+static bool aggregate_sink_emit(void* context, InternId process,
+                                const char* record, size_t size);
+static bool aggregate_sink_write(void* context, const SinkBatch* batch);
+static bool aggregate_sink_flush(void* context);
+static void aggregate_sink_close(void* context);
+
+// Latest output of the memory sink, oldest byte at end once wrapped
+// The lock is created once and kept, so readers never race its deletion
+static struct {
+    CRITICAL_SECTION lock;
+    volatile bool lock_ready;
+    bool open;
+    char data[SINK_MEMORY_VIEW_SIZE];
+    size_t end;          // Next byte to write
+    bool wrapped;        // data is full and end is the oldest byte
+} memory_view;
+
+// Only the log sink's worker formats through this cache
+static TimestampCache log_sink_timestamps;
+
+static const SinkDescriptor log_sink = {
+    .name = "log",
+    .format = SINK_FORMAT_EVENTS,
+    .context = &log_sink_timestamps,
+    .init = log_sink_init,
+    .write_batch = log_sink_write,
+    .flush = log_sink_flush
+};
+
+// Summaries of the aggregate sink; interval_ms is read at registration
+static struct {
+    Aggregator aggregator;   // Worker thread only
+    volatile DWORD interval_ms;
+} aggregate_state = { .interval_ms = AGGREGATE_DEFAULT_INTERVAL };
+
+static const SinkDescriptor memory_sink = {
+    .name = "memory",
+    .format = SINK_FORMAT_TEXT,
+    .context = &memory_view,
+    .init = memory_sink_init,
+    .write_batch = memory_sink_write,
+    .close = memory_sink_close
+};
+
+static const SinkDescriptor aggregate_sink = {
+    .name = "aggregate",
+    .format = SINK_FORMAT_EVENTS,
+    .context = &aggregate_state,
+    .init = aggregate_sink_init,
+    .write_batch = aggregate_sink_write,
+    .flush = aggregate_sink_flush,
+    .close = aggregate_sink_close
+};
+
+bool init_sinks(void) {
+    if (sinks.initialized) {
+        set_sink_error(SINK_ERROR_INIT);
+        return false;
+    }
+
+    if (!InitializeCriticalSectionAndSpinCount(&sinks.lock, 0x00000400)) {
+        set_sink_error(SINK_ERROR_INIT);
+        return false;
+    }
+
+    // Queued window events resolve their strings on the workers, so the
+    // registry keeps the tables until every queue is written out
+    sinks.owns_intern = !is_intern_initialized();
+    sinks.owns_process_cache = !is_process_cache_initialized();
+    if ((sinks.owns_intern && !init_intern_table()) ||
+        (sinks.owns_process_cache && !init_process_cache())) {
+        release_string_tables();
+        DeleteCriticalSection(&sinks.lock);
+        set_sink_error(SINK_ERROR_INIT);
+        return false;
+    }
+
+    memset(sinks.slots, 0, sizeof(sinks.slots));
+    sinks.next_id = 0;
+    sinks.last_error = SINK_ERROR_NONE;
+    metrics_reset(METRIC_SINK_EVENTS, METRIC_SINK_FAILED_WRITES);
+    sinks.initialized = true;
+
+    SINK_DEBUG("Sink registry initialized");
+    return true;
+}
+
+// Unregisters every sink, writing out whatever is still queued for it
+void cleanup_sinks(void) {
+    if (!sinks.initialized) return;
+
+    for (int i = 0; i < SINK_MAX_SINKS; i++) {
+        EnterCriticalSection(&sinks.lock);
+        SinkState* sink = sinks.slots[i];
+        sinks.slots[i] = NULL;
+        LeaveCriticalSection(&sinks.lock);
+
+        if (sink) {
+            stop_sink_worker(sink);
+            free_sink_state(sink);
+        }
+    }
+
+    sinks.initialized = false;
+    DeleteCriticalSection(&sinks.lock);
+    release_string_tables();
+    SINK_DEBUG("Sink registry cleaned up");
+}
+
+// Releases the intern table and process cache if init_sinks() created them
+static void release_string_tables(void) {
+    if (sinks.owns_process_cache) {
+        cleanup_process_cache();
+        sinks.owns_process_cache = false;
+    }
+    if (sinks.owns_intern) {
+        cleanup_intern_table();
+        sinks.owns_intern = false;
+    }
+}
+
+bool is_sinks_initialized(void) {
+    return sinks.initialized;
+}
+
+// Opens the sink and starts its worker; id (optional) receives its handle
+bool register_sink(const SinkDescriptor* desc, DWORD* id) {
+    if (id) *id = SINK_INVALID_ID;
+
+    if (!sinks.initialized) {
+        set_sink_error(SINK_ERROR_INIT);
+        return false;
+    }
+    if (!desc || !desc->write_batch || desc->format > SINK_FORMAT_TEXT ||
+        desc->queue_size > ((size_t)1 << 24)) {
+        set_sink_error(SINK_ERROR_INVALID);
+        return false;
+    }
+
+    // VirtualAlloc returns page-aligned, zeroed memory, so head and tail
+    // really sit on cache lines of their own
+    SinkState* sink = (SinkState*)VirtualAlloc(NULL, sizeof(SinkState),
+                                               MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+    if (!sink) {
+        set_sink_error(SINK_ERROR_MEMORY);
+        return false;
+    }
+
+    memcpy(&sink->desc, desc, sizeof(SinkDescriptor));
+    sink->capacity = round_queue_size(desc->queue_size ? desc->queue_size : SINK_DEFAULT_QUEUE_SIZE);
+    sink->events = (Event*)malloc(sink->capacity * sizeof(Event));
+    if (desc->format == SINK_FORMAT_TEXT) {
+        sink->text = (char*)malloc(SINK_BATCH_SIZE * BUFFER_MAX_EVENT_SIZE);
+    }
+    sink->signal = CreateEvent(NULL, FALSE, FALSE, NULL);
+    if (!sink->events || (desc->format == SINK_FORMAT_TEXT && !sink->text) || !sink->signal) {
+        set_sink_error(SINK_ERROR_MEMORY);
+        free_sink_state(sink);
+        return false;
+    }
+    init_timestamp_cache(&sink->timestamps);
+
+    if (desc->init && !desc->init(desc->context)) {
+        set_sink_error(SINK_ERROR_OPEN);
+        SINK_DEBUG("Sink %s failed to open", desc->name ? desc->name : "?");
+        free_sink_state(sink);
+        return false;
+    }
+
+    EnterCriticalSection(&sinks.lock);
+
+    int slot = -1;
+    for (int i = 0; i < SINK_MAX_SINKS; i++) {
+        if (!sinks.slots[i]) {
+            slot = i;
+            break;
+        }
+    }
+    if (slot < 0) {
+        LeaveCriticalSection(&sinks.lock);
+        set_sink_error(SINK_ERROR_FULL);
+        if (desc->close) desc->close(desc->context);
+        free_sink_state(sink);
+        return false;
+    }
+
+    sink->running = true;
+    sink->thread = CreateThread(NULL, 0, sink_worker_proc, sink, 0, NULL);
+    if (!sink->thread) {
+        LeaveCriticalSection(&sinks.lock);
+        set_sink_error(SINK_ERROR_THREAD);
+        if (desc->close) desc->close(desc->context);
+        free_sink_state(sink);
+        return false;
+    }
+
+    sink->id = sinks.next_id++;
+    sinks.slots[slot] = sink;
+    if (id) *id = sink->id;
+
+    LeaveCriticalSection(&sinks.lock);
+
+    SINK_DEBUG("Sink %s registered (id %lu, queue %zu)",
+               desc->name ? desc->name : "?", (unsigned long)sink->id, sink->capacity);
+    return true;
+}
+
+// Detaches the sink from dispatch, then lets its worker write out the
+// queue, flush and close. Must not be called from the sink's own callbacks.
+bool unregister_sink(DWORD id) {
+    if (!sinks.initialized) {
+        set_sink_error(SINK_ERROR_INIT);
+        return false;
+    }
+
+    SinkState* sink = NULL;
+    EnterCriticalSection(&sinks.lock);
+    for (int i = 0; i < SINK_MAX_SINKS; i++) {
+        if (sinks.slots[i] && sinks.slots[i]->id == id) {
+            sink = sinks.slots[i];
+            sinks.slots[i] = NULL;
+            break;
+        }
+    }
+    LeaveCriticalSection(&sinks.lock);
+
+    if (!sink) {
+        set_sink_error(SINK_ERROR_INVALID);
+        return false;
+    }
+
+    stop_sink_worker(sink);
+    SINK_DEBUG("Sink %s unregistered: %zu delivered, %zu dropped",
+               sink->desc.name ? sink->desc.name : "?",
+               atomic_load(&sink->delivered), atomic_load(&sink->dropped));
+    free_sink_state(sink);
+    return true;
+}
+
+// Runs on the hook consumer thread. The lock only excludes registration
+// changes; the sinks' workers never take it.
+void dispatch_sink_events(const Event* events, size_t count) {
+    if (!sinks.initialized || !events || count == 0) return;
+
+    EnterCriticalSection(&sinks.lock);
+    for (int i = 0; i < SINK_MAX_SINKS; i++) {
+        if (sinks.slots[i]) {
+            enqueue_sink_events(sinks.slots[i], events, count);
+        }
+    }
+    LeaveCriticalSection(&sinks.lock);
+}
+
+bool get_sink_stats(DWORD id, SinkStats* stats) {
+    if (!stats || !sinks.initialized) {
+        set_sink_error(SINK_ERROR_INVALID);
+        return false;
+    }
+
+    bool found = false;
+    EnterCriticalSection(&sinks.lock);
+    for (int i = 0; i < SINK_MAX_SINKS; i++) {
+        SinkState* sink = sinks.slots[i];
+        if (!sink || sink->id != id) continue;
+
+        stats->delivered = atomic_load_explicit(&sink->delivered, memory_order_relaxed);
+        stats->dropped = atomic_load_explicit(&sink->dropped, memory_order_relaxed);
+        stats->written = atomic_load_explicit(&sink->written, memory_order_relaxed);
+        stats->failed = atomic_load_explicit(&sink->failed, memory_order_relaxed);
+        stats->queue_depth = atomic_load_explicit(&sink->tail, memory_order_relaxed) -
+                             atomic_load_explicit(&sink->head, memory_order_relaxed);
+        found = true;
+        break;
+    }
+    LeaveCriticalSection(&sinks.lock);
+
+    if (!found) set_sink_error(SINK_ERROR_INVALID);
+    return found;
+}
+
+size_t get_sink_count(void) {
+    if (!sinks.initialized) return 0;
+
+    size_t count = 0;
+    EnterCriticalSection(&sinks.lock);
+    for (int i = 0; i < SINK_MAX_SINKS; i++) {
+        if (sinks.slots[i]) count++;
+    }
+    LeaveCriticalSection(&sinks.lock);
+    return count;
+}
+
+DWORD get_sink_last_error(void) {
+    return sinks.last_error;
+}
+
+const SinkDescriptor* get_log_sink(void) {
+    return &log_sink;
+}
+
+const SinkDescriptor* get_memory_sink(void) {
+    return &memory_sink;
+}
+
+const SinkDescriptor* get_aggregate_sink(void) {
+    return &aggregate_sink;
+}
+
+// Takes effect for the next registration of the aggregate sink
+bool set_aggregate_sink_interval(DWORD interval_ms) {
+    if (interval_ms == 0) interval_ms = AGGREGATE_DEFAULT_INTERVAL;
+    if (interval_ms < AGGREGATE_MIN_INTERVAL) {
+        set_sink_error(SINK_ERROR_INVALID);
+        return false;
+    }
+    aggregate_state.interval_ms = interval_ms;
+    return true;
+}
+
+// Copies the memory sink's text, oldest first, NUL-terminated; returns its
+// length. Once the view has wrapped its first line may be cut.
+size_t read_memory_sink(char* out, size_t size) {
+    if (!out || size == 0) return 0;
+    out[0] = '\0';
+    if (!memory_view.lock_ready) return 0;
+
+    EnterCriticalSection(&memory_view.lock);
+    size_t stored = !memory_view.open ? 0 :
+                    memory_view.wrapped ? SINK_MEMORY_VIEW_SIZE : memory_view.end;
+    size_t length = stored < size - 1 ? stored : size - 1;
+
+    // The newest length bytes end at memory_view.end
+    size_t start = (memory_view.end + SINK_MEMORY_VIEW_SIZE - length) % SINK_MEMORY_VIEW_SIZE;
+    size_t first = SINK_MEMORY_VIEW_SIZE - start;
+    if (first > length) first = length;
+    memcpy(out, memory_view.data + start, first);
+    memcpy(out + first, memory_view.data, length - first);
+    LeaveCriticalSection(&memory_view.lock);
+
+    out[length] = '\0';
+    return length;
+}
+
+static void set_sink_error(DWORD error) {
+    sinks.last_error = error;
+    SINK_DEBUG("Sink error set: %lu", (unsigned long)error);
+}
+
+static size_t round_queue_size(size_t size) {
+    size_t capacity = 1;
+    while (capacity < size) capacity <<= 1;
+    return capacity;
+}
+
+static void free_sink_state(SinkState* sink) {
+    if (sink->thread) CloseHandle(sink->thread);
+    if (sink->signal) CloseHandle(sink->signal);
+    free(sink->events);
+    free(sink->text);
+    VirtualFree(sink, 0, MEM_RELEASE);
+}
+
+// The worker writes out the rest of the queue before it exits
+static void stop_sink_worker(SinkState* sink) {
+    sink->running = false;
+    SetEvent(sink->signal);
+    WaitForSingleObject(sink->thread, INFINITE);
+}
+
+// Producer side of a sink queue. A full queue drops the events that do not
+// fit instead of waiting, so one slow sink never holds up the others.
+static void enqueue_sink_events(SinkState* sink, const Event* events, size_t count) {
+    size_t tail = atomic_load_explicit(&sink->tail, memory_order_relaxed);
+    size_t head = atomic_load_explicit(&sink->head, memory_order_acquire);
+    size_t space = sink->capacity - (tail - head);
+    size_t queued = count < space ? count : space;
+
+    if (queued < count) {
+        atomic_fetch_add_explicit(&sink->dropped, count - queued, memory_order_relaxed);
+        metrics_add(METRIC_SINK_EVENTS_DROPPED, count - queued);
+    }
+    if (queued == 0) return;
+
+    size_t first = tail & (sink->capacity - 1);
+    size_t span = sink->capacity - first;
+    if (span > queued) span = queued;
+    memcpy(&sink->events[first], events, span * sizeof(Event));
+    memcpy(sink->events, events + span, (queued - span) * sizeof(Event));
+
+    atomic_store_explicit(&sink->tail, tail + queued, memory_order_release);
+    atomic_fetch_add_explicit(&sink->delivered, queued, memory_order_relaxed);
+    metrics_add(METRIC_SINK_EVENTS, queued);
+
+    // Wake the worker only if it had caught up with everything before these
+    // events. Pairs with the fence in sink_worker_proc().
+    atomic_thread_fence(memory_order_seq_cst);
+    if (atomic_load_explicit(&sink->head, memory_order_relaxed) == tail) {
+        SetEvent(sink->signal);
+    }
+}
+
+// Consumer side: hands one contiguous run of up to SINK_BATCH_SIZE queued
+// events to the sink, in place, and returns how many it consumed
+static size_t write_queued_events(SinkState* sink) {
+    size_t head = atomic_load_explicit(&sink->head, memory_order_relaxed);
+    size_t tail = atomic_load_explicit(&sink->tail, memory_order_acquire);
+    if (tail == head) return 0;
+
+    size_t first = head & (sink->capacity - 1);
+    size_t count = tail - head;
+    if (count > SINK_BATCH_SIZE) count = SINK_BATCH_SIZE;
+    if (count > sink->capacity - first) count = sink->capacity - first;
+
+    SinkBatch batch = {0};
+    batch.events = &sink->events[first];
+    batch.count = count;
+
+    if (sink->desc.format == SINK_FORMAT_TEXT) {
+        TRACE_EVENT(TRACE_KEYWORD_FORMAT, trace_format_start(count));
+        for (size_t i = 0; i < count; i++) {
+            batch.text_size += format_event_text(&batch.events[i], &sink->timestamps,
+                                                 sink->text + batch.text_size,
+                                                 BUFFER_MAX_EVENT_SIZE);
+        }
+        batch.text = sink->text;
+        TRACE_EVENT(TRACE_KEYWORD_FORMAT, trace_format_stop(count, batch.text_size));
+    }
+
+    if (!sink->desc.write_batch(sink->desc.context, &batch)) {
+        atomic_fetch_add_explicit(&sink->failed, count, memory_order_relaxed);
+        metrics_add(METRIC_SINK_FAILED_WRITES, count);
+    }
+    atomic_fetch_add_explicit(&sink->written, count, memory_order_relaxed);
+
+    atomic_store_explicit(&sink->head, head + count, memory_order_release);
+    return count;
+}
+
+// Worker thread: writes the queue out in batches, sleeps on the signal
+// once it has caught up and flushes the sink after a quiet period
+static DWORD WINAPI sink_worker_proc(LPVOID param) {
+    SinkState* sink = (SinkState*)param;
+    bool unflushed = false;
+
+    for (;;) {
+        if (write_queued_events(sink) > 0) {
+            unflushed = true;
+            continue;
+        }
+        if (!sink->running) break;
+
+        // Re-check after publishing head; pairs with the fence in enqueue_sink_events()
+        atomic_thread_fence(memory_order_seq_cst);
+        if (atomic_load_explicit(&sink->tail, memory_order_relaxed) !=
+            atomic_load_explicit(&sink->head, memory_order_relaxed)) {
+            continue;
+        }
+
+        DWORD wait = WaitForSingleObject(sink->signal, unflushed ? SINK_FLUSH_INTERVAL : INFINITE);
+        if (wait == WAIT_TIMEOUT) {
+            if (sink->desc.flush) sink->desc.flush(sink->desc.context);
+            unflushed = false;
+        }
+    }
+
+    if (sink->desc.flush) sink->desc.flush(sink->desc.context);
+    if (sink->desc.close) sink->desc.close(sink->desc.context);
+
+    SINK_DEBUG("Sink %s worker exiting", sink->desc.name ? sink->desc.name : "?");
+    return 0;
+}
+
+static bool log_sink_init(void* context) {
+    init_timestamp_cache((TimestampCache*)context);
+    return is_buffer_initialized();
+}
+
+// Formats the batch straight into reserved buffer entries in one pass.
+// Only key presses, clicks and window changes go to the text log.
+static bool log_sink_write(void* context, const SinkBatch* batch) {
+    TimestampCache* cache = (TimestampCache*)context;
+    bool success = true;
+    size_t formatted = 0;
+    size_t bytes = 0;
+
+    if (!begin_buffer_batch()) return false;
+    TRACE_EVENT(TRACE_KEYWORD_FORMAT, trace_format_start(batch->count));
+
+    for (size_t i = 0; i < batch->count; i++) {
+        const Event* event = &batch->events[i];
+        if (event->type != EVENT_KEY_PRESS && event->type != EVENT_MOUSE_CLICK &&
+            event->type != EVENT_WINDOW_CHANGE) {
+            continue;
+        }
+
+        char* entry = reserve_buffer(BUFFER_MAX_EVENT_SIZE);
+        if (!entry) {
+            success = false;
+            break;
+        }
+        size_t len = format_event_text(event, cache, entry, BUFFER_MAX_EVENT_SIZE);
+        if (!commit_buffer(len)) {
+            success = false;
+        }
+        formatted++;
+        bytes += len;
+    }
+
+    TRACE_EVENT(TRACE_KEYWORD_FORMAT, trace_format_stop(formatted, bytes));
+    return end_buffer_batch() && success;
+}
+
+// Quiet periods hand the pending output to the logger's writer
+static bool log_sink_flush(void* context) {
+    (void)context;
+    return get_buffer_size() == 0 || force_flush_buffer();
+}
+
+static bool memory_sink_init(void* context) {
+    (void)context;
+    if (!memory_view.lock_ready) {
+        if (!InitializeCriticalSectionAndSpinCount(&memory_view.lock, 0x00000400)) {
+            return false;
+        }
+        memory_view.lock_ready = true;
+    }
+
+    EnterCriticalSection(&memory_view.lock);
+    bool opened = !memory_view.open;  // One memory sink at a time
+    if (opened) {
+        memory_view.end = 0;
+        memory_view.wrapped = false;
+        memory_view.open = true;
+    }
+    LeaveCriticalSection(&memory_view.lock);
+    return opened;
+}
+
+static bool memory_sink_write(void* context, const SinkBatch* batch) {
+    (void)context;
+    const char* text = batch->text;
+    size_t size = batch->text_size;
+
+    // Only the newest SINK_MEMORY_VIEW_SIZE bytes can be kept
+    if (size > SINK_MEMORY_VIEW_SIZE) {
+        text += size - SINK_MEMORY_VIEW_SIZE;
+        size = SINK_MEMORY_VIEW_SIZE;
+    }
+
+    EnterCriticalSection(&memory_view.lock);
+    while (size > 0) {
+        size_t chunk = SINK_MEMORY_VIEW_SIZE - memory_view.end;
+        if (chunk > size) chunk = size;
+        memcpy(memory_view.data + memory_view.end, text, chunk);
+        memory_view.end += chunk;
+        if (memory_view.end == SINK_MEMORY_VIEW_SIZE) {
+            memory_view.end = 0;
+            memory_view.wrapped = true;
+        }
+        text += chunk;
+        size -= chunk;
+    }
+    LeaveCriticalSection(&memory_view.lock);
+    return true;
+}
+
+static void memory_sink_close(void* context) {
+    (void)context;
+    EnterCriticalSection(&memory_view.lock);
+    memory_view.open = false;
+    LeaveCriticalSection(&memory_view.lock);
+}
+
+static bool aggregate_sink_init(void* context) {
+    (void)context;
+    return is_buffer_initialized() &&
+           init_aggregator(&aggregate_state.aggregator, aggregate_state.interval_ms,
+                           aggregate_sink_emit, NULL);
+}
+
+static bool aggregate_sink_emit(void* context, InternId process,
+                                const char* record, size_t size) {
+    (void)context;
+    (void)process;
+    return add_to_buffer(record, size);
+}
+
+static bool aggregate_sink_write(void* context, const SinkBatch* batch) {
+    (void)context;
+    return aggregate_events(&aggregate_state.aggregator, batch->events, batch->count);
+}
+
+// A quiet period past the interval's end closes it without waiting for input
+static bool aggregate_sink_flush(void* context) {
+    (void)context;
+    bool success = flush_aggregator(&aggregate_state.aggregator, get_precise_time());
+    return (get_buffer_size() == 0 || force_flush_buffer()) && success;
+}
+
+static void aggregate_sink_close(void* context) {
+    (void)context;
+    finish_aggregator(&aggregate_state.aggregator);
+    if (get_buffer_size() > 0) force_flush_buffer();
+}
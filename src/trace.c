@@ -0,0 +1,197 @@
+#include "trace.h"
+#include <stdio.h>
+
+#if defined(_WIN32) && defined(KEYLOG_TRACE)
+#include <winmeta.h>
+#include <TraceLoggingProvider.h>
+#endif
+
+// Debug logging
+#ifdef DEBUG
+    #define TRACE_DEBUG(msg, ...) fprintf(stderr, "[Trace] " msg "\n", ##__VA_ARGS__)
+#else
+    #define TRACE_DEBUG(msg, ...)
+#endif
+
+static volatile DWORD last_error = TRACE_ERROR_NONE;
+
+#if defined(_WIN32) && defined(KEYLOG_TRACE)
+
+#define TRACE_ALL_KEYWORDS (TRACE_KEYWORD_HOOKS | TRACE_KEYWORD_QUEUE | \
+                            TRACE_KEYWORD_FORMAT | TRACE_KEYWORD_OUTPUT)
+
+// d7bf1e41-3bb4-53ca-2864-4687bcae9b6d
+TRACELOGGING_DEFINE_PROVIDER(trace_provider, TRACE_PROVIDER_NAME,
+    (0xd7bf1e41, 0x3bb4, 0x53ca, 0x28, 0x64, 0x46, 0x87, 0xbc, 0xae, 0x9b, 0x6d));
+
+// Keywords some session has enabled at verbose level; read by TRACE_EVENT()
+atomic_ullong trace_keywords;
+static bool registered = false;
+
+// TraceLogging has already updated the provider's combined session state
+// when it forwards the notification, so each keyword is simply re-tested
+static void NTAPI trace_enable_callback(LPCGUID source, ULONG control, UCHAR level,
+                                        ULONGLONG match_any, ULONGLONG match_all,
+                                        PEVENT_FILTER_DESCRIPTOR filter, PVOID context) {
+    (void)source;
+    (void)control;
+    (void)level;
+    (void)match_any;
+    (void)match_all;
+    (void)filter;
+    (void)context;
+
+    ULONGLONG enabled = 0;
+    for (ULONGLONG keyword = 1; keyword & TRACE_ALL_KEYWORDS; keyword <<= 1) {
+        if (TraceLoggingProviderEnabled(trace_provider, WINEVENT_LEVEL_VERBOSE, keyword)) {
+            enabled |= keyword;
+        }
+    }
+    atomic_store_explicit(&trace_keywords, enabled, memory_order_relaxed);
+    TRACE_DEBUG("Enabled keywords: 0x%llx", enabled);
+}
+
+bool init_trace(void) {
+    if (registered) {
+        return true;
+    }
+
+    atomic_store(&trace_keywords, 0);
+    if (FAILED(TraceLoggingRegisterEx(trace_provider, trace_enable_callback, NULL))) {
+        last_error = TRACE_ERROR_REGISTER;
+        TRACE_DEBUG("Failed to register provider %s", TRACE_PROVIDER_NAME);
+        return false;
+    }
+
+    registered = true;
+    last_error = TRACE_ERROR_NONE;
+    TRACE_DEBUG("Provider %s registered", TRACE_PROVIDER_NAME);
+    return true;
+}
+
+// Call once every traced thread has stopped
+void cleanup_trace(void) {
+    if (!registered) {
+        return;
+    }
+
+    atomic_store(&trace_keywords, 0);
+    TraceLoggingUnregister(trace_provider);
+    registered = false;
+}
+
+bool is_trace_listening(void) {
+    return atomic_load_explicit(&trace_keywords, memory_order_relaxed) != 0;
+}
+
+// Event writers
+// Every event is verbose; the keyword says which stage it belongs to
+void trace_hook_enter(DWORD source) {
+    TraceLoggingWrite(trace_provider, "Hook",
+                      TraceLoggingKeyword(TRACE_KEYWORD_HOOKS),
+                      TraceLoggingLevel(WINEVENT_LEVEL_VERBOSE),
+                      TraceLoggingOpcode(WINEVENT_OPCODE_START),
+                      TraceLoggingUInt32(source, "Source"));
+}
+
+void trace_hook_exit(DWORD source) {
+    TraceLoggingWrite(trace_provider, "Hook",
+                      TraceLoggingKeyword(TRACE_KEYWORD_HOOKS),
+                      TraceLoggingLevel(WINEVENT_LEVEL_VERBOSE),
+                      TraceLoggingOpcode(WINEVENT_OPCODE_STOP),
+                      TraceLoggingUInt32(source, "Source"));
+}
+
+void trace_enqueue(DWORD type, bool spilled) {
+    TraceLoggingWrite(trace_provider, "Enqueue",
+                      TraceLoggingKeyword(TRACE_KEYWORD_QUEUE),
+                      TraceLoggingLevel(WINEVENT_LEVEL_VERBOSE),
+                      TraceLoggingUInt32(type, "EventType"),
+                      TraceLoggingBool(spilled, "Spilled"));
+}
+
+void trace_dequeue_batch(size_t count) {
+    TraceLoggingWrite(trace_provider, "DequeueBatch",
+                      TraceLoggingKeyword(TRACE_KEYWORD_QUEUE),
+                      TraceLoggingLevel(WINEVENT_LEVEL_VERBOSE),
+                      TraceLoggingUInt64((UINT64)count, "Events"));
+}
+
+void trace_format_start(size_t events) {
+    TraceLoggingWrite(trace_provider, "Format",
+                      TraceLoggingKeyword(TRACE_KEYWORD_FORMAT),
+                      TraceLoggingLevel(WINEVENT_LEVEL_VERBOSE),
+                      TraceLoggingOpcode(WINEVENT_OPCODE_START),
+                      TraceLoggingUInt64((UINT64)events, "Events"));
+}
+
+void trace_format_stop(size_t events, size_t bytes) {
+    TraceLoggingWrite(trace_provider, "Format",
+                      TraceLoggingKeyword(TRACE_KEYWORD_FORMAT),
+                      TraceLoggingLevel(WINEVENT_LEVEL_VERBOSE),
+                      TraceLoggingOpcode(WINEVENT_OPCODE_STOP),
+                      TraceLoggingUInt64((UINT64)events, "Events"),
+                      TraceLoggingUInt64((UINT64)bytes, "Bytes"));
+}
+
+void trace_buffer_flush(size_t bytes) {
+    TraceLoggingWrite(trace_provider, "BufferFlush",
+                      TraceLoggingKeyword(TRACE_KEYWORD_OUTPUT),
+                      TraceLoggingLevel(WINEVENT_LEVEL_VERBOSE),
+                      TraceLoggingUInt64((UINT64)bytes, "Bytes"));
+}
+
+void trace_write_submit(ULONGLONG offset, size_t bytes) {
+    TraceLoggingWrite(trace_provider, "Write",
+                      TraceLoggingKeyword(TRACE_KEYWORD_OUTPUT),
+                      TraceLoggingLevel(WINEVENT_LEVEL_VERBOSE),
+                      TraceLoggingOpcode(WINEVENT_OPCODE_START),
+                      TraceLoggingUInt64(offset, "Offset"),
+                      TraceLoggingUInt64((UINT64)bytes, "Bytes"));
+}
+
+void trace_write_complete(ULONGLONG offset, size_t bytes, bool success) {
+    TraceLoggingWrite(trace_provider, "Write",
+                      TraceLoggingKeyword(TRACE_KEYWORD_OUTPUT),
+                      TraceLoggingLevel(WINEVENT_LEVEL_VERBOSE),
+                      TraceLoggingOpcode(WINEVENT_OPCODE_STOP),
+                      TraceLoggingUInt64(offset, "Offset"),
+                      TraceLoggingUInt64((UINT64)bytes, "Bytes"),
+                      TraceLoggingBool(success, "Success"));
+}
+
+void trace_commit(size_t latency_us, bool success) {
+    TraceLoggingWrite(trace_provider, "Commit",
+                      TraceLoggingKeyword(TRACE_KEYWORD_OUTPUT),
+                      TraceLoggingLevel(WINEVENT_LEVEL_VERBOSE),
+                      TraceLoggingUInt64((UINT64)latency_us, "LatencyUs"),
+                      TraceLoggingBool(success, "Success"));
+}
+
+void trace_rotation(const char* rotated_path) {
+    TraceLoggingWrite(trace_provider, "Rotation",
+                      TraceLoggingKeyword(TRACE_KEYWORD_OUTPUT),
+                      TraceLoggingLevel(WINEVENT_LEVEL_VERBOSE),
+                      TraceLoggingString(rotated_path, "RotatedPath"));
+}
+
+#else
+
+// No provider in this build: nothing listens, trace points are compiled out
+bool init_trace(void) {
+    TRACE_DEBUG("Built without the %s provider", TRACE_PROVIDER_NAME);
+    return true;
+}
+
+void cleanup_trace(void) {
+}
+
+bool is_trace_listening(void) {
+    return false;
+}
+
+#endif
+
+DWORD get_trace_last_error(void) {
+    return last_error;
+}
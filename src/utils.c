@@ -20,6 +20,59 @@ DWORD get_time_ms(void) {
     return GetTickCount();
 }
 
+// Get the current UTC time in FILETIME units (100 ns since 1601)
+// Event timestamps use this clock: sub-microsecond resolution, no wrap,
+// and directly convertible to wall-clock time
+ULONGLONG get_precise_time(void) {
+    FILETIME ft;
+    GetSystemTimePreciseAsFileTime(&ft);
+    return ((ULONGLONG)ft.dwHighDateTime << 32) | ft.dwLowDateTime;
+}
+
+void init_timestamp_cache(TimestampCache* cache) {
+    if (!cache) return;
+    memset(cache, 0, sizeof(TimestampCache));
+}
+
+// Format a get_precise_time() value as local "YYYY-MM-DD HH:MM:SS.mmm"
+// The date/second prefix is converted and formatted once per second;
+// time zone offsets are whole minutes, so the fraction is the same in
+// UTC and local time. Returns the length, 0 on failure.
+size_t format_timestamp_cached(TimestampCache* cache, ULONGLONG time,
+                               char* buffer, size_t size) {
+    if (!cache || !buffer || size < TIMESTAMP_TEXT_SIZE) return 0;
+
+    ULONGLONG second = time / TIMESTAMP_TICKS_PER_SECOND;
+    if (!cache->valid || cache->second != second) {
+        FILETIME utc, local;
+        SYSTEMTIME st;
+        ULONGLONG whole = second * TIMESTAMP_TICKS_PER_SECOND;
+
+        utc.dwLowDateTime = (DWORD)(whole & 0xFFFFFFFF);
+        utc.dwHighDateTime = (DWORD)(whole >> 32);
+        if (!FileTimeToLocalFileTime(&utc, &local) ||
+            !FileTimeToSystemTime(&local, &st)) {
+            buffer[0] = '\0';
+            return 0;
+        }
+
+        // The fields are in range; the modulos let the compiler see it
+        snprintf(cache->text, sizeof(cache->text), "%04u-%02u-%02u %02u:%02u:%02u.000",
+                 st.wYear % 10000u, st.wMonth % 100u, st.wDay % 100u,
+                 st.wHour % 100u, st.wMinute % 100u, st.wSecond % 100u);
+        cache->second = second;
+        cache->valid = true;
+    }
+
+    unsigned ms = (unsigned)((time / TIMESTAMP_TICKS_PER_MS) % 1000);
+    cache->text[TIMESTAMP_TEXT_SIZE - 4] = (char)('0' + ms / 100);
+    cache->text[TIMESTAMP_TEXT_SIZE - 3] = (char)('0' + (ms / 10) % 10);
+    cache->text[TIMESTAMP_TEXT_SIZE - 2] = (char)('0' + ms % 10);
+
+    memcpy(buffer, cache->text, TIMESTAMP_TEXT_SIZE);
+    return TIMESTAMP_TEXT_SIZE - 1;
+}
+
 // Check if a string ends with a specific suffix
 bool str_ends_with(const char* str, const char* suffix) {
     if (!str || !suffix) return false;
@@ -116,10 +169,11 @@ bool ensure_path_exists(const char* path) {
     strncpy(temp, path, MAX_PATH - 1);
     temp[MAX_PATH - 1] = '\0';
     
-    while ((p = strchr(p, '\\'))) {
+    while ((p = strpbrk(p, "\\/"))) {
+        char separator = *p;
         *p = '\0';
         if (!create_directory_if_needed(temp)) return false;
-        *p = '\\';
+        *p = separator;
         p++;
     }
     return create_directory_if_needed(temp);
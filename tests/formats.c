@@ -0,0 +1,701 @@
+#include "formats.h"
+#include <stdlib.h>
+#include <string.h>
+#include "hooks.h"
+#include "binlog.h"
+#include "buffer.h"
+#include "compress.h"
+#include "format.h"
+#include "intern.h"
+#include "logger.h"
+#include "logindex.h"
+
+#define FORMAT_TIME_STEP 370        // FILETIME ticks between events (a multiple of the grid)
+#define FORMAT_BACKSTEP 2000        // Every FORMAT_BACKSTEP_EVERY-th event goes back this far
+#define FORMAT_BACKSTEP_EVERY 50
+#define FORMAT_WINDOW_EVERY 40      // Events between window changes
+
+// An encoded binary log and the events that went into it
+typedef struct {
+    BYTE* data;
+    size_t size;
+    Event events[FORMAT_EVENT_COUNT];
+} FormatStream;
+
+static Event decoded[FORMAT_EVENT_COUNT];
+static BYTE raw_input[FORMAT_LOG_FRAMES * COMPRESS_BLOCK_SIZE];
+static BYTE frames[FORMAT_LOG_FRAMES * COMPRESS_MAX_FRAME_SIZE];
+static BYTE unpacked[COMPRESS_BLOCK_SIZE];
+
+// Records of the indexed log, as written
+typedef struct {
+    char text[FORMAT_INDEX_RECORDS * 128];
+    size_t size;
+    size_t offsets[FORMAT_INDEX_RECORDS + 1];  // Start of each record in text
+    ULONGLONG times[FORMAT_INDEX_RECORDS];
+    size_t count;
+} IndexedLog;
+
+static IndexedLog indexed;
+static char segments[FORMAT_MAX_SEGMENTS][LOG_ROTATED_NAME_SIZE];
+
+static bool start_intern(bool* owned);
+static void make_format_event(Event* event, size_t i, ULONGLONG timestamp);
+static bool encode_stream(FormatStream* stream);
+static size_t decode_stream(const BYTE* data, size_t size, size_t chunk, int* status);
+static bool events_match(const Event* expected, const Event* actual);
+static bool check_decoded(const FormatStream* stream, size_t count,
+                          char* error_msg, size_t msg_size);
+static void fill_text(BYTE* out, size_t size);
+static void fill_random(BYTE* out, size_t size, ULONGLONG seed);
+static bool frame_round_trip(const BYTE* in, size_t size, bool* stored,
+                             char* error_msg, size_t msg_size);
+static size_t write_frames(const BYTE* in, size_t size, size_t* offsets);
+static bool write_indexed_log(const char* path);
+static size_t find_segments(const char* path, const SYSTEMTIME* from, const SYSTEMTIME* to);
+static size_t find_record(ULONGLONG time);
+static bool check_segment(const char* path, bool rotated, LogIndexOutput* output,
+                          size_t* inside, char* error_msg, size_t msg_size);
+
+static bool test_binlog_round_trip(char* error_msg, size_t msg_size);
+static bool test_binlog_buffer_boundaries(char* error_msg, size_t msg_size);
+static bool test_binlog_truncated_tail(char* error_msg, size_t msg_size);
+static bool test_compress_round_trip(char* error_msg, size_t msg_size);
+static bool test_compress_incompressible(char* error_msg, size_t msg_size);
+static bool test_compress_log_damage(char* error_msg, size_t msg_size);
+static bool test_index_lookups(char* error_msg, size_t msg_size);
+
+bool create_format_suite(TestSuite* suite) {
+    if (!create_test_suite(suite, "formats", 7)) return false;
+    add_test_case(suite, "binlog_round_trip", test_binlog_round_trip, NULL, NULL);
+    add_test_case(suite, "binlog_buffer_boundaries", test_binlog_buffer_boundaries, NULL, NULL);
+    add_test_case(suite, "binlog_truncated_tail", test_binlog_truncated_tail, NULL, NULL);
+    add_test_case(suite, "compress_round_trip", test_compress_round_trip, NULL, NULL);
+    add_test_case(suite, "compress_incompressible", test_compress_incompressible, NULL, NULL);
+    add_test_case(suite, "compress_log_damage", test_compress_log_damage, NULL, NULL);
+    add_test_case(suite, "index_lookups", test_index_lookups, NULL, NULL);
+    return true;
+}
+
+// Window records intern their strings on both sides
+static bool start_intern(bool* owned) {
+    *owned = !is_intern_initialized();
+    return !*owned || init_intern_table();
+}
+
+// Cycles through every event type and flag the format keeps
+static void make_format_event(Event* event, size_t i, ULONGLONG timestamp) {
+    memset(event, 0, sizeof(Event));
+    event->timestamp = timestamp;
+
+    if (i % FORMAT_WINDOW_EVERY == 0) {
+        char title[MAX_WINDOW_TITLE];
+        int len = snprintf(title, sizeof(title), "%s (%zu)", FORMAT_TITLE, i);
+        event->type = EVENT_WINDOW_CHANGE;
+        event->data.window.titleId = intern_string(title, (size_t)len);
+        event->data.window.processNameId = intern_string(FORMAT_PROCESS, strlen(FORMAT_PROCESS));
+        event->data.window.processId = (DWORD)(1000 + i);
+        return;
+    }
+
+    switch (i % 5) {
+        case 0:
+        case 1:
+            event->type = (i % 5) ? EVENT_KEY_RELEASE : EVENT_KEY_PRESS;
+            event->data.keyboard.vkCode = (DWORD)(0x41 + i % 26);
+            event->data.keyboard.scanCode = (DWORD)(i * 7);
+            event->data.keyboard.extended = i % 3 == 0;
+            event->data.keyboard.injected = i % 7 == 0;
+            event->data.keyboard.modifiers = (BYTE)(i & 0x0F);
+            break;
+        case 2:
+            event->type = EVENT_MOUSE_CLICK;
+            event->data.mouse.buttonFlags = (BYTE)(1 << (i % 3));
+            event->data.mouse.buttons = (i & 8) ? INPUT_BTN_RIGHT : 0;
+            event->data.mouse.injected = i % 4 == 0;
+            break;
+        case 3:
+            event->type = EVENT_MOUSE_MOVE;
+            event->data.mouse.moveCount = (WORD)(1 + i % 4);
+            break;
+        default:
+            event->type = EVENT_MOUSE_WHEEL;
+            event->data.mouse.wheelDelta = (short)((i & 1) ? -120 * (LONG)(i % 3 + 1) : 120);
+            break;
+    }
+
+    // Positions jump around, across the origin and far apart
+    if (event->type != EVENT_KEY_PRESS && event->type != EVENT_KEY_RELEASE) {
+        event->data.mouse.position.x = (LONG)(i * 37 % 5000) - 2500;
+        event->data.mouse.position.y = (LONG)((i * 91) % 3000) - (i % 2 ? 100000 : 0);
+    }
+}
+
+// Header, the first half of the events, a sync record (as after a reopen
+// or at an index block), the second half. Times sit on the encoder's
+// microsecond grid and sometimes step back, like events of other threads.
+static bool encode_stream(FormatStream* stream) {
+    size_t capacity = BINLOG_HEADER_SIZE + (1 + BINLOG_SYNC_SIZE) +
+                      FORMAT_EVENT_COUNT * BINLOG_MAX_RECORD_SIZE;
+    stream->data = (BYTE*)malloc(capacity);
+    if (!stream->data) return false;
+
+    BinlogState state;
+    stream->size = binlog_write_header(&state, stream->data, capacity);
+    if (stream->size == 0) return false;
+
+    ULONGLONG time = state.base_time;
+    for (size_t i = 0; i < FORMAT_EVENT_COUNT; i++) {
+        if (i == FORMAT_EVENT_COUNT / 2) {
+            size_t len = binlog_write_sync(&state, stream->data + stream->size,
+                                           capacity - stream->size);
+            if (len == 0) return false;
+            stream->size += len;
+            time = state.base_time;
+        }
+
+        time += (i % FORMAT_BACKSTEP_EVERY == FORMAT_BACKSTEP_EVERY - 1) ?
+                (ULONGLONG)-FORMAT_BACKSTEP : FORMAT_TIME_STEP;
+        make_format_event(&stream->events[i], i, time);
+
+        size_t len = binlog_encode_event(&state, &stream->events[i], stream->data + stream->size,
+                                         capacity - stream->size);
+        if (len == 0) return false;
+        stream->size += len;
+    }
+    return true;
+}
+
+// Decodes into decoded[] the way a reader with a chunk-sized read buffer
+// would: a record cut at the end of what has been read so far is decoded
+// again once the next chunk is in. Returns the events decoded; status is
+// the result that ended the stream (BINLOG_OK at its end).
+static size_t decode_stream(const BYTE* data, size_t size, size_t chunk, int* status) {
+    BinlogState state;
+    size_t pos = BINLOG_HEADER_SIZE;
+    size_t filled = pos + chunk < size ? pos + chunk : size;
+    size_t count = 0;
+
+    *status = BINLOG_CORRUPT;
+    if (!binlog_read_header(&state, data, size)) return 0;
+
+    *status = BINLOG_OK;
+    while (pos < size && count < FORMAT_EVENT_COUNT) {
+        Event event;
+        size_t consumed = 0;
+        int result = binlog_decode_record(&state, data + pos, filled - pos, &event, &consumed);
+
+        if (result == BINLOG_TRUNCATED && filled < size) {
+            filled = size - filled < chunk ? size : filled + chunk;
+            continue;
+        }
+        if (result == BINLOG_TRUNCATED || result == BINLOG_CORRUPT) {
+            *status = result;
+            break;
+        }
+
+        pos += consumed;
+        if (result == BINLOG_OK) {
+            decoded[count++] = event;
+        }
+    }
+    return count;
+}
+
+static bool events_match(const Event* expected, const Event* actual) {
+    if (expected->type != actual->type || expected->timestamp != actual->timestamp) {
+        return false;
+    }
+
+    const KeyboardEvent* kb = &expected->data.keyboard;
+    const KeyboardEvent* kb_out = &actual->data.keyboard;
+    const MouseEvent* mouse = &expected->data.mouse;
+    const MouseEvent* mouse_out = &actual->data.mouse;
+
+    switch (expected->type) {
+        case EVENT_KEY_PRESS:
+        case EVENT_KEY_RELEASE:
+            return kb->vkCode == kb_out->vkCode && kb->scanCode == kb_out->scanCode &&
+                   kb->extended == kb_out->extended && kb->injected == kb_out->injected &&
+                   kb->modifiers == kb_out->modifiers;
+        case EVENT_MOUSE_CLICK:
+        case EVENT_MOUSE_MOVE:
+        case EVENT_MOUSE_WHEEL:
+            return mouse->position.x == mouse_out->position.x &&
+                   mouse->position.y == mouse_out->position.y &&
+                   mouse->buttonFlags == mouse_out->buttonFlags &&
+                   mouse->buttons == mouse_out->buttons &&
+                   mouse->injected == mouse_out->injected &&
+                   mouse->wheelDelta == mouse_out->wheelDelta &&
+                   (expected->type != EVENT_MOUSE_MOVE || mouse->moveCount == mouse_out->moveCount);
+        case EVENT_WINDOW_CHANGE: {
+            char title[MAX_WINDOW_TITLE], title_out[MAX_WINDOW_TITLE];
+            char process[MAX_PROCESS_NAME], process_out[MAX_PROCESS_NAME];
+            intern_resolve(expected->data.window.titleId, title, sizeof(title));
+            intern_resolve(actual->data.window.titleId, title_out, sizeof(title_out));
+            intern_resolve(expected->data.window.processNameId, process, sizeof(process));
+            intern_resolve(actual->data.window.processNameId, process_out, sizeof(process_out));
+            return expected->data.window.processId == actual->data.window.processId &&
+                   strcmp(title, title_out) == 0 && strcmp(process, process_out) == 0;
+        }
+        default:
+            return true;
+    }
+}
+
+static bool check_decoded(const FormatStream* stream, size_t count,
+                          char* error_msg, size_t msg_size) {
+    for (size_t i = 0; i < count; i++) {
+        if (!events_match(&stream->events[i], &decoded[i])) {
+            snprintf(error_msg, msg_size, "event %zu (type %d) decoded differently",
+                     i, (int)stream->events[i].type);
+            return false;
+        }
+    }
+    return true;
+}
+
+// Text log lines, like the writer compresses
+static void fill_text(BYTE* out, size_t size) {
+    TimestampCache cache;
+    char line[BUFFER_MAX_EVENT_SIZE];
+    size_t pos = 0;
+
+    init_timestamp_cache(&cache);
+    for (size_t i = 0; pos < size; i++) {
+        Event event;
+        make_format_event(&event, i, get_precise_time() + i * FORMAT_TIME_STEP);
+        size_t len = format_event_text(&event, &cache, line, sizeof(line));
+        if (len > size - pos) len = size - pos;
+        memcpy(out + pos, line, len);
+        pos += len;
+    }
+}
+
+// xorshift64: no match an LZ4 encoder could use
+static void fill_random(BYTE* out, size_t size, ULONGLONG seed) {
+    ULONGLONG x = seed | 1;
+    for (size_t i = 0; i < size; i++) {
+        x ^= x << 13;
+        x ^= x >> 7;
+        x ^= x << 17;
+        out[i] = (BYTE)(x >> 32);
+    }
+}
+
+// One frame out and back in; stored tells whether it kept the raw bytes
+static bool frame_round_trip(const BYTE* in, size_t size, bool* stored,
+                             char* error_msg, size_t msg_size) {
+    size_t frame_size = compress_frame(in, size, frames, COMPRESS_MAX_FRAME_SIZE);
+    if (!assert_true(frame_size > 0 && frame_size <= COMPRESS_FRAME_HEADER_SIZE +
+                     COMPRESS_BOUND(size), "frame within COMPRESS_BOUND", error_msg, msg_size)) {
+        return false;
+    }
+    *stored = (frames[7] & (COMPRESS_FRAME_STORED >> 24)) != 0;
+
+    size_t consumed, produced;
+    int status = decompress_frame(frames, frame_size, unpacked, sizeof(unpacked),
+                                  &consumed, &produced);
+    return assert_equal(COMPRESS_OK, status, "frame status", error_msg, msg_size) &&
+           assert_equal((int)frame_size, (int)consumed, "frame bytes read", error_msg, msg_size) &&
+           assert_equal((int)size, (int)produced, "frame output", error_msg, msg_size) &&
+           assert_true(memcmp(in, unpacked, size) == 0, "frame output matches",
+                       error_msg, msg_size);
+}
+
+// Frames of up to COMPRESS_BLOCK_SIZE raw bytes back to back, as the
+// writer produces them; offsets (FORMAT_LOG_FRAMES + 1 entries) gets
+// each frame's start and the end
+static size_t write_frames(const BYTE* in, size_t size, size_t* offsets) {
+    size_t pos = 0;
+    size_t frame = 0;
+
+    for (size_t raw = 0; raw < size; raw += COMPRESS_BLOCK_SIZE) {
+        size_t length = size - raw < COMPRESS_BLOCK_SIZE ? size - raw : COMPRESS_BLOCK_SIZE;
+        offsets[frame++] = pos;
+        pos += compress_frame(in + raw, length, frames + pos, sizeof(frames) - pos);
+    }
+    offsets[frame] = pos;
+    return pos;
+}
+
+// Text records of one process, indexed and committed like capture's,
+// through a compressing writer that rotates every FORMAT_ROTATE_SIZE bytes
+static bool write_indexed_log(const char* path) {
+    LoggerConfig config = {0};
+    config.async = true;
+    config.compress = true;
+    config.index_interval = FORMAT_INDEX_INTERVAL;
+    config.rotate_size = FORMAT_ROTATE_SIZE;
+    if (!init_logger_ex(path, &config)) return false;
+
+    TimestampCache cache;
+    DWORD process = log_index_process_key(FORMAT_PROCESS);
+    ULONGLONG time = get_precise_time();
+    bool success = true;
+
+    init_timestamp_cache(&cache);
+    memset(&indexed, 0, sizeof(indexed));
+    for (size_t i = 0; success && i < FORMAT_INDEX_RECORDS &&
+                       sizeof(indexed.text) - indexed.size >= BUFFER_MAX_EVENT_SIZE; i++) {
+        Event event;
+        time += TIMESTAMP_TICKS_PER_MS;
+        make_format_event(&event, i, time);
+
+        char* entry = reserve_log_space(BUFFER_MAX_EVENT_SIZE);
+        if (!entry) {
+            success = false;
+            break;
+        }
+        note_log_index(time, process);
+        size_t len = format_event_text(&event, &cache, entry, BUFFER_MAX_EVENT_SIZE);
+        success = commit_log_space(len);
+        if (len == 0) continue;
+
+        memcpy(indexed.text + indexed.size, entry, len);
+        indexed.offsets[indexed.count] = indexed.size;
+        indexed.times[indexed.count++] = time;
+        indexed.size += len;
+    }
+    indexed.offsets[indexed.count] = indexed.size;
+
+    cleanup_logger();
+    return success;
+}
+
+// Rotated segments are named after the local second of their rotation,
+// with _n for later ones in the same second
+static size_t find_segments(const char* path, const SYSTEMTIME* from, const SYSTEMTIME* to) {
+    FILETIME file_time;
+    ULARGE_INTEGER second, last;
+    SYSTEMTIME st = *from;
+    size_t found = 0;
+
+    st.wMilliseconds = 0;
+    SystemTimeToFileTime(&st, &file_time);
+    second.LowPart = file_time.dwLowDateTime;
+    second.HighPart = file_time.dwHighDateTime;
+    SystemTimeToFileTime(to, &file_time);
+    last.LowPart = file_time.dwLowDateTime;
+    last.HighPart = file_time.dwHighDateTime;
+
+    for (; second.QuadPart <= last.QuadPart; second.QuadPart += TIMESTAMP_TICKS_PER_SECOND) {
+        file_time.dwLowDateTime = second.LowPart;
+        file_time.dwHighDateTime = second.HighPart;
+        FileTimeToSystemTime(&file_time, &st);
+
+        for (int i = 0; i < LOG_MAX_ROTATED_NAMES && found < FORMAT_MAX_SEGMENTS; i++) {
+            char* name = segments[found];
+            int len = snprintf(name, LOG_ROTATED_NAME_SIZE, "%s.%04d%02d%02d_%02d%02d%02d",
+                               path, st.wYear, st.wMonth, st.wDay,
+                               st.wHour, st.wMinute, st.wSecond);
+            if (i > 0) {
+                snprintf(name + len, LOG_ROTATED_NAME_SIZE - len, "_%d", i);
+            }
+            if (GetFileAttributesA(name) == INVALID_FILE_ATTRIBUTES) break;
+            found++;
+        }
+    }
+    return found;
+}
+
+// Record written at time, or indexed.count
+static size_t find_record(ULONGLONG time) {
+    size_t low = 0;
+    size_t high = indexed.count;
+
+    while (low < high) {
+        size_t middle = low + (high - low) / 2;
+        if (indexed.times[middle] < time) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    return low < indexed.count && indexed.times[low] == time ? low : indexed.count;
+}
+
+// Every block of the segment must read back as exactly its records;
+// inside counts blocks that begin within a frame's output
+static bool check_segment(const char* path, bool rotated, LogIndexOutput* output,
+                          size_t* inside, char* error_msg, size_t msg_size) {
+    LogIndexSegment segment;
+    if (!assert_equal(LOG_INDEX_OK, log_index_open_segment(path, &segment),
+                      "log_index_open_segment", error_msg, msg_size)) {
+        return false;
+    }
+
+    ULONGLONG bits = log_index_process_bits(log_index_process_key(FORMAT_PROCESS));
+    // The live segment may have just begun, with nothing written yet
+    bool passed = assert_true(!rotated || segment.entries > 1, "segment has blocks",
+                              error_msg, msg_size) &&
+                  assert_true(segment.entries == 0 || (segment.compressed && !segment.binary),
+                              "compressed text segment", error_msg, msg_size);
+
+    LogIndexEntry entry, next;
+    bool have_entry = passed && log_index_read_entry(&segment, 0, &entry);
+    for (size_t i = 0; passed && have_entry; i++) {
+        bool have_next = log_index_read_entry(&segment, i + 1, &next);
+        size_t first = find_record(entry.first_time);
+        passed = assert_true(first + entry.events <= indexed.count, "block starts at a record",
+                             error_msg, msg_size) &&
+                 assert_true((entry.processes & bits) == bits, "block filter has the process",
+                             error_msg, msg_size) &&
+                 assert_true(log_index_read_block(&segment, &entry, have_next ? &next : NULL,
+                                                  output), "log_index_read_block",
+                             error_msg, msg_size);
+        if (!passed) break;
+
+        size_t start = indexed.offsets[first];
+        size_t size = indexed.offsets[first + entry.events] - start;
+        passed = assert_equal((int)size, (int)output->size, "block output size",
+                              error_msg, msg_size) &&
+                 assert_true(memcmp(indexed.text + start, output->data, size) == 0,
+                             "block output matches", error_msg, msg_size);
+        if (entry.skip > 0) (*inside)++;
+
+        entry = next;
+        have_entry = have_next;
+    }
+
+    // A time between a rotated segment's blocks finds the block holding it
+    if (passed && rotated) {
+        size_t middle = segment.entries / 2;
+        passed = log_index_read_entry(&segment, middle, &entry) &&
+                 assert_true(entry.events > 1, "block has several records", error_msg, msg_size);
+        ULONGLONG time = passed ? indexed.times[find_record(entry.first_time) + 1] : 0;
+        passed = passed &&
+                 assert_equal((int)middle, (int)log_index_find_block(&segment, time),
+                              "log_index_find_block", error_msg, msg_size) &&
+                 assert_true(entry.skip > 0, "block inside a frame", error_msg, msg_size);
+    }
+
+    log_index_close_segment(&segment);
+    return passed;
+}
+
+// Round-trip cases
+static bool test_binlog_round_trip(char* error_msg, size_t msg_size) {
+    static FormatStream stream;
+    bool owned;
+    if (!assert_true(start_intern(&owned), "init_intern_table", error_msg, msg_size)) {
+        return false;
+    }
+
+    bool passed = assert_true(encode_stream(&stream), "stream encoded", error_msg, msg_size);
+    if (passed) {
+        int status;
+        size_t count = decode_stream(stream.data, stream.size, stream.size, &status);
+        passed = assert_equal(BINLOG_OK, status, "decoder status", error_msg, msg_size) &&
+                 assert_equal(FORMAT_EVENT_COUNT, (int)count, "events decoded",
+                              error_msg, msg_size) &&
+                 check_decoded(&stream, count, error_msg, msg_size);
+    }
+
+    free(stream.data);
+    if (owned) cleanup_intern_table();
+    return passed;
+}
+
+// Reads of 1 byte cut every record; the odd sizes cut them everywhere else
+static bool test_binlog_buffer_boundaries(char* error_msg, size_t msg_size) {
+    static const size_t chunks[] = { 1, 2, 7, 61, 509, 4096 };
+    static FormatStream stream;
+    bool owned;
+    if (!assert_true(start_intern(&owned), "init_intern_table", error_msg, msg_size)) {
+        return false;
+    }
+
+    bool passed = assert_true(encode_stream(&stream), "stream encoded", error_msg, msg_size);
+    for (size_t c = 0; passed && c < sizeof(chunks) / sizeof(chunks[0]); c++) {
+        int status;
+        size_t count = decode_stream(stream.data, stream.size, chunks[c], &status);
+        passed = assert_equal(BINLOG_OK, status, "decoder status", error_msg, msg_size) &&
+                 assert_equal(FORMAT_EVENT_COUNT, (int)count, "events decoded",
+                              error_msg, msg_size) &&
+                 check_decoded(&stream, count, error_msg, msg_size);
+        if (!passed) {
+            char reason[MAX_ERROR_MSG];
+            snprintf(reason, sizeof(reason), "%zu-byte reads: %s", chunks[c], error_msg);
+            snprintf(error_msg, msg_size, "%s", reason);
+        }
+    }
+
+    free(stream.data);
+    if (owned) cleanup_intern_table();
+    return passed;
+}
+
+// A file cut inside its last record decodes up to the record before,
+// as the decoder does after a crash
+static bool test_binlog_truncated_tail(char* error_msg, size_t msg_size) {
+    static FormatStream stream;
+    bool owned;
+    if (!assert_true(start_intern(&owned), "init_intern_table", error_msg, msg_size)) {
+        return false;
+    }
+
+    bool passed = assert_true(encode_stream(&stream), "stream encoded", error_msg, msg_size);
+    if (passed) {
+        int status;
+        size_t count = decode_stream(stream.data, stream.size - 1, stream.size, &status);
+        passed = assert_equal(BINLOG_TRUNCATED, status, "decoder status", error_msg, msg_size) &&
+                 assert_equal(FORMAT_EVENT_COUNT - 1, (int)count, "events decoded",
+                              error_msg, msg_size) &&
+                 check_decoded(&stream, count, error_msg, msg_size);
+    }
+
+    free(stream.data);
+    if (owned) cleanup_intern_table();
+    return passed;
+}
+
+// Short inputs (below the match limit), runs whose matches overlap their
+// own output, text and a full block
+static bool test_compress_round_trip(char* error_msg, size_t msg_size) {
+    static const size_t sizes[] = { 1, 5, 12, 13, 100, 4096, COMPRESS_BLOCK_SIZE };
+    bool stored;
+    bool owned;
+    if (!assert_true(start_intern(&owned), "init_intern_table", error_msg, msg_size)) {
+        return false;
+    }
+
+    bool passed = true;
+    fill_text(raw_input, COMPRESS_BLOCK_SIZE);
+    for (size_t s = 0; passed && s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+        passed = frame_round_trip(raw_input, sizes[s], &stored, error_msg, msg_size);
+    }
+    passed = passed && assert_false(stored, "text block compressed", error_msg, msg_size);
+
+    memset(raw_input, 'x', COMPRESS_BLOCK_SIZE);
+    passed = passed && frame_round_trip(raw_input, COMPRESS_BLOCK_SIZE, &stored,
+                                        error_msg, msg_size) &&
+             assert_false(stored, "run compressed", error_msg, msg_size);
+
+    if (owned) cleanup_intern_table();
+    return passed;
+}
+
+// Random bytes must fit COMPRESS_BOUND as a block and come out stored,
+// one header larger, as a frame; a random half still compresses the rest
+static bool test_compress_incompressible(char* error_msg, size_t msg_size) {
+    static BYTE block[COMPRESS_BOUND(COMPRESS_BLOCK_SIZE)];
+    bool stored;
+
+    fill_random(raw_input, COMPRESS_BLOCK_SIZE, 0x9E3779B97F4A7C15ULL);
+    size_t length = compress_block(raw_input, COMPRESS_BLOCK_SIZE, block, sizeof(block));
+    if (!assert_true(length > COMPRESS_BLOCK_SIZE && length <= sizeof(block),
+                     "random block grows within COMPRESS_BOUND", error_msg, msg_size) ||
+        !assert_equal(COMPRESS_BLOCK_SIZE,
+                      (int)decompress_block(block, length, unpacked, sizeof(unpacked)),
+                      "random block output", error_msg, msg_size) ||
+        !assert_true(memcmp(raw_input, unpacked, COMPRESS_BLOCK_SIZE) == 0,
+                     "random block output matches", error_msg, msg_size)) {
+        return false;
+    }
+
+    if (!frame_round_trip(raw_input, COMPRESS_BLOCK_SIZE, &stored, error_msg, msg_size) ||
+        !assert_true(stored, "random frame stored", error_msg, msg_size) ||
+        !assert_equal(COMPRESS_FRAME_HEADER_SIZE + COMPRESS_BLOCK_SIZE,
+                      (int)compress_frame(raw_input, COMPRESS_BLOCK_SIZE, frames, sizeof(frames)),
+                      "stored frame size", error_msg, msg_size)) {
+        return false;
+    }
+
+    memset(raw_input + COMPRESS_BLOCK_SIZE / 2, 0, COMPRESS_BLOCK_SIZE / 2);
+    return frame_round_trip(raw_input, COMPRESS_BLOCK_SIZE, &stored, error_msg, msg_size) &&
+           assert_false(stored, "half random frame compressed", error_msg, msg_size);
+}
+
+// A whole log unpacks to its input; cut inside the last frame it stops
+// there (a crash), with a flipped byte it stops at the damaged frame
+static bool test_compress_log_damage(char* error_msg, size_t msg_size) {
+    const size_t raw_size = (FORMAT_LOG_FRAMES - 1) * COMPRESS_BLOCK_SIZE + 1000;
+    size_t offsets[FORMAT_LOG_FRAMES + 1];
+    size_t produced, consumed;
+    int status;
+    bool owned;
+    if (!assert_true(start_intern(&owned), "init_intern_table", error_msg, msg_size)) {
+        return false;
+    }
+    fill_text(raw_input, raw_size);
+    fill_random(raw_input + COMPRESS_BLOCK_SIZE, COMPRESS_BLOCK_SIZE, 42);
+    if (owned) cleanup_intern_table();
+
+    size_t size = write_frames(raw_input, raw_size, offsets);
+    BYTE* raw = decompress_log(frames, size, &produced, &consumed, &status);
+    bool passed = assert_not_null(raw, "log unpacked", error_msg, msg_size) &&
+                  assert_equal(COMPRESS_OK, status, "log status", error_msg, msg_size) &&
+                  assert_equal((int)size, (int)consumed, "log bytes read", error_msg, msg_size) &&
+                  assert_equal((int)raw_size, (int)produced, "log output", error_msg, msg_size) &&
+                  assert_true(memcmp(raw_input, raw, raw_size) == 0, "log output matches",
+                              error_msg, msg_size);
+    free(raw);
+    if (!passed) return false;
+
+    size_t last = offsets[FORMAT_LOG_FRAMES - 1];
+    raw = decompress_log(frames, size - 1, &produced, &consumed, &status);
+    passed = assert_not_null(raw, "torn log unpacked", error_msg, msg_size) &&
+             assert_equal(COMPRESS_TRUNCATED, status, "torn log status", error_msg, msg_size) &&
+             assert_equal((int)last, (int)consumed, "torn log bytes read", error_msg, msg_size) &&
+             assert_equal((int)((FORMAT_LOG_FRAMES - 1) * COMPRESS_BLOCK_SIZE), (int)produced,
+                          "torn log output", error_msg, msg_size) &&
+             assert_true(memcmp(raw_input, raw, produced) == 0, "torn log output matches",
+                         error_msg, msg_size);
+    free(raw);
+    if (!passed) return false;
+
+    frames[offsets[2] + COMPRESS_FRAME_HEADER_SIZE + 10] ^= 0x01;
+    raw = decompress_log(frames, size, &produced, &consumed, &status);
+    passed = assert_not_null(raw, "damaged log unpacked", error_msg, msg_size) &&
+             assert_equal(COMPRESS_CORRUPT, status, "damaged log status", error_msg, msg_size) &&
+             assert_equal((int)offsets[2], (int)consumed, "damaged log bytes read",
+                          error_msg, msg_size) &&
+             assert_equal(2 * COMPRESS_BLOCK_SIZE, (int)produced, "damaged log output",
+                          error_msg, msg_size);
+    free(raw);
+    return passed;
+}
+
+// Index blocks of rotated and live segments, most of them inside a frame
+static bool test_index_lookups(char* error_msg, size_t msg_size) {
+    char path[LOG_MAX_PATH];
+    char index_path[LOG_ROTATED_NAME_SIZE + 8];
+    SYSTEMTIME from, to;
+    bool owned;
+
+    snprintf(path, sizeof(path), "%s/formats_index.log", get_test_directory());
+    snprintf(index_path, sizeof(index_path), "%s%s", path, LOG_INDEX_SUFFIX);
+    DeleteFileA(path);
+    DeleteFileA(index_path);
+    if (!assert_true(start_intern(&owned), "init_intern_table", error_msg, msg_size)) {
+        return false;
+    }
+
+    GetLocalTime(&from);
+    bool passed = assert_true(write_indexed_log(path), "indexed log written", error_msg, msg_size);
+    GetLocalTime(&to);
+    if (owned) cleanup_intern_table();
+
+    size_t found = find_segments(path, &from, &to);
+    passed = passed && assert_true(found >= 2, "segments rotated", error_msg, msg_size);
+
+    LogIndexOutput output = {0};
+    size_t inside = 0;
+    for (size_t i = 0; passed && i < found; i++) {
+        passed = check_segment(segments[i], true, &output, &inside, error_msg, msg_size);
+    }
+    passed = passed && check_segment(path, false, &output, &inside, error_msg, msg_size) &&
+             assert_true(inside > found, "blocks inside frames", error_msg, msg_size);
+    free(output.data);
+
+    for (size_t i = 0; i < found; i++) {
+        snprintf(index_path, sizeof(index_path), "%s%s", segments[i], LOG_INDEX_SUFFIX);
+        DeleteFileA(segments[i]);
+        DeleteFileA(index_path);
+    }
+    snprintf(index_path, sizeof(index_path), "%s%s", path, LOG_INDEX_SUFFIX);
+    DeleteFileA(path);
+    DeleteFileA(index_path);
+    return passed;
+}
@@ -0,0 +1,33 @@
+#ifndef FORMATS_H
+#define FORMATS_H
+
+#include <stdbool.h>
+#include "platform.h"
+#include "test.h"
+
+/**
+ * Round-trip suite for the on-disk formats
+ * The binary log cases encode a mixed event stream and decode it again,
+ * whole, read in small pieces (records cut at every buffer boundary) and
+ * cut short like a file after a crash; every field that the format keeps
+ * must come back unchanged. The compression cases run frames of text,
+ * runs and random bytes (which must be stored, within COMPRESS_BOUND) in
+ * both directions, and unpack whole logs that end in a torn or a corrupt
+ * frame. The index case writes a compressed, indexed log that rotates
+ * several times, the way capture writes text records, and reads every
+ * index block of every segment back through the segment reader the query
+ * tool uses.
+ */
+
+#define FORMAT_EVENT_COUNT 600               // Events of the generated streams
+#define FORMAT_TITLE "Untitled - Notepad"    // Window title of the stream
+#define FORMAT_PROCESS "notepad.exe"         // Process of the stream's windows
+#define FORMAT_LOG_FRAMES 5                  // Frames of the compressed log cases
+#define FORMAT_INDEX_RECORDS 1500            // Records of the indexed log
+#define FORMAT_INDEX_INTERVAL 16             // Records per index block
+#define FORMAT_ROTATE_SIZE (16 * 1024)       // Segment size of the indexed log
+#define FORMAT_MAX_SEGMENTS 32               // Segments the index case looks for
+
+bool create_format_suite(TestSuite* suite);
+
+#endif
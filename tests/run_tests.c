@@ -0,0 +1,81 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "test.h"
+#include "stress.h"
+#include "formats.h"
+#include "units.h"
+#include "metrics.h"
+
+// Test runner: the unit cases, the format round trips, the stress suite,
+// then the soak suite if asked for.
+//   usage: run_tests [-d <seconds>] [-t <threads>] [-s <seconds>]
+// -d is the run time of each stress case, -t the number of producer
+// threads, -s the run time of the soak (no soak by default).
+
+static bool parse_count(const char* text, unsigned long* value);
+static bool run_suite(bool (*create)(TestSuite* suite), size_t* failed);
+
+int main(int argc, char* argv[]) {
+    StressOptions options;
+    get_stress_options(&options);
+    int arg = 1;
+
+    for (; arg + 1 < argc && argv[arg][0] == '-'; arg += 2) {
+        unsigned long value = 0;
+        if (!parse_count(argv[arg + 1], &value)) {
+            break;
+        } else if (strcmp(argv[arg], "-d") == 0 && value > 0) {
+            options.duration_ms = (DWORD)(value * 1000);
+        } else if (strcmp(argv[arg], "-t") == 0 && value > 0 && value <= STRESS_MAX_THREADS) {
+            options.threads = value;
+        } else if (strcmp(argv[arg], "-s") == 0) {
+            options.soak_ms = (DWORD)(value * 1000);
+        } else {
+            break;
+        }
+    }
+    if (arg != argc) {
+        fprintf(stderr, "Usage: %s [-d <seconds>] [-t <threads 1-%d>] [-s <soak seconds>]\n",
+                argv[0], STRESS_MAX_THREADS);
+        return 1;
+    }
+    set_stress_options(&options);
+
+    if (!init_metrics() || !create_test_directory()) {
+        fprintf(stderr, "Failed to set up the test environment\n");
+        return 1;
+    }
+
+    size_t failed = 0;
+    bool complete = run_suite(create_unit_suite, &failed) &&
+                    run_suite(create_format_suite, &failed) &&
+                    run_suite(create_stress_suite, &failed);
+    if (complete && options.soak_ms > 0) {
+        complete = run_suite(create_soak_suite, &failed);
+    }
+
+    cleanup_metrics();
+    if (!complete) {
+        fprintf(stderr, "Failed to create a test suite\n");
+        return 1;
+    }
+    return failed == 0 ? 0 : 1;
+}
+
+static bool parse_count(const char* text, unsigned long* value) {
+    char* end = NULL;
+    *value = strtoul(text, &end, 10);
+    return end != text && *end == '\0';
+}
+
+static bool run_suite(bool (*create)(TestSuite* suite), size_t* failed) {
+    TestSuite suite;
+    if (!create(&suite)) {
+        return false;
+    }
+    run_test_suite(&suite);
+    *failed += suite.failed;
+    destroy_test_suite(&suite);
+    return true;
+}
@@ -0,0 +1,990 @@
+#include "stress.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include "hooks.h"
+#include "buffer.h"
+#include "logger.h"
+#include "format.h"
+#include "metrics.h"
+#include "sink.h"
+#include "utils.h"
+
+#define STRESS_KEY_BASE 0x41       // Producer i sends virtual key 'A' + i
+#define STRESS_LINE_SIZE 32        // "<id> <sequence>\n"
+#define STRESS_SETTLE_MS 20        // Lets exited threads drop their handles
+#define STRESS_ABANDON_PERIOD 8    // Partial-commit producers abandon every 8th reservation
+#define STRESS_FILTER_UPDATERS 4   // Threads replacing the hook filters at once
+#define STRESS_FAST_SINK_QUEUE (64 * 1024)  // Producers stay within half of it
+#define STRESS_SLOW_SINK_QUEUE 1024
+
+// Logger modes the buffer cases run over
+typedef enum {
+    STRESS_LOGGER_SYNC,
+    STRESS_LOGGER_ASYNC,
+    STRESS_LOGGER_MAPPED
+} StressLoggerMode;
+
+// Per-producer state; a producer thread writes only its own entry
+typedef struct {
+    size_t id;
+    size_t sent;        // Sequence numbers used
+    size_t accepted;    // Calls that returned true
+    size_t refused;
+} StressProducer;
+
+// What the consumer (or the log read back) saw, written by one thread at a time
+typedef struct {
+    size_t next[STRESS_MAX_THREADS];       // Expected next sequence
+    size_t delivered[STRESS_MAX_THREADS];
+    size_t gaps;        // Sequence numbers skipped
+    size_t repeats;     // Sequence numbers seen again or out of order
+    size_t foreign;     // Events of no producer
+} StressSeen;
+
+typedef struct {
+    size_t private_bytes;
+    DWORD handles;
+} StressUsage;
+
+static StressOptions options = {
+    STRESS_DEFAULT_DURATION_MS, STRESS_DEFAULT_THREADS, 0
+};
+
+static StressProducer producers[STRESS_MAX_THREADS];
+static StressProducer updaters[STRESS_FILTER_UPDATERS];  // sent = tables published
+static StressSeen seen;
+static atomic_bool running;
+static atomic_size_t output_bytes;     // Stops the producers at STRESS_MAX_LOG_BYTES
+static size_t spill_high_water;        // Producers back off at this spill depth (0 = never)
+static bool format_events;             // Consumer writes the events to the buffer
+static atomic_size_t sink_backlog;     // Submitted events the fast sink has not written
+static atomic_size_t slow_sink_written;
+static HANDLE slow_sink_gate;          // The slow sink's write_batch() waits for it
+static TimestampCache timestamp_cache; // Consumer thread only
+
+static void reset_stress_state(void);
+static bool keep_producing(void);
+static void make_stress_event(Event* event, size_t id, size_t sequence);
+static void note_sequence(size_t id, size_t sequence);
+static void stress_event_callback(const Event* event);
+static DWORD WINAPI queue_producer(LPVOID param);
+static DWORD WINAPI buffer_producer(LPVOID param);
+static DWORD WINAPI partial_commit_producer(LPVOID param);
+static DWORD WINAPI log_producer(LPVOID param);
+static DWORD WINAPI filter_updater(LPVOID param);
+static DWORD WINAPI sink_producer(LPVOID param);
+static bool fast_sink_write(void* context, const SinkBatch* batch);
+static bool slow_sink_write(void* context, const SinkBatch* batch);
+static bool start_producers(LPTHREAD_START_ROUTINE proc, HANDLE* threads);
+static void stop_producers(HANDLE* threads);
+static bool start_stress_hooks(HookOverflowPolicy policy);
+static bool start_stress_logger(const char* path, StressLoggerMode mode);
+static bool check_sequences(bool exact, char* error_msg, size_t msg_size);
+static bool check_log_file(const char* path, char* error_msg, size_t msg_size);
+static void stress_log_path(char* path, size_t size, const char* name);
+static void delete_stress_log(const char* path);
+static bool run_queue_stress(HookOverflowPolicy policy, char* error_msg, size_t msg_size);
+static bool run_buffer_stress(LPTHREAD_START_ROUTINE proc, const char* name,
+                              StressLoggerMode mode, char* error_msg, size_t msg_size);
+static bool run_log_stress(StressLoggerMode mode, char* error_msg, size_t msg_size);
+static bool run_pipeline_cycle(const char* path, char* error_msg, size_t msg_size);
+static bool read_usage(StressUsage* usage);
+
+static bool test_queue_spill_lossless(char* error_msg, size_t msg_size);
+static bool test_queue_drop_newest(char* error_msg, size_t msg_size);
+static bool test_queue_drop_oldest(char* error_msg, size_t msg_size);
+static bool test_queue_drop_oldest_blocks(char* error_msg, size_t msg_size);
+static bool test_queue_cleanup_under_load(char* error_msg, size_t msg_size);
+static bool test_queue_filter_swaps(char* error_msg, size_t msg_size);
+static bool test_queue_filter_updaters(char* error_msg, size_t msg_size);
+static bool test_sink_slow_fan_out(char* error_msg, size_t msg_size);
+static bool test_buffer_appends_sync(char* error_msg, size_t msg_size);
+static bool test_buffer_appends_async(char* error_msg, size_t msg_size);
+static bool test_buffer_appends_mapped(char* error_msg, size_t msg_size);
+static bool test_buffer_partial_commits_sync(char* error_msg, size_t msg_size);
+static bool test_buffer_partial_commits_async(char* error_msg, size_t msg_size);
+static bool test_buffer_partial_commits_mapped(char* error_msg, size_t msg_size);
+static bool test_log_concurrent_writes(char* error_msg, size_t msg_size);
+static bool test_log_async_concurrent_writes(char* error_msg, size_t msg_size);
+static bool test_pipeline_soak(char* error_msg, size_t msg_size);
+
+void set_stress_options(const StressOptions* new_options) {
+    if (!new_options) return;
+    options = *new_options;
+    if (options.threads == 0) options.threads = STRESS_DEFAULT_THREADS;
+    if (options.threads > STRESS_MAX_THREADS) options.threads = STRESS_MAX_THREADS;
+}
+
+void get_stress_options(StressOptions* out) {
+    if (out) *out = options;
+}
+
+bool create_stress_suite(TestSuite* suite) {
+    if (!create_test_suite(suite, "stress", 16)) return false;
+    add_test_case(suite, "queue_spill_lossless", test_queue_spill_lossless, NULL, NULL);
+    add_test_case(suite, "queue_drop_newest", test_queue_drop_newest, NULL, NULL);
+    add_test_case(suite, "queue_drop_oldest", test_queue_drop_oldest, NULL, NULL);
+    add_test_case(suite, "queue_drop_oldest_blocks", test_queue_drop_oldest_blocks, NULL, NULL);
+    add_test_case(suite, "queue_cleanup_under_load", test_queue_cleanup_under_load, NULL, NULL);
+    add_test_case(suite, "queue_filter_swaps", test_queue_filter_swaps, NULL, NULL);
+    add_test_case(suite, "queue_filter_updaters", test_queue_filter_updaters, NULL, NULL);
+    add_test_case(suite, "sink_slow_fan_out", test_sink_slow_fan_out, NULL, NULL);
+    add_test_case(suite, "buffer_appends_sync", test_buffer_appends_sync, NULL, NULL);
+    add_test_case(suite, "buffer_appends_async", test_buffer_appends_async, NULL, NULL);
+    add_test_case(suite, "buffer_appends_mapped", test_buffer_appends_mapped, NULL, NULL);
+    add_test_case(suite, "buffer_partial_commits_sync", test_buffer_partial_commits_sync,
+                  NULL, NULL);
+    add_test_case(suite, "buffer_partial_commits_async", test_buffer_partial_commits_async,
+                  NULL, NULL);
+    add_test_case(suite, "buffer_partial_commits_mapped", test_buffer_partial_commits_mapped,
+                  NULL, NULL);
+    add_test_case(suite, "log_concurrent_writes", test_log_concurrent_writes, NULL, NULL);
+    add_test_case(suite, "log_async_concurrent_writes", test_log_async_concurrent_writes,
+                  NULL, NULL);
+    return true;
+}
+
+bool create_soak_suite(TestSuite* suite) {
+    if (!create_test_suite(suite, "soak", 1)) return false;
+    add_test_case(suite, "pipeline_soak", test_pipeline_soak, NULL, NULL);
+    return true;
+}
+
+// Producers and bookkeeping
+static void reset_stress_state(void) {
+    memset(producers, 0, sizeof(producers));
+    for (size_t i = 0; i < STRESS_MAX_THREADS; i++) {
+        producers[i].id = i;
+    }
+    memset(&seen, 0, sizeof(seen));
+    atomic_store(&output_bytes, 0);
+    spill_high_water = 0;
+    format_events = false;
+    init_timestamp_cache(&timestamp_cache);
+}
+
+static bool keep_producing(void) {
+    return atomic_load_explicit(&running, memory_order_relaxed) &&
+           atomic_load_explicit(&output_bytes, memory_order_relaxed) < STRESS_MAX_LOG_BYTES;
+}
+
+// Key events never coalesce or get shed, so each one must come out once
+static void make_stress_event(Event* event, size_t id, size_t sequence) {
+    memset(event, 0, sizeof(Event));
+    event->type = (sequence & 1) ? EVENT_KEY_RELEASE : EVENT_KEY_PRESS;
+    event->timestamp = get_precise_time();
+    event->data.keyboard.vkCode = (DWORD)(STRESS_KEY_BASE + id);
+    event->data.keyboard.scanCode = (DWORD)sequence;
+}
+
+static void note_sequence(size_t id, size_t sequence) {
+    if (id >= options.threads) {
+        seen.foreign++;
+    } else if (sequence < seen.next[id]) {
+        seen.repeats++;
+    } else {
+        seen.gaps += sequence - seen.next[id];
+        seen.next[id] = sequence + 1;
+        seen.delivered[id]++;
+    }
+}
+
+// Consumer thread
+static void stress_event_callback(const Event* event) {
+    note_sequence(event->data.keyboard.vkCode - STRESS_KEY_BASE, event->data.keyboard.scanCode);
+
+    if (format_events) {
+        char line[BUFFER_MAX_EVENT_SIZE];
+        size_t len = format_event_text(event, &timestamp_cache, line, sizeof(line));
+        if (len > 0 && add_to_buffer(line, len)) {
+            atomic_fetch_add_explicit(&output_bytes, len, memory_order_relaxed);
+        }
+    }
+}
+
+static DWORD WINAPI queue_producer(LPVOID param) {
+    StressProducer* producer = (StressProducer*)param;
+    Event event;
+
+    while (keep_producing()) {
+        // Stay under the overflow cap where the policy must not lose anything
+        if (spill_high_water && get_metric_gauge(METRIC_SPILL_DEPTH) >= spill_high_water) {
+            Sleep(0);
+            continue;
+        }
+
+        make_stress_event(&event, producer->id, producer->sent++);
+        if (submit_hook_event(&event)) {
+            producer->accepted++;
+        } else {
+            producer->refused++;
+        }
+    }
+    return 0;
+}
+
+static DWORD WINAPI buffer_producer(LPVOID param) {
+    StressProducer* producer = (StressProducer*)param;
+    char line[STRESS_LINE_SIZE];
+
+    while (keep_producing()) {
+        int len = snprintf(line, sizeof(line), "%02zu %010zu\n", producer->id, producer->sent++);
+        atomic_fetch_add_explicit(&output_bytes, (size_t)len, memory_order_relaxed);
+        if (add_to_buffer(line, (size_t)len)) {
+            producer->accepted++;
+        } else {
+            producer->refused++;
+        }
+    }
+    return 0;
+}
+
+// Reserves the most an entry may take and commits only the line, as the
+// log sink does; the unused tail must not reach the file
+static DWORD WINAPI partial_commit_producer(LPVOID param) {
+    StressProducer* producer = (StressProducer*)param;
+    size_t attempts = 0;
+
+    while (keep_producing()) {
+        char* space = reserve_buffer(BUFFER_MAX_EVENT_SIZE);
+        if (!space) {
+            producer->sent++;
+            producer->refused++;
+            continue;
+        }
+        // Every 8th reservation is abandoned, as a formatter with nothing
+        // to write does; it takes no sequence number and must leave no line
+        if (++attempts % STRESS_ABANDON_PERIOD == 0) {
+            memset(space, '#', STRESS_LINE_SIZE);
+            commit_buffer(0);
+            continue;
+        }
+        int len = snprintf(space, STRESS_LINE_SIZE, "%02zu %010zu\n", producer->id, producer->sent++);
+        atomic_fetch_add_explicit(&output_bytes, (size_t)len, memory_order_relaxed);
+        if (commit_buffer((size_t)len)) {
+            producer->accepted++;
+        } else {
+            producer->refused++;
+        }
+    }
+    return 0;
+}
+
+// write_to_log() adds the timestamp and the newline
+static DWORD WINAPI log_producer(LPVOID param) {
+    StressProducer* producer = (StressProducer*)param;
+    char line[STRESS_LINE_SIZE];
+
+    while (keep_producing()) {
+        int len = snprintf(line, sizeof(line), "%02zu %010zu", producer->id, producer->sent++);
+        atomic_fetch_add_explicit(&output_bytes, LOG_TIMESTAMP_SIZE + (size_t)len + 1,
+                                  memory_order_relaxed);
+        if (write_to_log(line, (size_t)len)) {
+            producer->accepted++;
+        } else {
+            producer->refused++;
+        }
+    }
+    return 0;
+}
+
+// Publishes tables nobody else does: the move settings carry the updater's
+// id and count, and only ever change moves, so no producer key is dropped
+static DWORD WINAPI filter_updater(LPVOID param) {
+    StressProducer* updater = (StressProducer*)param;
+    HookFilters filters;
+    get_hook_filters(&filters);
+
+    while (atomic_load_explicit(&running, memory_order_relaxed)) {
+        DWORD mark = (DWORD)((updater->id << 8) | (updater->sent & 0xFF));
+        filters.move_min_distance = mark;
+        filters.move_coalesce_ms = mark;
+        set_hook_filters(&filters);
+        updater->sent++;
+    }
+    return 0;
+}
+
+// Backs off while the fast sink is half a queue behind, so only the slow
+// sink can run out of queue space
+static DWORD WINAPI sink_producer(LPVOID param) {
+    StressProducer* producer = (StressProducer*)param;
+    Event event;
+
+    while (keep_producing()) {
+        if (atomic_load_explicit(&sink_backlog, memory_order_relaxed) >= STRESS_FAST_SINK_QUEUE / 2) {
+            Sleep(0);
+            continue;
+        }
+
+        make_stress_event(&event, producer->id, producer->sent++);
+        atomic_fetch_add_explicit(&sink_backlog, 1, memory_order_relaxed);
+        if (submit_hook_event(&event)) {
+            producer->accepted++;
+        } else {
+            producer->refused++;
+            atomic_fetch_sub_explicit(&sink_backlog, 1, memory_order_relaxed);
+        }
+    }
+    return 0;
+}
+
+// Sink callbacks; each runs on its own sink's worker thread
+static bool fast_sink_write(void* context, const SinkBatch* batch) {
+    (void)context;
+    for (size_t i = 0; i < batch->count; i++) {
+        stress_event_callback(&batch->events[i]);
+    }
+    atomic_fetch_sub_explicit(&sink_backlog, batch->count, memory_order_relaxed);
+    return true;
+}
+
+static bool slow_sink_write(void* context, const SinkBatch* batch) {
+    (void)context;
+    WaitForSingleObject(slow_sink_gate, INFINITE);
+    atomic_fetch_add_explicit(&slow_sink_written, batch->count, memory_order_relaxed);
+    return true;
+}
+
+static bool start_producers(LPTHREAD_START_ROUTINE proc, HANDLE* threads) {
+    atomic_store(&running, true);
+    for (size_t i = 0; i < options.threads; i++) {
+        threads[i] = CreateThread(NULL, 0, proc, &producers[i], 0, NULL);
+        if (!threads[i]) {
+            atomic_store(&running, false);
+            while (i-- > 0) {
+                WaitForSingleObject(threads[i], INFINITE);
+                CloseHandle(threads[i]);
+            }
+            return false;
+        }
+    }
+    return true;
+}
+
+static void stop_producers(HANDLE* threads) {
+    atomic_store(&running, false);
+    for (size_t i = 0; i < options.threads; i++) {
+        WaitForSingleObject(threads[i], INFINITE);
+        CloseHandle(threads[i]);
+    }
+}
+
+// Synthetic-input pipeline with a consumer thread, as the benchmark runs it
+static bool start_stress_hooks(HookOverflowPolicy policy) {
+    HookOptions hook_options = {0};
+    hook_options.consumer_thread = true;
+    hook_options.batch_size = HOOK_DEFAULT_BATCH_SIZE;
+    hook_options.synthetic_input = true;
+    hook_options.overflow_policy = policy;
+    hook_options.spill_limit = STRESS_SPILL_LIMIT;
+    return init_hooks_ex(stress_event_callback, &hook_options);
+}
+
+static bool start_stress_logger(const char* path, StressLoggerMode mode) {
+    delete_stress_log(path);
+
+    LoggerConfig config = {0};
+    if (mode == STRESS_LOGGER_ASYNC) {
+        config.async = true;
+        config.buffer_size = LOG_ASYNC_BUFFER_SIZE;
+        config.buffer_count = LOG_ASYNC_BUFFER_COUNT;
+    } else if (mode == STRESS_LOGGER_MAPPED) {
+        config.mapped = true;
+    }
+    return init_logger_ex(path, &config);
+}
+
+// exact: nothing may be missing. Otherwise every missing event must have
+// been counted as dropped. Either way nothing may arrive twice, out of
+// order or from nowhere.
+static bool check_sequences(bool exact, char* error_msg, size_t msg_size) {
+    size_t sent = 0, delivered = 0;
+    for (size_t i = 0; i < options.threads; i++) {
+        sent += producers[i].sent;
+        delivered += seen.delivered[i];
+    }
+
+    if (!assert_true(sent > 0, "producers made progress", error_msg, msg_size) ||
+        !assert_equal(0, (int)seen.foreign, "events of no producer", error_msg, msg_size) ||
+        !assert_equal(0, (int)seen.repeats, "duplicated or reordered events", error_msg, msg_size)) {
+        return false;
+    }
+
+    if (exact) {
+        for (size_t i = 0; i < options.threads; i++) {
+            if (!assert_equal(0, (int)producers[i].refused, "refused events", error_msg, msg_size) ||
+                !assert_equal((int)producers[i].sent, (int)seen.delivered[i],
+                              "events delivered per producer", error_msg, msg_size)) {
+                return false;
+            }
+        }
+        return assert_equal(0, (int)seen.gaps, "lost events", error_msg, msg_size);
+    }
+
+    // Events past the last one delivered were lost as well
+    size_t missing = sent - delivered;
+    return assert_equal((int)missing, (int)get_dropped_events(),
+                        "missing events counted as dropped", error_msg, msg_size);
+}
+
+// Reads the lines back: formatted key events, or "<id> <sequence>" lines
+// with or without the timestamp write_to_log() adds
+static bool check_log_file(const char* path, char* error_msg, size_t msg_size) {
+    FILE* file = fopen(path, "r");
+    if (!assert_not_null(file, "log file readable", error_msg, msg_size)) {
+        return false;
+    }
+
+    char line[LOG_RECORD_MAX_SIZE];
+    while (fgets(line, sizeof(line), file)) {
+        Event event;
+        if (parse_event_text(line, strlen(line), &event) &&
+            (event.type == EVENT_KEY_PRESS || event.type == EVENT_KEY_RELEASE)) {
+            note_sequence(event.data.keyboard.vkCode - STRESS_KEY_BASE,
+                          event.data.keyboard.scanCode);
+            continue;
+        }
+
+        char* record = line;
+        if (record[0] == '[') {
+            char* end = strstr(record, "] ");
+            record = end ? end + 2 : record;
+        }
+        char* next = NULL;
+        size_t id = (size_t)strtoul(record, &next, 10);
+        size_t sequence = (size_t)strtoul(next, NULL, 10);
+        note_sequence(next != record ? id : STRESS_MAX_THREADS, sequence);
+    }
+    fclose(file);
+    return true;
+}
+
+static void stress_log_path(char* path, size_t size, const char* name) {
+    snprintf(path, size, "%s/%s", get_test_directory(), name);
+}
+
+// The mapped logger keeps its recovery record next to the log
+static void delete_stress_log(const char* path) {
+    char end_path[LOG_MAX_PATH + sizeof(LOG_MAP_END_SUFFIX)];
+    snprintf(end_path, sizeof(end_path), "%s%s", path, LOG_MAP_END_SUFFIX);
+    DeleteFileA(path);
+    DeleteFileA(end_path);
+}
+
+// Stress cases
+static bool run_queue_stress(HookOverflowPolicy policy, char* error_msg, size_t msg_size) {
+    HANDLE threads[STRESS_MAX_THREADS];
+    reset_stress_state();
+    if (policy == HOOK_OVERFLOW_SPILL) {
+        spill_high_water = STRESS_SPILL_LIMIT / sizeof(SpillBlock) * HOOK_SPILL_BLOCK_EVENTS / 2;
+    }
+
+    if (!assert_true(start_stress_hooks(policy), "init_hooks_ex", error_msg, msg_size)) {
+        return false;
+    }
+    if (!start_producers(queue_producer, threads)) {
+        cleanup_hooks();
+        return assert_true(false, "producer threads started", error_msg, msg_size);
+    }
+
+    Sleep(options.duration_ms);
+    stop_producers(threads);
+    cleanup_hooks();  // Drains the ring and the overflow chain
+
+    // A call that returned true is kept unless DROP_OLDEST evicted it later
+    if (policy != HOOK_OVERFLOW_DROP_OLDEST) {
+        for (size_t i = 0; i < options.threads; i++) {
+            if (!assert_equal((int)producers[i].accepted, (int)seen.delivered[i],
+                              "accepted events delivered", error_msg, msg_size)) {
+                return false;
+            }
+        }
+    }
+    return check_sequences(policy == HOOK_OVERFLOW_SPILL, error_msg, msg_size);
+}
+
+static bool test_queue_spill_lossless(char* error_msg, size_t msg_size) {
+    return run_queue_stress(HOOK_OVERFLOW_SPILL, error_msg, msg_size);
+}
+
+static bool test_queue_drop_newest(char* error_msg, size_t msg_size) {
+    return run_queue_stress(HOOK_OVERFLOW_DROP_NEWEST, error_msg, msg_size);
+}
+
+static bool test_queue_drop_oldest(char* error_msg, size_t msg_size) {
+    return run_queue_stress(HOOK_OVERFLOW_DROP_OLDEST, error_msg, msg_size);
+}
+
+// Without a consumer: a full ring, then three blocks of overflow against a
+// cap rounded up to two. The first block is evicted at once, the ring and
+// the newer two blocks come out.
+static bool test_queue_drop_oldest_blocks(char* error_msg, size_t msg_size) {
+    const size_t total = MAX_EVENT_QUEUE + 3 * HOOK_SPILL_BLOCK_EVENTS;
+    reset_stress_state();
+
+    HookOptions hook_options = {0};
+    hook_options.synthetic_input = true;
+    hook_options.overflow_policy = HOOK_OVERFLOW_DROP_OLDEST;
+    hook_options.spill_limit = 1;
+    if (!assert_true(init_hooks_ex(stress_event_callback, &hook_options), "init_hooks_ex",
+                     error_msg, msg_size)) {
+        return false;
+    }
+
+    Event event;
+    for (size_t sequence = 0; sequence < total; sequence++) {
+        make_stress_event(&event, 0, sequence);
+        if (!submit_hook_event(&event)) {
+            producers[0].refused++;
+        }
+    }
+    size_t dropped = get_dropped_events();
+    cleanup_hooks();  // Drains the ring and the overflow chain
+
+    return assert_equal(0, (int)producers[0].refused, "events refused", error_msg, msg_size) &&
+           assert_equal(HOOK_SPILL_BLOCK_EVENTS, (int)dropped, "events dropped",
+                        error_msg, msg_size) &&
+           assert_equal((int)(total - HOOK_SPILL_BLOCK_EVENTS), (int)seen.delivered[0],
+                        "events delivered", error_msg, msg_size) &&
+           assert_equal(HOOK_SPILL_BLOCK_EVENTS, (int)seen.gaps, "events skipped",
+                        error_msg, msg_size) &&
+           assert_equal(0, (int)seen.repeats, "events out of order", error_msg, msg_size);
+}
+
+// The pipeline starts and stops while the producers never pause: every
+// call that returned true must still be delivered, refusals are not drops
+static bool test_queue_cleanup_under_load(char* error_msg, size_t msg_size) {
+    HANDLE threads[STRESS_MAX_THREADS];
+    reset_stress_state();
+    spill_high_water = STRESS_SPILL_LIMIT / sizeof(SpillBlock) * HOOK_SPILL_BLOCK_EVENTS / 2;
+
+    if (!assert_true(start_producers(queue_producer, threads), "producer threads started",
+                     error_msg, msg_size)) {
+        return false;
+    }
+
+    size_t cycles = 0, dropped = 0;
+    bool started = true;
+    ULONGLONG deadline = GetTickCount64() + options.duration_ms;
+    while (GetTickCount64() < deadline) {
+        if (!start_stress_hooks(HOOK_OVERFLOW_SPILL)) {
+            started = false;
+            break;
+        }
+        Sleep(STRESS_CYCLE_MS / 5);
+        cleanup_hooks();
+        dropped += get_dropped_events();
+        cycles++;
+    }
+    stop_producers(threads);
+
+    if (!assert_true(started, "init_hooks_ex", error_msg, msg_size) ||
+        !assert_true(cycles > 0, "pipeline cycles ran", error_msg, msg_size) ||
+        !assert_equal(0, (int)dropped, "dropped events", error_msg, msg_size) ||
+        !assert_equal(0, (int)seen.repeats, "duplicated or reordered events", error_msg, msg_size) ||
+        !assert_equal(0, (int)seen.foreign, "events of no producer", error_msg, msg_size)) {
+        return false;
+    }
+    for (size_t i = 0; i < options.threads; i++) {
+        if (!assert_equal((int)producers[i].accepted, (int)seen.delivered[i],
+                          "accepted events delivered", error_msg, msg_size)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// The filters are replaced nonstop while the producers run. No table drops
+// a producer's key, so every accepted event is delivered, and replaced
+// tables must be freed while the pipeline runs rather than at cleanup.
+// DROP_NEWEST keeps the overflow chain from growing the process meanwhile.
+static bool test_queue_filter_swaps(char* error_msg, size_t msg_size) {
+    HANDLE threads[STRESS_MAX_THREADS];
+    StressUsage baseline = {0}, usage = {0};
+    reset_stress_state();
+
+    if (!assert_true(start_stress_hooks(HOOK_OVERFLOW_DROP_NEWEST), "init_hooks_ex",
+                     error_msg, msg_size)) {
+        return false;
+    }
+    if (!start_producers(queue_producer, threads)) {
+        cleanup_hooks();
+        return assert_true(false, "producer threads started", error_msg, msg_size);
+    }
+
+    HookFilters filters;
+    get_hook_filters(&filters);
+    bool measured = read_usage(&baseline);
+    size_t swaps = 0;
+    ULONGLONG deadline = GetTickCount64() + options.duration_ms;
+    while (GetTickCount64() < deadline) {
+        filters.move_min_distance = (DWORD)(swaps & 0xFF);  // Moves only
+        set_hook_filters(&filters);
+        swaps++;
+    }
+    measured = measured && read_usage(&usage);
+    stop_producers(threads);
+    cleanup_hooks();
+
+    if (!assert_true(measured, "process usage readable", error_msg, msg_size)) {
+        return false;
+    }
+    if (usage.private_bytes > baseline.private_bytes + SOAK_MEMORY_SLACK) {
+        snprintf(error_msg, msg_size, "Private memory grew from %zu KB to %zu KB over %zu swaps",
+                 baseline.private_bytes / 1024, usage.private_bytes / 1024, swaps);
+        return false;
+    }
+    for (size_t i = 0; i < options.threads; i++) {
+        if (!assert_equal((int)producers[i].accepted, (int)seen.delivered[i],
+                          "accepted events delivered", error_msg, msg_size)) {
+            return false;
+        }
+    }
+    return check_sequences(false, error_msg, msg_size);
+}
+
+// Several threads replace the filters at once while the producers run.
+// Each swap waits for the filter checks before freeing the table it
+// replaced; overlapping waits must neither free a table a check still
+// reads nor stall, and the filters left in effect are one updater's whole.
+static bool test_queue_filter_updaters(char* error_msg, size_t msg_size) {
+    HANDLE threads[STRESS_MAX_THREADS];
+    HANDLE updater_threads[STRESS_FILTER_UPDATERS];
+    size_t started = 0;
+    reset_stress_state();
+    memset(updaters, 0, sizeof(updaters));
+
+    if (!assert_true(start_stress_hooks(HOOK_OVERFLOW_DROP_NEWEST), "init_hooks_ex",
+                     error_msg, msg_size)) {
+        return false;
+    }
+    if (!start_producers(queue_producer, threads)) {
+        cleanup_hooks();
+        return assert_true(false, "producer threads started", error_msg, msg_size);
+    }
+    for (; started < STRESS_FILTER_UPDATERS; started++) {
+        updaters[started].id = started;
+        updater_threads[started] = CreateThread(NULL, 0, filter_updater, &updaters[started],
+                                                0, NULL);
+        if (!updater_threads[started]) break;
+    }
+    if (started == STRESS_FILTER_UPDATERS) {
+        Sleep(options.duration_ms);
+    }
+    stop_producers(threads);
+    for (size_t i = 0; i < started; i++) {
+        WaitForSingleObject(updater_threads[i], INFINITE);
+        CloseHandle(updater_threads[i]);
+    }
+
+    HookFilters filters;
+    get_hook_filters(&filters);
+    cleanup_hooks();
+
+    if (!assert_equal(STRESS_FILTER_UPDATERS, (int)started, "updater threads started",
+                      error_msg, msg_size) ||
+        !assert_equal((int)filters.move_min_distance, (int)filters.move_coalesce_ms,
+                      "filters in effect come from one update", error_msg, msg_size)) {
+        return false;
+    }
+    for (size_t i = 0; i < STRESS_FILTER_UPDATERS; i++) {
+        if (!assert_true(updaters[i].sent > 0, "every updater published a table",
+                         error_msg, msg_size)) {
+            return false;
+        }
+    }
+    for (size_t i = 0; i < options.threads; i++) {
+        if (!assert_equal((int)producers[i].accepted, (int)seen.delivered[i],
+                          "accepted events delivered", error_msg, msg_size)) {
+            return false;
+        }
+    }
+    return check_sequences(false, error_msg, msg_size);
+}
+
+// Two sinks behind one dispatcher: one blocks in write_batch() until the
+// producers are done, the other keeps up. The fast sink must get every
+// event while the slow one drops what does not fit its queue, and
+// unregistering the slow sink must write out what it did queue.
+static bool test_sink_slow_fan_out(char* error_msg, size_t msg_size) {
+    HANDLE threads[STRESS_MAX_THREADS];
+    SinkDescriptor fast = {0}, slow = {0};
+    SinkStats fast_stats = {0}, slow_stats = {0};
+    DWORD fast_id = SINK_INVALID_ID, slow_id = SINK_INVALID_ID;
+    reset_stress_state();
+    atomic_store(&sink_backlog, 0);
+    atomic_store(&slow_sink_written, 0);
+
+    fast.name = "stress_fast";
+    fast.queue_size = STRESS_FAST_SINK_QUEUE;
+    fast.write_batch = fast_sink_write;
+    slow.name = "stress_slow";
+    slow.queue_size = STRESS_SLOW_SINK_QUEUE;
+    slow.write_batch = slow_sink_write;
+
+    slow_sink_gate = CreateEvent(NULL, TRUE, FALSE, NULL);
+    if (!assert_true(slow_sink_gate != NULL, "gate event created", error_msg, msg_size)) {
+        return false;
+    }
+    if (!init_sinks() || !register_sink(&fast, &fast_id) || !register_sink(&slow, &slow_id)) {
+        cleanup_sinks();
+        CloseHandle(slow_sink_gate);
+        return assert_true(false, "sinks registered", error_msg, msg_size);
+    }
+
+    HookOptions hook_options = {0};
+    hook_options.consumer_thread = true;
+    hook_options.batch_callback = dispatch_sink_events;
+    hook_options.batch_size = HOOK_DEFAULT_BATCH_SIZE;
+    hook_options.synthetic_input = true;
+    hook_options.overflow_policy = HOOK_OVERFLOW_SPILL;
+    hook_options.spill_limit = STRESS_SPILL_LIMIT;
+    bool started = init_hooks_ex(NULL, &hook_options);
+    if (started && !start_producers(sink_producer, threads)) {
+        cleanup_hooks();
+        started = false;
+    }
+    if (started) {
+        Sleep(options.duration_ms);
+        stop_producers(threads);
+        cleanup_hooks();  // Every accepted event has been dispatched
+
+        // The slow sink is still stuck in its first batch
+        get_sink_stats(fast_id, &fast_stats);
+        get_sink_stats(slow_id, &slow_stats);
+    }
+    SetEvent(slow_sink_gate);
+    bool slow_removed = unregister_sink(slow_id);
+    size_t slow_written = atomic_load(&slow_sink_written);
+    bool fast_removed = unregister_sink(fast_id);
+    cleanup_sinks();
+    CloseHandle(slow_sink_gate);
+    slow_sink_gate = NULL;
+
+    size_t accepted = 0;
+    for (size_t i = 0; i < options.threads; i++) {
+        accepted += producers[i].accepted;
+    }
+    if (!assert_true(started, "pipeline started", error_msg, msg_size) ||
+        !assert_true(slow_removed && fast_removed, "sinks unregistered", error_msg, msg_size) ||
+        !assert_equal((int)accepted, (int)fast_stats.delivered, "fast sink got every event",
+                      error_msg, msg_size) ||
+        !assert_equal(0, (int)fast_stats.dropped, "fast sink dropped nothing",
+                      error_msg, msg_size) ||
+        !assert_true(slow_stats.dropped > 0, "slow sink dropped events", error_msg, msg_size) ||
+        !assert_equal((int)accepted, (int)(slow_stats.delivered + slow_stats.dropped),
+                      "slow sink accounted for every event", error_msg, msg_size) ||
+        !assert_equal((int)slow_stats.delivered, (int)slow_written,
+                      "slow sink queue written out on unregister", error_msg, msg_size)) {
+        return false;
+    }
+    return check_sequences(true, error_msg, msg_size);
+}
+
+// Any line that is not "<id> <sequence>" counts as foreign, so padding or
+// torn entries fail the case as surely as lost ones
+static bool run_buffer_stress(LPTHREAD_START_ROUTINE proc, const char* name,
+                              StressLoggerMode mode, char* error_msg, size_t msg_size) {
+    HANDLE threads[STRESS_MAX_THREADS];
+    char path[MAX_PATH];
+    stress_log_path(path, sizeof(path), name);
+    reset_stress_state();
+
+    if (!assert_true(start_stress_logger(path, mode), "init_logger_ex", error_msg, msg_size)) {
+        return false;
+    }
+    if (!init_buffer()) {
+        cleanup_logger();
+        return assert_true(false, "init_buffer", error_msg, msg_size);
+    }
+    if (!start_producers(proc, threads)) {
+        cleanup_buffer();
+        cleanup_logger();
+        return assert_true(false, "producer threads started", error_msg, msg_size);
+    }
+
+    Sleep(options.duration_ms);
+    stop_producers(threads);
+    cleanup_buffer();  // Hands over the last entries
+    cleanup_logger();
+
+    bool result = check_log_file(path, error_msg, msg_size) &&
+                  check_sequences(true, error_msg, msg_size);
+    delete_stress_log(path);
+    return result;
+}
+
+static bool test_buffer_appends_sync(char* error_msg, size_t msg_size) {
+    return run_buffer_stress(buffer_producer, "stress_buffer_sync.txt", STRESS_LOGGER_SYNC,
+                             error_msg, msg_size);
+}
+
+static bool test_buffer_appends_async(char* error_msg, size_t msg_size) {
+    return run_buffer_stress(buffer_producer, "stress_buffer_async.txt", STRESS_LOGGER_ASYNC,
+                             error_msg, msg_size);
+}
+
+static bool test_buffer_appends_mapped(char* error_msg, size_t msg_size) {
+    return run_buffer_stress(buffer_producer, "stress_buffer_mapped.txt", STRESS_LOGGER_MAPPED,
+                             error_msg, msg_size);
+}
+
+static bool test_buffer_partial_commits_sync(char* error_msg, size_t msg_size) {
+    return run_buffer_stress(partial_commit_producer, "stress_partial_sync.txt",
+                             STRESS_LOGGER_SYNC, error_msg, msg_size);
+}
+
+static bool test_buffer_partial_commits_async(char* error_msg, size_t msg_size) {
+    return run_buffer_stress(partial_commit_producer, "stress_partial_async.txt",
+                             STRESS_LOGGER_ASYNC, error_msg, msg_size);
+}
+
+static bool test_buffer_partial_commits_mapped(char* error_msg, size_t msg_size) {
+    return run_buffer_stress(partial_commit_producer, "stress_partial_mapped.txt",
+                             STRESS_LOGGER_MAPPED, error_msg, msg_size);
+}
+
+static bool run_log_stress(StressLoggerMode mode, char* error_msg, size_t msg_size) {
+    HANDLE threads[STRESS_MAX_THREADS];
+    char path[MAX_PATH];
+    stress_log_path(path, sizeof(path),
+                    mode == STRESS_LOGGER_ASYNC ? "stress_log_async.txt" : "stress_log.txt");
+    reset_stress_state();
+
+    if (!assert_true(start_stress_logger(path, mode), "init_logger_ex", error_msg, msg_size)) {
+        return false;
+    }
+    if (!start_producers(log_producer, threads)) {
+        cleanup_logger();
+        return assert_true(false, "producer threads started", error_msg, msg_size);
+    }
+
+    Sleep(options.duration_ms);
+    stop_producers(threads);
+    cleanup_logger();
+
+    bool result = check_log_file(path, error_msg, msg_size) &&
+                  check_sequences(true, error_msg, msg_size);
+    delete_stress_log(path);
+    return result;
+}
+
+static bool test_log_concurrent_writes(char* error_msg, size_t msg_size) {
+    return run_log_stress(STRESS_LOGGER_SYNC, error_msg, msg_size);
+}
+
+static bool test_log_async_concurrent_writes(char* error_msg, size_t msg_size) {
+    return run_log_stress(STRESS_LOGGER_ASYNC, error_msg, msg_size);
+}
+
+// Soak
+// One start-to-stop run of queue, consumer, buffer and async logger
+static bool run_pipeline_cycle(const char* path, char* error_msg, size_t msg_size) {
+    HANDLE threads[STRESS_MAX_THREADS];
+    reset_stress_state();
+    spill_high_water = STRESS_SPILL_LIMIT / sizeof(SpillBlock) * HOOK_SPILL_BLOCK_EVENTS / 2;
+    format_events = true;
+
+    if (!assert_true(start_stress_logger(path, STRESS_LOGGER_ASYNC), "init_logger_ex",
+                     error_msg, msg_size)) {
+        return false;
+    }
+    if (!init_buffer()) {
+        cleanup_logger();
+        return assert_true(false, "init_buffer", error_msg, msg_size);
+    }
+    if (!start_stress_hooks(HOOK_OVERFLOW_SPILL)) {
+        cleanup_buffer();
+        cleanup_logger();
+        return assert_true(false, "init_hooks_ex", error_msg, msg_size);
+    }
+    if (!start_producers(queue_producer, threads)) {
+        cleanup_hooks();
+        cleanup_buffer();
+        cleanup_logger();
+        return assert_true(false, "producer threads started", error_msg, msg_size);
+    }
+
+    Sleep(STRESS_CYCLE_MS);
+    stop_producers(threads);
+    cleanup_hooks();
+    cleanup_buffer();
+    cleanup_logger();
+
+    // Everything the consumer saw must also have reached the file
+    if (!check_sequences(true, error_msg, msg_size)) {
+        delete_stress_log(path);
+        return false;
+    }
+    memset(&seen, 0, sizeof(seen));
+    bool written = check_log_file(path, error_msg, msg_size) &&
+                   check_sequences(true, error_msg, msg_size);
+    delete_stress_log(path);
+    return written;
+}
+
+static bool read_usage(StressUsage* usage) {
+    PROCESS_MEMORY_COUNTERS counters;
+    Sleep(STRESS_SETTLE_MS);
+    if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)) ||
+        !GetProcessHandleCount(GetCurrentProcess(), &usage->handles)) {
+        return false;
+    }
+    usage->private_bytes = counters.PagefileUsage;
+    return true;
+}
+
+// Usage is compared between cycles, when no pipeline thread is alive
+static bool test_pipeline_soak(char* error_msg, size_t msg_size) {
+    char path[MAX_PATH];
+    stress_log_path(path, sizeof(path), "soak.txt");
+
+    StressUsage baseline = {0}, usage = {0};
+    size_t peak_private = 0;
+    size_t cycles = 0;
+    ULONGLONG start = GetTickCount64();
+    ULONGLONG report = start + SOAK_REPORT_INTERVAL_MS;
+
+    while (GetTickCount64() - start < options.soak_ms || cycles <= SOAK_WARMUP_CYCLES) {
+        if (!run_pipeline_cycle(path, error_msg, msg_size)) {
+            char reason[MAX_ERROR_MSG];
+            snprintf(reason, sizeof(reason), "cycle %zu: %s", cycles, error_msg);
+            snprintf(error_msg, msg_size, "%s", reason);
+            return false;
+        }
+        cycles++;
+
+        if (!assert_true(read_usage(&usage), "process usage readable", error_msg, msg_size)) {
+            return false;
+        }
+        if (cycles == SOAK_WARMUP_CYCLES) {
+            baseline = usage;
+        }
+        if (usage.private_bytes > peak_private) {
+            peak_private = usage.private_bytes;
+        }
+
+        if (GetTickCount64() >= report) {
+            printf("\n  %llu s, %zu cycles, private %zu KB, handles %lu ",
+                   (GetTickCount64() - start) / 1000, cycles,
+                   usage.private_bytes / 1024, (unsigned long)usage.handles);
+            fflush(stdout);
+            report += SOAK_REPORT_INTERVAL_MS;
+        }
+    }
+
+    if (usage.handles > baseline.handles) {
+        snprintf(error_msg, msg_size, "handle count grew from %lu to %lu over %zu cycles",
+                 (unsigned long)baseline.handles, (unsigned long)usage.handles, cycles);
+        return false;
+    }
+    if (usage.private_bytes > baseline.private_bytes + SOAK_MEMORY_SLACK) {
+        snprintf(error_msg, msg_size, "private memory grew from %zu KB to %zu KB (peak %zu KB) "
+                 "over %zu cycles", baseline.private_bytes / 1024, usage.private_bytes / 1024,
+                 peak_private / 1024, cycles);
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,50 @@
+#ifndef STRESS_H
+#define STRESS_H
+
+#include <stdbool.h>
+#include "platform.h"
+#include "test.h"
+
+/**
+ * Concurrency stress and soak suites
+ * The stress cases hammer queue_event() (through submit_hook_event()),
+ * add_to_buffer() and write_to_log() from several threads at full rate for
+ * a fixed time; the buffer cases run over the sync, async and mapped
+ * logger. Every event carries its producer and a per-producer
+ * sequence number, so the consumer, or the log file read back, shows any
+ * event that was lost, duplicated or reordered. Under the policies that
+ * promise no loss (HOOK_OVERFLOW_SPILL inside its cap, the buffer and the
+ * logger) the counts must match exactly; the drop policies must account
+ * for every missing event in METRIC_EVENTS_DROPPED. The sink case fans
+ * the events out to a blocked sink and a fast one behind the same
+ * dispatcher; only the blocked one may drop.
+ *
+ * The soak case runs the whole pipeline through start/stop cycles until
+ * its deadline, reads every cycle's log back and checks that the process' private memory and handle
+ * count stay flat once the first cycles have warmed the allocator up.
+ */
+
+#define STRESS_DEFAULT_DURATION_MS 2000     // Per stress case
+#define STRESS_DEFAULT_THREADS 4
+#define STRESS_MAX_THREADS 16
+#define STRESS_MAX_LOG_BYTES (64 * 1024 * 1024)  // A case stops early past this much output
+#define STRESS_SPILL_LIMIT (16 * 1024 * 1024)    // Overflow cap of the queue cases
+#define STRESS_CYCLE_MS 250                 // Pipeline lifetime in the soak and cleanup cases
+#define SOAK_WARMUP_CYCLES 4                // Cycles before the usage baseline is taken
+#define SOAK_MEMORY_SLACK (8 * 1024 * 1024) // Allowed private memory growth (bytes)
+#define SOAK_REPORT_INTERVAL_MS (60 * 1000) // Progress line interval
+
+typedef struct {
+    DWORD duration_ms;      // Run time of each stress case
+    size_t threads;         // Producer threads
+    DWORD soak_ms;          // Run time of the soak case (0 = no soak suite)
+} StressOptions;
+
+void set_stress_options(const StressOptions* options);
+void get_stress_options(StressOptions* options);
+
+// Suites; the caller runs and destroys them
+bool create_stress_suite(TestSuite* suite);
+bool create_soak_suite(TestSuite* suite);
+
+#endif
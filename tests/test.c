@@ -1,7 +1,6 @@
-#include "test_framework.h"
+#include "test.h"
 #include <stdlib.h>
 #include <string.h>
-#include <direct.h>
 
 static char test_directory[MAX_PATH] = "test_data";
 
@@ -143,33 +142,51 @@ void set_test_directory(const char* path) {
     if (path) strncpy(test_directory, path, MAX_PATH - 1);
 }
 
+const char* get_test_directory(void) {
+    return test_directory;
+}
+
 bool create_test_directory(void) {
-    return _mkdir(test_directory) == 0 || errno == EEXIST;
+    return CreateDirectoryA(test_directory, NULL) || GetLastError() == ERROR_ALREADY_EXISTS;
 }
 
 void cleanup_test_directory(void) {
     // Implement directory cleanup
 }
 
+// Input injection only exists on Windows
 bool simulate_keyboard_event(WORD vkCode, bool keyDown) {
+#ifdef _WIN32
     INPUT input = {0};
     input.type = INPUT_KEYBOARD;
     input.ki.wVk = vkCode;
     input.ki.dwFlags = keyDown ? 0 : KEYEVENTF_KEYUP;
     return SendInput(1, &input, sizeof(INPUT)) == 1;
+#else
+    (void)vkCode;
+    (void)keyDown;
+    return false;
+#endif
 }
 
 bool simulate_mouse_event(int x, int y, DWORD flags) {
+#ifdef _WIN32
     INPUT input = {0};
     input.type = INPUT_MOUSE;
     input.mi.dx = x;
     input.mi.dy = y;
     input.mi.dwFlags = flags;
     return SendInput(1, &input, sizeof(INPUT)) == 1;
+#else
+    (void)x;
+    (void)y;
+    (void)flags;
+    return false;
+#endif
 }
 
 bool verify_log_contents(const char* expected) {
-    char path[MAX_PATH];
+    char path[MAX_PATH + 16];  // test_directory plus the file name
     snprintf(path, sizeof(path), "%s/keylog.txt", test_directory);
     
     FILE* file = fopen(path, "r");
@@ -3,7 +3,7 @@
 
 #include <stdbool.h>
 #include <stdio.h>
-#include <windows.h>
+#include "platform.h"
 
 #define MAX_ERROR_MSG 256
 #define MAX_TEST_NAME 64
@@ -57,6 +57,7 @@ bool assert_not_null(void* ptr, const char* message, char* error_msg, size_t msg
 
 // Test utilities
 void set_test_directory(const char* path);
+const char* get_test_directory(void);
 bool create_test_directory(void);
 void cleanup_test_directory(void);
 bool simulate_keyboard_event(WORD vkCode, bool keyDown);
@@ -0,0 +1,450 @@
+#include "units.h"
+#include <stdio.h>
+#include <string.h>
+#include "intern.h"
+#include "aggregate.h"
+
+// Summary lines an aggregator emitted, without their trailing newline
+typedef struct {
+    char lines[UNIT_MAX_SUMMARIES][AGGREGATE_RECORD_SIZE];
+    InternId processes[UNIT_MAX_SUMMARIES];
+    size_t count;
+} SummaryLog;
+
+static SummaryLog summaries;
+
+static void reset_intern(void);
+static void stop_intern(void);
+static InternId intern_title(size_t i);
+static bool collect_summary(void* context, InternId process, const char* record, size_t size);
+static bool start_aggregator(Aggregator* aggregator);
+static ULONGLONG at_ms(ULONGLONG ms);
+static Event window_event(ULONGLONG ms, const char* process);
+static Event key_event(ULONGLONG ms, EventType type);
+static Event mouse_event(ULONGLONG ms, EventType type, BYTE flags, BYTE buttons, short wheel,
+                         WORD moves);
+static int find_summary(const char* process);
+static const char* summary_body(size_t index);
+static bool check_summary_start(size_t index, ULONGLONG ms, char* error_msg, size_t msg_size);
+
+static bool test_intern_dedupe(char* error_msg, size_t msg_size);
+static bool test_intern_table_eviction(char* error_msg, size_t msg_size);
+static bool test_intern_pool_eviction(char* error_msg, size_t msg_size);
+static bool test_intern_generation_wrap(char* error_msg, size_t msg_size);
+static bool test_aggregate_interval_rollover(char* error_msg, size_t msg_size);
+static bool test_aggregate_click_detection(char* error_msg, size_t msg_size);
+static bool test_aggregate_active_gaps(char* error_msg, size_t msg_size);
+static bool test_aggregate_table_overflow(char* error_msg, size_t msg_size);
+static bool test_aggregate_flush_quiet(char* error_msg, size_t msg_size);
+
+bool create_unit_suite(TestSuite* suite) {
+    if (!create_test_suite(suite, "units", 9)) return false;
+
+    add_test_case(suite, "intern_dedupe", test_intern_dedupe, reset_intern, stop_intern);
+    add_test_case(suite, "intern_table_eviction", test_intern_table_eviction,
+                  reset_intern, stop_intern);
+    add_test_case(suite, "intern_pool_eviction", test_intern_pool_eviction,
+                  reset_intern, stop_intern);
+    add_test_case(suite, "intern_generation_wrap", test_intern_generation_wrap,
+                  reset_intern, stop_intern);
+    add_test_case(suite, "aggregate_interval_rollover", test_aggregate_interval_rollover,
+                  reset_intern, stop_intern);
+    add_test_case(suite, "aggregate_click_detection", test_aggregate_click_detection,
+                  reset_intern, stop_intern);
+    add_test_case(suite, "aggregate_active_gaps", test_aggregate_active_gaps,
+                  reset_intern, stop_intern);
+    add_test_case(suite, "aggregate_table_overflow", test_aggregate_table_overflow,
+                  reset_intern, stop_intern);
+    add_test_case(suite, "aggregate_flush_quiet", test_aggregate_flush_quiet,
+                  reset_intern, stop_intern);
+    return true;
+}
+
+// Every intern case starts from an empty table
+static void reset_intern(void) {
+    cleanup_intern_table();
+    init_intern_table();
+}
+
+static void stop_intern(void) {
+    cleanup_intern_table();
+}
+
+static InternId intern_title(size_t i) {
+    char title[64];
+    int len = snprintf(title, sizeof(title), UNIT_TITLE_FORMAT, i);
+    return intern_string(title, (size_t)len);
+}
+
+// Aggregator helpers
+static bool collect_summary(void* context, InternId process, const char* record, size_t size) {
+    (void)context;
+    if (summaries.count == UNIT_MAX_SUMMARIES || size == 0 || size >= AGGREGATE_RECORD_SIZE) {
+        return false;
+    }
+    memcpy(summaries.lines[summaries.count], record, size - 1);  // Drops the newline
+    summaries.lines[summaries.count][size - 1] = '\0';
+    summaries.processes[summaries.count++] = process;
+    return true;
+}
+
+static bool start_aggregator(Aggregator* aggregator) {
+    memset(&summaries, 0, sizeof(summaries));
+    return init_aggregator(aggregator, UNIT_AGGREGATE_INTERVAL, collect_summary, NULL);
+}
+
+// Milliseconds after the start of an interval-aligned epoch (in 2022)
+static ULONGLONG at_ms(ULONGLONG ms) {
+    const ULONGLONG interval = UNIT_AGGREGATE_INTERVAL * TIMESTAMP_TICKS_PER_MS;
+    return 221700000ULL * interval + ms * TIMESTAMP_TICKS_PER_MS;
+}
+
+static Event window_event(ULONGLONG ms, const char* process) {
+    Event event;
+    memset(&event, 0, sizeof(event));
+    event.type = EVENT_WINDOW_CHANGE;
+    event.timestamp = at_ms(ms);
+    event.data.window.processNameId = intern_string(process, strlen(process));
+    return event;
+}
+
+static Event key_event(ULONGLONG ms, EventType type) {
+    Event event;
+    memset(&event, 0, sizeof(event));
+    event.type = type;
+    event.timestamp = at_ms(ms);
+    event.data.keyboard.vkCode = 'A';
+    return event;
+}
+
+static Event mouse_event(ULONGLONG ms, EventType type, BYTE flags, BYTE buttons, short wheel,
+                         WORD moves) {
+    Event event;
+    memset(&event, 0, sizeof(event));
+    event.type = type;
+    event.timestamp = at_ms(ms);
+    event.data.mouse.buttonFlags = flags;
+    event.data.mouse.buttons = buttons;
+    event.data.mouse.wheelDelta = wheel;
+    event.data.mouse.moveCount = moves;
+    return event;
+}
+
+static int find_summary(const char* process) {
+    char pattern[MAX_PROCESS_NAME + 16];
+    snprintf(pattern, sizeof(pattern), "PROCESS:'%s' ", process);
+    for (size_t i = 0; i < summaries.count; i++) {
+        if (strstr(summaries.lines[i], pattern)) return (int)i;
+    }
+    return -1;
+}
+
+// The line after its "[timestamp] " prefix
+static const char* summary_body(size_t index) {
+    const char* body = strstr(summaries.lines[index], "] ");
+    return body ? body + 2 : summaries.lines[index];
+}
+
+static bool check_summary_start(size_t index, ULONGLONG ms, char* error_msg, size_t msg_size) {
+    TimestampCache cache;
+    char timestamp[TIMESTAMP_TEXT_SIZE];
+    char expected[TIMESTAMP_TEXT_SIZE + 2];
+    init_timestamp_cache(&cache);
+    format_timestamp_cached(&cache, at_ms(ms), timestamp, sizeof(timestamp));
+    snprintf(expected, sizeof(expected), "[%s]", timestamp);
+    return assert_true(strncmp(summaries.lines[index], expected, strlen(expected)) == 0,
+                       "summary stamped with its interval start", error_msg, msg_size);
+}
+
+// Intern cases
+static bool test_intern_dedupe(char* error_msg, size_t msg_size) {
+    char text[INTERN_MAX_LENGTH + 1];
+    InternId first = intern_string("notepad.exe", 11);
+    InternId again = intern_string("notepad.exe", 11);
+    InternId other = intern_string("explorer.exe", 12);
+
+    return assert_true(first != INTERN_NONE, "string interned", error_msg, msg_size) &&
+           assert_equal(first, again, "same string, same ID", error_msg, msg_size) &&
+           assert_true(other != first, "other string, other ID", error_msg, msg_size) &&
+           assert_equal(INTERN_NONE, intern_string("", 0), "empty string", error_msg, msg_size) &&
+           assert_equal(11, (int)intern_resolve(first, text, sizeof(text)), "resolved length",
+                        error_msg, msg_size) &&
+           assert_str_equal("notepad.exe", text, "resolved string", error_msg, msg_size) &&
+           assert_equal(0, (int)intern_resolve(INTERN_NONE, text, sizeof(text)),
+                        "INTERN_NONE resolves to nothing", error_msg, msg_size) &&
+           assert_equal(2, (int)get_intern_count(), "live strings", error_msg, msg_size);
+}
+
+// The oldest string gives up its slot to the one past capacity; its old
+// ID must not resolve to the newcomer
+static bool test_intern_table_eviction(char* error_msg, size_t msg_size) {
+    char text[INTERN_MAX_LENGTH + 1];
+    char expected[64];
+    InternId oldest = intern_title(0);
+    for (size_t i = 1; i < INTERN_MAX_STRINGS; i++) {
+        intern_title(i);
+    }
+    if (!assert_equal(0, (int)get_intern_evictions(), "table full without evictions",
+                      error_msg, msg_size)) {
+        return false;
+    }
+
+    InternId newest = intern_title(INTERN_MAX_STRINGS);
+    snprintf(expected, sizeof(expected), UNIT_TITLE_FORMAT, (size_t)INTERN_MAX_STRINGS);
+    return assert_equal(1, (int)get_intern_evictions(), "oldest evicted", error_msg, msg_size) &&
+           assert_equal(oldest & INTERN_SLOT_MASK, newest & INTERN_SLOT_MASK, "slot reused",
+                        error_msg, msg_size) &&
+           assert_true(newest != oldest, "reused slot, new ID", error_msg, msg_size) &&
+           assert_equal(0, (int)intern_resolve(oldest, text, sizeof(text)),
+                        "stale ID resolves to nothing", error_msg, msg_size) &&
+           assert_true(intern_resolve(newest, text, sizeof(text)) > 0 &&
+                       strcmp(text, expected) == 0, "new ID resolves", error_msg, msg_size) &&
+           assert_true(intern_title(0) != oldest, "evicted string interned again",
+                       error_msg, msg_size);
+}
+
+// Long strings run out of pool bytes long before slots
+static bool test_intern_pool_eviction(char* error_msg, size_t msg_size) {
+    char text[INTERN_MAX_LENGTH + 1];
+    char long_text[INTERN_MAX_LENGTH];
+    const size_t fit = INTERN_POOL_SIZE / (INTERN_MAX_LENGTH + 1);
+    InternId ids[INTERN_POOL_SIZE / (INTERN_MAX_LENGTH + 1) + 2];
+
+    memset(long_text, 'x', sizeof(long_text));
+    for (size_t i = 0; i < fit + 2; i++) {
+        snprintf(long_text, sizeof(long_text), "%zu", i);
+        long_text[strlen(long_text)] = 'x';
+        ids[i] = intern_string(long_text, sizeof(long_text));
+        if (!assert_true(ids[i] != INTERN_NONE, "long string interned", error_msg, msg_size)) {
+            return false;
+        }
+    }
+
+    return assert_true(get_intern_evictions() >= 2, "pool evictions", error_msg, msg_size) &&
+           assert_true(get_intern_count() <= fit, "pool bounds the live strings",
+                       error_msg, msg_size) &&
+           assert_equal(0, (int)intern_resolve(ids[0], text, sizeof(text)),
+                        "evicted ID resolves to nothing", error_msg, msg_size) &&
+           assert_equal(INTERN_MAX_LENGTH, (int)intern_resolve(ids[fit + 1], text, sizeof(text)),
+                        "newest ID resolves", error_msg, msg_size);
+}
+
+// Each reuse of a slot hands out a different ID until the generations
+// wrap, after INTERN_GENERATIONS reuses
+static bool test_intern_generation_wrap(char* error_msg, size_t msg_size) {
+    InternId seen[INTERN_GENERATIONS + 1];
+    size_t next = 0;
+
+    for (size_t round = 0; round <= INTERN_GENERATIONS; round++) {
+        seen[round] = intern_title(next);
+        for (size_t i = 1; i < INTERN_MAX_STRINGS; i++) {
+            intern_title(next + i);
+        }
+        next += INTERN_MAX_STRINGS;
+
+        for (size_t earlier = 0; earlier < round && round < INTERN_GENERATIONS; earlier++) {
+            if (!assert_true(seen[earlier] != seen[round], "generation reused early",
+                             error_msg, msg_size)) {
+                return false;
+            }
+        }
+    }
+    return assert_equal(seen[0] & INTERN_SLOT_MASK, seen[INTERN_GENERATIONS] & INTERN_SLOT_MASK,
+                        "same slot every round", error_msg, msg_size) &&
+           assert_equal(seen[0], seen[INTERN_GENERATIONS], "generations wrap",
+                        error_msg, msg_size);
+}
+
+// Aggregator cases
+// The first event opens the interval it falls into, not one starting at
+// the event; an event past the end emits it and opens the one it falls
+// into, skipping the idle ones in between
+static bool test_aggregate_interval_rollover(char* error_msg, size_t msg_size) {
+    Aggregator aggregator;
+    Event events[] = {
+        window_event(30000, "editor.exe"),
+        key_event(31000, EVENT_KEY_PRESS),
+        key_event(31100, EVENT_KEY_RELEASE),
+        key_event(32000, EVENT_KEY_PRESS),
+        key_event(61000, EVENT_KEY_PRESS),
+        key_event(200000, EVENT_KEY_PRESS)
+    };
+    if (!assert_true(start_aggregator(&aggregator), "init_aggregator", error_msg, msg_size) ||
+        !assert_true(aggregate_events(&aggregator, events, 4), "first interval counted",
+                     error_msg, msg_size) ||
+        !assert_equal(0, (int)summaries.count, "nothing emitted mid-interval",
+                      error_msg, msg_size) ||
+        !assert_true(aggregate_events(&aggregator, &events[4], 2), "later intervals counted",
+                     error_msg, msg_size) ||
+        !assert_equal(2, (int)summaries.count, "closed intervals emitted",
+                      error_msg, msg_size) ||
+        !assert_true(finish_aggregator(&aggregator), "finish_aggregator", error_msg, msg_size) ||
+        !assert_equal(3, (int)summaries.count, "open interval emitted on finish",
+                      error_msg, msg_size)) {
+        return false;
+    }
+
+    return check_summary_start(0, 0, error_msg, msg_size) &&
+           assert_str_equal("SUMMARY PROCESS:'editor.exe' SECS:60 KEYS:2 CLICKS:0 SCROLL:0 "
+                            "MOVES:0 ACTIVE_MS:1000 WINDOWS:1", summary_body(0),
+                            "first interval", error_msg, msg_size) &&
+           check_summary_start(1, 60000, error_msg, msg_size) &&
+           assert_str_equal("SUMMARY PROCESS:'editor.exe' SECS:60 KEYS:1 CLICKS:0 SCROLL:0 "
+                            "MOVES:0 ACTIVE_MS:0 WINDOWS:0", summary_body(1),
+                            "second interval", error_msg, msg_size) &&
+           check_summary_start(2, 180000, error_msg, msg_size) &&
+           assert_str_equal("SUMMARY PROCESS:'editor.exe' SECS:60 KEYS:1 CLICKS:0 SCROLL:0 "
+                            "MOVES:0 ACTIVE_MS:0 WINDOWS:0", summary_body(2),
+                            "interval after the idle ones", error_msg, msg_size);
+}
+
+// A click counts when a button in buttonFlags was not held before it;
+// releases and repeats of a held button do not. Wheel notches count in
+// either direction and moves count their merged raw moves.
+static bool test_aggregate_click_detection(char* error_msg, size_t msg_size) {
+    Aggregator aggregator;
+    Event events[] = {
+        window_event(0, "paint.exe"),
+        mouse_event(100, EVENT_MOUSE_CLICK, 0x01, 0, 0, 0),                // Left down
+        mouse_event(200, EVENT_MOUSE_CLICK, 0x02, INPUT_BTN_LEFT, 0, 0),   // Right down
+        mouse_event(300, EVENT_MOUSE_CLICK, 0x01, INPUT_BTN_LEFT | INPUT_BTN_RIGHT, 0, 0),
+        mouse_event(400, EVENT_MOUSE_CLICK, 0x02, INPUT_BTN_RIGHT, 0, 0),  // Right up
+        mouse_event(500, EVENT_MOUSE_CLICK, 0x04, 0, 0, 0),                // Middle down
+        mouse_event(600, EVENT_MOUSE_WHEEL, 0, 0, -240, 0),
+        mouse_event(700, EVENT_MOUSE_WHEEL, 0, 0, 120, 0),
+        mouse_event(800, EVENT_MOUSE_MOVE, 0, 0, 0, 5),
+        mouse_event(900, EVENT_MOUSE_MOVE, 0, 0, 0, 0)                     // Unmerged move
+    };
+
+    return assert_true(start_aggregator(&aggregator), "init_aggregator", error_msg, msg_size) &&
+           assert_true(aggregate_events(&aggregator, events, sizeof(events) / sizeof(events[0])),
+                       "events counted", error_msg, msg_size) &&
+           assert_true(finish_aggregator(&aggregator), "finish_aggregator", error_msg, msg_size) &&
+           assert_equal(1, (int)summaries.count, "one summary", error_msg, msg_size) &&
+           assert_str_equal("SUMMARY PROCESS:'paint.exe' SECS:60 KEYS:0 CLICKS:3 SCROLL:3 "
+                            "MOVES:6 ACTIVE_MS:800 WINDOWS:1", summary_body(0),
+                            "clicks, notches and moves", error_msg, msg_size);
+}
+
+// Gaps up to AGGREGATE_IDLE_GAP add to the active time, longer ones do not;
+// the time is kept per process
+static bool test_aggregate_active_gaps(char* error_msg, size_t msg_size) {
+    Aggregator aggregator;
+    Event events[] = {
+        window_event(0, "editor.exe"),
+        key_event(1000, EVENT_KEY_PRESS),
+        key_event(2000, EVENT_KEY_PRESS),                   // +1000
+        key_event(4000, EVENT_KEY_PRESS),                   // +2000
+        key_event(4000 + AGGREGATE_IDLE_GAP + 1, EVENT_KEY_PRESS),  // Idle
+        key_event(9500, EVENT_KEY_PRESS),                   // +499
+        key_event(9500 + AGGREGATE_IDLE_GAP, EVENT_KEY_PRESS),      // +5000, at the limit
+        window_event(20000, "shell.exe"),
+        key_event(21000, EVENT_KEY_PRESS),
+        window_event(22000, "editor.exe"),
+        key_event(23000, EVENT_KEY_PRESS)                   // Idle since 14500
+    };
+    if (!assert_true(start_aggregator(&aggregator), "init_aggregator", error_msg, msg_size) ||
+        !assert_true(aggregate_events(&aggregator, events, sizeof(events) / sizeof(events[0])),
+                     "events counted", error_msg, msg_size) ||
+        !assert_true(finish_aggregator(&aggregator), "finish_aggregator", error_msg, msg_size)) {
+        return false;
+    }
+
+    int editor = find_summary("editor.exe");
+    int shell = find_summary("shell.exe");
+    return assert_equal(2, (int)summaries.count, "one summary per process",
+                        error_msg, msg_size) &&
+           assert_true(editor >= 0 && shell >= 0, "both processes summarized",
+                       error_msg, msg_size) &&
+           assert_str_equal("SUMMARY PROCESS:'editor.exe' SECS:60 KEYS:7 CLICKS:0 SCROLL:0 "
+                            "MOVES:0 ACTIVE_MS:8499 WINDOWS:2", summary_body((size_t)editor),
+                            "editor active time", error_msg, msg_size) &&
+           assert_str_equal("SUMMARY PROCESS:'shell.exe' SECS:60 KEYS:1 CLICKS:0 SCROLL:0 "
+                            "MOVES:0 ACTIVE_MS:0 WINDOWS:1", summary_body((size_t)shell),
+                            "single event, no active time", error_msg, msg_size);
+}
+
+// Processes past 3/4 of the table, and input before any window change,
+// are counted under AGGREGATE_OTHER_NAME
+static bool test_aggregate_table_overflow(char* error_msg, size_t msg_size) {
+    const size_t fit = AGGREGATE_TABLE_SLOTS * 3 / 4;
+    const size_t processes = fit + 2;
+    Aggregator aggregator;
+    char name[MAX_PROCESS_NAME];
+
+    if (!assert_true(start_aggregator(&aggregator), "init_aggregator", error_msg, msg_size)) {
+        return false;
+    }
+    Event early = key_event(0, EVENT_KEY_PRESS);
+    aggregate_events(&aggregator, &early, 1);
+    for (size_t i = 0; i < processes; i++) {
+        snprintf(name, sizeof(name), UNIT_PROCESS_FORMAT, i);
+        Event events[] = {
+            window_event(100 + i * 1000, name),
+            key_event(150 + i * 1000, EVENT_KEY_PRESS)
+        };
+        aggregate_events(&aggregator, events, 2);
+    }
+    if (!assert_true(finish_aggregator(&aggregator), "finish_aggregator", error_msg, msg_size) ||
+        !assert_equal((int)fit + 1, (int)summaries.count, "table slots plus other",
+                      error_msg, msg_size)) {
+        return false;
+    }
+
+    for (size_t i = 0; i < processes; i++) {
+        snprintf(name, sizeof(name), UNIT_PROCESS_FORMAT, i);
+        if (!assert_equal(i < fit, find_summary(name) >= 0, "process summarized while it fits",
+                          error_msg, msg_size)) {
+            return false;
+        }
+    }
+    int other = find_summary(AGGREGATE_OTHER_NAME);
+    return assert_true(other >= 0, "overflow summarized", error_msg, msg_size) &&
+           assert_equal(INTERN_NONE, summaries.processes[other], "other has no process",
+                        error_msg, msg_size) &&
+           assert_str_equal("SUMMARY PROCESS:'(other)' SECS:60 KEYS:3 CLICKS:0 SCROLL:0 "
+                            "MOVES:0 ACTIVE_MS:1000 WINDOWS:2", summary_body((size_t)other),
+                            "early input and overflow", error_msg, msg_size);
+}
+
+// flush_aggregator() emits an interval only once it has ended, and only
+// once; the next event then opens the interval it falls into
+static bool test_aggregate_flush_quiet(char* error_msg, size_t msg_size) {
+    Aggregator aggregator;
+    Event events[] = {
+        window_event(1000, "editor.exe"),
+        key_event(2000, EVENT_KEY_PRESS)
+    };
+    Event late = key_event(250000, EVENT_KEY_PRESS);
+
+    if (!assert_true(start_aggregator(&aggregator), "init_aggregator", error_msg, msg_size) ||
+        !assert_true(flush_aggregator(&aggregator, at_ms(0)), "flush before any event",
+                     error_msg, msg_size) ||
+        !assert_true(aggregate_events(&aggregator, events, 2), "events counted",
+                     error_msg, msg_size) ||
+        !assert_true(flush_aggregator(&aggregator, at_ms(UNIT_AGGREGATE_INTERVAL - 1)),
+                     "flush before the end", error_msg, msg_size) ||
+        !assert_equal(0, (int)summaries.count, "open interval kept", error_msg, msg_size) ||
+        !assert_true(flush_aggregator(&aggregator, at_ms(UNIT_AGGREGATE_INTERVAL)),
+                     "flush at the end", error_msg, msg_size) ||
+        !assert_equal(1, (int)summaries.count, "ended interval emitted", error_msg, msg_size) ||
+        !assert_true(flush_aggregator(&aggregator, at_ms(3 * UNIT_AGGREGATE_INTERVAL)),
+                     "flush while quiet", error_msg, msg_size) ||
+        !assert_equal(1, (int)summaries.count, "quiet intervals emit nothing",
+                      error_msg, msg_size) ||
+        !assert_true(aggregate_events(&aggregator, &late, 1), "late event counted",
+                     error_msg, msg_size) ||
+        !assert_true(finish_aggregator(&aggregator), "finish_aggregator", error_msg, msg_size) ||
+        !assert_equal(2, (int)summaries.count, "late interval emitted", error_msg, msg_size)) {
+        return false;
+    }
+
+    return check_summary_start(0, 0, error_msg, msg_size) &&
+           assert_str_equal("SUMMARY PROCESS:'editor.exe' SECS:60 KEYS:1 CLICKS:0 SCROLL:0 "
+                            "MOVES:0 ACTIVE_MS:0 WINDOWS:1", summary_body(0),
+                            "flushed interval", error_msg, msg_size) &&
+           check_summary_start(1, 240000, error_msg, msg_size) &&
+           assert_str_equal("SUMMARY PROCESS:'editor.exe' SECS:60 KEYS:1 CLICKS:0 SCROLL:0 "
+                            "MOVES:0 ACTIVE_MS:0 WINDOWS:0", summary_body(1),
+                            "foreground kept across the flush", error_msg, msg_size);
+}
@@ -0,0 +1,23 @@
+#ifndef UNITS_H
+#define UNITS_H
+
+#include <stdbool.h>
+#include "platform.h"
+#include "test.h"
+
+/**
+ * Unit suite for the pipeline's pure building blocks
+ * The intern cases fill the table past its capacity and its pool, and
+ * check that IDs of evicted strings resolve to nothing rather than to the
+ * strings that took over their slots. The aggregator cases feed fixed
+ * event sequences and compare the summary lines they emit.
+ */
+
+#define UNIT_TITLE_FORMAT "Document %zu - Editor"  // Distinct interned strings
+#define UNIT_PROCESS_FORMAT "app%zu.exe"           // Distinct process names
+#define UNIT_AGGREGATE_INTERVAL 60000              // ms per summary in the aggregator cases
+#define UNIT_MAX_SUMMARIES 64                      // Summary lines one case can collect
+
+bool create_unit_suite(TestSuite* suite);
+
+#endif
@@ -0,0 +1,147 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "binlog.h"
+#include "compress.h"
+#include "format.h"
+#include "intern.h"
+
+// Offline decoder: converts a binary event log to the text log format;
+// compressed logs (binary or text) are unpacked first
+//   usage: keylog_decode <input> [output.txt]
+
+#define DECODE_LINE_SIZE 1024
+
+static BYTE* read_file(const char* path, size_t* size);
+
+int main(int argc, char* argv[]) {
+    if (argc < 2 || argc > 3) {
+        fprintf(stderr, "Usage: %s <input> [output.txt]\n", argv[0]);
+        return 1;
+    }
+
+    size_t size = 0;
+    BYTE* data = read_file(argv[1], &size);
+    if (!data) {
+        fprintf(stderr, "Failed to read %s\n", argv[1]);
+        return 1;
+    }
+
+    bool compressed = is_compressed_log(data, size);
+    bool corrupt = false;
+    if (compressed) {
+        size_t unpacked = 0;
+        size_t consumed = 0;
+        int status;
+        BYTE* raw = decompress_log(data, size, &unpacked, &consumed, &status);
+        free(data);
+        if (!raw) {
+            fprintf(stderr, "Failed to unpack %s\n", argv[1]);
+            return 1;
+        }
+        if (status == COMPRESS_TRUNCATED) {
+            fprintf(stderr, "Ignoring truncated frame at offset %zu\n", consumed);
+        } else if (status == COMPRESS_CORRUPT) {
+            fprintf(stderr, "Corrupt frame at offset %zu\n", consumed);
+            corrupt = true;
+        }
+        data = raw;
+        size = unpacked;
+    }
+
+    FILE* out = stdout;
+    if (argc == 3) {
+        out = fopen(argv[2], "wb");
+        if (!out) {
+            fprintf(stderr, "Failed to open %s\n", argv[2]);
+            free(data);
+            return 1;
+        }
+    }
+
+    if (!init_intern_table()) {
+        fprintf(stderr, "Failed to initialize intern table\n");
+        free(data);
+        return 1;
+    }
+
+    BinlogState state;
+    TimestampCache cache;
+    int result = 1;
+
+    init_timestamp_cache(&cache);
+
+    if (compressed && (size < BINLOG_MAGIC_SIZE ||
+                       memcmp(data, BINLOG_MAGIC, BINLOG_MAGIC_SIZE) != 0)) {
+        // A compressed text log only needs unpacking
+        fwrite(data, 1, size, out);
+        fprintf(stderr, "Unpacked %zu bytes from %s\n", size, argv[1]);
+        result = corrupt ? 1 : 0;
+    } else if (!binlog_read_header(&state, data, size)) {
+        fprintf(stderr, "%s is not a binary event log (version %d-%d)\n",
+                argv[1], BINLOG_MIN_VERSION, BINLOG_VERSION);
+    } else {
+        size_t pos = BINLOG_HEADER_SIZE;
+        size_t events = 0;
+        result = 0;
+
+        while (pos < size) {
+            Event event;
+            size_t consumed = 0;
+            int status = binlog_decode_record(&state, data + pos, size - pos,
+                                              &event, &consumed);
+
+            if (status == BINLOG_TRUNCATED) {
+                // A crash can leave a partial last record behind
+                fprintf(stderr, "Ignoring truncated record at offset %zu\n", pos);
+                break;
+            }
+            if (status == BINLOG_CORRUPT) {
+                fprintf(stderr, "Corrupt record at offset %zu\n", pos);
+                result = 1;
+                break;
+            }
+
+            pos += consumed;
+            if (status == BINLOG_SYNC) continue;
+
+            char line[DECODE_LINE_SIZE];
+            size_t len = format_event_text(&event, &cache, line, sizeof(line));
+            if (len > 0) {
+                fwrite(line, 1, len, out);
+                events++;
+            }
+        }
+
+        fprintf(stderr, "Decoded %zu events from %s\n", events, argv[1]);
+        if (corrupt) result = 1;
+    }
+
+    if (out != stdout) fclose(out);
+    cleanup_intern_table();
+    free(data);
+    return result;
+}
+
+static BYTE* read_file(const char* path, size_t* size) {
+    FILE* file = fopen(path, "rb");
+    if (!file) return NULL;
+
+    fseek(file, 0, SEEK_END);
+    long length = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    if (length < 0) {
+        fclose(file);
+        return NULL;
+    }
+
+    BYTE* data = (BYTE*)malloc(length > 0 ? (size_t)length : 1);
+    if (data && fread(data, 1, (size_t)length, file) != (size_t)length) {
+        free(data);
+        data = NULL;
+    }
+    fclose(file);
+
+    *size = (size_t)length;
+    return data;
+}
@@ -0,0 +1,266 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "binlog.h"
+#include "format.h"
+#include "intern.h"
+#include "logindex.h"
+#include "utils.h"
+
+// Offline query: prints the events of a time range, optionally of one
+// process, from indexed log segments (text, binary or compressed)
+//   usage: keylog_query [-p process.exe] <from> <to> <log>...
+// Times are local, "YYYY-MM-DD HH:MM[:SS]", and the range is [from, to).
+// Each segment's .idx is binary searched by time, and only the index
+// blocks that can hold matching events are read from the log.
+
+#define QUERY_LINE_SIZE 1024
+#define QUERY_TIME_CHARS (TIMESTAMP_TEXT_SIZE - 1)
+
+typedef struct {
+    ULONGLONG from;                     // FILETIME (UTC)
+    ULONGLONG to;
+    char from_text[TIMESTAMP_TEXT_SIZE]; // Same bounds as text log timestamps
+    char to_text[TIMESTAMP_TEXT_SIZE];
+    DWORD process;                      // Process key (0 = any process)
+} Query;
+
+static bool parse_time(const char* text, ULONGLONG* time);
+static bool open_segment(const char* path, LogIndexSegment* segment);
+static size_t print_text_block(const LogIndexOutput* block, const LogIndexEntry* entry,
+                               const Query* query, FILE* out);
+static size_t print_binary_block(const LogIndexOutput* block, const LogIndexEntry* entry,
+                                 const Query* query, TimestampCache* cache, FILE* out);
+static DWORD text_line_process(const char* line, size_t length);
+
+int main(int argc, char* argv[]) {
+    Query query = {0};
+    int arg = 1;
+
+    if (arg + 1 < argc && strcmp(argv[arg], "-p") == 0) {
+        query.process = log_index_process_key(argv[arg + 1]);
+        arg += 2;
+    }
+    if (argc - arg < 3) {
+        fprintf(stderr, "Usage: %s [-p process.exe] <from> <to> <log>...\n", argv[0]);
+        return 1;
+    }
+    if (!parse_time(argv[arg], &query.from) || !parse_time(argv[arg + 1], &query.to)) {
+        fprintf(stderr, "Times must look like \"YYYY-MM-DD HH:MM[:SS]\"\n");
+        return 1;
+    }
+
+    TimestampCache cache;
+    init_timestamp_cache(&cache);
+    format_timestamp_cached(&cache, query.from, query.from_text, sizeof(query.from_text));
+    format_timestamp_cached(&cache, query.to, query.to_text, sizeof(query.to_text));
+
+    if (!init_intern_table()) {
+        fprintf(stderr, "Failed to initialize intern table\n");
+        return 1;
+    }
+
+    LogIndexOutput block = {0};
+    int result = 0;
+
+    for (arg += 2; arg < argc; arg++) {
+        // Globs over the rotated segments may also match their indexes
+        if (str_ends_with(argv[arg], LOG_INDEX_SUFFIX)) continue;
+
+        LogIndexSegment segment;
+        if (!open_segment(argv[arg], &segment)) {
+            result = 1;
+            continue;
+        }
+
+        size_t events = 0;
+        size_t blocks = 0;
+        LogIndexEntry entry;
+        LogIndexEntry next = {0};
+        size_t i = log_index_find_block(&segment, query.from);
+        bool have_entry = log_index_read_entry(&segment, i, &entry);
+
+        while (have_entry && entry.first_time < query.to) {
+            bool have_next = log_index_read_entry(&segment, i + 1, &next);
+            bool wanted = entry.last_time >= query.from &&
+                          (query.process == 0 ||
+                           (entry.processes & log_index_process_bits(query.process)) ==
+                               log_index_process_bits(query.process));
+
+            if (wanted) {
+                if (!log_index_read_block(&segment, &entry, have_next ? &next : NULL, &block)) {
+                    fprintf(stderr, "Failed to read block %zu of %s\n", i, argv[arg]);
+                    result = 1;
+                    break;
+                }
+                events += segment.binary ?
+                    print_binary_block(&block, &entry, &query, &cache, stdout) :
+                    print_text_block(&block, &entry, &query, stdout);
+                blocks++;
+            }
+
+            entry = next;
+            have_entry = have_next;
+            i++;
+        }
+
+        fprintf(stderr, "%s: %zu events from %zu of %zu blocks\n",
+                argv[arg], events, blocks, segment.entries);
+        log_index_close_segment(&segment);
+    }
+
+    free(block.data);
+    cleanup_intern_table();
+    return result;
+}
+
+// Local "YYYY-MM-DD HH:MM[:SS]" to FILETIME (UTC)
+static bool parse_time(const char* text, ULONGLONG* time) {
+    int year, month, day, hour, minute, second = 0;
+    if (sscanf(text, "%d-%d-%d %d:%d:%d", &year, &month, &day, &hour, &minute, &second) < 5) {
+        return false;
+    }
+
+    SYSTEMTIME st = {0};
+    st.wYear = (WORD)year;
+    st.wMonth = (WORD)month;
+    st.wDay = (WORD)day;
+    st.wHour = (WORD)hour;
+    st.wMinute = (WORD)minute;
+    st.wSecond = (WORD)second;
+
+    FILETIME local, utc;
+    if (!SystemTimeToFileTime(&st, &local) || !LocalFileTimeToFileTime(&local, &utc)) {
+        return false;
+    }
+    *time = ((ULONGLONG)utc.dwHighDateTime << 32) | utc.dwLowDateTime;
+    return true;
+}
+
+// Opens a segment through the index reader, saying why it could not
+static bool open_segment(const char* path, LogIndexSegment* segment) {
+    switch (log_index_open_segment(path, segment)) {
+        case LOG_INDEX_OK:
+            return true;
+        case LOG_INDEX_NO_INDEX:
+            fprintf(stderr, "%s has no index\n", path);
+            break;
+        case LOG_INDEX_BAD_INDEX:
+            fprintf(stderr, "%s%s is not a log index (version %d)\n",
+                    path, LOG_INDEX_SUFFIX, LOG_INDEX_VERSION);
+            break;
+        case LOG_INDEX_MEMORY:
+            fprintf(stderr, "Out of memory opening %s\n", path);
+            break;
+        default:
+            fprintf(stderr, "Failed to open %s\n", path);
+            break;
+    }
+    return false;
+}
+
+// Prints the lines of a text block inside the range, following window
+// changes to know each line's process
+static size_t print_text_block(const LogIndexOutput* block, const LogIndexEntry* entry,
+                               const Query* query, FILE* out) {
+    const char* data = (const char*)block->data;
+    DWORD process = entry->start_process;
+    size_t printed = 0;
+    size_t pos = 0;
+
+    while (pos < block->size) {
+        const char* line = data + pos;
+        const char* newline = memchr(line, '\n', block->size - pos);
+        size_t length = newline ? (size_t)(newline - line) + 1 : block->size - pos;
+        pos += length;
+
+        if (length < QUERY_TIME_CHARS + 2 || line[0] != '[') continue;
+
+        DWORD line_process = text_line_process(line, length);
+        if (line_process != 0) {
+            process = line_process;
+        }
+
+        if (strncmp(line + 1, query->from_text, QUERY_TIME_CHARS) >= 0 &&
+            strncmp(line + 1, query->to_text, QUERY_TIME_CHARS) < 0 &&
+            (query->process == 0 || process == query->process)) {
+            fwrite(line, 1, length, out);
+            printed++;
+        }
+    }
+    return printed;
+}
+
+// Decodes a binary block, which starts with a sync record, and prints the
+// events inside the range as text
+static size_t print_binary_block(const LogIndexOutput* block, const LogIndexEntry* entry,
+                                 const Query* query, TimestampCache* cache, FILE* out) {
+    BinlogState state = {0};
+    DWORD process = entry->start_process;
+    size_t printed = 0;
+    size_t pos = 0;
+
+    while (pos < block->size) {
+        Event event;
+        size_t consumed = 0;
+        int status = binlog_decode_record(&state, block->data + pos, block->size - pos,
+                                          &event, &consumed);
+        if (status == BINLOG_TRUNCATED || status == BINLOG_CORRUPT) break;
+
+        pos += consumed;
+        if (status == BINLOG_SYNC) continue;
+
+        if (event.type == EVENT_WINDOW_CHANGE) {
+            char name[MAX_PROCESS_NAME];
+            intern_resolve(event.data.window.processNameId, name, sizeof(name));
+            process = log_index_process_key(name);
+        }
+
+        if (event.timestamp >= query->from && event.timestamp < query->to &&
+            (query->process == 0 || process == query->process)) {
+            char line[QUERY_LINE_SIZE];
+            size_t len = format_event_text(&event, cache, line, sizeof(line));
+            if (len > 0) {
+                fwrite(line, 1, len, out);
+                printed++;
+            }
+        }
+    }
+    return printed;
+}
+
+// Process key of a WINDOW line ("... PROCESS:'name' PID:n") or of an
+// aggregation SUMMARY line, 0 otherwise; WINDOW lines are searched from the
+// end since titles may contain anything
+static DWORD text_line_process(const char* line, size_t length) {
+    static const char marker[] = " PROCESS:'";
+    static const char summary[] = "] SUMMARY PROCESS:'";
+    char text[QUERY_LINE_SIZE];
+
+    if (length >= sizeof(text) || (!memchr(line, 'W', length) && !memchr(line, 'S', length))) {
+        return 0;
+    }
+    memcpy(text, line, length);
+    text[length] = '\0';
+
+    char* name = strstr(text, summary);
+    if (name) {
+        name += sizeof(summary) - 1;
+        char* name_end = strstr(name, "' SECS:");
+        if (!name_end) return 0;
+        *name_end = '\0';
+        return log_index_process_key(name);
+    }
+
+    if (!strstr(text, "] WINDOW ")) return 0;
+
+    char* end = NULL;
+    for (char* p = strstr(text, "' PID:"); p; p = strstr(p + 1, "' PID:")) end = p;
+    char* start = NULL;
+    for (char* p = strstr(text, marker); p && (!end || p < end); p = strstr(p + 1, marker)) start = p;
+    if (!start || !end) return 0;
+
+    start += sizeof(marker) - 1;
+    *end = '\0';
+    return log_index_process_key(start);
+}